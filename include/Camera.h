@@ -18,6 +18,14 @@
 
 class MatrixStack;
 
+/**
+ * @brief View state of the camera, what a keyframed camera path interpolates.
+ */
+struct CameraPose {
+    glm::vec3 translations;
+    glm::vec2 rotations;
+};
+
 
 /**
  * @brief Handler class for movement, modelview and projection matrices, as well as user event callbacks.
@@ -53,6 +61,9 @@ class Camera {
         void gizmoUpdate(glm::vec3 forward);
         void keyUpdate(char key);
 
+        CameraPose getPose() const;
+        void setPose(const CameraPose &pose);
+
         glm::vec3 pos;
         float yaw;
         float pitch;
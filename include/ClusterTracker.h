@@ -0,0 +1,152 @@
+#pragma once
+#ifndef CLUSTER_TRACKER_H
+#define CLUSTER_TRACKER_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Finds the moving objects inside the shutter and follows them from one window to the next, where the
+    PCA overlay of drawFrame can only describe the shutter as a single blob.
+
+    Clustering is exact DBSCAN over (x, y, t) with a spatial hash: points are bucketed into cells of
+    side eps / sqrt(2) in space (and timeEps in time), so any two points sharing a cell are neighbours
+    and a neighbourhood query only visits the 5 x 5 (x 3) cells around a point. Cells are found by
+    binary search over the sorted cell keys, which is read only and lets every stage run as an OpenMP
+    loop: core point tests per point, core to core links per cell, border labels per point. Only the
+    union find over the (few) linked cells is serial. Windows larger than maxPoints are strided.
+
+    Tracking is greedy nearest neighbour association between the new clusters and the positions the
+    active tracks predict from their last velocity, gated by a maximum distance. Tracks that go
+    unmatched for more than maxMissed windows end but stay in the history for export.
+*/
+
+/**
+ * @brief Clustering and tracking parameters. Times are normalized.
+ */
+struct ClusterSettings {
+    float eps = 4.0f;         // neighbourhood radius in pixels
+    float timeEps = 0.0f;     // neighbourhood half width in time, <= 0 clusters in space only
+    int minPts = 10;          // events within eps (self included) that make a core event
+    int maxPoints = 200000;   // events per window before striding
+    float gate = 20.0f;       // pixels between a track prediction and a cluster
+    int maxMissed = 3;        // windows a track survives without a cluster
+    int trailLength = 32;     // track positions drawn behind every cluster
+
+    bool operator==(const ClusterSettings &) const = default;
+};
+
+/**
+ * @brief One cluster of the current window.
+ */
+struct Cluster {
+    int trackID;
+    uint32_t count;
+    glm::vec2 mean;
+    float t;          // mean normalized time
+    glm::vec2 sigma;  // standard deviations along the major and minor axes
+    float angle;      // of the major axis, radians
+};
+
+/**
+ * @brief A cluster followed across windows.
+ */
+struct Track {
+    struct Point {
+        float t;      // normalized window time
+        glm::vec2 pos;
+        uint32_t count;
+        glm::vec2 sigma;
+        float angle;
+    };
+
+    int id;
+    std::vector<Point> history;
+    glm::vec2 velocity; // pixels per normalized time
+    int missed;
+    bool active;
+};
+
+/**
+ * @brief DBSCAN over the shutter events and centroid tracking across windows.
+ */
+class ClusterTracker {
+    public:
+        ClusterTracker();
+
+        /**
+         * @brief Forgets every track
+         */
+        void reset();
+
+        /**
+         * @brief Clusters the events in [eventBound_L, eventBound_R] and advances the tracks to this window
+         * @param events time sorted (x, y, t, polarity)
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         * @return bool false if nothing changed since the last call and the clusters were kept
+         */
+        bool update(const std::vector<glm::vec4> &events, int eventBound_L, int eventBound_R,
+            const glm::vec4 &spaceWindow, bool isPositiveOnly);
+
+        /**
+         * @brief Writes every track position as a CSV row
+         * @param path
+         * @param timeToSeconds converts normalized time to seconds
+         * @return bool true if successful
+         */
+        bool exportCSV(const std::string &path, double timeToSeconds) const;
+
+        ClusterSettings &getSettings() { return settings; }
+        const std::vector<Cluster> &getClusters() const { return clusters; }
+        const std::vector<Track> &getTracks() const { return tracks; }
+        size_t getNumPoints() const { return numPoints; }
+        size_t getNumNoise() const { return numNoise; }
+        int getNumActiveTracks() const;
+        double getMilliseconds() const { return milliseconds; }
+
+        static const int MAX_CLUSTERS = 64; // largest clusters kept per window
+
+    private:
+        // Everything that changes the clusters of a window
+        struct UpdateKey {
+            int eventBound_L;
+            int eventBound_R;
+            glm::vec4 spaceWindow;
+            bool isPositiveOnly;
+            ClusterSettings settings;
+
+            bool operator==(const UpdateKey &) const = default;
+        };
+
+        void cluster();
+        void track(float t);
+
+        ClusterSettings settings;
+        UpdateKey lastKey;
+        bool hasKey;
+
+        std::vector<glm::vec4> points;   // sampled window events, sorted by cell
+        std::vector<uint64_t> pointKeys; // cell key of every point
+        std::vector<uint64_t> cellKeys;  // unique, ascending
+        std::vector<int> cellBegin;      // points of cell c are [cellBegin[c], cellBegin[c + 1])
+        std::vector<uint8_t> core;
+        std::vector<int> labels;         // cluster of every point, -1 for noise
+
+        std::vector<Cluster> clusters;
+        std::vector<Track> tracks;
+        int nextTrackID;
+        float lastTime;
+        bool hasTime;
+
+        size_t numPoints;
+        size_t numNoise;
+        double milliseconds;
+};
+
+#endif // CLUSTER_TRACKER_H
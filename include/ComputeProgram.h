@@ -19,22 +19,52 @@ class ComputeProgram {
         bool isVerbose() const { return verbose; }
 
         void setShaderName(const std::string &c);
+
+        /**
+         * @brief Replaces each marker line in the shader source with code when init() compiles it
+         * @param marker text to look for, e.g. a comment placeholder
+         * @param code 
+         */
+        void setInjection(const std::string &marker, const std::string &code);
+
+        /**
+         * @brief Adds a #define right after the #version line when init() compiles, used to build specialized variants
+         * @param name 
+         * @param value 
+         */
+        void addDefine(const std::string &name, const std::string &value = "");
+
+        // Compile or link log of the last failed init()
+        const std::string &getInfoLog() const { return infoLog; }
+
         virtual bool init();
         virtual void bind();
         virtual void unbind();
         void dispatch(GLuint numGroupsX, GLuint numGroupsY = 1,
                       GLuint numGroupsZ = 1);
 
+        /**
+         * @brief 1D dispatch covering numItems for shaders that grid-stride over their items.
+         * The group count is capped at 65535, the minimum GL_MAX_COMPUTE_WORK_GROUP_COUNT every
+         * implementation guarantees, and the shader loops over whatever the groups did not cover.
+         * @param numItems 
+         * @param localSize local_size_x of the shader
+         */
+        void dispatchGridStride(GLuint numItems, GLuint localSize = 256);
+
         void addUniform(const std::string &name);
         GLint getUniform(const std::string &name) const;
 
     protected:
         std::string cShaderName;
+        std::map<std::string, std::string> injections;
+        std::map<std::string, std::string> defines;
 
     private:
         GLuint pid;
         std::map<std::string, GLint> uniforms;
         bool verbose;
+        std::string infoLog;
 };
 
 #endif // COMPUTE_PROGRAM_H
\ No newline at end of file
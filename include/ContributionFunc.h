@@ -1,5 +1,11 @@
 #pragma once
 
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 /*
     A collection of derived classes each storing a given contribution function as well as 
     the necessary attributes to execute that function. The general idea is to use polymorphism
@@ -64,4 +70,165 @@ class MorletFunc : public BaseFunc {
         float center_t;
 };
 
-    
\ No newline at end of file
+/*
+    Registry of contribution functions for the GPU shutter. Every entry pairs a CPU implementation
+    with the GLSL body of the same function. The body is injected into the shutter compute shaders
+    (see ContributionKernels) so each function gets its own program variant and no per event branch
+    on the function type is left in the shader.
+
+    Injected bodies implement
+        float contributionWeight(float t, float polarityVal, float centerT, float endT)
+    and may read the uniforms baseContribution, funcFreq and funcWidth. polarityVal is -1 or 1.
+*/
+
+/**
+ * @brief Parameters a contribution function may use, all in normalized time units
+ */
+struct ContributionParams {
+    float contribution; // BaseFunc::contribution
+    float freq;         // normalized frequency (funcFreq)
+    float width;        // MorletFunc::h (funcWidth): FWHM, standard deviation or decay constant depending on the function
+    float centerT;      // center of the shutter window
+    float endT;         // right edge of the shutter window
+};
+
+/**
+ * @brief A registered contribution function
+ */
+struct ContributionFunction {
+    std::string name;
+    std::string glsl; // body of contributionWeight, see above
+    float (*cpu)(float t, float polarityVal, const ContributionParams &p); // nullptr if only the GLSL is known
+    bool usesTime;     // false if the weight only depends on polarity, which allows incremental accumulation
+    uint64_t revision; // bumped whenever glsl changes so cached programs get rebuilt
+    std::string error; // compile log of the last failed build
+};
+
+/**
+ * @brief Singleton list of contribution functions, indexed by id. Ids of the builtins are fixed.
+ */
+class ContributionRegistry {
+    public:
+        enum Builtin { BOX = 0, GAUSSIAN, EXPONENTIAL, GABOR, MORLET, USER_GLSL };
+
+        // Marker in the shutter shaders that is replaced by the function definition
+        static inline const std::string PLACEHOLDER = "//@CONTRIBUTION_FUNCTION@";
+
+        static ContributionRegistry &instance() {
+            static ContributionRegistry registry;
+            return registry;
+        }
+
+        /**
+         * @brief Registers a new function
+         * @return int id of the function
+         */
+        int add(const ContributionFunction &func) {
+            funcs.push_back(func);
+            comboItems.clear();
+            return static_cast<int>(funcs.size()) - 1;
+        }
+
+        int size() const { return static_cast<int>(funcs.size()); }
+        bool isValid(int id) const { return id >= 0 && id < size(); }
+        ContributionFunction &get(int id) { return funcs.at(id); }
+        const ContributionFunction &get(int id) const { return funcs.at(id); }
+
+        /**
+         * @brief Replaces the body of the user function, the next dispatch compiles it
+         * @param body GLSL body of contributionWeight
+         */
+        void setUserGLSL(const std::string &body) {
+            funcs[USER_GLSL].glsl = body;
+            funcs[USER_GLSL].revision++;
+            funcs[USER_GLSL].error.clear();
+        }
+
+        /**
+         * @brief Full GLSL definition of a function, to be injected at PLACEHOLDER
+         */
+        std::string buildGLSL(int id) const {
+            return "float contributionWeight(float t, float polarityVal, float centerT, float endT) {\n"
+                "    const float PI = 3.14159265359;\n" + get(id).glsl + "\n}\n";
+        }
+
+        /**
+         * @brief Evaluates a function on the CPU, functions without a CPU implementation fall back to the box
+         * @param polarityVal -1 or 1
+         */
+        float evaluate(int id, float t, float polarityVal, const ContributionParams &p) const {
+            const ContributionFunction &func = isValid(id) ? get(id) : get(BOX);
+            return func.cpu ? func.cpu(t, polarityVal, p) : p.contribution * polarityVal;
+        }
+
+        /**
+         * @brief Names separated by '\0' for ImGui::Combo
+         */
+        const char *getComboItems() {
+            if (comboItems.empty()) {
+                for (const ContributionFunction &func : funcs) {
+                    comboItems += func.name;
+                    comboItems.push_back('\0');
+                }
+                comboItems.push_back('\0');
+            }
+            return comboItems.c_str();
+        }
+
+    private:
+        ContributionRegistry() {
+            add({ "Box",
+                "    return baseContribution * polarityVal;",
+                [](float, float polarityVal, const ContributionParams &p) {
+                    return p.contribution * polarityVal;
+                }, false, 0, "" });
+
+            // width is the FWHM
+            add({ "Gaussian",
+                "    float d = t - centerT;\n"
+                "    return baseContribution * polarityVal * exp(-4.0 * 0.693147 * d * d / (funcWidth * funcWidth));",
+                [](float t, float polarityVal, const ContributionParams &p) {
+                    float d = t - p.centerT;
+                    return p.contribution * polarityVal * std::exp(-4.0f * 0.693147f * d * d / (p.width * p.width));
+                }, true, 0, "" });
+
+            // Most recent events weigh the most, width is the time constant
+            add({ "Exponential Decay",
+                "    return baseContribution * polarityVal * exp(-max(endT - t, 0.0) / funcWidth);",
+                [](float t, float polarityVal, const ContributionParams &p) {
+                    return p.contribution * polarityVal * std::exp(-std::fmax(p.endT - t, 0.0f) / p.width);
+                }, true, 0, "" });
+
+            // Cosine carrier under a Gaussian with standard deviation width, lobes are not rebalanced
+            add({ "Gabor",
+                "    float d = t - centerT;\n"
+                "    float envelope = exp(-0.5 * d * d / (funcWidth * funcWidth));\n"
+                "    return baseContribution * polarityVal * cos(2.0 * PI * funcFreq * d) * envelope;",
+                [](float t, float polarityVal, const ContributionParams &p) {
+                    float d = t - p.centerT;
+                    float envelope = std::exp(-0.5f * d * d / (p.width * p.width));
+                    return p.contribution * polarityVal * std::cos(2.0f * std::acos(-1.0f) * p.freq * d) * envelope;
+                }, true, 0, "" });
+
+            // Same as MorletFunc: FWHM envelope, negative lobes scaled by 4 to counter basic.fsh
+            add({ "Morlet",
+                "    float d = t - centerT;\n"
+                "    float gaussian = exp(-4.0 * 0.693147 * d * d / (funcWidth * funcWidth));\n"
+                "    float unweighted = cos(2.0 * PI * funcFreq * d) * gaussian * polarityVal;\n"
+                "    return unweighted < 0.0 ? unweighted * 4.0 * baseContribution : unweighted * baseContribution;",
+                [](float t, float polarityVal, const ContributionParams &p) {
+                    float d = t - p.centerT;
+                    float gaussian = std::exp(-4.0f * 0.693147f * d * d / (p.width * p.width));
+                    float unweighted = std::cos(2.0f * std::acos(-1.0f) * p.freq * d) * gaussian * polarityVal;
+                    return unweighted < 0.0f ? unweighted * 4.0f * p.contribution : unweighted * p.contribution;
+                }, true, 0, "" });
+
+            // Edited from the GUI, there is no CPU counterpart
+            add({ "User GLSL",
+                "    return baseContribution * polarityVal * exp(-abs(t - centerT) / funcWidth);",
+                nullptr, true, 0, "" });
+        }
+
+        std::vector<ContributionFunction> funcs;
+        std::string comboItems;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef CONTRIBUTION_KERNELS_H
+#define CONTRIBUTION_KERNELS_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ComputeProgram.h"
+
+/*
+    Lazily compiled variants of one shutter compute shader, one per registered contribution function
+    and combination of feature defines. The function definition from ContributionRegistry replaces
+    ContributionRegistry::PLACEHOLDER in the source and each set feature bit adds its #define, so the
+    per event work has no branches on the function type or on toggles such as positive only.
+*/
+
+/**
+ * @brief Cache of contribution function specialized programs built from a single shader file.
+ */
+class ContributionKernels {
+    public:
+        ContributionKernels() {}
+
+        /**
+         * @brief Sets the shader source and the uniforms every variant registers, drops built variants
+         * @param shaderName path of the compute shader containing the placeholder
+         * @param uniformNames
+         * @param featureDefines define added for each bit of the feature mask, bit i <-> featureDefines[i]
+         */
+        void setup(const std::string &shaderName, const std::vector<std::string> &uniformNames,
+            const std::vector<std::string> &featureDefines = {});
+
+        /**
+         * @brief Returns the program for a function and feature set, compiling it on first use or after its GLSL changed
+         * @param funcID id in ContributionRegistry
+         * @param features bit mask over the feature defines given to setup
+         * @return ComputeProgram* nullptr if the variant fails to compile (the log is stored in the registry)
+         */
+        ComputeProgram *get(int funcID, unsigned features = 0);
+
+        /**
+         * @brief Adds a shared injection applied to every variant besides the contribution function, drops built variants
+         * @param marker 
+         * @param code 
+         */
+        void setInjection(const std::string &marker, const std::string &code);
+
+    private:
+        struct Variant {
+            std::unique_ptr<ComputeProgram> prog;
+            uint64_t revision = 0;
+            bool failed = false;
+        };
+
+        std::string shaderName;
+        std::vector<std::string> uniformNames;
+        std::vector<std::string> featureDefines;
+        std::map<std::string, std::string> injections;
+        std::map<std::pair<int, unsigned>, Variant> variants;
+};
+
+#endif // CONTRIBUTION_KERNELS_H
@@ -4,12 +4,31 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include "MatrixStack.h"
 #include "Program.h"
 #include "BPMaterial.h"
 #include "Mesh.h"
 #include "ComputeProgram.h"
+#include "ClusterTracker.h"
+#include "ContributionKernels.h"
+#include "EventFilterChain.h"
+#include "EventSelection.h"
+#include "EventVisibility.h"
+#include "FrameBatch.h"
+#include "FrameExporter.h"
+#include "PlaybackPrefetch.h"
+#include "FilterBank.h"
+#include "SpectrumAnalyzer.h"
+#include "SlidingAccumulator.h"
+#include "TimeIndex.h"
+#include "TimeSurface.h"
+#include "VoxelGridExporter.h"
+#include "PixelIndex.h"
+#include "MortonIndex.h"
+#include "PixelStatistics.h"
+#include "RatePyramid.h"
 #include <dv-processing/io/mono_camera_recording.hpp>
 #include <memory>
 
@@ -116,13 +135,265 @@ class EventData {
          * @brief Computes the weight of valid events (within shutter) and passes them into the vertex to render DCE
          * @param prog bound to access the associated shaders and uniforms
          * @param viewport_resolution used to compute needed point size
-         * @param morlet specifies the contribution function to be used
-         * @param freq used to calculate morlet shutter contribution if needed
+         * @param funcID contribution function to be used (id in ContributionRegistry)
+         * @param freq frequency used by oscillating contribution functions
          * @param pca specifies whether pca is computed and displayed
+         * @param weightedPCA uses the |weight| weighted moments instead of plain event counts for pca
+         * @param incremental slides a persistent accumulation for the box function instead of redrawing every event
+         * @param waitForMoments blocks on the moments readback so the pca overlay is drawn in this very frame (offline export)
          */
         void drawFrame(Program &prog, glm::vec2 viewport_resolution, 
-            bool morlet, float freq, bool pca);
+            int funcID, float freq, bool pca, bool weightedPCA = false, bool incremental = false, bool waitForMoments = false);
 
+
+        /**
+         * @brief Renders numFrames consecutive DCE frames, each shifted by one frame period, into the layers of the frame batch
+         * @param numFrames at most FrameBatch::MAX_LAYERS
+         * @param eventPeriod steps the window by framePeriod_E events instead of framePeriod_T time
+         * @param framePeriod_T normalized time period
+         * @param framePeriod_E event period
+         * @param funcID contribution function to be used (id in ContributionRegistry)
+         * @param freq frequency used by oscillating contribution functions
+         */
+        void drawFrameBatch(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E,
+            int funcID, float freq);
+
+        /**
+         * @brief Builds the shutter ranges of numFrames consecutive windows starting firstFrame periods after the current one
+         * @param numFrames
+         * @param eventPeriod
+         * @param framePeriod_T
+         * @param framePeriod_E
+         * @param firstFrame
+         * @return std::vector<ShutterRange> with non-decreasing bounds, clamped to the data
+         */
+        std::vector<ShutterRange> buildShutterRanges(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E,
+            int firstFrame = 0) const;
+
+        FrameBatch &getFrameBatch() { return frameBatch; }
+
+        /**
+         * @brief Starts a raw export of numFrames DCE frames from the current window (see FrameExporter)
+         * @param basePath
+         * @param numFrames
+         * @param eventPeriod steps the window by framePeriod_E events instead of framePeriod_T time
+         * @param framePeriod_T normalized time period
+         * @param framePeriod_E event period
+         * @param funcID contribution function to be used (id in ContributionRegistry)
+         * @param freq frequency used by oscillating contribution functions
+         * @return bool true if started
+         */
+        bool beginFrameExport(const std::string &basePath, int numFrames, bool eventPeriod, float framePeriod_T,
+            uint framePeriod_E, int funcID, float freq);
+
+        /**
+         * @brief Renders the next chunk of a running raw export when the readback and encoders have room for it
+         */
+        void stepFrameExport();
+
+        FrameExporter &getFrameExporter() { return frameExporter; }
+
+        /**
+         * @brief Starts converting the recording into voxel grids (see VoxelGridExporter): the resident events
+         * chunk by chunk through stepVoxelExport, or while streaming every batch as it is read
+         * @param path .npy file
+         * @return bool true if started
+         */
+        bool beginVoxelExport(const std::string &path);
+
+        /**
+         * @brief Feeds the next chunk of resident events to a running voxel export and finishes it after the last one
+         */
+        void stepVoxelExport();
+
+        VoxelGridExporter &getVoxelExporter() { return voxelExporter; }
+
+        /**
+         * @brief Serves the current auto-play frame from the prefetch ring and keeps the following frames in flight (see PlaybackPrefetch)
+         * @param numFrames frames rendered per refill, at most FrameBatch::MAX_LAYERS
+         * @param eventPeriod playback steps by framePeriod_E events instead of framePeriod_T time
+         * @param framePeriod_T normalized time period
+         * @param framePeriod_E event period
+         * @param funcID contribution function to be used (id in ContributionRegistry)
+         * @param freq frequency used by oscillating contribution functions
+         * @param presentTime seconds, feeds the achieved playback rate
+         * @return true if the frame is in the prefetch preview texture, false if it must be drawn with drawFrame
+         */
+        bool drawFramePrefetched(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E,
+            int funcID, float freq, double presentTime);
+        PlaybackPrefetch &getPlaybackPrefetch() { return playbackPrefetch; }
+
+        /**
+         * @brief Evaluates a bank of Morlet filters over the current shutter in one pass (see FilterBank)
+         * @param numFilters at most FilterBank::MAX_FILTERS
+         * @param minFreq lowest frequency in Hz
+         * @param maxFreq highest frequency in Hz, frequencies are spaced logarithmically in between
+         * @param cycles FWHM of each filter in periods of its own frequency, <= 0 uses MorletFunc::h for all
+         */
+        void runFilterBank(int numFilters, float minFreq, float maxFreq, float cycles);
+        FilterBank &getFilterBank() { return filterBank; }
+
+        /**
+         * @brief Dominant frequency, magnitude and phase of every pixel over the current time window (see SpectrumAnalyzer)
+         * @param gpu uses the compute shader path, otherwise the multithreaded CPU path over the pixel index
+         * @param numBins at most SpectrumAnalyzer::MAX_BINS
+         * @param minFreq lowest frequency in Hz
+         * @param maxFreq highest frequency in Hz, bins are spaced linearly in between
+         */
+        void runSpectrum(bool gpu, int numBins, float minFreq, float maxFreq);
+        SpectrumAnalyzer &getSpectrumAnalyzer() { return spectrumAnalyzer; }
+
+        /**
+         * @brief Count, polarity, interval and last event maps of every pixel (see PixelStatistics)
+         * @param gpu uses the compute shader over the pixel index, otherwise the multithreaded CPU path
+         * @param shutter over the current shutter instead of the whole time window
+         */
+        void runPixelStatistics(bool gpu, bool shutter);
+        PixelStatistics &getPixelStatistics() { return pixelStatistics; }
+
+        /**
+         * @brief Clusters the events of the current shutter and advances the tracks, nothing runs while the shutter is unchanged (see ClusterTracker)
+         */
+        void updateClusters();
+
+        /**
+         * @brief Draws the cluster ellipses and track trails over the DCE frame, call with the frame FBO bound
+         */
+        void drawClusters();
+
+        /**
+         * @brief Writes the tracks as CSV with times in seconds since the first event
+         * @param path
+         * @return bool true if successful
+         */
+        bool exportTracks(const std::string &path) const;
+        ClusterTracker &getClusterTracker() { return clusterTracker; }
+        const SlidingAccumulator &getSlidingAccumulator() const { return slidingAccumulator; }
+
+        /**
+         * @brief Draws the decayed time surface at the end of the shutter (the newest event while streaming)
+         *        instead of the DCE frame, see TimeSurface
+         * @param viewport_resolution
+         * @param tau decay time constant in microseconds
+         * @param mode TimeSurface::POLARITY_MODE, MERGED_MODE or SIGNED_MODE
+         */
+        void drawTimeSurface(glm::vec2 viewport_resolution, float tau, int mode);
+        const TimeSurface &getTimeSurface() const { return timeSurface; }
+
+        /**
+         * @brief Filters run over every batch as it is read, changes apply to the next load or stream batch
+         */
+        EventFilterChain &getFilterChain() { return *filterChain; }
+
+        /**
+         * @brief Shares a filter chain owned by the caller, so its settings outlive this EventData across reloads
+         * @param chain must not be null
+         */
+        void setFilterChain(std::shared_ptr<EventFilterChain> chain) { filterChain = std::move(chain); }
+
+        /**
+         * @brief Flags outlier pixels in the rates counted during the last load or stream, applies the mask and saves it for the camera
+         * @param numMADs outlier threshold in scaled median absolute deviations above the median rate
+         * @param minRate events per second a pixel must exceed to be flagged
+         * @return number of hot pixels, the mask removes their events from the next load onwards
+         */
+        size_t detectHotPixels(float numMADs, float minRate);
+
+        /**
+         * @brief Loads the stored mask of the current camera into the hot pixel filter, which only uses it while enabled
+         * @return bool true if a mask was found for the camera
+         */
+        bool loadHotPixelMask();
+        std::string getHotPixelMaskPath() const;
+        const HotPixelDetector &getHotPixelDetector() const { return hotPixelDetector; }
+        const std::string &getCameraName() const { return cameraName; }
+        bool &getAutoHotPixelMask() { return autoHotPixelMask; }
+
+        /**
+         * @brief GPU filters over the resident events, honoured by drawInstanced and every DCE pass without re-uploading
+         */
+        EventVisibility &getVisibility() { return visibility; }
+
+        /**
+         * @brief (Re)builds the per pixel event index over the current events
+         */
+        void buildPixelIndex();
+        const PixelIndex &getPixelIndex() const { return pixelIndex; }
+        bool &getAutoPixelIndex() { return autoPixelIndex; }
+
+        /**
+         * @brief (Re)builds the spatio-temporal index over the current events, queries build it when missing
+         */
+        void buildSpatialIndex();
+        const MortonIndex &getSpatialIndex() const { return spatialIndex; }
+
+        /**
+         * @brief Picks the event under a point of the main viewport, closest to the camera
+         * @param viewProj projection * modelview the viewport was drawn with
+         * @param ndc point in normalized device coordinates
+         * @param pixelRadius pick tolerance in viewport pixels
+         * @param viewportHeight in pixels
+         * @return int event index, -1 if there is none (also stored, see getPickedEvent)
+         */
+        int pickEvent(const glm::mat4 &viewProj, const glm::vec2 &ndc, float pixelRadius, float viewportHeight);
+        int getPickedEvent() const { return pickedEvent; }
+
+        /**
+         * @brief Indices of the events inside the space window and time window
+         * @param out
+         */
+        void queryWindowBox(std::vector<uint32_t> &out);
+
+        /**
+         * @brief Indices of the events inside the view frustum
+         * @param viewProj projection * modelview of the main viewport
+         * @param out
+         */
+        void queryFrustum(const glm::mat4 &viewProj, std::vector<uint32_t> &out);
+
+        /**
+         * @brief The k events closest to an event in (x, y, t), itself included, nearest first
+         * @param event
+         * @param k
+         * @param out
+         */
+        void nearestEvents(uint32_t event, int k, std::vector<uint32_t> &out);
+        const glm::vec4 &getEvent(uint32_t event) const { return evtParticles[event]; }
+
+        /**
+         * @brief Selects the events whose projection falls inside a screen space polygon, on the GPU
+         * @param viewProj projection * modelview of the main viewport
+         * @param polygon normalized device coordinates
+         * @param mode EventSelection::REPLACE, ADD or SUBTRACT
+         */
+        void selectLasso(const glm::mat4 &viewProj, const std::vector<glm::vec2> &polygon, int mode);
+
+        /**
+         * @brief Selects the picked event (see pickEvent), a miss with REPLACE clears the selection
+         * @param mode EventSelection::REPLACE, ADD or SUBTRACT
+         */
+        void selectPicked(int mode);
+        void clearSelection();
+        const EventSelection &getSelection() const { return selection; }
+        bool hasSelection() const { return selection.hasSelection(dataVersion); }
+
+        /**
+         * @brief Moves the event, time and space windows onto the selection so the DCE and analysis panels follow it
+         * @param oddFactor time windows are set in this unit, as getTimestamp
+         */
+        void fitWindowsToSelection(float oddFactor);
+
+        /**
+         * @brief Writes the selected events as CSV with times in seconds since the first event
+         * @param path
+         * @return bool true if successful
+         */
+        bool exportSelection(const std::string &path) const;
+
+        /**
+         * @brief Event rate over the whole recording or stream at every zoom level, for the timeline
+         */
+        const RatePyramid &getRatePyramid() const { return ratePyramid; }
         
         /**
          * @brief Set the resource directory path for compute shader initialization
@@ -140,6 +411,27 @@ class EventData {
          */
         void initComputeBuffers();
 
+        /**
+         * @brief Re-uploads the events only if they changed since the last upload, at most once per data change
+         */
+        void syncComputeBuffers();
+
+        /**
+         * @brief Consumes any finished DCE counter/moment readbacks without stalling on the GPU
+         * @return true if the result of the most recent dispatch just became available
+         */
+        bool pollReadbacks();
+
+        /**
+         * @brief Waits for every readback still in flight, then consumes them like pollReadbacks()
+         */
+        void waitReadbacks();
+
+        /**
+         * @brief Number of events that contributed to the last DCE frame whose readback has landed
+         */
+        GLuint getDCEOutputCount() const { return readbackCount; }
+
         /**
          * @brief Used by utils/drawGUI to allow for changing back into time from specified unit of time
          */
@@ -172,6 +464,17 @@ class EventData {
         uint getLastEvent(float timestamp, float normFactor = 1.0f) const;
 
         const float getDiffScale() const { return diffScale; }
+        /**
+         * @brief Normalized event time per microsecond, with the particle time density the resident events were actually
+         *        scaled with (1 for loaded files, the density of the last rebuild while streaming)
+         * @return float
+         */
+        float getTimeScale() const { return diffScale * scaledTimeDensity; }
+        /**
+         * @brief Normalized time per GUI time unit, the factor normalizeTime and oddizeTime apply
+         * @return float
+         */
+        float getUnitFactor() const { return getTimeScale() * TIME_CONVERSION; }
         const glm::vec3 &getCenter() const { return center; }
         const glm::vec3 getMin_XYZ() const { return minXYZ; }
         const glm::vec3 getMax_XYZ() const { return maxXYZ; }
@@ -194,6 +497,7 @@ class EventData {
 
         glm::vec3 &getNegColor() { return negColor; }
         glm::vec3 &getPosColor() { return posColor; }
+        glm::vec3 &getSelectColor() { return selectColor; }
 
         void setParticleTimeDensity(float _particleTimeDensity) { this->particleTimeDensity = _particleTimeDensity; }
         float getParticleTimeDensity() { return particleTimeDensity; }
@@ -203,12 +507,53 @@ class EventData {
         static inline int TIME_CONVERSION; 
         static const int TIME_SHUTTER = 0; // values must match ImGui::Combo order in utils.cpp
         static const int EVENT_SHUTTER = 1;
+        static const int NUM_MOMENTS = 12; // must match NUM_MOMENTS in digital_shutter.comp and moment_reduce.comp
+        static const int READBACK_RING_SIZE = 3;
         static inline uint modFreq = 1; // only draw the modFreq'th particle of the ones we read in
     private:
+        /**
+         * @brief Copies the counters (and moments) of the dispatch just issued into the next readback slot and fences it
+         * @param withMoments whether the moment reduction ran for this dispatch
+         */
+        void queueReadback(bool withMoments);
+
+        /**
+         * @brief Recomputes the visibility bitmask if any GPU filter or the resident data changed
+         */
+        void updateVisibility();
+
+        // Everything that changes the DCE output; used to skip redundant dispatches
+        struct DCEDispatchKey {
+            int eventBound_L;
+            int eventBound_R;
+            float shutterCenterT; // time dependent contributions change when only the time window moves
+            float shutterEndT;
+            glm::vec4 spaceWindow;
+            bool isPositiveOnly;
+            int funcID;
+            uint64_t funcRevision;
+            bool pca;
+            float freq;
+            float width;
+            float contribution;
+            uint64_t visibilityVersion;
+
+            bool operator==(const DCEDispatchKey &) const = default;
+        };
+
+        // Small staging buffer holding { counters[4], moments[NUM_MOMENTS] } and the fence guarding it
+        struct ReadbackSlot {
+            GLuint buffer = 0;
+            GLsync fence = nullptr;
+            uint64_t generation = 0;
+            bool hasMoments = false;
+        };
+
         glm::vec2 camera_resolution;
         float diffScale;
 
         float particleTimeDensity; // Density of particles along time axis
+        float scaledTimeDensity;   // particleTimeDensity the resident event times were scaled with, see getTimeScale
 
         bool isStreaming; // Flag to indicate if data is being streamed
 
@@ -250,18 +595,63 @@ class EventData {
 
         glm::vec3 negColor;
         glm::vec3 posColor;
+        glm::vec3 selectColor;
 
         bool isPositiveOnly;
         int unitType;
 
         // GPU Compute resources
-        ComputeProgram computeProg;
+        ContributionKernels shutterKernels; // digital_shutter.comp, one variant per contribution function and feature set
+        static const unsigned SHUTTER_POSITIVE_ONLY = 1u << 0;
+        static const unsigned SHUTTER_MOMENTS = 1u << 1;
+        static const unsigned SHUTTER_VISIBILITY = 1u << 2;
+        ComputeProgram momentReduceProg; // Second level of the PCA moment reduction
         GLuint evtParticlesSSBO;
         GLuint outputDataSSBO;
         GLuint countersSSBO;
+        GLuint partialMomentsSSBO; // NUM_MOMENTS floats per work group
+        GLuint momentsSSBO; // NUM_MOMENTS doubles, the only data read back for PCA
+        
+        // Asynchronous readback of counters / moments
+        ReadbackSlot readbackRing[READBACK_RING_SIZE];
+        int readbackHead; // slot the next dispatch copies into
+        uint64_t dispatchGeneration; // incremented per dispatch
+        uint64_t consumedGeneration; // generation of readbackCount / readbackMoments
+        GLuint readbackCount;
+        GLdouble readbackMoments[NUM_MOMENTS];
+        bool readbackHasMoments;
+        bool hasDispatched;
+        DCEDispatchKey lastDispatchKey;
         bool computeInitialized;
         std::string resourceDir;
 
+        FrameBatch frameBatch;
+        FrameExporter frameExporter; // Renders with its own batch, the scrub batch is left alone
+        VoxelGridExporter voxelExporter; // Fed from evtParticles, or from the stream while streaming
+        PlaybackPrefetch playbackPrefetch;
+        FilterBank filterBank;
+        SpectrumAnalyzer spectrumAnalyzer;
+        PixelStatistics pixelStatistics;
+        ClusterTracker clusterTracker;
+        SlidingAccumulator slidingAccumulator;
+        TimeSurface timeSurface; // Streamed batches are ingested once it has been drawn while streaming
+        TimeIndex timeIndex; // Timestamp -> event index for getFirstEvent/getLastEvent
+        PixelIndex pixelIndex; // Optional, empty unless built
+        MortonIndex spatialIndex; // Optional, built by the first query after the events change
+        int pickedEvent; // -1 when nothing is picked
+        EventSelection selection; // Bitmask over the resident events, stale once dataVersion moves on
+        RatePyramid ratePyramid; // Built at load, appended to while streaming
+        bool autoPixelIndex; // Build pixelIndex whenever new events are loaded
+        uint64_t dataVersion; // bumped whenever evtParticlesSSBO is re-uploaded
+        uint64_t hostVersion; // bumped whenever evtParticles changes
+        uint64_t uploadedHostVersion; // hostVersion of the last upload
+
+        std::shared_ptr<EventFilterChain> filterChain; // Applied at ingest, before events become particles; shared with main.cpp
+        HotPixelDetector hotPixelDetector; // Counts the unfiltered ingest per pixel
+        std::string cameraName; // Of the last recording, keys the stored hot pixel masks
+        bool autoHotPixelMask; // Apply the stored mask of the camera whenever a recording starts
+        EventVisibility visibility; // Applied on the GPU to the resident events
+
         std::shared_ptr<dv::io::MonoCameraRecording> liveStreamReader;
 };
 
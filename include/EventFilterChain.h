@@ -0,0 +1,256 @@
+#pragma once
+#ifndef EVENT_FILTER_CHAIN_H
+#define EVENT_FILTER_CHAIN_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+    Filters applied to every batch of events as it is read from a recording, before the events are
+    converted to particles (file mode) or kept in the stream deque (streaming mode).
+
+    Stages run in order over the whole batch and only see the events that earlier stages kept, so the
+    chain composes: each stage clears entries of a shared keep mask and counts what it passed and
+    dropped. Stateless stages (ROI, polarity, hot pixel) are flat loops over the batch split across
+    threads. Stateful stages (refractory, background activity) keep the last timestamp per pixel and
+    run in parallel over horizontal bands of the sensor: a counting sort first buckets the event indices
+    by band, in time order, so every thread only visits the events of the rows it owns. The background
+    activity filter also replays the events of the row just outside each edge of its band into a private
+    copy of that row, so the result is the same as one sequential pass for any number of threads.
+
+    Timestamps stay in integer microseconds so refractory and support windows are exact.
+
+    The hot pixel mask comes from HotPixelDetector, which counts every ingested event per pixel (again
+    in parallel row bands, so no atomics) and flags pixels whose rate is a robust outlier: more than k
+    scaled median absolute deviations above the median rate of the active pixels. Masks are defects of
+    the sensor, not of a recording, so they are stored per camera and reapplied on every later load.
+*/
+
+/**
+ * @brief One event of a batch being ingested.
+ */
+struct FilterEvent {
+    int64_t timestamp; // microseconds
+    int16_t x;
+    int16_t y;
+    uint8_t polarity;
+};
+
+/**
+ * @brief A filter stage; drops events by clearing their keep entry.
+ */
+class EventFilterStage {
+    public:
+        virtual ~EventFilterStage() = default;
+
+        virtual const char *getName() const = 0;
+
+        /**
+         * @brief Clears per pixel state, called when a new recording or stream starts
+         * @param resolution sensor size
+         */
+        virtual void reset(glm::ivec2 resolution) { this->resolution = resolution; }
+
+        /**
+         * @brief Clears keep[i] of every event with keep[i] != 0 that the stage rejects
+         * @param batch time sorted events
+         * @param keep one entry per event
+         */
+        virtual void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) = 0;
+
+        bool enabled = false;
+        uint64_t passed = 0;
+        uint64_t dropped = 0;
+
+    protected:
+        glm::ivec2 resolution = glm::ivec2(0);
+};
+
+/**
+ * @brief Keeps events inside an inclusive pixel rectangle.
+ */
+class ROIFilter : public EventFilterStage {
+    public:
+        const char *getName() const override { return "ROI"; }
+        void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) override;
+
+        glm::ivec2 roiMin = glm::ivec2(0);
+        glm::ivec2 roiMax = glm::ivec2(INT16_MAX);
+};
+
+/**
+ * @brief Keeps events of one polarity.
+ */
+class PolarityFilter : public EventFilterStage {
+    public:
+        const char *getName() const override { return "Polarity"; }
+        void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) override;
+
+        int keepPolarity = 1; // 1 positive, 0 negative
+};
+
+/**
+ * @brief Drops events that follow a kept event of the same pixel within the refractory period.
+ */
+class RefractoryFilter : public EventFilterStage {
+    public:
+        const char *getName() const override { return "Refractory"; }
+        void reset(glm::ivec2 resolution) override;
+        void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) override;
+
+        int64_t period = 1000; // microseconds
+
+    private:
+        std::vector<int64_t> lastKept;
+};
+
+/**
+ * @brief Keeps events supported by a recent event in one of the 8 neighbouring pixels.
+ */
+class BackgroundActivityFilter : public EventFilterStage {
+    public:
+        const char *getName() const override { return "Background Activity"; }
+        void reset(glm::ivec2 resolution) override;
+        void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) override;
+
+        int64_t window = 2000; // microseconds
+
+    private:
+        std::vector<int64_t> lastSeen;
+};
+
+/**
+ * @brief Drops events of pixels flagged in a mask.
+ */
+class HotPixelFilter : public EventFilterStage {
+    public:
+        const char *getName() const override { return "Hot Pixel"; }
+        void apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) override;
+
+        /**
+         * @brief Replaces the mask, row major at the sensor resolution, non zero means hot
+         */
+        void setMask(std::vector<uint8_t> newMask) { mask = std::move(newMask); revision++; }
+        const std::vector<uint8_t> &getMask() const { return mask; }
+        uint64_t getRevision() const { return revision; } // bumped by every setMask
+        size_t getNumMasked() const;
+
+    private:
+        std::vector<uint8_t> mask;
+        uint64_t revision = 0;
+};
+
+/**
+ * @brief Per pixel event rates of the ingested data and the outlier test that turns them into a hot pixel mask.
+ */
+class HotPixelDetector {
+    public:
+        /**
+         * @brief Clears the counts for a new recording or stream
+         * @param resolution sensor size
+         */
+        void reset(glm::ivec2 resolution);
+
+        /**
+         * @brief Adds a batch to the per pixel counts, called before any filter drops events
+         * @param batch time sorted events
+         */
+        void accumulate(const std::vector<FilterEvent> &batch);
+
+        /**
+         * @brief Flags pixels firing faster than median + numMADs * 1.4826 * MAD of the active pixel rates
+         * @param numMADs outlier threshold in scaled median absolute deviations
+         * @param minRate pixels below this rate (events per second) are never flagged
+         * @return mask row major at the sensor resolution, 1 means hot, empty if nothing was counted
+         */
+        std::vector<uint8_t> detect(float numMADs, float minRate);
+
+        /**
+         * @brief Writes a mask as an 8 bit PNG (255 = hot) so it can be inspected and edited by hand
+         * @return bool true if successful
+         */
+        static bool saveMask(const std::string &path, const std::vector<uint8_t> &mask, glm::ivec2 resolution);
+
+        /**
+         * @brief Reads a mask written by saveMask
+         * @return bool true if the file exists and matches the resolution
+         */
+        static bool loadMask(const std::string &path, glm::ivec2 resolution, std::vector<uint8_t> &mask);
+
+        /**
+         * @brief File of the mask belonging to a camera, e.g. masks/DAVIS346_00000499.png
+         * @param maskDir directory ending in a separator
+         * @param cameraName as reported by the recording, includes the serial number
+         */
+        static std::string getMaskPath(const std::string &maskDir, const std::string &cameraName);
+
+        uint64_t getNumEvents() const { return numEvents; }
+        double getDurationSeconds() const;
+        float getMedianRate() const { return medianRate; }
+        float getThresholdRate() const { return thresholdRate; }
+        size_t getNumDetected() const { return numDetected; }
+        double getMilliseconds() const { return milliseconds; }
+
+    private:
+        glm::ivec2 resolution = glm::ivec2(0);
+        std::vector<uint32_t> counts;
+        uint64_t numEvents = 0;
+        int64_t firstTimestamp = 0;
+        int64_t lastTimestamp = 0;
+
+        float medianRate = 0.0f;
+        float thresholdRate = 0.0f;
+        size_t numDetected = 0;
+        double milliseconds = 0.0;
+};
+
+/**
+ * @brief Ordered set of filter stages run over every ingested batch.
+ */
+class EventFilterChain {
+    public:
+        EventFilterChain();
+
+        /**
+         * @brief Clears stage state and counters for a new recording or stream
+         * @param resolution sensor size
+         */
+        void reset(glm::ivec2 resolution);
+
+        /**
+         * @brief Runs every enabled stage and removes the dropped events, keeping the order
+         * @param batch time sorted events, compacted in place
+         */
+        void apply(std::vector<FilterEvent> &batch);
+
+        bool isActive() const;
+        int getNumStages() const { return static_cast<int>(stages.size()); }
+        EventFilterStage &getStage(int i) { return *stages[i]; }
+        uint64_t getInput() const { return input; }
+        uint64_t getOutput() const { return output; }
+
+        ROIFilter &getROI() { return *roi; }
+        PolarityFilter &getPolarity() { return *polarity; }
+        RefractoryFilter &getRefractory() { return *refractory; }
+        BackgroundActivityFilter &getBackgroundActivity() { return *backgroundActivity; }
+        HotPixelFilter &getHotPixel() { return *hotPixel; }
+
+    private:
+        std::vector<std::unique_ptr<EventFilterStage>> stages; // in the order they run
+        ROIFilter *roi;
+        PolarityFilter *polarity;
+        RefractoryFilter *refractory;
+        BackgroundActivityFilter *backgroundActivity;
+        HotPixelFilter *hotPixel;
+
+        std::vector<uint8_t> keep;
+        uint64_t input;
+        uint64_t output;
+};
+
+#endif // EVENT_FILTER_CHAIN_H
@@ -0,0 +1,134 @@
+#pragma once
+#ifndef EVENT_SELECTION_H
+#define EVENT_SELECTION_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+
+/*
+    Events selected in the main viewport, kept on the GPU as one bit per resident event (binding 13,
+    the layout of the visibility bitmask) so the viewport can highlight them, the visibility filters can
+    keep only them and the DCE passes follow without anything being re-uploaded.
+
+    A lasso is a screen space polygon: event_select.comp projects every event with the viewport camera
+    and tests it against the polygon (even-odd rule), a single coalesced pass like event_visibility.comp.
+    A click selects the one event the spatial index picked, through the same shader. Either way the pass
+    combines the new bits with the old ones (replace, add, subtract) and reduces the statistics of the
+    resulting selection in shared memory, so only a handful of words are read back.
+*/
+
+/**
+ * @brief Summary of the selected events.
+ */
+struct SelectionStats {
+    uint32_t count = 0;
+    uint32_t positive = 0;
+    uint32_t firstEvent = 0;  // lowest selected index, the events are time sorted
+    uint32_t lastEvent = 0;   // highest selected index
+    glm::ivec2 pixelMin = glm::ivec2(0);
+    glm::ivec2 pixelMax = glm::ivec2(0);
+    float t0 = 0.0f;          // normalized
+    float t1 = 0.0f;
+};
+
+/**
+ * @brief Owns the selection bitmask and the compute program that edits it.
+ */
+class EventSelection {
+    public:
+        EventSelection();
+        ~EventSelection();
+
+        /**
+         * @brief Compiles the selection compute shader
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Selects the events whose projection falls inside a polygon
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param numEvents
+         * @param dataVersion changes whenever evtParticlesSSBO is re-uploaded, an older selection is dropped
+         * @param viewProj projection * modelview of the main viewport
+         * @param polygon normalized device coordinates, at most MAX_LASSO_POINTS, closed implicitly
+         * @param mode REPLACE, ADD or SUBTRACT
+         * @param visibilitySSBO only visible events are selected, 0 to ignore visibility
+         */
+        void selectLasso(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, const glm::mat4 &viewProj,
+            const std::vector<glm::vec2> &polygon, int mode, GLuint visibilitySSBO);
+
+        /**
+         * @brief Selects a single event
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param numEvents
+         * @param dataVersion changes whenever evtParticlesSSBO is re-uploaded, an older selection is dropped
+         * @param event index, < 0 only applies the mode (REPLACE clears)
+         * @param mode REPLACE, ADD or SUBTRACT
+         */
+        void selectEvent(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, int event, int mode);
+
+        /**
+         * @brief Forgets the selection, the bitmask is cleared on the next select
+         */
+        void clear();
+
+        /**
+         * @brief Binds the bitmask at binding 13 for the shaders that read it
+         */
+        void bind() const;
+
+        /**
+         * @brief Copies the selection bits of events [firstEvent, lastEvent] back to the CPU
+         * @param bits one bit per event, word 0 holds the word containing firstEvent
+         * @return uint32_t index of the first event of bits[0]
+         */
+        uint32_t readBits(std::vector<uint32_t> &bits) const;
+
+        /**
+         * @brief The bitmask was made over this data, it may be empty
+         */
+        bool isValid(uint64_t dataVersion) const { return valid && selectedDataVersion == dataVersion; }
+
+        /**
+         * @brief A non empty selection made over this data
+         */
+        bool hasSelection(uint64_t dataVersion) const { return isValid(dataVersion) && stats.count > 0; }
+        const SelectionStats &getStats() const { return stats; }
+        uint64_t getRevision() const { return revision; } // changes whenever the bits do
+        GLuint getBuffer() const { return selectionSSBO; }
+        double getMilliseconds() const { return milliseconds; }
+
+        static const GLuint BINDING = 13; // must match the Selection binding in the shaders
+        static const int MAX_LASSO_POINTS = 512;
+        static const int REPLACE = 0; // values must match ImGui::RadioButton order in utils.cpp
+        static const int ADD = 1;
+        static const int SUBTRACT = 2;
+
+    private:
+        void run(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, const glm::mat4 &viewProj,
+            int numPoints, int event, int mode, GLuint visibilitySSBO);
+
+        ComputeProgram selectProg;
+        bool initialized;
+
+        GLuint selectionSSBO;
+        GLuint statsSSBO;
+        GLuint polygonSSBO;
+        size_t selectionCapacity;
+
+        SelectionStats stats;
+        uint64_t selectedDataVersion;
+        uint64_t revision;
+        bool valid;
+        double milliseconds;
+};
+
+#endif // EVENT_SELECTION_H
@@ -0,0 +1,151 @@
+#pragma once
+#ifndef EVENT_VISIBILITY_H
+#define EVENT_VISIBILITY_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+#include "PixelIndex.h"
+
+/*
+    Filters evaluated on the GPU over the resident event buffer. The result is one visibility bit per
+    event (binding 7) that phong_inst.vsh and the DCE shaders built with VISIBILITY honour, so toggling a
+    filter only reruns event_visibility.comp, a single coalesced pass over the events, and nothing is
+    re-uploaded.
+
+    The noise filter is the one expensive stage: event_support.comp binary searches the neighbouring
+    pixels of every event in the per pixel index. Its bits are kept in their own buffer and only
+    recomputed when the support window or the data changes, so switching it on and off is as cheap as
+    any other filter.
+*/
+
+/**
+ * @brief What the GPU filters keep. Times are normalized.
+ */
+struct VisibilitySettings {
+    static const int MAX_TIME_RANGES = 8; // must match MAX_TIME_RANGES in event_visibility.comp
+
+    bool polarity = false;
+    int keepPolarity = 1; // 1 positive, 0 negative
+    bool roi = false;
+    glm::vec4 roiWindow = glm::vec4(0.0f); // x = top, y = right, z = bottom, w = left
+    int numTimeRanges = 0; // 0 disables the time filter
+    glm::vec2 timeRanges[MAX_TIME_RANGES] = {};
+    bool hotPixels = false;
+    bool noise = false;
+    float noiseWindow = 1.0f; // support window
+    bool selection = false; // only the events selected in the viewport
+
+    bool operator==(const VisibilitySettings &) const = default;
+};
+
+/**
+ * @brief Owns the per event visibility bitmask and the compute programs that fill it.
+ */
+class EventVisibility {
+    public:
+        EventVisibility();
+        ~EventVisibility();
+
+        /**
+         * @brief Compiles the visibility and noise support compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Recomputes the bitmask if the settings, data or hot pixel mask changed since the last call
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param numEvents
+         * @param resolution camera resolution
+         * @param dataVersion changes whenever evtParticlesSSBO is re-uploaded
+         * @param pixelIndex per pixel index of the resident events, required by the noise filter
+         * @param hotPixelMask row major at the camera resolution, non zero means hot
+         * @param hotPixelRevision changes whenever hotPixelMask does
+         * @param selectionSSBO selection bitmask over these events, 0 while there is none
+         * @param selectionRevision changes whenever selectionSSBO does
+         */
+        void update(GLuint evtParticlesSSBO, size_t numEvents, glm::ivec2 resolution, uint64_t dataVersion,
+            const PixelIndex &pixelIndex, const std::vector<uint8_t> &hotPixelMask, uint64_t hotPixelRevision,
+            GLuint selectionSSBO, uint64_t selectionRevision);
+
+        /**
+         * @brief Binds the bitmask at binding 7 for the shaders that read it
+         */
+        void bind() const;
+
+        VisibilitySettings &getSettings() { return settings; }
+
+        /**
+         * @brief Any filter is switched on
+         */
+        bool isActive() const;
+
+        /**
+         * @brief A filter is on, could run and the bitmask holds its result, only then may shaders read it
+         */
+        bool isApplied() const { return initialized && hasApplied && isActive() && appliedAny; }
+
+        /**
+         * @brief The noise filter is part of the bitmask, false while it is on but has no pixel index to search
+         */
+        bool isNoiseApplied() const { return isApplied() && appliedNoise; }
+
+        /**
+         * @brief Changes whenever the bitmask content does, 0 while not applied
+         */
+        uint64_t getVersion() const { return isApplied() ? version : 0; }
+        GLuint getBuffer() const { return visibilitySSBO; }
+
+        /**
+         * @brief GPU time of the last recompute, polled without stalling
+         */
+        double getMilliseconds();
+
+        static const GLuint BINDING = 7; // must match the Visibility binding in the shaders
+
+    private:
+        void resizeBuffer(GLuint &buffer, size_t &capacity, size_t bytes);
+        void runSupport(GLuint evtParticlesSSBO, size_t numEvents, glm::ivec2 resolution, const PixelIndex &pixelIndex);
+
+        ComputeProgram visibilityProg;
+        ComputeProgram supportProg;
+        bool initialized;
+
+        GLuint visibilitySSBO;
+        GLuint supportSSBO;
+        GLuint hotPixelSSBO;
+        GLuint offsetsSSBO;
+        GLuint timesSSBO;
+        size_t visibilityCapacity;
+        size_t supportCapacity;
+        size_t hotPixelCapacity;
+        size_t offsetsCapacity;
+        size_t timesCapacity;
+        GLuint timerQuery;
+        bool timerPending;
+        double milliseconds;
+
+        VisibilitySettings settings;
+        VisibilitySettings appliedSettings;
+        uint64_t appliedDataVersion;
+        uint64_t appliedHotPixelRevision;
+        uint64_t appliedSelectionRevision;
+        bool hasApplied;
+        bool appliedAny;   // some switched on filter had what it needs
+        bool appliedNoise; // the noise filter had a matching pixel index
+        uint64_t version;
+
+        // Noise support bits are valid for this data and window
+        uint64_t supportDataVersion;
+        float supportWindow;
+        bool hasSupport;
+};
+
+#endif // EVENT_VISIBILITY_H
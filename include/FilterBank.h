@@ -0,0 +1,101 @@
+#pragma once
+#ifndef FILTER_BANK_H
+#define FILTER_BANK_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+
+/*
+    Evaluates several Morlet filters (frequency, FWHM) over the shutter events in a single dispatch.
+    The complex response of every filter is accumulated per pixel into a GL_TEXTURE_2D_ARRAY (real and
+    imaginary layer per filter), so flipping between filters or showing the best responding one per
+    pixel is only a resolve dispatch and never touches the events again.
+*/
+
+/**
+ * @brief One filter of the bank, both in normalized time units.
+ */
+struct BankFilter {
+    float freq;
+    float fwhm;
+};
+
+/**
+ * @brief Owns the response volume, preview texture and compute programs of the Morlet filter bank.
+ */
+class FilterBank {
+    public:
+        FilterBank();
+        ~FilterBank();
+
+        /**
+         * @brief Compiles the bank (all and positive only variants) and resolve compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Accumulates the response of every filter over the events in [eventBound_L, eventBound_R]
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param filters at most MAX_FILTERS
+         * @param resolution camera resolution
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param centerT normalized time every filter is centered on
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         */
+        void run(GLuint evtParticlesSSBO, const std::vector<BankFilter> &filters, glm::ivec2 resolution,
+            int eventBound_L, int eventBound_R, float centerT, const glm::vec4 &spaceWindow, bool isPositiveOnly);
+
+        /**
+         * @brief Writes the preview texture
+         * @param layer filter whose magnitude is shown, BEST_FILTER for the colour mapped best filter per pixel
+         * @param gain brightness is 1 - exp(-gain * magnitude)
+         */
+        void resolve(int layer, float gain);
+
+        /**
+         * @brief Colour of filter k out of n in the best filter map (matches morlet_bank_resolve.comp)
+         */
+        static glm::vec3 colorMap(int k, int n);
+
+        /**
+         * @brief Jet colour of x in [0, 1], shared with the other analysis maps
+         */
+        static glm::vec3 colorMap(float x);
+
+        GLuint getPreviewTexture() const { return previewTexture; }
+        int getNumFilters() const { return static_cast<int>(filters.size()); }
+        const BankFilter &getFilter(int k) const { return filters[k]; }
+        bool isResolved(int layer, float gain) const { return layer == resolvedLayer && gain == resolvedGain; }
+
+        static const int MAX_FILTERS = 32; // must match MAX_FILTERS in morlet_bank.comp
+        static const int BEST_FILTER = -1;
+
+    private:
+        void allocate(glm::ivec2 res, int numFilters);
+
+        ComputeProgram bankProg[2]; // [0] all events, [1] POSITIVE_ONLY
+        ComputeProgram resolveProg;
+        bool initialized;
+
+        GLuint responseTexture; // GL_TEXTURE_2D_ARRAY, GL_R32I, 2 layers per filter
+        GLuint previewTexture;  // GL_TEXTURE_2D, GL_RGBA8
+        GLuint filtersSSBO;
+        GLuint zeroPBO;         // one zeroed layer, clears the response volume without a CPU upload
+
+        glm::ivec2 resolution;
+        int allocatedLayers;
+        int resolvedLayer;
+        float resolvedGain;
+        std::vector<BankFilter> filters;
+};
+
+#endif // FILTER_BANK_H
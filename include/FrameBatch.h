@@ -0,0 +1,122 @@
+#pragma once
+#ifndef FRAME_BATCH_H
+#define FRAME_BATCH_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+#include "ContributionKernels.h"
+
+/*
+    Renders many consecutive DCE frames at once. Each frame is one layer of a GL_TEXTURE_2D_ARRAY at
+    camera resolution, and all layers are filled by a single compute dispatch that reads each event once.
+
+    Layers hold the fixed point sum of log(1 - s) over the events of that frame (s being what basic.fsh
+    blends in), which is additive and therefore order independent. dce_resolve.comp turns a layer back
+    into the same grey level the point based drawFrame produces.
+*/
+
+/**
+ * @brief One DCE frame of a batch: the event range that is exposed and the times the contribution function is anchored to.
+ */
+struct ShutterRange {
+    int eventBound_L;
+    int eventBound_R;
+    float centerT;
+    float endT;
+};
+
+/**
+ * @brief Owns the texture array, compute programs and buffers used to render a batch of DCE frames.
+ */
+class FrameBatch {
+    public:
+        FrameBatch();
+        ~FrameBatch();
+
+        /**
+         * @brief Compiles the batch and resolve compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Renders every range into its own layer in one dispatch. Ranges must have non-decreasing bounds.
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param ranges at most MAX_LAYERS frames
+         * @param resolution camera resolution, the size of each layer
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         * @param funcID contribution function id in ContributionRegistry
+         * @param freq normalized frequency (same units drawFrame sends to the shader)
+         * @param width normalized width of the contribution function
+         * @param contribution
+         * @param useVisibility honour the event visibility bitmask, which the caller binds (see EventVisibility)
+         */
+        void render(GLuint evtParticlesSSBO, const std::vector<ShutterRange> &ranges, glm::ivec2 resolution,
+            const glm::vec4 &spaceWindow, bool isPositiveOnly, int funcID, float freq, float width, float contribution,
+            bool useVisibility = false);
+
+        /**
+         * @brief Converts a layer into the RGBA8 preview texture
+         * @param layer
+         */
+        void resolveLayer(int layer);
+
+        /**
+         * @brief Resolves a layer and binds the preview texture as the read framebuffer, for VideoRecorder::capture
+         * @param layer
+         */
+        void bindLayerForRead(int layer);
+
+        /**
+         * @brief Queues a copy of the raw accumulation of every allocated layer into a pixel pack buffer, without waiting for it
+         * @param packBuffer at least getLayerBytes() * getAllocatedLayers() bytes, receives GL_R32I layers bottom row first
+         */
+        void readLayersRaw(GLuint packBuffer) const;
+
+        GLuint getPreviewTexture() const { return previewTexture; }
+        int getNumLayers() const { return static_cast<int>(ranges.size()); }
+        int getResolvedLayer() const { return resolvedLayer; }
+        glm::ivec2 getResolution() const { return resolution; }
+        const ShutterRange &getRange(int layer) const { return ranges[layer]; }
+        int getAllocatedLayers() const { return allocatedLayers; }
+        size_t getLayerBytes() const { return static_cast<size_t>(resolution.x) * resolution.y * sizeof(GLint); }
+
+        /**
+         * @brief GLSL for the fixed point layer format: LOG_SCALE and int logTransmittance(float weight).
+         * Injected at LOG_TRANSMITTANCE_PLACEHOLDER by every shader that writes or reads the layers, so the
+         * scale only lives here.
+         * @return std::string 
+         */
+        static std::string buildLogTransmittanceGLSL();
+
+        static const int MAX_LAYERS = 64; // must match MAX_LAYERS in digital_shutter_batch.comp
+        static const int LOG_SCALE = 4096; // fixed point scale of a layer
+        static inline const std::string LOG_TRANSMITTANCE_PLACEHOLDER = "//@LOG_TRANSMITTANCE@";
+
+    private:
+        void allocate(glm::ivec2 res, int layers);
+
+        ContributionKernels batchKernels;
+        ComputeProgram resolveProg;
+        bool initialized;
+
+        GLuint accumTexture;   // GL_TEXTURE_2D_ARRAY, GL_R32I
+        GLuint previewTexture; // GL_TEXTURE_2D, GL_RGBA8
+        GLuint rangesSSBO;
+        GLuint zeroPBO;        // one zeroed layer, clears the layers without a CPU upload per render
+        GLuint readFBO;        // previewTexture as a read framebuffer
+
+        glm::ivec2 resolution;
+        int allocatedLayers;
+        int resolvedLayer;
+        std::vector<ShutterRange> ranges;
+};
+
+#endif // FRAME_BATCH_H
@@ -0,0 +1,151 @@
+#pragma once
+#ifndef FRAME_EXPORTER_H
+#define FRAME_EXPORTER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameBatch.h"
+
+/*
+    Exports DCE frames as raw values instead of tone mapped video: 32 bit float TIFF or EXR, or 16 bit PNG.
+
+    Frames are rendered CHUNK_LAYERS at a time with a FrameBatch of their own (the scrub batch is left
+    alone), and the fixed point layers are copied into one of two pixel pack buffers behind a fence.
+    Later steps map the buffers whose fence passed and hand every layer to a pool of encoder threads,
+    so neither the readback nor the encoding stalls the render loop; a chunk is only rendered while a
+    buffer is free and the encoders are less than two chunks behind, which bounds memory.
+
+    A frame is written either as the intensity the DCE view shows, unclamped and unquantized
+    (1 - 0.5 exp(sum log(1 - s)), see dce_resolve.comp), or as the additive sum of log(1 - s) itself.
+    <basePath>_index.csv maps each frame file to its event and time window.
+*/
+
+/**
+ * @brief Asynchronous readback and multithreaded encoding of raw DCE frames, with a sidecar index.
+ */
+class FrameExporter {
+    public:
+        FrameExporter();
+        ~FrameExporter();
+
+        /**
+         * @brief Starts an export and writes its index, the frames are rendered by EventData::stepFrameExport
+         * @param basePath frames are <basePath>_<frame>.<ext>
+         * @param ranges every frame of the export
+         * @param resolution camera resolution
+         * @param timeToSeconds converts normalized event times to seconds for the index
+         * @param funcID contribution function id in ContributionRegistry
+         * @param freq normalized frequency, as FrameBatch::render
+         * @return bool true if started
+         */
+        bool begin(const std::string &basePath, const std::vector<ShutterRange> &ranges, glm::ivec2 resolution,
+            double timeToSeconds, int funcID, float freq);
+
+        /**
+         * @brief Forwards finished readbacks to the encoders and returns the next chunk to render, if there is room for it
+         * @return std::vector<ShutterRange> empty while waiting or when every frame was rendered
+         */
+        std::vector<ShutterRange> nextChunk();
+
+        /**
+         * @brief Queues the readback of the chunk just rendered into getBatch()
+         * @param numFrames frames in that chunk
+         */
+        void queueReadback(int numFrames);
+
+        /**
+         * @brief Ends the export once every frame is on disk
+         * @return bool true if the export just finished
+         */
+        bool finishIfDone();
+
+        /**
+         * @brief Drops the frames not written yet
+         */
+        void cancel();
+
+        FrameBatch &getBatch() { return batch; }
+        int getFuncID() const { return funcID; }
+        float getFreq() const { return freq; }
+
+        bool isActive() const { return active; }
+        int getNumFrames() const { return static_cast<int>(ranges.size()); }
+        int getRenderedFrames() const { return nextFrame; }
+        int getWrittenFrames() const { return writtenFrames.load(); }
+        int getFailedFrames() const { return failedFrames.load(); }
+        double getMilliseconds() const { return milliseconds; } // whole export, or so far
+
+        bool &getRequest() { return request; } // set by the GUI, begun by main.cpp
+        int &getFormat() { return format; }
+        int &getValues() { return values; }
+        int &getRequestFrames() { return requestFrames; } // frames of the next export
+        bool &getEventPeriod() { return eventPeriod; }
+
+        static const int CHUNK_LAYERS = 16;
+        static const int FLOAT_TIFF_FORMAT = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int FLOAT_EXR_FORMAT = 1;
+        static const int PNG16_FORMAT = 2;
+        static const int INTENSITY_VALUES = 0;
+        static const int LOG_VALUES = 1;
+
+    private:
+        struct Slot {
+            GLuint buffer = 0;
+            GLsync fence = nullptr;
+            int firstFrame = 0;
+            int numFrames = 0;
+        };
+
+        struct Job {
+            int frame;
+            std::vector<GLint> accum;
+        };
+
+        bool retire(Slot &slot); // false while its readback is in flight
+        void encode(const Job &job); // on a worker thread
+        void workerLoop();
+        void startWorkers();
+        void stopWorkers();
+        std::string framePath(int frame) const;
+
+        FrameBatch batch;
+        bool request;
+        bool active;
+        int format;
+        int values;
+        int requestFrames;
+        bool eventPeriod;
+
+        std::string basePath;
+        std::vector<ShutterRange> ranges;
+        glm::ivec2 resolution;
+        int funcID;
+        float freq;
+        int nextFrame;
+        double startTime;
+        double milliseconds;
+
+        Slot slots[2];
+        int nextSlot;
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable jobsChanged;
+        std::deque<Job> jobs;
+        int busyWorkers;
+        bool stopping;
+        std::atomic<int> writtenFrames;
+        std::atomic<int> failedFrames;
+};
+
+#endif // FRAME_EXPORTER_H
@@ -13,9 +13,17 @@
  */
 class FrameViewportFBO : public BaseViewportFBO {
 public:
-    FrameViewportFBO() : BaseViewportFBO::BaseViewportFBO(), morlet(false), pca(false),
+    FrameViewportFBO() : BaseViewportFBO::BaseViewportFBO(), contributionFunc(0), pca(false), weightedPCA(false),
         autoUpdate(false), freq(0.01f), fps(0.0f), 
-        framePeriod_T(0.0f), framePeriod_E(0)  {}
+        framePeriod_T(0.0f), framePeriod_E(0), batchFrames(16), batchRequest(MANUAL_UPDATE),
+        batchLayer(0), showBatch(false), recordBatch(false), incremental(false),
+        bankFilters(8), bankMinFreq(1.0f), bankMaxFreq(100.0f), bankCycles(3.0f), bankLayer(-1), bankGain(0.05f),
+        bankRequest(false), showBank(false),
+        spectrumBins(32), spectrumMinFreq(0.0f), spectrumMaxFreq(200.0f), spectrumGPU(true), spectrumMap(0),
+        spectrumGain(0.05f), spectrumRequest(false), showSpectrum(false),
+        statsGPU(false), statsShutter(false), statsMap(0), statsGain(0.05f), statsRequest(false), showStats(false),
+        prefetch(false), prefetchFrames(8), showPrefetch(false), clusters(false),
+        timeSurface(false), surfaceTau(10.0f), surfaceMode(0) {}
     ~FrameViewportFBO() {}
 
     /**
@@ -37,14 +45,57 @@ public:
      */
     void oddizeTime(float factor) { framePeriod_T /= factor; }
 
-    bool &isMorlet() { return morlet; }
+    int &getContributionFunc() { return contributionFunc; }
     bool &getPCA() { return pca; }
+    bool &getWeightedPCA() { return weightedPCA; }
+    bool &getIncremental() { return incremental; }
     int &getAutoUpdate() { return autoUpdate; }
     float &getFreq() { return freq; }
     float &getUpdateFPS() { return fps; }
     float &getFramePeriod_T() { return framePeriod_T; }
     uint &getFramePeriod_E() { return framePeriod_E; }
 
+    int &getBatchFrames() { return batchFrames; }
+    int &getBatchRequest() { return batchRequest; }
+    int &getBatchLayer() { return batchLayer; }
+    bool &getShowBatch() { return showBatch; }
+    bool &getRecordBatch() { return recordBatch; }
+
+    int &getBankFilters() { return bankFilters; }
+    float &getBankMinFreq() { return bankMinFreq; }
+    float &getBankMaxFreq() { return bankMaxFreq; }
+    float &getBankCycles() { return bankCycles; }
+    int &getBankLayer() { return bankLayer; }
+    float &getBankGain() { return bankGain; }
+    bool &getBankRequest() { return bankRequest; }
+    bool &getShowBank() { return showBank; }
+
+    int &getSpectrumBins() { return spectrumBins; }
+    float &getSpectrumMinFreq() { return spectrumMinFreq; }
+    float &getSpectrumMaxFreq() { return spectrumMaxFreq; }
+    bool &getSpectrumGPU() { return spectrumGPU; }
+    int &getSpectrumMap() { return spectrumMap; }
+    float &getSpectrumGain() { return spectrumGain; }
+    bool &getSpectrumRequest() { return spectrumRequest; }
+    bool &getShowSpectrum() { return showSpectrum; }
+
+    bool &getStatsGPU() { return statsGPU; }
+    bool &getStatsShutter() { return statsShutter; }
+    int &getStatsMap() { return statsMap; }
+    float &getStatsGain() { return statsGain; }
+    bool &getStatsRequest() { return statsRequest; }
+    bool &getShowStats() { return showStats; }
+
+    bool &getPrefetch() { return prefetch; }
+    int &getPrefetchFrames() { return prefetchFrames; }
+    bool &getShowPrefetch() { return showPrefetch; }
+
+    bool &getClusters() { return clusters; }
+
+    bool &getTimeSurface() { return timeSurface; }
+    float &getSurfaceTau() { return surfaceTau; }
+    int &getSurfaceMode() { return surfaceMode; }
+
     float getLastRenderTime() const { return lastRenderTime; } 
     void setLastRenderTime(float x) { lastRenderTime = x; } 
 
@@ -53,13 +104,63 @@ public:
     static const int TIME_AUTO_UPDATE = 2;
 
 private:
-    bool morlet;
+    int contributionFunc; // id in ContributionRegistry
     bool pca;
+    bool weightedPCA;
     int autoUpdate;
     float freq;
     float fps;
     float framePeriod_T;
     uint framePeriod_E;
 
+    // Batched rendering of consecutive frames (see FrameBatch)
+    int batchFrames;
+    int batchRequest; // MANUAL_UPDATE when idle, otherwise which period to step by
+    int batchLayer;   // layer shown when scrubbing
+    bool showBatch;
+    bool recordBatch;
+
+    bool incremental; // Sliding accumulation for the box shutter
+
+    // Morlet filter bank (see FilterBank)
+    int bankFilters;
+    float bankMinFreq; // Hz
+    float bankMaxFreq; // Hz
+    float bankCycles;  // FWHM in periods, 0 uses the FWHM slider
+    int bankLayer;     // filter shown, -1 for the best filter per pixel
+    float bankGain;
+    bool bankRequest;
+    bool showBank;
+
+    // Per pixel spectrum (see SpectrumAnalyzer)
+    int spectrumBins;
+    float spectrumMinFreq; // Hz
+    float spectrumMaxFreq; // Hz
+    bool spectrumGPU;      // compute shader path, otherwise CPU
+    int spectrumMap;       // SpectrumAnalyzer::FREQUENCY_MAP, MAGNITUDE_MAP or PHASE_MAP
+    float spectrumGain;
+    bool spectrumRequest;
+    bool showSpectrum;
+
+    // Per pixel statistics maps (see PixelStatistics)
+    bool statsGPU;     // compute shader path over the pixel index, otherwise CPU
+    bool statsShutter; // over the shutter, otherwise the whole time window
+    int statsMap;      // PixelStatistics::COUNT_MAP ... LAST_EVENT_MAP
+    float statsGain;
+    bool statsRequest;
+    bool showStats;
+
+    // Auto-play frames rendered ahead (see PlaybackPrefetch)
+    bool prefetch;
+    int prefetchFrames; // frames per refill of each ring slot
+    bool showPrefetch;  // the current frame is the prefetch preview, not the FBO
+
+    bool clusters; // Cluster and track the shutter every frame (see ClusterTracker)
+
+    // Decayed time surface instead of the DCE frame (see TimeSurface)
+    bool timeSurface;
+    float surfaceTau; // ms
+    int surfaceMode;  // TimeSurface::POLARITY_MODE, MERGED_MODE or SIGNED_MODE
+
     float lastRenderTime;
 };
\ No newline at end of file
@@ -16,6 +16,9 @@
 
 #include <GL/glew.h>
 
+#include <cstdint>
+#include <string>
+
 ///////////////////////////////////////////////////////////////////////////////
 // For printing out the current file and line number                         //
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,6 +43,13 @@ namespace GLSL {
 	void printShaderInfoLog(GLuint shader);
 	int textFileWrite(const char *filename, const char *s);
 	char *textFileRead(const char *filename);
+
+	// On-disk cache of linked program binaries, keyed by a hash of the full source and the driver string.
+	// Disabled until a directory is set. Pruned to the most recently used binaries after every save.
+	void setProgramCacheDir(const std::string &dir);
+	uint64_t hashString(const std::string &s, uint64_t seed = 14695981039346656037ull);
+	GLuint loadCachedProgram(const std::string &source); // linked program or 0 on a miss
+	void saveCachedProgram(GLuint program, const std::string &source);
 }
 
 #endif
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef MORTON_INDEX_H
+#define MORTON_INDEX_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Spatio-temporal index over the (x, y, t) positions the main viewport draws, for picking events
+    with the mouse and for box, frustum and nearest neighbour queries without scanning every event.
+
+    Positions are quantized to 10 bits per axis over the bounds of the events and interleaved into a
+    30 bit Morton code, then the event indices are sorted by code with a parallel LSD radix sort
+    (3 passes of 11 bits, per thread histograms, passes whose digit is constant are skipped). Runs of
+    LEAF_SIZE consecutive sorted events are the leaves of an implicit binary tree stored heap style
+    (children of node i are 2i + 1 and 2i + 2), with one float bounding box per node computed bottom
+    up, a level at a time in parallel. Morton order keeps every leaf compact in space and time, so
+    the boxes are tight even though the tree never looks at the codes again; the codes only have to
+    order the events, which is why 10 bits per axis is plenty.
+
+    Queries walk the tree from the root and prune on the boxes. Only event indices are stored, the
+    positions are read from the events passed to every call, which must be the ones the index was
+    built over.
+*/
+
+/**
+ * @brief Morton ordered bounding volume tree over events.
+ */
+class MortonIndex {
+    public:
+        MortonIndex();
+
+        /**
+         * @brief Rebuilds the index
+         * @param events (x, y, t, polarity)
+         */
+        void build(const std::vector<glm::vec4> &events);
+        void clear();
+
+        /**
+         * @brief Appends the indices of every event inside the box (inclusive)
+         * @param events the events the index was built over
+         * @param boxMin (x, y, t)
+         * @param boxMax (x, y, t)
+         * @param out
+         */
+        void queryBox(const std::vector<glm::vec4> &events, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+            std::vector<uint32_t> &out) const;
+
+        /**
+         * @brief Appends the indices of every event inside the view frustum of a camera
+         * @param events the events the index was built over
+         * @param viewProj projection * modelview of the camera
+         * @param out
+         */
+        void queryFrustum(const std::vector<glm::vec4> &events, const glm::mat4 &viewProj, std::vector<uint32_t> &out) const;
+
+        /**
+         * @brief Event closest to the ray origin among those within radius of the ray
+         * @param events the events the index was built over
+         * @param origin
+         * @param dir normalized
+         * @param radius distance from the ray, in world units
+         * @return int event index, -1 if no event is close enough
+         */
+        int pick(const std::vector<glm::vec4> &events, const glm::vec3 &origin, const glm::vec3 &dir, float radius) const;
+
+        /**
+         * @brief The k events closest to a point, nearest first
+         * @param events the events the index was built over
+         * @param point (x, y, t)
+         * @param k
+         * @param out replaced with at most k event indices
+         */
+        void nearest(const std::vector<glm::vec4> &events, const glm::vec3 &point, int k, std::vector<uint32_t> &out) const;
+
+        bool isBuilt() const { return !nodes.empty(); }
+        size_t getNumEvents() const { return order.size(); }
+        size_t getNumLeaves() const { return numLeaves; }
+        double getBuildMilliseconds() const { return buildMilliseconds; }
+
+        static const int LEAF_SIZE = 64;
+        static const int MORTON_BITS = 10; // per axis
+
+    private:
+        struct Node {
+            glm::vec3 boxMin;
+            glm::vec3 boxMax;
+        };
+
+        static uint32_t spreadBits(uint32_t v);
+        void sortByKey(std::vector<uint32_t> &keys);
+
+        // Sorted events of a leaf node
+        size_t leafBegin(size_t node) const { return (node - firstLeaf) * LEAF_SIZE; }
+        size_t leafEnd(size_t node) const { return std::min(order.size(), leafBegin(node) + LEAF_SIZE); }
+        bool isLeaf(size_t node) const { return node >= firstLeaf; }
+        void appendSubtree(size_t node, std::vector<uint32_t> &out) const; // whole subtree, no tests
+
+        std::vector<uint32_t> order; // event indices in Morton order
+        std::vector<Node> nodes;     // heap layout, padding leaves have empty (inverted) boxes
+        size_t firstLeaf;
+        size_t numLeaves;
+        double buildMilliseconds;
+};
+
+#endif // MORTON_INDEX_H
@@ -0,0 +1,111 @@
+#pragma once
+#ifndef PIXEL_INDEX_H
+#define PIXEL_INDEX_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Per pixel compressed sparse row index over the time sorted events.
+
+    offsets[p] .. offsets[p + 1] is the slice of eventIndices (and of the parallel times array) that
+    belongs to pixel p = y * width + x. Slices stay sorted by time because events are scattered in
+    their original order, so a pixel's events in [t0, t1] are found with two binary searches and
+    every query costs time proportional to what it returns.
+
+    Built in parallel: each thread counts a contiguous chunk of events, a prefix sum over pixels and
+    chunks gives every (chunk, pixel) pair its own output range, then each thread scatters its chunk.
+*/
+
+/**
+ * @brief Inter event interval statistics of one pixel.
+ */
+struct IntervalStats {
+    uint32_t count = 0;   // number of events (count - 1 intervals)
+    float mean = 0.0f;
+    float variance = 0.0f;
+    float min = 0.0f;
+    float max = 0.0f;
+};
+
+/**
+ * @brief Events of each pixel, sorted by time.
+ */
+class PixelIndex {
+    public:
+        /**
+         * @brief Contiguous run of the index, eventIndices points into the source events
+         */
+        struct Slice {
+            const uint32_t *eventIndices = nullptr;
+            const float *times = nullptr;
+            size_t size = 0;
+        };
+
+        PixelIndex();
+
+        /**
+         * @brief Rebuilds the index, events outside the resolution are skipped
+         * @param events time sorted (x, y, t, polarity)
+         * @param resolution sensor size
+         */
+        void build(const std::vector<glm::vec4> &events, glm::ivec2 resolution);
+
+        void clear();
+        bool isBuilt() const { return !offsets.empty(); }
+        glm::ivec2 getResolution() const { return resolution; }
+        size_t getNumEvents() const { return eventIndices.size(); }
+        double getBuildMilliseconds() const { return buildMilliseconds; }
+        const std::vector<uint32_t> &getOffsets() const { return offsets; }
+        const std::vector<float> &getTimes() const { return times; }
+        const std::vector<uint32_t> &getEventIndices() const { return eventIndices; }
+
+        /**
+         * @brief All events of a pixel
+         */
+        Slice getPixel(int x, int y) const;
+
+        /**
+         * @brief Events of a pixel with t0 <= t <= t1
+         */
+        Slice getPixel(int x, int y, float t0, float t1) const;
+
+        /**
+         * @brief Events of a pixel with eventBound_L <= event index <= eventBound_R, the same selection as a shutter range
+         */
+        Slice getPixelEvents(int x, int y, uint32_t eventBound_L, uint32_t eventBound_R) const;
+
+        /**
+         * @brief Appends the indices of every event inside the ROI (inclusive) with t0 <= t <= t1, grouped by pixel
+         * @param roiMin lower corner in pixels
+         * @param roiMax upper corner in pixels
+         * @param t0
+         * @param t1
+         * @param out
+         */
+        void queryROI(glm::ivec2 roiMin, glm::ivec2 roiMax, float t0, float t1, std::vector<uint32_t> &out) const;
+
+        /**
+         * @brief Same as queryROI but only counts, two binary searches per pixel
+         */
+        size_t countROI(glm::ivec2 roiMin, glm::ivec2 roiMax, float t0, float t1) const;
+
+        /**
+         * @brief Inter event intervals of one pixel within [t0, t1]
+         */
+        IntervalStats getIntervalStats(int x, int y, float t0, float t1) const;
+
+    private:
+        bool contains(int x, int y) const { return x >= 0 && y >= 0 && x < resolution.x && y < resolution.y; }
+
+        glm::ivec2 resolution;
+        std::vector<uint32_t> offsets;      // width * height + 1
+        std::vector<uint32_t> eventIndices; // into the events passed to build
+        std::vector<float> times;           // times[i] == events[eventIndices[i]].z
+        double buildMilliseconds;
+};
+
+#endif // PIXEL_INDEX_H
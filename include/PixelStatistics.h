@@ -0,0 +1,160 @@
+#pragma once
+#ifndef PIXEL_STATISTICS_H
+#define PIXEL_STATISTICS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+#include "PixelIndex.h"
+
+/*
+    Per pixel activity maps over a window of events: event count, fraction of positive events, mean and
+    variance of the inter event interval, and the time of the last event. Used to spot flicker, dead and
+    noisy regions and the age of the scene at a glance, alongside the DCE frame.
+
+    The CPU path splits the window into one contiguous run of events per tile and accumulates every run
+    into its own sensor sized tile (count, positives, first and last time, Welford mean / M2 of the
+    intervals), so threads never share a pixel. The merge then walks the tiles of every pixel in time
+    order: the gap between one tile's last event and the next tile's first is one more interval, and the
+    interval statistics of the two sides combine with Chan's formula. Tiles are capped by MAX_TILE_BYTES
+    on large sensors, which only lowers the parallelism of the accumulation.
+
+    The GPU path runs one invocation per pixel over the PixelIndex slices (offsets, times and event
+    indices uploaded once per data version), so it needs the index but no atomics. Both select the
+    window by event index, so switching backend does not change which events count; the maps match up
+    to float rounding and are read back to the CPU for the tooltip and the export.
+*/
+
+/**
+ * @brief Computes count, polarity, interval and last event maps of every pixel.
+ */
+class PixelStatistics {
+    public:
+        PixelStatistics();
+        ~PixelStatistics();
+
+        /**
+         * @brief Compiles the statistics compute shader
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Multithreaded CPU pass over the events in [eventBound_L, eventBound_R]
+         * @param events time sorted (x, y, t, polarity)
+         * @param resolution camera resolution
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param t0 normalized window start, last event times are measured from here
+         * @param t1 normalized window end
+         * @param timeToSeconds converts normalized time differences to seconds
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         */
+        void computeCPU(const std::vector<glm::vec4> &events, glm::ivec2 resolution, int eventBound_L, int eventBound_R,
+            float t0, float t1, float timeToSeconds, const glm::vec4 &spaceWindow);
+
+        /**
+         * @brief Compute shader pass over the pixel index slices of [eventBound_L, eventBound_R], the maps are read back
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity) the index was built over
+         * @param index per pixel slices of events
+         * @param dataVersion changes whenever the events (and so the index) change
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param t0 normalized window start, last event times are measured from here
+         * @param t1 normalized window end
+         * @param timeToSeconds converts normalized time differences to seconds
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         */
+        void computeGPU(GLuint evtParticlesSSBO, const PixelIndex &index, uint64_t dataVersion, int eventBound_L,
+            int eventBound_R, float t0, float t1, float timeToSeconds, const glm::vec4 &spaceWindow);
+
+        /**
+         * @brief Writes the preview texture from the maps
+         * @param map COUNT_MAP, POLARITY_MAP, INTERVAL_MEAN_MAP, INTERVAL_VARIANCE_MAP or LAST_EVENT_MAP
+         * @param gain brightness is 1 - exp(-gain * count)
+         */
+        void updatePreview(int map, float gain);
+
+        /**
+         * @brief Writes every map as a 32 bit float TIFF, <basePath>_<map name>.tiff
+         * @param basePath
+         * @return bool true if every map was written
+         */
+        bool exportMaps(const std::string &basePath) const;
+
+        GLuint getPreviewTexture() const { return previewTexture; }
+        bool hasResult() const { return !countMap.empty(); }
+        bool isResolved(int map, float gain) const { return map == previewMap && gain == previewGain; }
+        glm::ivec2 getResolution() const { return resolution; }
+        float getWindowSeconds() const { return windowSeconds; }
+        size_t getNumEvents() const { return numEvents; }
+        int getNumTiles() const { return numTiles; }
+        double getMilliseconds() const { return milliseconds; }
+        bool getUsedGPU() const { return usedGPU; }
+
+        // Row major, y * width + x, zero where a pixel has too few events
+        const std::vector<float> &getCountMap() const { return countMap; }
+        const std::vector<float> &getPolarityMap() const { return polarityMap; }                 // fraction of positive events
+        const std::vector<float> &getIntervalMeanMap() const { return intervalMeanMap; }         // seconds
+        const std::vector<float> &getIntervalVarianceMap() const { return intervalVarianceMap; } // seconds^2
+        const std::vector<float> &getLastEventMap() const { return lastEventMap; }               // seconds since t0
+
+        static const int COUNT_MAP = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int POLARITY_MAP = 1;
+        static const int INTERVAL_MEAN_MAP = 2;
+        static const int INTERVAL_VARIANCE_MAP = 3;
+        static const int LAST_EVENT_MAP = 4;
+        static const size_t MAX_TILE_BYTES = size_t(256) << 20; // all CPU tiles together
+
+    private:
+        // Accumulated events of one pixel in one tile, times relative to t0 in seconds
+        struct Cell {
+            uint32_t count;
+            uint32_t positive;
+            float first;
+            float last;
+            double intervalMean;
+            double intervalM2;
+        };
+
+        void resizeMaps(glm::ivec2 res, float windowSeconds);
+        void uploadIndex(const PixelIndex &index, uint64_t dataVersion);
+
+        ComputeProgram statsProg;
+        bool initialized;
+
+        GLuint statsTexture;     // GL_TEXTURE_2D, GL_RGBA32F (count, polarity, interval mean, interval variance)
+        GLuint lastEventTexture; // GL_TEXTURE_2D, GL_R32F
+        GLuint previewTexture;   // GL_TEXTURE_2D, GL_RGBA8
+        GLuint offsetsSSBO;
+        GLuint timesSSBO;
+        GLuint eventIndicesSSBO;
+        glm::ivec2 allocatedResolution;
+        uint64_t uploadedDataVersion;
+        bool hasUpload;
+
+        std::vector<Cell> tiles; // numTiles sensor sized tiles, kept between calls
+        int numTiles;
+
+        glm::ivec2 resolution;
+        float windowSeconds;
+        size_t numEvents;
+        double milliseconds;
+        bool usedGPU;
+        int previewMap;
+        float previewGain;
+
+        std::vector<float> countMap;
+        std::vector<float> polarityMap;
+        std::vector<float> intervalMeanMap;
+        std::vector<float> intervalVarianceMap;
+        std::vector<float> lastEventMap;
+};
+
+#endif // PIXEL_STATISTICS_H
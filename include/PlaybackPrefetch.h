@@ -0,0 +1,138 @@
+#pragma once
+#ifndef PLAYBACK_PREFETCH_H
+#define PLAYBACK_PREFETCH_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FrameBatch.h"
+
+/*
+    Keeps the DCE frames auto-play is about to show rendered ahead of time.
+
+    Two FrameBatch slots form a ring: playback resolves layers of the front slot (a cheap resolve
+    dispatch per frame) while the back slot already holds, or is being filled with, the frames that
+    follow. Once playback crosses into the back slot the roles swap and the new back slot is refilled
+    right away, so its single batch dispatch runs on the GPU while the front frames are on screen
+    instead of on the frame that needs them.
+
+    Frames are looked up by their event range, which stays valid under window drift and seeking: a
+    range that is in neither slot is a miss and refills the front slot from the current window. The
+    back slot is then filled on the next frame, not on the one that already paid for the miss.
+
+    Prefetched frames are the FrameBatch log transmittance resolve, while a paused frame is drawn by
+    EventData::drawFrame as blended points. The two match in grey level but not in point size or
+    filtering, so prefetching is opt-in.
+*/
+
+/**
+ * @brief Everything besides the event range that changes a prefetched frame; a change empties the ring.
+ */
+struct PrefetchKey {
+    glm::vec4 spaceWindow;
+    bool isPositiveOnly;
+    int funcID;
+    uint64_t funcRevision;
+    float freq;
+    float width;
+    float contribution;
+    bool eventPeriod;
+    float framePeriod_T;
+    uint32_t framePeriod_E;
+    glm::ivec2 resolution;
+    uint64_t dataVersion;
+    uint64_t visibilityVersion; // 0 while the GPU event filters are off
+
+    bool operator==(const PrefetchKey &) const = default;
+};
+
+/**
+ * @brief Ring of two frame batches ahead of auto-play, plus achieved playback rate bookkeeping.
+ */
+class PlaybackPrefetch {
+    public:
+        PlaybackPrefetch();
+
+        /**
+         * @brief Compiles the shaders of both slots
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Empties the ring if the key differs from the one the frames were rendered with
+         * @param key
+         */
+        void validate(const PrefetchKey &key);
+
+        /**
+         * @brief Slot holding a frame with the same event range
+         * @param range
+         * @param layer set to the frame's layer in that slot
+         * @return slot index or -1
+         */
+        int find(const ShutterRange &range, int &layer) const;
+
+        /**
+         * @brief Renders frames into a slot in one dispatch and marks it filled
+         * @param slot
+         * @param ranges at most FrameBatch::MAX_LAYERS
+         * @param evtParticlesSSBO
+         */
+        void fill(int slot, const std::vector<ShutterRange> &ranges, GLuint evtParticlesSSBO);
+
+        /**
+         * @brief Drops the back slot, after a miss it no longer follows the front
+         */
+        void invalidateBack();
+
+        /**
+         * @brief Resolves a frame into the displayed texture. Entering the back slot makes it the front.
+         * @param slot
+         * @param layer
+         */
+        void show(int slot, int layer);
+
+        int getFront() const { return front; }
+        int getBack() const { return 1 - front; }
+        bool isFilled(int slot) const { return filled[slot]; }
+        int getNumLayers(int slot) const { return slots[slot].getNumLayers(); }
+        const ShutterRange &getRange(int slot, int layer) const { return slots[slot].getRange(layer); }
+        GLuint getPreviewTexture() const { return slots[shownSlot].getPreviewTexture(); }
+
+        /**
+         * @brief Records that playback presented a frame at time t (seconds), prefetched or not
+         * @param t
+         * @param hit whether the frame came from the ring
+         */
+        void notePresented(double t, bool hit);
+
+        /**
+         * @brief Forgets the rate history, e.g. when playback starts
+         */
+        void resetStats();
+
+        float getAchievedFPS() const { return achievedFPS; }
+        uint64_t getHits() const { return hits; }
+        uint64_t getMisses() const { return misses; }
+
+    private:
+        FrameBatch slots[2];
+        bool filled[2];
+        int front;
+        int shownSlot;
+        PrefetchKey key;
+        bool hasKey;
+
+        double lastPresentTime; // < 0 until the first presented frame
+        float achievedFPS;      // exponential moving average
+        uint64_t hits;
+        uint64_t misses;
+};
+
+#endif // PLAYBACK_PREFETCH_H
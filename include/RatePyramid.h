@@ -0,0 +1,96 @@
+#pragma once
+#ifndef RATE_PYRAMID_H
+#define RATE_PYRAMID_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "EventFilterChain.h"
+
+/*
+    Event rate of a whole recording at every zoom level, backing the timeline panel.
+
+    Level 0 counts positive and negative events in fixed BASE_BIN_US bins from the first event on.
+    Level k + 1 merges pairs of level k bins, keeping the polarity sums and the minimum and maximum
+    total of the base bins underneath, so a zoomed out column still shows how bursty it is. The
+    levels together hold about twice the base bins.
+
+    A query picks the level whose bins are about one screen column wide and merges at most a few bins
+    per column, so its cost depends on the number of columns and not on the number of events. Loading
+    builds level 0 with one binary search per thread chunk and a linear scan, then every level above in
+    parallel. Streaming appends each batch to level 0 and only rebuilds the parents of the bins it touched.
+*/
+
+/**
+ * @brief Events of one polarity per second over a query column, plus the base bin rate envelope.
+ */
+struct TimelineColumn {
+    float positiveRate;
+    float negativeRate;
+    float minRate; // slowest base bin under the column, both polarities
+    float maxRate; // fastest base bin under the column, both polarities
+};
+
+/**
+ * @brief Min / max / sum pyramid over event counts in time.
+ */
+class RatePyramid {
+    public:
+        RatePyramid();
+
+        /**
+         * @brief Drops every level
+         */
+        void clear();
+
+        /**
+         * @brief Rebuilds every level from time sorted events
+         * @param events (x, y, t, polarity) with t relative to the first event
+         * @param toMicroseconds converts t to microseconds
+         */
+        void build(const std::vector<glm::vec4> &events, double toMicroseconds);
+
+        /**
+         * @brief Adds a streamed batch and updates the bins above it
+         * @param batch
+         * @param origin timestamp (microseconds) of time 0
+         */
+        void append(const std::vector<FilterEvent> &batch, int64_t origin);
+
+        /**
+         * @brief Rates over numColumns equal columns of [t0, t1)
+         * @param t0 microseconds since the first event
+         * @param t1 microseconds since the first event
+         * @param numColumns
+         * @param columns resized to numColumns
+         */
+        void query(double t0, double t1, int numColumns, std::vector<TimelineColumn> &columns) const;
+
+        double getDurationMicroseconds() const { return static_cast<double>(getNumBaseBins()) * BASE_BIN_US; }
+        size_t getNumBaseBins() const { return levels.empty() ? 0 : levels[0].size(); }
+        int getNumLevels() const { return static_cast<int>(levels.size()); }
+        uint64_t getVersion() const { return version; } // bumped by build and clear
+        double getBuildMilliseconds() const { return buildMilliseconds; }
+
+        static const int64_t BASE_BIN_US = 1000;
+
+    private:
+        struct Bin {
+            uint64_t positive;
+            uint64_t negative;
+            uint32_t minCount;
+            uint32_t maxCount;
+        };
+
+        static Bin merge(const Bin &a, const Bin &b);
+        void resizeBase(size_t numBins);
+        void updateParents(size_t first, size_t last);
+
+        std::vector<std::vector<Bin>> levels; // levels[k] bins are BASE_BIN_US << k wide
+        uint64_t version;
+        double buildMilliseconds;
+};
+
+#endif // RATE_PYRAMID_H
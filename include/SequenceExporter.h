@@ -0,0 +1,167 @@
+#pragma once
+#ifndef SEQUENCE_EXPORTER_H
+#define SEQUENCE_EXPORTER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "MainScene.h"
+#include "VideoRecorder.h"
+
+class EventData;
+class FrameViewportFBO;
+
+/*
+    Offline export of DCE and main scene sequences, independent of the live window and its frame rate.
+
+    Frame k of an export is rendered with the time (or event) window begin(start) + k * period, computed
+    from where the export started rather than stepped from the previous frame, and with the camera at
+    k / (numFrames - 1) along a keyframed path (or held where it was). Both viewports are rendered
+    off-screen at a fixed export resolution, so the same settings give the same frames whatever the
+    window size or how long a frame took.
+
+    main.cpp renders as many frames per loop iteration as fit in a time budget, the UI stays live and
+    shows the progress. Videos go through one VideoRecorder per viewport with back-pressure, so no
+    frame is dropped while the readback still overlaps rendering; image sequences are written as PNG.
+*/
+
+/**
+ * @brief Camera pose at a fraction of the export, from 0 (first frame) to 1 (last frame).
+ */
+struct CameraKeyframe {
+    float at;
+    CameraPose pose;
+};
+
+/**
+ * @brief Deterministic, fixed step off-screen export of DCE and main scene frames.
+ */
+class SequenceExporter {
+    public:
+        SequenceExporter();
+        ~SequenceExporter();
+
+        /**
+         * @brief Compiles what the video recorders need
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Starts an export from the current windows and camera, recording stays with main.cpp which opens the videos
+         * @param evtData
+         * @param camera
+         * @param frameScene its playback is stopped while the export owns the windows
+         * @param basePath outputs are <basePath>_dce and <basePath>_scene
+         * @param framePeriod_T normalized time period, as FrameViewportFBO::getFramePeriod_T
+         * @param framePeriod_E event period
+         * @return bool true if started
+         */
+        bool begin(EventData &evtData, const Camera &camera, FrameViewportFBO &frameScene, const std::string &basePath,
+            float framePeriod_T, GLuint framePeriod_E);
+
+        /**
+         * @brief Moves the windows and the camera to frame k
+         * @param evtData
+         * @param camera
+         * @param k frame index
+         */
+        void applyFrame(EventData &evtData, Camera &camera, int k) const;
+
+        /**
+         * @brief Writes the bound framebuffer as frame k of a viewport's output
+         * @param target DCE_TARGET or SCENE_TARGET
+         * @param k frame index
+         */
+        void writeFrame(int target, int k);
+
+        /**
+         * @brief Flushes the outputs and puts the windows, camera and playback back where the export started
+         * @param evtData
+         * @param camera
+         * @param frameScene
+         */
+        void finish(EventData &evtData, Camera &camera, FrameViewportFBO &frameScene);
+
+        /**
+         * @brief Camera pose at a fraction of the export, linear between keyframes, clamped at the ends
+         * @param keyframes sorted by at
+         * @param at
+         * @param fallback used without keyframes
+         * @return CameraPose
+         */
+        static CameraPose samplePath(const std::vector<CameraKeyframe> &keyframes, float at, const CameraPose &fallback);
+
+        /**
+         * @brief Adds or replaces the keyframe at a fraction of the export, keeping them sorted
+         * @param at
+         * @param pose
+         */
+        void addKeyframe(float at, const CameraPose &pose);
+
+        bool isActive() const { return active; }
+        bool renders(int target) const { return this->target == target || this->target == BOTH_TARGET; }
+        int getNextFrame() const { return nextFrame; }
+        void advance(); // after every viewport of the frame was written
+        bool isDone() const { return nextFrame >= numFrames; }
+
+        BaseViewportFBO &getFBO(int target) { return target == SCENE_TARGET ? *sceneFBO : *frameFBO; }
+        VideoRecorder &getRecorder(int target) { return target == SCENE_TARGET ? sceneRecorder : frameRecorder; }
+        std::string getOutputName(int target) const;
+        double getMilliseconds() const { return milliseconds; } // per frame, averaged over the export
+
+        bool &getRequest() { return request; } // set by the GUI, begun by main.cpp
+        int &getTarget() { return target; }
+        int &getOutput() { return output; }
+        int &getFormat() { return format; }
+        int &getNumFrames() { return numFrames; }
+        bool &getEventPeriod() { return eventPeriod; }
+        glm::ivec2 &getResolution() { return resolution; }
+        bool &getFollowPath() { return followPath; }
+        std::vector<CameraKeyframe> &getKeyframes() { return keyframes; }
+
+        static const int DCE_TARGET = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int SCENE_TARGET = 1;
+        static const int BOTH_TARGET = 2;
+        static const int VIDEO_OUTPUT = 0;
+        static const int IMAGE_OUTPUT = 1;
+
+    private:
+        bool request;
+        bool active;
+        int target;
+        int output;
+        int format; // VideoRecorder format of the videos
+        int numFrames;
+        bool eventPeriod;
+        glm::ivec2 resolution;
+        bool followPath;
+        std::vector<CameraKeyframe> keyframes;
+
+        // Where the export started, frame k is computed from these
+        std::string basePath;
+        float timeWindow_L, timeWindow_R;
+        GLuint eventWindow_L, eventWindow_R;
+        float period_T;
+        GLuint period_E;
+        CameraPose startPose;
+        int startAutoUpdate;
+        int nextFrame;
+        double startTime;
+        double milliseconds;
+
+        std::unique_ptr<BaseViewportFBO> sceneFBO;
+        std::unique_ptr<BaseViewportFBO> frameFBO; // floating point like the DCE viewport
+        glm::ivec2 fboResolution;
+        VideoRecorder sceneRecorder;
+        VideoRecorder frameRecorder;
+        std::vector<unsigned char> pixels;
+};
+
+#endif // SEQUENCE_EXPORTER_H
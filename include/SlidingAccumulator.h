@@ -0,0 +1,105 @@
+#pragma once
+#ifndef SLIDING_ACCUMULATOR_H
+#define SLIDING_ACCUMULATOR_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+
+#include "ComputeProgram.h"
+
+/*
+    Persistent DCE accumulation for the base (box) contribution function. Every event adds a
+    constant per polarity, so moving the shutter only needs the events that entered or left it:
+    those are added or subtracted and the rest of the image is left alone. The accumulation is
+    integer fixed point, so adding and removing the same event cancels exactly and nothing drifts.
+
+    The image uses the same log transmittance format as FrameBatch and is displayed with dce_resolve.comp.
+    The number of events in the window is kept the same way, in a one int buffer next to the image.
+*/
+
+/**
+ * @brief Incrementally maintained box-shutter DCE image whose update cost scales with window movement.
+ */
+class SlidingAccumulator {
+    public:
+        SlidingAccumulator();
+        ~SlidingAccumulator();
+
+        /**
+         * @brief Compiles the accumulate and resolve compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Moves the accumulated window to [eventBound_L, eventBound_R], rebuilding from scratch only when
+         *        something other than the bounds changed or the new window does not overlap the old one
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param dataVersion changes whenever the event buffer is re-uploaded
+         * @param resolution camera resolution
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         * @param contribution
+         * @return bool true if the accumulation changed
+         */
+        bool update(GLuint evtParticlesSSBO, uint64_t dataVersion, glm::ivec2 resolution, int eventBound_L, int eventBound_R,
+            const glm::vec4 &spaceWindow, bool isPositiveOnly, float contribution);
+
+        /**
+         * @brief Resolves the accumulation and blits the region [srcMin, srcMax] of it into the bound draw framebuffer
+         * @param srcMin lower left of the event data in pixels
+         * @param srcMax upper right of the event data in pixels (inclusive)
+         * @param viewport_resolution size of the bound draw framebuffer
+         */
+        void draw(glm::ivec2 srcMin, glm::ivec2 srcMax, glm::vec2 viewport_resolution);
+
+        /**
+         * @brief Forgets the accumulated window so the next update rebuilds it
+         */
+        void invalidate() { valid = false; }
+
+        /**
+         * @brief Number of events touched by the last update, for debugging
+         */
+        uint64_t getLastUpdateEvents() const { return lastUpdateEvents; }
+
+        /**
+         * @brief Buffer holding the number of events in the accumulated window, a single GLint
+         */
+        GLuint getCountBuffer() const { return countSSBO; }
+
+    private:
+        void allocate(glm::ivec2 res);
+        void clear();
+        void accumulate(int eventBound_L, int eventBound_R, int sign);
+
+        ComputeProgram accumulateProg;
+        ComputeProgram resolveProg;
+        bool initialized;
+
+        GLuint accumTexture;   // single layer GL_TEXTURE_2D_ARRAY, GL_R32I
+        GLuint previewTexture; // GL_TEXTURE_2D, GL_RGBA8
+        GLuint readFBO;        // previewTexture as a blit source
+        GLuint countSSBO;      // events in the window, maintained by dce_accumulate.comp
+        GLuint zeroPBO;        // one zeroed layer, clears the accumulation without a CPU upload per rebuild
+        glm::ivec2 resolution;
+
+        // What the accumulation currently holds
+        bool valid;
+        int curBound_L;
+        int curBound_R;
+        uint64_t curDataVersion;
+        glm::vec4 curSpaceWindow;
+        bool curIsPositiveOnly;
+        float curContribution;
+
+        uint64_t lastUpdateEvents;
+};
+
+#endif // SLIDING_ACCUMULATOR_H
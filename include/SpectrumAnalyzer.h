@@ -0,0 +1,137 @@
+#pragma once
+#ifndef SPECTRUM_ANALYZER_H
+#define SPECTRUM_ANALYZER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+#include "PixelIndex.h"
+
+/*
+    Per pixel spectrum of event polarity over a time window, used to find flicker and vibration
+    frequencies without tuning a Morlet filter by hand.
+
+    Events are impulses, so the DFT of a pixel is an exact sum over its events of
+    polarity * exp(-2i pi f t) at every analysed frequency (no time binning). Frequencies are spaced
+    linearly so each event needs a single sin/cos pair, the remaining bins follow by rotating with
+    exp(-2i pi df t), the same recurrence a Goertzel filter runs over uniform samples.
+
+    Both paths analyse the same events, those with index in [eventBound_L, eventBound_R].
+    The CPU path walks the PixelIndex slices of that range with OpenMP, one pixel per iteration and no
+    shared state. The GPU path scatters every event into a fixed point GL_TEXTURE_2D_ARRAY (real and
+    imaginary layer per bin, like FilterBank), then a resolve picks the dominant bin.
+
+    The maps agree up to rounding, not bit for bit. The GPU rounds every contribution to 1 / SPECTRUM_SCALE
+    (256) per component, and it reduces the angles in float where the CPU uses double. So a bin
+    magnitude differs by at most about 0.003 per event of the pixel. Phases differ by a similar relative
+    amount. The dominant frequency only changes where two bins are within that distance of each other.
+*/
+
+/**
+ * @brief Computes dominant frequency, magnitude and phase maps of every pixel.
+ */
+class SpectrumAnalyzer {
+    public:
+        SpectrumAnalyzer();
+        ~SpectrumAnalyzer();
+
+        /**
+         * @brief Compiles the spectrum (all and positive only variants) and resolve compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Multithreaded CPU analysis of the events in [eventBound_L, eventBound_R] over the pixel index
+         * @param events the events the index was built over
+         * @param index per pixel slices of events
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param t0 normalized window start, phases are measured from here
+         * @param timeToSeconds converts normalized time differences to seconds
+         * @param minFreq lowest analysed frequency in Hz
+         * @param maxFreq highest analysed frequency in Hz
+         * @param numBins at most MAX_BINS, spaced linearly
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         */
+        void analyzeCPU(const std::vector<glm::vec4> &events, const PixelIndex &index, int eventBound_L, int eventBound_R,
+            float t0, float timeToSeconds, float minFreq, float maxFreq, int numBins, const glm::vec4 &spaceWindow, bool isPositiveOnly);
+
+        /**
+         * @brief Compute shader analysis of the events in [eventBound_L, eventBound_R], the maps are read back
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param resolution camera resolution
+         * @param eventBound_L
+         * @param eventBound_R
+         * @param t0 normalized window start, phases are measured from here
+         * @param timeToSeconds converts normalized time differences to seconds
+         * @param minFreq lowest analysed frequency in Hz
+         * @param maxFreq highest analysed frequency in Hz
+         * @param numBins at most MAX_BINS, spaced linearly
+         * @param spaceWindow x = top, y = right, z = bottom, w = left
+         * @param isPositiveOnly
+         */
+        void analyzeGPU(GLuint evtParticlesSSBO, glm::ivec2 resolution, int eventBound_L, int eventBound_R, float t0,
+            float timeToSeconds, float minFreq, float maxFreq, int numBins, const glm::vec4 &spaceWindow, bool isPositiveOnly);
+
+        /**
+         * @brief Writes the preview texture from the maps
+         * @param map FREQUENCY_MAP, MAGNITUDE_MAP or PHASE_MAP
+         * @param gain brightness is 1 - exp(-gain * magnitude)
+         */
+        void updatePreview(int map, float gain);
+
+        GLuint getPreviewTexture() const { return previewTexture; }
+        bool hasResult() const { return !frequencyMap.empty(); }
+        bool isResolved(int map, float gain) const { return map == previewMap && gain == previewGain; }
+        glm::ivec2 getResolution() const { return resolution; }
+        float getMinFreq() const { return minFreq; }
+        float getMaxFreq() const { return maxFreq; }
+        double getMilliseconds() const { return milliseconds; }
+        bool getUsedGPU() const { return usedGPU; }
+
+        // Row major, y * width + x
+        const std::vector<float> &getFrequencyMap() const { return frequencyMap; } // Hz
+        const std::vector<float> &getMagnitudeMap() const { return magnitudeMap; } // in events
+        const std::vector<float> &getPhaseMap() const { return phaseMap; }         // radians, at t0
+
+        static const int MAX_BINS = 64; // must match MAX_BINS in spectrum.comp
+        static const int FREQUENCY_MAP = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int MAGNITUDE_MAP = 1;
+        static const int PHASE_MAP = 2;
+
+    private:
+        void allocate(glm::ivec2 res, int numBins);
+        void resizeMaps(glm::ivec2 res, float minFreq, float maxFreq);
+
+        ComputeProgram spectrumProg[2]; // [0] all events, [1] POSITIVE_ONLY
+        ComputeProgram resolveProg;
+        bool initialized;
+
+        GLuint spectrumTexture; // GL_TEXTURE_2D_ARRAY, GL_R32I, 2 layers per bin
+        GLuint mapsTexture;     // GL_TEXTURE_2D, GL_RGBA32F (frequency, magnitude, phase, unused)
+        GLuint previewTexture;  // GL_TEXTURE_2D, GL_RGBA8
+        GLuint zeroPBO;         // one zeroed layer, clears the spectrum volume without a CPU upload
+        int allocatedLayers;
+        glm::ivec2 allocatedResolution;
+
+        glm::ivec2 resolution;
+        float minFreq;
+        float maxFreq;
+        double milliseconds;
+        bool usedGPU;
+        int previewMap;
+        float previewGain;
+
+        std::vector<float> frequencyMap;
+        std::vector<float> magnitudeMap;
+        std::vector<float> phaseMap;
+};
+
+#endif // SPECTRUM_ANALYZER_H
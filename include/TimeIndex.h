@@ -0,0 +1,63 @@
+#pragma once
+#ifndef TIME_INDEX_H
+#define TIME_INDEX_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Constant time timestamp -> event index lookup for time sorted events.
+
+    Timestamps are copied into a compact float array (4 bytes per event instead of the 16 byte vec4s)
+    and the time range is cut into uniform buckets, each storing the index of its first event. A query
+    jumps to its bucket and only searches the few events inside it. Buckets are sized for about
+    EVENTS_PER_BUCKET events, so lookups touch one or two cache lines.
+
+    The streaming path re-times every event relative to the newest one on each update, so the index
+    is always rebuilt from the events rather than extended.
+*/
+
+/**
+ * @brief Uniform bucket index over non-decreasing event timestamps.
+ */
+class TimeIndex {
+    public:
+        TimeIndex();
+
+        /**
+         * @brief Rebuilds the index from the t (z) component of time sorted events
+         * @param events
+         */
+        void build(const std::vector<glm::vec4> &events);
+
+        void clear();
+
+        /**
+         * @brief Index of the first event with timestamp >= t, size() if there is none
+         */
+        size_t lowerBound(float t) const;
+
+        /**
+         * @brief Index of the first event with timestamp > t, size() if there is none
+         */
+        size_t upperBound(float t) const;
+
+        size_t size() const { return times.size(); }
+        bool empty() const { return times.empty(); }
+
+        static const size_t EVENTS_PER_BUCKET = 8;
+
+    private:
+        void rebucket();
+        size_t bucketOf(float t) const;
+
+        std::vector<float> times;
+        std::vector<uint32_t> bucketStart; // bucketStart[b] = first event with time >= t0 + b * width, one sentinel at the end
+        float t0;
+        float invWidth;
+};
+
+#endif // TIME_INDEX_H
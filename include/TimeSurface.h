@@ -0,0 +1,163 @@
+#pragma once
+#ifndef TIME_SURFACE_H
+#define TIME_SURFACE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeProgram.h"
+#include "EventFilterChain.h"
+
+/*
+    Surface of active events: the timestamp of the last event of every pixel, one layer per polarity,
+    rendered as an exponentially decayed time surface exp(-(t_query - t_last) / tau) at any query time.
+
+    The surface is a GL_R32I image of microseconds since an epoch, so every event is a single O(1)
+    store or atomic max, whatever happened before it. 32 bits of microseconds only span about 35.8
+    minutes, so the epoch follows the query: file mode puts it at the query time whenever the surface
+    is rebuilt and rebuilds once the query has moved REBASE_SPAN past it, streaming shifts the host
+    copy down by the same amount. Times more than 2^31 us before the epoch fall to NEVER, far beyond
+    the decay horizon of any tau the GUI allows. In file mode time_surface_update.comp scatters
+    the resident events with imageAtomicMax and, like SlidingAccumulator, only the events the query
+    moved over are scattered: moving forward adds the new events, anything else rebuilds from the
+    decay horizon (HORIZON time constants back, where exp(-HORIZON) is below what 8 bits can show).
+    While streaming the events arrive on the CPU with absolute timestamps and the resident buffer is
+    re-timed every batch, so they are stored into a host copy as they are ingested and only the rows
+    that changed are uploaded before rendering.
+
+    time_surface.comp then turns both layers into the preview, one invocation per pixel.
+*/
+
+/**
+ * @brief Per pixel, per polarity last event times and their decayed rendering.
+ */
+class TimeSurface {
+    public:
+        TimeSurface();
+        ~TimeSurface();
+
+        /**
+         * @brief Compiles the update and render compute shaders
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Forgets every timestamp, host and device
+         */
+        void clear();
+
+        /**
+         * @brief Stores a streamed batch into the host surface, O(1) per event
+         * @param batch time ordered events with absolute timestamps
+         * @param resolution camera resolution
+         * @param firstTimestamp absolute timestamp (us) of the first event
+         */
+        void ingest(const std::vector<FilterEvent> &batch, glm::ivec2 resolution, int64_t firstTimestamp);
+
+        /**
+         * @brief Stores events already relative to the first event into the host surface, O(1) per event
+         * @param events time ordered (x, y, t in us since the first event, polarity)
+         * @param resolution camera resolution
+         */
+        void ingest(const std::vector<glm::vec4> &events, glm::ivec2 resolution);
+
+        /**
+         * @brief Uploads the rows of the host surface that changed since the last call
+         * @param resolution camera resolution
+         */
+        void updateStreamed(glm::ivec2 resolution);
+
+        /**
+         * @brief Moves the device surface to hold every event up to eventEnd, drops the host surface
+         * @param evtParticlesSSBO resident event buffer (x, y, t, polarity)
+         * @param dataVersion changes whenever the event buffer is re-uploaded
+         * @param resolution camera resolution
+         * @param horizonBegin first event within the decay horizon of the query, older ones may be skipped
+         * @param eventEnd last event included, the query time is its time
+         * @param toMicros converts normalized event times to microseconds since the first event
+         * @param query microseconds since the first event, the epoch is rebased around it
+         * @param visibilityVersion of the bound visibility bitmask, 0 when not applied
+         */
+        void update(GLuint evtParticlesSSBO, uint64_t dataVersion, glm::ivec2 resolution, int horizonBegin, int eventEnd,
+            float toMicros, int64_t query, uint64_t visibilityVersion);
+
+        /**
+         * @brief Renders the decayed surface and blits the region [srcMin, srcMax] of it into the bound draw framebuffer
+         * @param query microseconds since the first event
+         * @param tau decay time constant in microseconds
+         * @param mode POLARITY_MODE, MERGED_MODE or SIGNED_MODE
+         * @param posColor
+         * @param negColor
+         * @param srcMin lower left of the event data in pixels
+         * @param srcMax upper right of the event data in pixels (inclusive)
+         * @param viewport_resolution size of the bound draw framebuffer
+         */
+        void draw(int64_t query, float tau, int mode, const glm::vec3 &posColor, const glm::vec3 &negColor,
+            glm::ivec2 srcMin, glm::ivec2 srcMax, glm::vec2 viewport_resolution);
+
+        /**
+         * @brief Writes the decayed surface of each polarity as a 32 bit float TIFF, <basePath>_positive.tiff and _negative.tiff
+         * @param basePath
+         * @param query microseconds since the first event
+         * @param tau decay time constant in microseconds
+         * @return bool true if both were written
+         */
+        bool exportSurfaces(const std::string &basePath, int64_t query, float tau) const;
+
+        bool isStreamed() const { return hostValid; }
+        bool hasResult() const { return valid || hostValid; }
+        int64_t getQueryTime() const { return queryTime; } // of the last draw
+        uint64_t getLastUpdateEvents() const { return lastUpdateEvents; }
+        double getMilliseconds() const { return milliseconds; }
+
+        static const int32_t NEVER = INT32_MIN; // no event yet, must match NEVER in the shaders
+        static const int HORIZON = 12;           // time constants kept when rebuilding
+        static const int32_t REBASE_SPAN = 1 << 30; // microseconds past the epoch before it moves, about 17.9 minutes
+        static const int POLARITY_MODE = 0;      // values must match ImGui::Combo order in utils.cpp
+        static const int MERGED_MODE = 1;
+        static const int SIGNED_MODE = 2;
+
+    private:
+        void allocate(glm::ivec2 res);
+        void clearDevice();
+        void scatter(int eventBound_L, int eventBound_R);
+        void store(size_t index, int64_t time, glm::ivec2 res);
+        void rebaseHost(int64_t newEpoch, glm::ivec2 res);
+        int32_t relative(int64_t time) const;
+
+        ComputeProgram updateProg;
+        ComputeProgram renderProg;
+        bool initialized;
+
+        GLuint lastTexture;    // GL_TEXTURE_2D_ARRAY, GL_R32I, layer 0 positive, layer 1 negative
+        GLuint previewTexture; // GL_TEXTURE_2D, GL_RGBA8
+        GLuint readFBO;        // previewTexture as a blit source
+        glm::ivec2 resolution;
+        int64_t epoch; // microseconds since the first event that a stored 0 stands for
+
+        // What the device surface holds: every event in [curBegin, curEnd] of this data
+        bool valid;
+        int curBegin;
+        int curEnd;
+        uint64_t curDataVersion;
+        float curToMicros;
+        uint64_t curVisibilityVersion;
+
+        // Streaming: host copy with the same layout and the rows not uploaded yet
+        std::vector<int32_t> hostLast;
+        bool hostValid;
+        int dirtyRowMin;
+        int dirtyRowMax;
+
+        int64_t queryTime;
+        uint64_t lastUpdateEvents;
+        double milliseconds;
+};
+
+#endif // TIME_SURFACE_H
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ComputeProgram.h"
+
+/*
+    Records the bound read framebuffer to an ffmpeg pipe without stalling the render thread.
+
+    Every captured frame is read into the next pixel buffer object of a small ring with glReadPixels,
+    which only queues the copy, and a fence marks when it lands. Later captures poll the fences oldest
+    first (the GPU retires them in order, as in EventData::pollReadbacks), map the finished buffers and
+    hand the pixels to a writer thread over a bounded queue; the thread does the blocking fwrite into
+    the pipe. Frame buffers are recycled through a free list, so steady recording allocates nothing.
+
+    When the encoder falls behind, either the ring or the queue fills up. DROP_POLICY skips the frame
+    being captured and counts it, BLOCK_POLICY waits for space instead (back-pressure: the render loop
+    slows down to the encoder, no frame is lost). Stopping always flushes every captured frame.
+
+    RGB24_FORMAT sends the framebuffer as read and leaves flipping, padding and colour conversion to
+    ffmpeg. The other formats convert on the GPU instead: the frame is copied into a texture and
+    video_yuv420.comp writes flipped, evenly padded yuv420p planes straight into the ring buffer, half
+    the bytes of rgb24. YUV420_FORMAT pipes them to ffmpeg, Y4M_FORMAT writes a lossless .y4m file
+    that needs no encoder at all.
+*/
+
+/**
+ * @brief Asynchronous PBO-pipelined screen recorder feeding a writer thread.
+ */
+class VideoRecorder {
+    public:
+        VideoRecorder();
+        ~VideoRecorder();
+
+        /**
+         * @brief Compiles the yuv420p conversion shader, without it only RGB24_FORMAT records
+         * @param resource_dir
+         * @return bool true if successful
+         */
+        bool init(const std::string &resource_dir);
+
+        /**
+         * @brief Starts recording in the current format into an open pipe or file, which the recorder closes on stop
+         * @param pipe raw rgb24 or yuv420p input of the encoder, or a .y4m file
+         * @param closePipe pclose, _pclose or fclose
+         * @param width of the region read from (0, 0)
+         * @param height
+         * @return bool true if recording started
+         */
+        bool start(FILE *pipe, int (*closePipe)(FILE *), GLuint width, GLuint height);
+
+        /**
+         * @brief Queues a read of the bound read framebuffer and forwards the finished reads to the writer
+         */
+        void capture();
+
+        /**
+         * @brief Flushes every captured frame, joins the writer and closes the pipe
+         */
+        void stop();
+
+        bool isRecording() const { return recording; }
+        int &getPolicy() { return policy; } // DROP_POLICY or BLOCK_POLICY, may change while recording
+        int &getFormat() { return format; } // applied by the next start()
+
+        /**
+         * @brief Size of the frames written for a framebuffer size, yuv420p pads to even dimensions
+         * @param format
+         * @param width
+         * @param height
+         * @return size_t bytes per frame, without the Y4M frame header
+         */
+        static size_t frameSize(int format, GLuint width, GLuint height);
+        static GLuint paddedSize(int format, GLuint size) { return format == RGB24_FORMAT ? size : (size + 1) & ~1u; }
+
+        uint64_t getCapturedFrames() const { return capturedFrames; }
+        uint64_t getWrittenFrames() const { return writtenFrames.load(); }
+        uint64_t getDroppedFrames() const { return droppedFrames; }
+        uint64_t getBlockedFrames() const { return blockedFrames; } // captures that had to wait for space
+        int getQueueDepth() const { return queueDepth.load(); }
+        double getLagMilliseconds() const { return lagMilliseconds.load(); } // capture to written, last frame
+        double getWriteMilliseconds() const { return writeMilliseconds.load(); } // one fwrite, last frame
+
+        static const int RING_SIZE = 3;
+        static const int QUEUE_CAPACITY = 8;
+        static const int DROP_POLICY = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int BLOCK_POLICY = 1;
+        static const int RGB24_FORMAT = 0; // values must match ImGui::Combo order in utils.cpp
+        static const int YUV420_FORMAT = 1;
+        static const int Y4M_FORMAT = 2;
+
+    private:
+        struct Slot {
+            GLuint buffer = 0;
+            GLsync fence = nullptr;
+            double captureTime = 0.0;
+        };
+
+        struct Frame {
+            std::vector<unsigned char> pixels;
+            double captureTime = 0.0;
+        };
+
+        bool retire(Slot &slot, bool wait, bool force); // map a finished slot and enqueue its pixels
+        bool enqueue(Slot &slot, bool force);
+        void writerLoop();
+        static double now();
+
+        ComputeProgram convertProg;
+        bool initialized;
+        GLuint sourceTexture; // GL_RGBA8 copy of the framebuffer for the conversion
+
+        bool recording;
+        int policy;
+        int format;
+        int recordFormat; // format of the running recording
+        GLuint width;
+        GLuint height;
+        size_t frameBytes;
+        FILE *pipe;
+        int (*closePipe)(FILE *);
+
+        Slot ring[RING_SIZE];
+        int head; // slot the next capture reads into
+
+        std::thread writer;
+        std::mutex mutex;
+        std::condition_variable queueChanged;
+        std::deque<Frame> queue;
+        std::vector<Frame> freeFrames;
+        bool stopping;
+
+        uint64_t capturedFrames;
+        uint64_t droppedFrames;
+        uint64_t blockedFrames;
+        std::atomic<uint64_t> writtenFrames;
+        std::atomic<int> queueDepth;
+        std::atomic<double> lagMilliseconds;
+        std::atomic<double> writeMilliseconds;
+};
+
+#endif // VIDEO_RECORDER_H
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef VOXEL_GRID_EXPORTER_H
+#define VOXEL_GRID_EXPORTER_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "EventFilterChain.h"
+
+/*
+    Converts events into voxel grids over sliding windows and streams them into one .npy tensor of shape
+    (windows, 2, bins, height, width), float32, channel 0 positive and 1 negative polarity.
+
+    Window k covers [t0 + k * stride, t0 + k * stride + length) microseconds, t0 being the first event.
+    Every event is split between the two time bins around its normalized time t* = (bins - 1)(t - start) / length
+    with weights 1 - |b - t*| (bilinear binning in time), one OpenMP thread per slice of the events with
+    atomic adds into the shared grid.
+
+    Events arrive in time order through feed(), from the resident recording a chunk per frame or from
+    the streamed batches as they are read. Only the events of the windows not written yet are kept, and
+    each grid goes to disk as soon as its window is complete, so a recording of any length converts in
+    the memory of one window. The header is written first with room for the final window count and
+    rewritten by finish(), so the file loads with numpy.load(path, mmap_mode="r").
+*/
+
+/**
+ * @brief Sliding window event voxel grids written as a memory mappable .npy tensor.
+ */
+class VoxelGridExporter {
+    public:
+        VoxelGridExporter();
+        ~VoxelGridExporter();
+
+        /**
+         * @brief Opens the tensor file and writes a provisional header
+         * @param path .npy file
+         * @param resolution camera resolution
+         * @param streamed events come from the stream (absolute timestamps) rather than the resident recording
+         * @return bool true if started
+         */
+        bool begin(const std::string &path, glm::ivec2 resolution, bool streamed);
+
+        /**
+         * @brief Bins the events and writes every window they complete
+         * @param batch time ordered events, timestamps in microseconds
+         */
+        void feed(const std::vector<FilterEvent> &batch);
+
+        /**
+         * @brief Writes the remaining windows up to the last event, the final header and closes the file
+         * @return bool true if every write succeeded
+         */
+        bool finish();
+
+        bool isActive() const { return file != nullptr; }
+        bool isStreamed() const { return streamed; }
+        size_t &getNextEvent() { return nextEvent; } // resident recording: events fed so far
+        uint64_t getWrittenWindows() const { return writtenWindows; }
+        double getMilliseconds() const { return milliseconds; } // binning and writing, summed
+
+        bool &getRequest() { return request; } // set by the GUI, begun by main.cpp
+        int &getBins() { return bins; }
+        float &getWindowMs() { return windowMs; }
+        float &getStrideMs() { return strideMs; }
+
+        static const int POLARITIES = 2;
+        static const int HEADER_BYTES = 128; // room for any window count, a multiple of 64 as .npy asks
+
+    private:
+        void writeWindow(size_t end); // bins [pendingBegin, end) into the current window
+        bool writeHeader(uint64_t numWindows);
+
+        bool request;
+        int bins;
+        float windowMs;
+        float strideMs;
+
+        FILE *file;
+        bool streamed;
+        bool failed;
+        glm::ivec2 resolution;
+        int numBins;        // of the running export
+        int64_t length;     // microseconds
+        int64_t stride;
+        bool hasStart;
+        int64_t windowStart;
+        int64_t lastTimestamp;
+
+        std::vector<FilterEvent> pending; // events from windowStart on, [pendingBegin, size())
+        size_t pendingBegin;
+        std::vector<float> grid;
+        size_t nextEvent;
+        uint64_t writtenWindows;
+        double milliseconds;
+};
+
+#endif // VOXEL_GRID_EXPORTER_H
@@ -42,6 +42,8 @@
 #include "frameScene.h"
 #include "ContributionFunc.h"
 #include "Gizmo.h"
+#include "VideoRecorder.h"
+#include "SequenceExporter.h"
 
 // UTILS //
 #include "utils.h"
@@ -11,6 +11,8 @@
 class Program;
 class BaseViewportFBO;
 class EventData;
+class VideoRecorder;
+class SequenceExporter;
 
 /**
  * @brief Struct to hold context information for the GLFW window. This allows for callback functions to access information within other scopes.
@@ -62,12 +64,14 @@ void drawGUIDockspace();
  * @param datafilepath 
  * @param video_name 
  * @param recording 
+ * @param videoRecorder 
+ * @param sequenceExporter 
  * @param datadirectory 
  * @param loadFile 
  */
 void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool &is_mainViewportHovered,
     BaseViewportFBO &mainSceneFBO, FrameViewportFBO &frameScenceFBO, std::shared_ptr<EventData> &evtData, std::string &datafilepath, 
-    std::string &video_name, bool &recording, std::string& datadirectory, bool &loadFile, bool &dataStreamed, bool &resetStream, bool &pauseStream, bool &showFrameData, float &particleTimeDensity);
+    std::string &video_name, bool &recording, VideoRecorder &videoRecorder, SequenceExporter &sequenceExporter, std::string& datadirectory, bool &loadFile, bool &dataStreamed, bool &resetStream, bool &pauseStream, bool &showFrameData, float &particleTimeDensity);
 
 float randFloat();
 glm::vec3 randXYZ();
@@ -175,3 +175,13 @@ void Camera::keyUpdate(char key) {
         rotations.y = 0.0f;
     }
 }
+
+CameraPose Camera::getPose() const {
+    return { translations, rotations };
+}
+
+void Camera::setPose(const CameraPose &pose) {
+    translations = pose.translations;
+    rotations = pose.rotations;
+    pos = -glm::vec3(translations);
+}
@@ -0,0 +1,413 @@
+#include "ClusterTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <omp.h>
+
+namespace {
+    const int CELL_BITS = 21; // per axis in the packed cell key
+    const int64_t CELL_MAX = (int64_t(1) << CELL_BITS) - 1;
+    const int REACH = 2; // cells of side eps / sqrt(2) a neighbourhood spans on each side
+
+    uint64_t packCell(int64_t cx, int64_t cy, int64_t ct) {
+        return (static_cast<uint64_t>(ct) << (2 * CELL_BITS)) | (static_cast<uint64_t>(cy) << CELL_BITS) | static_cast<uint64_t>(cx);
+    }
+
+    void unpackCell(uint64_t key, int64_t &cx, int64_t &cy, int64_t &ct) {
+        cx = static_cast<int64_t>(key & CELL_MAX);
+        cy = static_cast<int64_t>((key >> CELL_BITS) & CELL_MAX);
+        ct = static_cast<int64_t>(key >> (2 * CELL_BITS));
+    }
+
+    int findCell(const std::vector<uint64_t> &cellKeys, uint64_t key) {
+        auto it = std::lower_bound(cellKeys.begin(), cellKeys.end(), key);
+        return (it != cellKeys.end() && *it == key) ? static_cast<int>(it - cellKeys.begin()) : -1;
+    }
+
+    int findRoot(std::vector<int> &parent, int c) {
+        while (parent[c] != c) {
+            parent[c] = parent[parent[c]];
+            c = parent[c];
+        }
+        return c;
+    }
+}
+
+ClusterTracker::ClusterTracker() : lastKey(), hasKey(false), nextTrackID(0), lastTime(0.0f), hasTime(false),
+    numPoints(0), numNoise(0), milliseconds(0.0) {}
+
+void ClusterTracker::reset() {
+    tracks.clear();
+    clusters.clear();
+    nextTrackID = 0;
+    hasTime = false;
+    hasKey = false;
+}
+
+int ClusterTracker::getNumActiveTracks() const {
+    return static_cast<int>(std::count_if(tracks.begin(), tracks.end(), [](const Track &track) { return track.active; }));
+}
+
+bool ClusterTracker::update(const std::vector<glm::vec4> &events, int eventBound_L, int eventBound_R,
+    const glm::vec4 &spaceWindow, bool isPositiveOnly) {
+
+    UpdateKey key = { eventBound_L, eventBound_R, spaceWindow, isPositiveOnly, settings };
+    key.settings.trailLength = 0; // display only
+    if (hasKey && key == lastKey) {
+        return false;
+    }
+    lastKey = key;
+    hasKey = true;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Sample the window, striding evenly once it holds more than maxPoints events
+    points.clear();
+    eventBound_L = std::max(eventBound_L, 0);
+    eventBound_R = std::min(eventBound_R, static_cast<int>(events.size()) - 1);
+    float t = 0.0f;
+    if (eventBound_L <= eventBound_R) {
+        int numEvents = eventBound_R - eventBound_L + 1;
+        int stride = std::max(1, (numEvents + std::max(settings.maxPoints, 1) - 1) / std::max(settings.maxPoints, 1));
+        for (int i = eventBound_L; i <= eventBound_R; i += stride) {
+            const glm::vec4 &e = events[i];
+            if ((isPositiveOnly && e.w < 0.5f) || e.x < spaceWindow.w || e.x > spaceWindow.y ||
+                e.y < spaceWindow.x || e.y > spaceWindow.z) {
+                continue;
+            }
+            points.push_back(e);
+        }
+        t = 0.5f * (events[eventBound_L].z + events[eventBound_R].z);
+    }
+
+    cluster();
+    track(t);
+
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void ClusterTracker::cluster() {
+    clusters.clear();
+    numPoints = points.size();
+    numNoise = numPoints;
+    if (points.empty() || settings.eps <= 0.0f) {
+        return;
+    }
+
+    const int n = static_cast<int>(points.size());
+    const float eps2 = settings.eps * settings.eps;
+    const bool useTime = settings.timeEps > 0.0f;
+    const float timeEps = settings.timeEps;
+    const int minPts = std::max(settings.minPts, 1);
+
+    // Cell side eps / sqrt(2): two points sharing a cell are always within eps of each other
+    const float invSide = std::sqrt(2.0f) / settings.eps;
+    const float t0 = points.front().z; // points are still time sorted here
+    const float span = points.back().z - t0;
+    const float invTime = useTime ? 1.0f / std::max(timeEps, span / static_cast<float>(CELL_MAX - 2)) : 0.0f;
+
+    // Sort points by cell so every cell is a contiguous run
+    std::vector<std::pair<uint64_t, int>> keyed(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        const glm::vec4 &p = points[i];
+        int64_t cx = std::clamp<int64_t>(static_cast<int64_t>(std::floor(p.x * invSide)) + REACH, 0, CELL_MAX);
+        int64_t cy = std::clamp<int64_t>(static_cast<int64_t>(std::floor(p.y * invSide)) + REACH, 0, CELL_MAX);
+        int64_t ct = std::clamp<int64_t>(static_cast<int64_t>(std::floor((p.z - t0) * invTime)) + 1, 0, CELL_MAX);
+        keyed[i] = { packCell(cx, cy, ct), i };
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    std::vector<glm::vec4> sorted(n);
+    pointKeys.resize(n);
+    cellKeys.clear();
+    cellBegin.clear();
+    for (int i = 0; i < n; i++) {
+        sorted[i] = points[keyed[i].second];
+        pointKeys[i] = keyed[i].first;
+        if (i == 0 || pointKeys[i] != pointKeys[i - 1]) {
+            cellKeys.push_back(pointKeys[i]);
+            cellBegin.push_back(i);
+        }
+    }
+    cellBegin.push_back(n);
+    points.swap(sorted);
+    const int numCells = static_cast<int>(cellKeys.size());
+    const int reachT = useTime ? 1 : 0;
+
+    // Calls visitCell(c) for every occupied cell around a cell key until it returns true
+    auto forNeighbourCells = [&](uint64_t key, auto &&visitCell) {
+        int64_t cx, cy, ct;
+        unpackCell(key, cx, cy, ct);
+        for (int64_t dt = -reachT; dt <= reachT; dt++) {
+            for (int64_t dy = -REACH; dy <= REACH; dy++) {
+                for (int64_t dx = -REACH; dx <= REACH; dx++) {
+                    int64_t nx = cx + dx, ny = cy + dy, nt = ct + dt;
+                    if (nx < 0 || ny < 0 || nt < 0 || nx > CELL_MAX || ny > CELL_MAX || nt > CELL_MAX) {
+                        continue;
+                    }
+                    int c = findCell(cellKeys, packCell(nx, ny, nt));
+                    if (c >= 0 && visitCell(c)) {
+                        return;
+                    }
+                }
+            }
+        }
+    };
+    auto isNeighbour = [&](const glm::vec4 &a, const glm::vec4 &b) {
+        float dx = a.x - b.x, dy = a.y - b.y;
+        return dx * dx + dy * dy <= eps2 && (!useTime || std::fabs(a.z - b.z) <= timeEps);
+    };
+
+    // Core points, counting stops as soon as minPts is reached
+    core.assign(n, 0);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; i++) {
+        const glm::vec4 &p = points[i];
+        int count = 0;
+        forNeighbourCells(pointKeys[i], [&](int c) {
+            for (int j = cellBegin[c]; j < cellBegin[c + 1] && count < minPts; j++) {
+                count += isNeighbour(p, points[j]);
+            }
+            return count >= minPts;
+        });
+        core[i] = count >= minPts;
+    }
+
+    // Cells holding a core point; all core points of one cell are density connected
+    std::vector<int> cellCore(numCells, -1); // first core point of the cell
+    #pragma omp parallel for
+    for (int c = 0; c < numCells; c++) {
+        for (int i = cellBegin[c]; i < cellBegin[c + 1]; i++) {
+            if (core[i]) {
+                cellCore[c] = i;
+                break;
+            }
+        }
+    }
+
+    // Link core cells that have a pair of core points within eps, each pair of cells is tested once
+    std::vector<std::vector<std::pair<int, int>>> threadLinks(omp_get_max_threads());
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int c = 0; c < numCells; c++) {
+        if (cellCore[c] < 0) {
+            continue;
+        }
+        std::vector<std::pair<int, int>> &links = threadLinks[omp_get_thread_num()];
+        forNeighbourCells(cellKeys[c], [&](int c2) {
+            if (c2 <= c || cellCore[c2] < 0) {
+                return false;
+            }
+            bool linked = false;
+            for (int i = cellBegin[c]; i < cellBegin[c + 1] && !linked; i++) {
+                if (!core[i]) {
+                    continue;
+                }
+                for (int j = cellBegin[c2]; j < cellBegin[c2 + 1] && !linked; j++) {
+                    linked = core[j] && isNeighbour(points[i], points[j]);
+                }
+            }
+            if (linked) {
+                links.push_back({ c, c2 });
+            }
+            return false;
+        });
+    }
+
+    std::vector<int> parent(numCells);
+    for (int c = 0; c < numCells; c++) {
+        parent[c] = c;
+    }
+    for (const auto &links : threadLinks) {
+        for (const auto &link : links) {
+            int a = findRoot(parent, link.first), b = findRoot(parent, link.second);
+            if (a != b) {
+                parent[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+
+    // Compact cluster ids per root cell
+    std::vector<int> cellCluster(numCells, -1);
+    int numClusters = 0;
+    for (int c = 0; c < numCells; c++) {
+        if (cellCore[c] < 0) {
+            continue;
+        }
+        int root = findRoot(parent, c);
+        if (cellCluster[root] < 0) {
+            cellCluster[root] = numClusters++;
+        }
+        cellCluster[c] = cellCluster[root];
+    }
+
+    // Core points take their cell's cluster, border points the cluster of any core neighbour
+    labels.assign(n, -1);
+    std::vector<int> pointCell(n);
+    for (int c = 0; c < numCells; c++) {
+        for (int i = cellBegin[c]; i < cellBegin[c + 1]; i++) {
+            pointCell[i] = c;
+        }
+    }
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < n; i++) {
+        if (core[i]) {
+            labels[i] = cellCluster[pointCell[i]];
+            continue;
+        }
+        const glm::vec4 &p = points[i];
+        int label = -1;
+        forNeighbourCells(pointKeys[i], [&](int c) {
+            if (cellCore[c] < 0) {
+                return false;
+            }
+            for (int j = cellBegin[c]; j < cellBegin[c + 1]; j++) {
+                if (core[j] && isNeighbour(p, points[j])) {
+                    label = cellCluster[c];
+                    return true;
+                }
+            }
+            return false;
+        });
+        labels[i] = label;
+    }
+
+    // Moments per cluster, then the same eigen decomposition as the PCA overlay
+    std::vector<double> sums(static_cast<size_t>(numClusters) * 7, 0.0); // n, x, y, t, xx, xy, yy
+    numNoise = 0;
+    for (int i = 0; i < n; i++) {
+        if (labels[i] < 0) {
+            numNoise++;
+            continue;
+        }
+        const glm::vec4 &p = points[i];
+        double *s = sums.data() + static_cast<size_t>(labels[i]) * 7;
+        s[0] += 1.0;
+        s[1] += p.x;
+        s[2] += p.y;
+        s[3] += p.z;
+        s[4] += double(p.x) * p.x;
+        s[5] += double(p.x) * p.y;
+        s[6] += double(p.y) * p.y;
+    }
+
+    for (int k = 0; k < numClusters; k++) {
+        const double *s = sums.data() + static_cast<size_t>(k) * 7;
+        double count = s[0];
+        double mx = s[1] / count, my = s[2] / count;
+        double cxx = std::max(s[4] / count - mx * mx, 0.0);
+        double cxy = s[5] / count - mx * my;
+        double cyy = std::max(s[6] / count - my * my, 0.0);
+        double trace = cxx + cyy;
+        double root = std::sqrt(std::max((cxx - cyy) * (cxx - cyy) * 0.25 + cxy * cxy, 0.0));
+
+        Cluster cluster;
+        cluster.trackID = -1;
+        cluster.count = static_cast<uint32_t>(count);
+        cluster.mean = glm::vec2(mx, my);
+        cluster.t = static_cast<float>(s[3] / count);
+        cluster.sigma = glm::vec2(std::sqrt(std::max(trace * 0.5 + root, 0.0)), std::sqrt(std::max(trace * 0.5 - root, 0.0)));
+        cluster.angle = static_cast<float>(0.5 * std::atan2(2.0 * cxy, cxx - cyy));
+        clusters.push_back(cluster);
+    }
+
+    std::sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.count > b.count; });
+    if (clusters.size() > static_cast<size_t>(MAX_CLUSTERS)) {
+        clusters.resize(MAX_CLUSTERS);
+    }
+}
+
+void ClusterTracker::track(float t) {
+    // Seeking back (or reclustering the same window) restarts tracking from here
+    if (hasTime && t <= lastTime) {
+        tracks.clear();
+        nextTrackID = 0;
+    }
+    hasTime = true;
+    lastTime = t;
+
+    // Every gated (distance, track, cluster) candidate, assigned greedily from the closest
+    struct Candidate {
+        float distance;
+        int track;
+        int cluster;
+    };
+    std::vector<Candidate> candidates;
+    for (int k = 0; k < static_cast<int>(tracks.size()); k++) {
+        const Track &trk = tracks[k];
+        if (!trk.active) {
+            continue;
+        }
+        const Track::Point &last = trk.history.back();
+        glm::vec2 predicted = last.pos + trk.velocity * (t - last.t);
+        for (int j = 0; j < static_cast<int>(clusters.size()); j++) {
+            float distance = glm::length(clusters[j].mean - predicted);
+            if (distance <= settings.gate) {
+                candidates.push_back({ distance, k, j });
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.distance < b.distance; });
+
+    std::vector<uint8_t> trackMatched(tracks.size(), 0);
+    for (const Candidate &candidate : candidates) {
+        Cluster &cluster = clusters[candidate.cluster];
+        if (trackMatched[candidate.track] || cluster.trackID >= 0) {
+            continue;
+        }
+        Track &trk = tracks[candidate.track];
+        const Track::Point &last = trk.history.back();
+        float dt = t - last.t;
+        if (dt > 0.0f) {
+            glm::vec2 velocity = (cluster.mean - last.pos) / dt;
+            trk.velocity = trk.history.size() > 1 ? 0.5f * (trk.velocity + velocity) : velocity;
+        }
+        trk.history.push_back({ t, cluster.mean, cluster.count, cluster.sigma, cluster.angle });
+        trk.missed = 0;
+        trackMatched[candidate.track] = 1;
+        cluster.trackID = trk.id;
+    }
+
+    for (int k = 0; k < static_cast<int>(trackMatched.size()); k++) {
+        Track &trk = tracks[k];
+        if (trk.active && !trackMatched[k] && ++trk.missed > settings.maxMissed) {
+            trk.active = false;
+        }
+    }
+
+    for (Cluster &cluster : clusters) {
+        if (cluster.trackID >= 0) {
+            continue;
+        }
+        Track trk;
+        trk.id = nextTrackID++;
+        trk.history.push_back({ t, cluster.mean, cluster.count, cluster.sigma, cluster.angle });
+        trk.velocity = glm::vec2(0.0f);
+        trk.missed = 0;
+        trk.active = true;
+        tracks.push_back(trk);
+        cluster.trackID = trk.id;
+    }
+}
+
+bool ClusterTracker::exportCSV(const std::string &path, double timeToSeconds) const {
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "track,time_s,x,y,events,sigma_major,sigma_minor,angle_rad\n");
+    for (const Track &trk : tracks) {
+        for (const Track::Point &p : trk.history) {
+            fprintf(file, "%d,%.6f,%.3f,%.3f,%u,%.3f,%.3f,%.5f\n", trk.id, p.t * timeToSeconds, p.pos.x, p.pos.y,
+                p.count, p.sigma.x, p.sigma.y, p.angle);
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
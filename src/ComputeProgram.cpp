@@ -1,5 +1,6 @@
 #include "ComputeProgram.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -16,7 +17,18 @@ ComputeProgram::~ComputeProgram() {
 
 void ComputeProgram::setShaderName(const std::string &c) { cShaderName = c; }
 
+void ComputeProgram::setInjection(const std::string &marker, const std::string &code) { injections[marker] = code; }
+
+void ComputeProgram::addDefine(const std::string &name, const std::string &value) { defines[name] = value; }
+
 bool ComputeProgram::init() {
+    infoLog.clear();
+    if (pid) {
+        glDeleteProgram(pid);
+        pid = 0;
+        uniforms.clear();
+    }
+
     // Read compute shader source
     std::ifstream cFile(cShaderName);
     if (!cFile.is_open()) {
@@ -28,6 +40,33 @@ bool ComputeProgram::init() {
     std::stringstream cStream;
     cStream << cFile.rdbuf();
     std::string cSource = cStream.str();
+    for (const auto &[marker, code] : injections) {
+        size_t pos = 0;
+        while ((pos = cSource.find(marker, pos)) != std::string::npos) {
+            cSource.replace(pos, marker.size(), code);
+            pos += code.size();
+        }
+    }
+
+    // Specialization defines go right after the #version line
+    if (!defines.empty()) {
+        std::string defineBlock;
+        for (const auto &[name, value] : defines) {
+            defineBlock += "#define " + name + " " + value + "\n";
+        }
+        size_t versionEnd = cSource.find('\n', cSource.find("#version"));
+        cSource.insert(versionEnd == std::string::npos ? 0 : versionEnd + 1, defineBlock);
+    }
+
+    // Linked binary from an earlier run with the exact same source and driver
+    pid = GLSL::loadCachedProgram(cSource);
+    if (pid) {
+        if (verbose) {
+            std::cout << "Compute program loaded from cache: " << cShaderName << std::endl;
+        }
+        return true;
+    }
+
     const char *cSourcePtr = cSource.c_str();
 
     // Create and compile compute shader
@@ -39,8 +78,9 @@ bool ComputeProgram::init() {
     GLint success;
     glGetShaderiv(cShader, GL_COMPILE_STATUS, &success);
     if (!success) {
-        GLchar infoLog[512];
-        glGetShaderInfoLog(cShader, 512, nullptr, infoLog);
+        GLchar log[512];
+        glGetShaderInfoLog(cShader, 512, nullptr, log);
+        infoLog = log;
         std::cerr << "Compute shader compilation failed:\n"
                   << infoLog << std::endl;
         glDeleteShader(cShader);
@@ -59,13 +99,15 @@ bool ComputeProgram::init() {
         return false;
     }
     glAttachShader(pid, cShader);
+    glProgramParameteri(pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(pid);
 
     // Check for linking errors
     glGetProgramiv(pid, GL_LINK_STATUS, &success);
     if (!success) {
-        GLchar infoLog[512];
-        glGetProgramInfoLog(pid, 512, nullptr, infoLog);
+        GLchar log[512];
+        glGetProgramInfoLog(pid, 512, nullptr, log);
+        infoLog = log;
         std::cerr << "Compute program linking failed:\n"
                   << infoLog << std::endl;
         glDeleteShader(cShader);
@@ -74,6 +116,7 @@ bool ComputeProgram::init() {
 
     // Clean up shader (no longer needed after linking)
     glDeleteShader(cShader);
+    GLSL::saveCachedProgram(pid, cSource);
 
     if (verbose) {
         std::cout << "Compute program linked successfully" << std::endl;
@@ -96,6 +139,10 @@ void ComputeProgram::dispatch(GLuint numGroupsX, GLuint numGroupsY,
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 }
 
+void ComputeProgram::dispatchGridStride(GLuint numItems, GLuint localSize) {
+    dispatch(std::min<GLuint>((numItems + localSize - 1) / localSize, 65535), 1, 1);
+}
+
 void ComputeProgram::addUniform(const std::string &name) {
     if (pid == 0) {
         std::cout << "Error: program not initialized - cannot add uniform" << std::endl;
@@ -0,0 +1,64 @@
+#include "ContributionKernels.h"
+
+#include <iostream>
+
+#include "ContributionFunc.h"
+
+void ContributionKernels::setup(const std::string &name, const std::vector<std::string> &uniforms,
+    const std::vector<std::string> &defines) {
+    shaderName = name;
+    uniformNames = uniforms;
+    featureDefines = defines;
+    injections.clear();
+    variants.clear();
+}
+
+void ContributionKernels::setInjection(const std::string &marker, const std::string &code) {
+    injections[marker] = code;
+    variants.clear();
+}
+
+ComputeProgram *ContributionKernels::get(int funcID, unsigned features) {
+    ContributionRegistry &registry = ContributionRegistry::instance();
+    if (!registry.isValid(funcID)) {
+        return nullptr;
+    }
+
+    ContributionFunction &func = registry.get(funcID);
+    Variant &variant = variants[{ funcID, features }];
+    if (variant.revision == func.revision && (variant.prog || variant.failed)) {
+        return variant.prog.get();
+    }
+
+    // Not built yet or the GLSL changed since
+    variant.prog = std::make_unique<ComputeProgram>();
+    variant.prog->setShaderName(shaderName);
+    variant.prog->setInjection(ContributionRegistry::PLACEHOLDER, registry.buildGLSL(funcID));
+    for (const auto &[marker, code] : injections) {
+        variant.prog->setInjection(marker, code);
+    }
+    for (size_t i = 0; i < featureDefines.size(); i++) {
+        if (features & (1u << i)) {
+            variant.prog->addDefine(featureDefines[i]);
+        }
+    }
+    variant.prog->setVerbose(false); // Not every function reads every uniform
+    variant.revision = func.revision;
+    variant.failed = !variant.prog->init();
+
+    if (variant.failed) {
+        std::cerr << "Failed to build " << shaderName << " for contribution function '" << func.name << "'" << std::endl;
+        func.error = variant.prog->getInfoLog();
+        variant.prog.reset();
+        return nullptr;
+    }
+    func.error.clear();
+
+    variant.prog->bind();
+    for (const std::string &uniform : uniformNames) {
+        variant.prog->addUniform(uniform);
+    }
+    variant.prog->unbind();
+
+    return variant.prog.get();
+}
@@ -2,24 +2,29 @@
 #include "utils.h"
 
 #include <algorithm>
+#include <bit>
+#include <cmath>
 #include <cstdio>
 #include <dv-processing/core/utils.hpp>
+#include <glm/gtc/constants.hpp>
 #include <omp.h>
 #include <windows.h>
 
 using std::vector, std::cout, std::endl;
 
 // do in order of declaration below
-EventData::EventData() : camera_resolution(0.0f), diffScale(0.0f),
+EventData::EventData() : camera_resolution(0.0f), diffScale(0.0f), scaledTimeDensity(1.0f),
     earliestTimestamp(0), latestTimestamp(0), shutterType(TIME_SHUTTER), 
     timeWindow_L(0.0f), timeWindow_R(0.0f), eventWindow_L(0), eventWindow_R(0),
     timeShutterWindow_L(0.0f), timeShutterWindow_R(0.0f), eventShutterWindow_L(0),
     eventShutterWindow_R(0), spaceWindow(0.0f), minXYZ(std::numeric_limits<float>::max()),
     maxXYZ(std::numeric_limits<float>::lowest()), center(0.0f), negColor({1.0f, 0.0f, 0.0f}), 
-    posColor({0.0f, 1.0f, 0.0f}),
+    posColor({0.0f, 1.0f, 0.0f}), selectColor({1.0f, 0.8f, 0.0f}),
       isPositiveOnly(false), unitType(1), evtParticlesSSBO(0),
-      outputDataSSBO(0), countersSSBO(0), computeInitialized(false),
-      isStreaming{false}, liveStreamReader() {}
+      outputDataSSBO(0), countersSSBO(0), partialMomentsSSBO(0), momentsSSBO(0), readbackHead(0),
+      dispatchGeneration(0), consumedGeneration(0), readbackCount(0), readbackMoments{0.0}, readbackHasMoments(false),
+      hasDispatched(false), lastDispatchKey(), computeInitialized(false), pickedEvent(-1), autoPixelIndex(false), dataVersion(0), hostVersion(1), uploadedHostVersion(0),
+      filterChain(std::make_shared<EventFilterChain>()), autoHotPixelMask(true), isStreaming{false}, liveStreamReader() {}
 
 EventData::~EventData() {
     if (instVBO) {
@@ -46,11 +51,43 @@ EventData::~EventData() {
         glDeleteBuffers(1, &countersSSBO);
         countersSSBO = 0;
     }
+
+    if (partialMomentsSSBO) {
+        glDeleteBuffers(1, &partialMomentsSSBO);
+        partialMomentsSSBO = 0;
+    }
+
+    if (momentsSSBO) {
+        glDeleteBuffers(1, &momentsSSBO);
+        momentsSSBO = 0;
+    }
+
+    for (ReadbackSlot &slot : readbackRing) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+            slot.buffer = 0;
+        }
+    }
 }
 
 void EventData::reset() {
     // TODO: Do we want to free the memory? Because if we go from like 100'000 particles -> 10 we should. Otherwise, better to keep
     evtParticles.clear();
+    hostVersion++;
+    timeIndex.clear();
+    pixelIndex.clear();
+    spatialIndex.clear();
+    pickedEvent = -1;
+    selection.clear();
+    timeSurface.clear();
+    frameExporter.cancel();
+    voxelExporter.finish(); // what was converted stays a valid tensor
+    ratePyramid.clear();
+    clusterTracker.reset();
 
     streamEvtParticles.clear(); // Clear stream particles, might move to another method later
 
@@ -96,12 +133,25 @@ void EventData::initParticlesFromFile(const std::string &filename) {
     // https://dv-processing.inivation.com/rel_1_7/reading_data.html#read-events-from-a-file
     uint counter = 0; // Necessary for modFreq;
     float threshold = 1.0/modFreq;;
+    cameraName = reader.getCameraName();
+    filterChain->reset(glm::ivec2(camera_resolution));
+    hotPixelDetector.reset(glm::ivec2(camera_resolution));
+    if (autoHotPixelMask) {
+        loadHotPixelMask();
+    }
+    std::vector<FilterEvent> batch;
     while (reader.isRunning()) {
         if (const auto events = reader.getNextEventBatch(); events.has_value()) {
+            batch.clear();
             for (auto &evt : events.value()) {
                 if (randFloat() > threshold) { continue; } // TODO instead skip batch if possible
+                batch.push_back({ evt.timestamp(), evt.x(), evt.y(), static_cast<uint8_t>(evt.polarity()) });
+            }
+            hotPixelDetector.accumulate(batch);
+            filterChain->apply(batch);
 
-                long long evtTimestamp = evt.timestamp();
+            for (const FilterEvent &evt : batch) {
+                long long evtTimestamp = evt.timestamp;
                 if (evtParticles.empty()) {
                     earliestTimestamp = evtTimestamp;
                 }
@@ -112,10 +162,10 @@ void EventData::initParticlesFromFile(const std::string &filename) {
                 // We can sort of "normalize" the timestamp to start at 0 this way.
                 float relativeTimestamp = static_cast<float>(evtTimestamp - earliestTimestamp);
                 glm::vec4 evt_xytp = glm::vec4(
-                    static_cast<float>(evt.x()),
-                    static_cast<float>(evt.y()),
+                    static_cast<float>(evt.x),
+                    static_cast<float>(evt.y),
                     relativeTimestamp,
-                    static_cast<float>(evt.polarity()) // (float)true == 1.0f, (float)false == 0.0f
+                    static_cast<float>(evt.polarity) // 1.0f positive, 0.0f negative
                 );
 
                 evtParticles.push_back(evt_xytp);
@@ -133,6 +183,7 @@ void EventData::initParticlesFromFile(const std::string &filename) {
     // TODO: This is arbitrary, we can should define as a constant somewhere
     // Apply scale
     this->diffScale = 5000.0f / static_cast<float>(latestTimestamp - earliestTimestamp);
+    this->scaledTimeDensity = particleTimeDensity;
     for (auto &evt : evtParticles) {
         evt.z *= diffScale * particleTimeDensity;
     }
@@ -144,6 +195,12 @@ void EventData::initParticlesFromFile(const std::string &filename) {
     
     this->spaceWindow = glm::vec4(minXYZ.y, maxXYZ.x, maxXYZ.y, minXYZ.x);
 
+    timeIndex.build(evtParticles);
+    ratePyramid.build(evtParticles, 1.0 / getTimeScale());
+    if (autoPixelIndex) {
+        buildPixelIndex();
+    }
+
     printf("Loaded %zu particles from %s\n", evtParticles.size(), filename.c_str());
 }
 
@@ -164,6 +221,12 @@ int EventData::streamParticlesFromFile(const std::string& filename, float maxZ,
         reset();
         liveStreamReader = std::make_shared<dv::io::MonoCameraRecording>(filename); 
         camera_resolution = glm::vec2(liveStreamReader -> getEventResolution().value().width, liveStreamReader -> getEventResolution().value().height);
+        cameraName = liveStreamReader->getCameraName();
+        filterChain->reset(glm::ivec2(camera_resolution));
+        hotPixelDetector.reset(glm::ivec2(camera_resolution));
+        if (autoHotPixelMask) {
+            loadHotPixelMask();
+        }
     }
 
     dv::io::MonoCameraRecording& reader(*liveStreamReader);
@@ -188,10 +251,16 @@ int EventData::streamParticlesFromFile(const std::string& filename, float maxZ,
         }
         // Read event data batch from file
         if (const auto events = reader.getNextEventBatch(); events.has_value()) {
+            std::vector<FilterEvent> batch;
             for (auto& evt : events.value()) {
                 if (counter++ % modFreq != 0) { continue; } // TODO instead skip batch if possible
+                batch.push_back({ evt.timestamp(), evt.x(), evt.y(), static_cast<uint8_t>(evt.polarity()) });
+            }
+            hotPixelDetector.accumulate(batch);
+            filterChain->apply(batch);
 
-                long long evtTimestamp = evt.timestamp();
+            for (const FilterEvent &evt : batch) {
+                long long evtTimestamp = evt.timestamp;
                 
                 // Find earliest global time
                 if (streamEvtParticles.empty())
@@ -206,15 +275,22 @@ int EventData::streamParticlesFromFile(const std::string& filename, float maxZ,
                 // We can sort of "normalize" the timestamp to start at 0 this way.
                 float relativeTimestamp = static_cast<float>(evtTimestamp - earliestTimestamp);
                 glm::vec4 evt_xytp = glm::vec4(
-                    static_cast<float>(evt.x()),
-                    static_cast<float>(evt.y()),
+                    static_cast<float>(evt.x),
+                    static_cast<float>(evt.y),
                     relativeTimestamp,
-                    static_cast<float>(evt.polarity()) // (float)true == 1.0f, (float)false == 0.0f
+                    static_cast<float>(evt.polarity) // 1.0f positive, 0.0f negative
                 );
 
                 // streamEvtParticles stores streamed data with relative (normalized) timestamps
                 streamEvtParticles.push_back(evt_xytp);    
             } 
+            ratePyramid.append(batch, earliestTimestamp);
+            if (timeSurface.isStreamed()) {
+                timeSurface.ingest(batch, glm::ivec2(camera_resolution), earliestTimestamp);
+            }
+            if (voxelExporter.isActive() && voxelExporter.isStreamed()) {
+                voxelExporter.feed(batch);
+            }
             
         }
         else
@@ -270,6 +346,7 @@ int EventData::streamParticlesFromFile(const std::string& filename, float maxZ,
     // Earliest data should show up further along the box
     // Latest data in batch should be at zero position
     evtParticles.clear(); // Stores the actual particles to be drawn in the box
+    scaledTimeDensity = particleTimeDensity;
     for (glm::vec4 &evt_xytp : streamEvtParticles)
     {
         // streamTime is adjusted time such that the latest particles show up at z = 0
@@ -284,6 +361,18 @@ int EventData::streamParticlesFromFile(const std::string& filename, float maxZ,
 
     // This is a patch solution. The evtParticles vector must be sorted from ascending order of timestamps to work.
     std::reverse(evtParticles.begin(), evtParticles.end()); // Necessary to ensure digital coded exposure functionality works
+    hostVersion++;
+
+    // Every event is re-timed relative to the newest one, so the index is rebuilt rather than appended to
+    timeIndex.build(evtParticles);
+    if (autoPixelIndex) {
+        buildPixelIndex();
+    }
+    else {
+        pixelIndex.clear(); // Stale
+    }
+    spatialIndex.clear(); // Rebuilt by the next query
+    pickedEvent = -1;
 
     frameCameraData.clear(); // Stores the actual frames to be drawn as textures in the box
     for (auto& frameDatum : streamFrameCameraData)
@@ -314,6 +403,7 @@ void EventData::initParticlesEmpty() {
     // TODO: This is arbitrary, we can should define as a constant somewhere
     // Apply scale
     this->diffScale = 5.0f;
+    this->scaledTimeDensity = 1.0f;
     for (auto &evt : evtParticles) {
         evt.z *= diffScale;
     }
@@ -321,6 +411,8 @@ void EventData::initParticlesEmpty() {
     timeWindow_L = 0.0f;
     timeWindow_R = 1.0f;
 
+    timeIndex.build(evtParticles);
+
     // Normalize the timestamp of the min/max XYZ for bounding box
     this->minXYZ = glm::vec3(0.0f,0.0f,0.0f);
     this->maxXYZ = glm::vec3(0.0f,0.0f,0.0f);
@@ -559,6 +651,22 @@ void EventData::drawInstanced(MatrixStack &MV, MatrixStack &P, Program &progInst
 
     size_t instCt = std::max(1ULL, evtParticles.size());
 
+    // GPU event filters hide instances through the visibility bitmask, nothing is re-uploaded
+    if (visibility.isActive())
+    {
+        if (!computeInitialized)
+        {
+            initComputeShader();
+            initComputeBuffers();
+        }
+        else
+        {
+            syncComputeBuffers(); // the mask must match this frame's events
+        }
+        updateVisibility();
+        visibility.bind();
+    }
+
     // glBindVertexArray(meshSphere.getVAOID());
 
     glBindBuffer(GL_ARRAY_BUFFER, instVBO);
@@ -583,6 +691,13 @@ void EventData::drawInstanced(MatrixStack &MV, MatrixStack &P, Program &progInst
     glUniform1f(progInst.getUniform("particleScale"), particleScale);
     glUniform3fv(progInst.getUniform("negColor"), 1, glm::value_ptr(negColor));
     glUniform3fv(progInst.getUniform("posColor"), 1, glm::value_ptr(posColor));
+    glUniform1i(progInst.getUniform("useVisibility"), visibility.isApplied());
+    bool useSelection = computeInitialized && selection.hasSelection(dataVersion);
+    if (useSelection) {
+        selection.bind();
+    }
+    glUniform1i(progInst.getUniform("useSelection"), useSelection);
+    glUniform3fv(progInst.getUniform("selectColor"), 1, glm::value_ptr(selectColor));
 
     // meshSphere.draw(prog, true, 0, instCt);
     glPointSize((GLfloat)particleScale);
@@ -626,29 +741,38 @@ void EventData::initComputeShader()
         resourceDir = "resources/";
     }
 
-    computeProg.setShaderName(resourceDir + "digital_shutter.comp");
-    if (!computeProg.init())
+    // Variants are compiled per contribution function on first use
+    shutterKernels.setup(resourceDir + "digital_shutter.comp", { "eventBound_L", "eventBound_R", "spaceWindow",
+        "funcFreq", "funcWidth", "shutterCenterT", "shutterEndT", "baseContribution" },
+        { "POSITIVE_ONLY", "COMPUTE_MOMENTS", "VISIBILITY" }); // Order matches SHUTTER_POSITIVE_ONLY, SHUTTER_MOMENTS, SHUTTER_VISIBILITY
+    if (!shutterKernels.get(ContributionRegistry::BOX))
     {
         printf("Failed to initialize compute shader\n");
         return;
     }
 
-    // Add uniforms
-    computeProg.bind();
-    computeProg.addUniform("eventBound_L");
-    computeProg.addUniform("eventBound_R");
-    computeProg.addUniform("spaceWindow");
-    computeProg.addUniform("isPositiveOnly");
-    computeProg.addUniform("useMorlet");
-    computeProg.addUniform("morletFreq");
-    computeProg.addUniform("morletCenterT");
-    computeProg.addUniform("morletH");
-    computeProg.addUniform("baseContribution");
-    computeProg.unbind();
+    momentReduceProg.setShaderName(resourceDir + "moment_reduce.comp");
+    if (!momentReduceProg.init())
+    {
+        printf("Failed to initialize moment reduction shader\n");
+        return;
+    }
+
+    momentReduceProg.bind();
+    momentReduceProg.addUniform("numPartials");
+    momentReduceProg.unbind();
 
     computeInitialized = true;
 }
 
+void EventData::syncComputeBuffers()
+{
+    if (hostVersion != uploadedHostVersion)
+    {
+        initComputeBuffers();
+    }
+}
+
 void EventData::initComputeBuffers()
 {
     if (evtParticles.empty())
@@ -665,6 +789,8 @@ void EventData::initComputeBuffers()
     glBufferData(GL_SHADER_STORAGE_BUFFER, evtParticles.size() * sizeof(glm::vec4), 
                  evtParticles.data(), GL_DYNAMIC_READ);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    dataVersion++;
+    uploadedHostVersion = hostVersion;
 
     // Create output data SSBO (max size = input size)
     if (outputDataSSBO == 0)
@@ -676,19 +802,134 @@ void EventData::initComputeBuffers()
                  nullptr, GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    // Create counters SSBO (outputCount, rollingXBits, rollingYBits)
+    // Create counters SSBO (vertexCount, outputCount, firstVertex, baseInstance), also the indirect draw command
     if (countersSSBO == 0)
     {
         glGenBuffers(1, &countersSSBO);
     }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, countersSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Create partial moments SSBO (one set of NUM_MOMENTS per work group of 256 events)
+    size_t maxWorkGroups = (evtParticles.size() + 255) / 256;
+    if (partialMomentsSSBO == 0)
+    {
+        glGenBuffers(1, &partialMomentsSSBO);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, partialMomentsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, maxWorkGroups * NUM_MOMENTS * sizeof(float), nullptr, GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Create final moments SSBO
+    if (momentsSSBO == 0)
+    {
+        glGenBuffers(1, &momentsSSBO);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, momentsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_MOMENTS * sizeof(GLdouble), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Readback ring, only allocated once since its size does not depend on the data
+    for (ReadbackSlot &slot : readbackRing)
+    {
+        if (slot.buffer == 0)
+        {
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, 4 * sizeof(GLuint) + NUM_MOMENTS * sizeof(GLdouble), nullptr, GL_STREAM_READ);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+    }
     
     GLSL::checkError(GET_FILE_LINE);
 }
 
-void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, bool morlet, float freq, bool pca)
+void EventData::queueReadback(bool withMoments)
+{
+    ReadbackSlot &slot = readbackRing[readbackHead];
+    if (slot.fence) // Ring is full, the oldest result is stale anyway so drop it
+    {
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, countersSSBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 4 * sizeof(GLuint));
+    if (withMoments)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, momentsSSBO);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 4 * sizeof(GLuint), NUM_MOMENTS * sizeof(GLdouble));
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.generation = ++dispatchGeneration;
+    slot.hasMoments = withMoments;
+    readbackHead = (readbackHead + 1) % READBACK_RING_SIZE;
+}
+
+bool EventData::pollReadbacks()
+{
+    bool latestArrived = false;
+
+    // Walk from the oldest slot; the GPU retires fences in order so stop at the first unfinished one
+    for (int i = 0; i < READBACK_RING_SIZE; i++)
+    {
+        ReadbackSlot &slot = readbackRing[(readbackHead + i) % READBACK_RING_SIZE];
+        if (!slot.fence)
+        {
+            continue;
+        }
+
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+        if (slot.generation <= consumedGeneration)
+        {
+            continue;
+        }
+
+        GLuint counters[4];
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counters), counters);
+        if (slot.hasMoments)
+        {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(counters), NUM_MOMENTS * sizeof(GLdouble), readbackMoments);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        readbackCount = counters[1];
+        readbackHasMoments = slot.hasMoments;
+        consumedGeneration = slot.generation;
+        latestArrived = consumedGeneration == dispatchGeneration;
+    }
+
+    return latestArrived;
+}
+
+void EventData::waitReadbacks()
+{
+    const GLuint64 timeout = 1000000000; // 1 s in ns, a lost context should not hang the export
+    for (ReadbackSlot &slot : readbackRing)
+    {
+        if (slot.fence)
+        {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        }
+    }
+    pollReadbacks();
+}
+
+void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, int funcID, float freq, bool pca, bool weightedPCA, bool incremental,
+    bool waitForMoments)
 {
     float timeBound_L, timeBound_R;
     int eventBound_L, eventBound_R;
@@ -720,45 +961,93 @@ void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, bool mor
         initComputeShader();    
         initComputeBuffers();   
     }
-   
-    if (computeInitialized || isStreaming) // If streaming, must update data
+    else
     {
-        initComputeBuffers();
+        syncComputeBuffers(); // Streamed data changes every update
     }
 
-    float rollingX(0), rollingY(0);
-    float f = freq / 1000000 / diffScale;
+    // GPU event filters, the bitmask is only recomputed when a filter or the data changed
+    updateVisibility();
+    bool useVisibility = visibility.isApplied();
+
+    // A function that fails to compile (user GLSL) falls back to the box
+    unsigned features = (isPositiveOnly ? SHUTTER_POSITIVE_ONLY : 0u) | (pca ? SHUTTER_MOMENTS : 0u) |
+        (useVisibility ? SHUTTER_VISIBILITY : 0u);
+    ComputeProgram *computeProg = computeInitialized ? shutterKernels.get(funcID, features) : nullptr;
+    if (!computeProg)
+    {
+        funcID = ContributionRegistry::BOX;
+        computeProg = computeInitialized ? shutterKernels.get(funcID, features) : nullptr;
+    }
+    const ContributionFunction &func = ContributionRegistry::instance().get(funcID);
+
+    // Time independent function without PCA: slide the persistent accumulation, cost scales with how far the window moved
+    if (incremental && !func.usesTime && !pca && !useVisibility && computeInitialized && !evtParticles.empty() && eventBound_L <= eventBound_R &&
+        slidingAccumulator.init(resourceDir))
+    {
+        glm::ivec2 resolution(camera_resolution);
+        bool changed = slidingAccumulator.update(evtParticlesSSBO, dataVersion, resolution, eventBound_L, eventBound_R,
+            spaceWindow, isPositiveOnly, BaseFunc::contribution);
+        slidingAccumulator.draw(glm::ivec2(minXYZ), glm::min(glm::ivec2(maxXYZ), resolution - 1), viewport_resolution);
+
+        // The window count goes through the same readback ring as the dispatch counters, so getDCEOutputCount() follows
+        if (changed || hasDispatched)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, slidingAccumulator.getCountBuffer());
+            glBindBuffer(GL_COPY_WRITE_BUFFER, countersSSBO);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(GLuint), sizeof(GLint));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            queueReadback(false);
+        }
+        hasDispatched = false; // the counters no longer describe a point dispatch, switching back dispatches again
+        GLSL::checkError(GET_FILE_LINE);
+        return;
+    }
+
+    float f = freq / 1000000 / getTimeScale();
+    float center_t = timeBound_L + (timeBound_R - timeBound_L) * 0.5f;
+
+    // Nothing that affects the output changed since the last dispatch; redraw what is already on the GPU
+    DCEDispatchKey key = { eventBound_L, eventBound_R, center_t, timeBound_R, spaceWindow, isPositiveOnly, funcID, func.revision,
+        pca, f, MorletFunc::h, BaseFunc::contribution, visibility.getVersion() };
+    bool needsDispatch = !hasDispatched || isStreaming || !(key == lastDispatchKey);
 
-    GLuint outputCount = 0;
-    
     // Use GPU compute shader for event processing
-    if (computeInitialized && !evtParticles.empty() && eventBound_L <= eventBound_R)
+    if (!computeProg || evtParticles.empty() || eventBound_L > eventBound_R)
+    {
+        hasDispatched = false;
+    }
+    else if (needsDispatch)
     {
         // Bind SSBOs to their binding points
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, outputDataSSBO);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countersSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, partialMomentsSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, momentsSSBO);
+        if (useVisibility)
+        {
+            visibility.bind();
+        }
         
-        // Reset counters
-        GLuint resetData[3] = {0, 0, 0};
+        // Reset counters, which double as the indirect draw command (1 vertex, outputCount instances)
+        GLuint resetData[4] = {1, 0, 0, 0};
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, countersSSBO);
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, 3 * sizeof(GLuint), resetData);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(resetData), resetData);
         glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
         // Bind compute shader and set uniforms
-        computeProg.bind();
+        computeProg->bind();
         
-        float center_t = timeBound_L + (timeBound_R - timeBound_L) * 0.5f;
-        
-        glUniform1i(computeProg.getUniform("eventBound_L"), eventBound_L);
-        glUniform1i(computeProg.getUniform("eventBound_R"), eventBound_R);
-        glUniform4fv(computeProg.getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
-        glUniform1i(computeProg.getUniform("isPositiveOnly"), isPositiveOnly ? 1 : 0);
-        glUniform1i(computeProg.getUniform("useMorlet"), morlet ? 1 : 0);
-        glUniform1f(computeProg.getUniform("morletFreq"), f);
-        glUniform1f(computeProg.getUniform("morletCenterT"), center_t);
-        glUniform1f(computeProg.getUniform("morletH"), MorletFunc::h);
-        glUniform1f(computeProg.getUniform("baseContribution"), BaseFunc::contribution);
+        glUniform1i(computeProg->getUniform("eventBound_L"), eventBound_L);
+        glUniform1i(computeProg->getUniform("eventBound_R"), eventBound_R);
+        glUniform4fv(computeProg->getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+        glUniform1f(computeProg->getUniform("funcFreq"), f);
+        glUniform1f(computeProg->getUniform("funcWidth"), MorletFunc::h);
+        glUniform1f(computeProg->getUniform("shutterCenterT"), center_t);
+        glUniform1f(computeProg->getUniform("shutterEndT"), timeBound_R);
+        glUniform1f(computeProg->getUniform("baseContribution"), BaseFunc::contribution);
 
         // Dispatch compute shader
         int numEvents = eventBound_R - eventBound_L + 1;
@@ -768,33 +1057,42 @@ void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, bool mor
         
         if (numWorkGroups > 0)
         {
-            computeProg.dispatch(numWorkGroups, 1, 1);
+            computeProg->dispatch(numWorkGroups, 1, 1);
         }
         
         GLSL::checkError(GET_FILE_LINE);
 
-        // Memory barrier to ensure compute shader writes are visible
-        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        // Memory barrier to ensure compute shader writes are visible to the draw, the indirect command and the copies below
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | 
+            GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
 
-        computeProg.unbind();
+        computeProg->unbind();
 
-        // Read back only the counters (small data - not a bottleneck)
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countersSSBO);
-        GLuint counters[3];
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, 3 * sizeof(GLuint), counters);
-        outputCount = counters[0];
-        rollingX = *reinterpret_cast<float*>(&counters[1]);
-        rollingY = *reinterpret_cast<float*>(&counters[2]);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        // Fold the per work group partial moments on the GPU, only NUM_MOMENTS values leave the device
+        if (pca && numWorkGroups > 0)
+        {
+            momentReduceProg.bind();
+            glUniform1ui(momentReduceProg.getUniform("numPartials"), static_cast<GLuint>(numWorkGroups));
+            momentReduceProg.dispatch(1, 1, 1);
+            momentReduceProg.unbind();
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        }
+
+        // Counters and moments are consumed a frame or two later through pollReadbacks(), no stall here
+        queueReadback(pca);
+
+        hasDispatched = true;
+        lastDispatchKey = key;
     }
 
-    // Render directly from GPU buffer (no CPU readback!)
-    if (outputCount > 0)
+    // Render directly from GPU buffer, the instance count comes from the counters written by the shader
+    if (hasDispatched)
     {
         glBindVertexArray(VAO);
         
         // Bind the SSBO as a vertex buffer - no data copy needed!
         glBindBuffer(GL_ARRAY_BUFFER, outputDataSSBO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, countersSSBO);
 
         prog.bind();
 
@@ -805,47 +1103,41 @@ void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, bool mor
 
         glm::mat4 projection = glm::ortho(minXYZ.x, maxXYZ.x, minXYZ.y, maxXYZ.y);
         glUniformMatrix4fv(prog.getUniform("projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glDrawArraysInstanced(GL_POINTS, 0, 1, static_cast<GLsizei>(outputCount));
+        glDrawArraysIndirect(GL_POINTS, nullptr);
 
         prog.unbind();
 
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     }
 
-    if (pca && outputCount > 0)
+    // An export draws each frame once and cannot wait for that redraw
+    if (pca && waitForMoments && hasDispatched)
     {
-        // PCA requires CPU-side data - read back only when needed
-        std::vector<glm::vec3> pcaData(outputCount);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, outputDataSSBO);
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, outputCount * sizeof(glm::vec3), pcaData.data());
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-        
-        // Calculate mean
-        float inverseNumElems = 1.0f / static_cast<float>(outputCount);
-        float mean_x = rollingX * inverseNumElems;
-        float mean_y = rollingY * inverseNumElems;
-
-        // Calculate covariance
-        float cov_x_x(0.0f), cov_x_y(0.0f), cov_y_y(0.0f);
-#pragma omp parallel
-        {
-#pragma omp for reduction(+ : cov_x_y) reduction(+ : cov_x_x) reduction(+ : cov_y_y)
-            for (int i = 0; i < (int)outputCount; i++)
-            {
-                float x = pcaData[i].x;
-                float y = pcaData[i].y;
+        waitReadbacks();
+    }
 
-                cov_x_y += (x - mean_x) * (y - mean_y);
-                cov_x_x += (x - mean_x) * (x - mean_x);
-                cov_y_y += (y - mean_y) * (y - mean_y);
-            }
-        }
+    // PCA only uses moments that belong to the current dispatch; pollReadbacks() requests a redraw once they land
+    GLuint outputCount = readbackCount;
+    GLdouble *moments = readbackMoments;
+    bool momentsCurrent = hasDispatched && consumedGeneration == dispatchGeneration && readbackHasMoments;
 
-        inverseNumElems = 1.0f / (static_cast<float>(outputCount) - 1.0f);
-        cov_x_y *= inverseNumElems;
-        cov_x_x *= inverseNumElems;
-        cov_y_y *= inverseNumElems;
+    // Weighted moments start at index 6, see digital_shutter.comp
+    const GLdouble *m = weightedPCA ? moments + NUM_MOMENTS / 2 : moments;
+    if (pca && momentsCurrent && outputCount > 1 && m[0] > 0.0)
+    {
+        // Mean and (sample) covariance straight from the reduced raw moments
+        double n = m[0];
+        double mean_xd = m[1] / n;
+        double mean_yd = m[2] / n;
+        double correction = weightedPCA ? 1.0 : n / (n - 1.0); // Bessel's correction for plain counts only
+
+        float mean_x = static_cast<float>(mean_xd);
+        float mean_y = static_cast<float>(mean_yd);
+        float cov_x_x = static_cast<float>((m[3] / n - mean_xd * mean_xd) * correction);
+        float cov_x_y = static_cast<float>((m[4] / n - mean_xd * mean_yd) * correction);
+        float cov_y_y = static_cast<float>((m[5] / n - mean_yd * mean_yd) * correction);
 
         // Eigenvalue calculation
         float a = 1;
@@ -887,9 +1179,443 @@ void EventData::drawFrame(Program &prog, glm::vec2 viewport_resolution, bool mor
     GLSL::checkError(GET_FILE_LINE);
 }
 
+std::vector<ShutterRange> EventData::buildShutterRanges(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E,
+    int firstFrame) const
+{
+    std::vector<ShutterRange> ranges;
+    if (evtParticles.empty())
+    {
+        return ranges;
+    }
+
+    uint maxEvent = getMaxEvent() - 1;
+    for (int k = firstFrame; k < firstFrame + numFrames; k++)
+    {
+        ShutterRange range{};
+        if (eventPeriod)
+        {
+            uint windowStart = std::min(maxEvent, eventWindow_L + k * framePeriod_E);
+            range.eventBound_L = static_cast<int>(std::min(maxEvent, windowStart + eventShutterWindow_L));
+            range.eventBound_R = static_cast<int>(std::min(maxEvent, windowStart + eventShutterWindow_R));
+            range.centerT = 0.5f * (getTimestamp(range.eventBound_L) + getTimestamp(range.eventBound_R));
+            range.endT = getTimestamp(range.eventBound_R);
+        }
+        else
+        {
+            float windowStart = std::min(getMaxTimestamp(), timeWindow_L + k * framePeriod_T);
+            float timeBound_L = windowStart + timeShutterWindow_L;
+            float timeBound_R = windowStart + timeShutterWindow_R;
+            range.eventBound_L = static_cast<int>(getFirstEvent(timeBound_L));
+            range.eventBound_R = static_cast<int>(getLastEvent(timeBound_R));
+            range.centerT = timeBound_L + (timeBound_R - timeBound_L) * 0.5f;
+            range.endT = timeBound_R;
+        }
+        ranges.push_back(range);
+    }
+
+    return ranges;
+}
+
+void EventData::drawTimeSurface(glm::vec2 viewport_resolution, float tau, int mode)
+{
+    if (!timeSurface.init(resourceDir))
+    {
+        return;
+    }
+    glm::ivec2 resolution(camera_resolution);
+
+    int64_t queryTime = 0;
+    if (isStreaming)
+    {
+        // The resident events are re-timed every batch, so the surface follows the ingest instead,
+        // seeded once from what was streamed before it was first shown
+        if (!timeSurface.isStreamed())
+        {
+            timeSurface.ingest(streamEvtParticles, resolution);
+        }
+        timeSurface.updateStreamed(resolution);
+        queryTime = static_cast<int64_t>(latestTimestamp - earliestTimestamp);
+    }
+    else
+    {
+        if (evtParticles.empty())
+        {
+            return;
+        }
+        if (!computeInitialized)
+        {
+            initComputeShader();
+            initComputeBuffers();
+        }
+        updateVisibility();
+        if (visibility.isApplied())
+        {
+            visibility.bind();
+        }
+
+        // Same shutter end as drawFrame, events older than the decay horizon cannot show
+        int last = static_cast<int>(evtParticles.size()) - 1;
+        int eventEnd = std::clamp(static_cast<int>(eventWindow_L + eventShutterWindow_R), 0, last);
+        float queryNorm = shutterType == TIME_SHUTTER ? timeWindow_L + timeShutterWindow_R : evtParticles[eventEnd].z;
+        float toMicros = 1.0f / getTimeScale();
+        int horizonBegin = static_cast<int>(timeIndex.lowerBound(queryNorm - TimeSurface::HORIZON * tau / toMicros));
+        queryTime = std::llround(static_cast<double>(queryNorm) * toMicros);
+        timeSurface.update(evtParticlesSSBO, dataVersion, resolution, std::min(horizonBegin, eventEnd), eventEnd, toMicros,
+            queryTime, visibility.getVersion());
+    }
+
+    timeSurface.draw(queryTime, tau, mode, posColor, negColor, glm::ivec2(minXYZ), glm::min(glm::ivec2(maxXYZ), resolution - 1),
+        viewport_resolution);
+}
+
+void EventData::drawFrameBatch(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E, int funcID, float freq)
+{
+    if (!computeInitialized)
+    {
+        initComputeShader();
+        initComputeBuffers();
+    }
+    if (!computeInitialized || evtParticles.empty() || !frameBatch.init(resourceDir))
+    {
+        return;
+    }
+
+    std::vector<ShutterRange> ranges = buildShutterRanges(numFrames, eventPeriod, framePeriod_T, framePeriod_E);
+    float f = freq / 1000000 / getTimeScale();
+    updateVisibility();
+    visibility.bind();
+    frameBatch.render(evtParticlesSSBO, ranges, glm::ivec2(camera_resolution), spaceWindow, isPositiveOnly,
+        funcID, f, MorletFunc::h, BaseFunc::contribution, visibility.isApplied());
+    frameBatch.resolveLayer(0);
+}
+
+bool EventData::beginFrameExport(const std::string &basePath, int numFrames, bool eventPeriod, float framePeriod_T,
+    uint framePeriod_E, int funcID, float freq)
+{
+    // Streaming re-times every event on each update, the index would not describe the frames
+    if (isStreaming || evtParticles.empty() || numFrames <= 0 || !frameExporter.getBatch().init(resourceDir))
+    {
+        frameExporter.getRequest() = false;
+        return false;
+    }
+    if (!computeInitialized)
+    {
+        initComputeShader();
+        initComputeBuffers();
+    }
+
+    double timeToSeconds = 1.0 / 1000000 / getTimeScale(); // normalized time back to seconds
+    return frameExporter.begin(basePath, buildShutterRanges(numFrames, eventPeriod, framePeriod_T, framePeriod_E),
+        glm::ivec2(camera_resolution), timeToSeconds, funcID, freq / 1000000 / getTimeScale());
+}
+
+void EventData::stepFrameExport()
+{
+    std::vector<ShutterRange> chunk = frameExporter.nextChunk();
+    if (!chunk.empty())
+    {
+        updateVisibility();
+        visibility.bind();
+        frameExporter.getBatch().render(evtParticlesSSBO, chunk, glm::ivec2(camera_resolution), spaceWindow, isPositiveOnly,
+            frameExporter.getFuncID(), frameExporter.getFreq(), MorletFunc::h, BaseFunc::contribution, visibility.isApplied());
+        frameExporter.queueReadback(static_cast<int>(chunk.size()));
+    }
+    frameExporter.finishIfDone();
+}
+
+bool EventData::beginVoxelExport(const std::string &path)
+{
+    if (!isStreaming && evtParticles.empty())
+    {
+        voxelExporter.getRequest() = false;
+        return false;
+    }
+    return voxelExporter.begin(path, glm::ivec2(camera_resolution), isStreaming);
+}
+
+void EventData::stepVoxelExport()
+{
+    if (!voxelExporter.isActive() || voxelExporter.isStreamed())
+    {
+        return;
+    }
+
+    // A bounded chunk per frame keeps the UI responsive, the exporter only holds the open windows
+    const size_t chunkEvents = 1 << 20;
+    size_t &nextEvent = voxelExporter.getNextEvent();
+    size_t end = std::min(evtParticles.size(), nextEvent + chunkEvents);
+    double toMicros = 1.0 / getTimeScale(); // normalized time back to microseconds, same as the streamed path
+
+    std::vector<FilterEvent> chunk(end - nextEvent);
+    for (size_t i = nextEvent; i < end; i++)
+    {
+        const glm::vec4 &evt = evtParticles[i];
+        chunk[i - nextEvent] = { static_cast<int64_t>(std::llround(evt.z * toMicros)), static_cast<int16_t>(evt.x),
+            static_cast<int16_t>(evt.y), static_cast<uint8_t>(evt.w > 0.5f ? 1 : 0) };
+    }
+    voxelExporter.feed(chunk);
+    nextEvent = end;
+
+    if (nextEvent >= evtParticles.size())
+    {
+        voxelExporter.finish();
+    }
+}
+
+bool EventData::drawFramePrefetched(int numFrames, bool eventPeriod, float framePeriod_T, uint framePeriod_E,
+    int funcID, float freq, double presentTime)
+{
+    // Streaming re-times every event on each update, nothing rendered ahead would stay valid
+    if (isStreaming || evtParticles.empty() || numFrames <= 0)
+    {
+        return false;
+    }
+    if (!computeInitialized)
+    {
+        initComputeShader();
+        initComputeBuffers();
+    }
+    if (!computeInitialized || !playbackPrefetch.init(resourceDir))
+    {
+        return false;
+    }
+
+    const ContributionFunction &func = ContributionRegistry::instance().get(funcID);
+    updateVisibility();
+    visibility.bind();
+    PrefetchKey key = { spaceWindow, isPositiveOnly, funcID, func.revision, freq / 1000000 / getTimeScale(), MorletFunc::h,
+        BaseFunc::contribution, eventPeriod, framePeriod_T, framePeriod_E, glm::ivec2(camera_resolution), dataVersion,
+        visibility.getVersion() };
+    playbackPrefetch.validate(key);
+    numFrames = std::min(numFrames, FrameBatch::MAX_LAYERS);
+
+    // Miss (first frame, seek or changed settings): render from the current window into the front slot
+    ShutterRange current = buildShutterRanges(1, eventPeriod, framePeriod_T, framePeriod_E).front();
+    int layer = 0;
+    int slot = playbackPrefetch.find(current, layer);
+    bool hit = slot >= 0;
+    if (!hit)
+    {
+        slot = playbackPrefetch.getFront();
+        playbackPrefetch.fill(slot, buildShutterRanges(numFrames, eventPeriod, framePeriod_T, framePeriod_E), evtParticlesSSBO);
+        if (playbackPrefetch.find(current, layer) != slot)
+        {
+            return false; // the function failed to compile
+        }
+        playbackPrefetch.invalidateBack();
+    }
+    playbackPrefetch.show(slot, layer);
+
+    // Queue the frames after the front slot so they render while these are displayed, on a later frame
+    // than a miss so one frame never issues both batch dispatches
+    int back = playbackPrefetch.getBack();
+    if (hit && !playbackPrefetch.isFilled(back))
+    {
+        int ahead = playbackPrefetch.getNumLayers(slot) - layer;
+        playbackPrefetch.fill(back, buildShutterRanges(numFrames, eventPeriod, framePeriod_T, framePeriod_E, ahead),
+            evtParticlesSSBO);
+    }
+
+    playbackPrefetch.notePresented(presentTime, hit);
+    return true;
+}
+
+void EventData::runFilterBank(int numFilters, float minFreq, float maxFreq, float cycles)
+{
+    if (!computeInitialized)
+    {
+        initComputeShader();
+        initComputeBuffers();
+    }
+    if (!computeInitialized || evtParticles.empty() || numFilters <= 0 || !filterBank.init(resourceDir))
+    {
+        return;
+    }
+
+    // Logarithmically spaced, converted to the normalized units the shaders use (same as drawFrame)
+    numFilters = std::min(numFilters, FilterBank::MAX_FILTERS);
+    minFreq = std::max(minFreq, 0.001f);
+    maxFreq = std::max(maxFreq, minFreq);
+    std::vector<BankFilter> filters(numFilters);
+    for (int k = 0; k < numFilters; k++)
+    {
+        float x = numFilters > 1 ? static_cast<float>(k) / (numFilters - 1) : 0.0f;
+        float freq = minFreq * std::pow(maxFreq / minFreq, x);
+        filters[k].freq = freq / 1000000 / getTimeScale();
+        filters[k].fwhm = cycles > 0.0f ? cycles / filters[k].freq : MorletFunc::h;
+        filters[k].fwhm = std::max(filters[k].fwhm, 1e-6f);
+    }
+
+    float timeBound_L = timeWindow_L + timeShutterWindow_L;
+    float timeBound_R = timeWindow_L + timeShutterWindow_R;
+    int eventBound_L = eventWindow_L + eventShutterWindow_L;
+    int eventBound_R = std::min(eventWindow_L + eventShutterWindow_R, getMaxEvent() - 1);
+    float centerT = timeBound_L + (timeBound_R - timeBound_L) * 0.5f;
+
+    filterBank.run(evtParticlesSSBO, filters, glm::ivec2(camera_resolution), eventBound_L, eventBound_R,
+        centerT, spaceWindow, isPositiveOnly);
+}
+
+void EventData::runSpectrum(bool gpu, int numBins, float minFreq, float maxFreq)
+{
+    if (evtParticles.empty() || numBins <= 0)
+    {
+        return;
+    }
+
+    minFreq = std::max(minFreq, 0.0f);
+    maxFreq = std::max(maxFreq, minFreq);
+    float timeToSeconds = 1.0f / 1000000 / getTimeScale(); // inverse of the frequency conversion in drawFrame
+    float t0 = timeWindow_L;
+
+    // Both backends analyse the same event range
+    int eventBound_L = eventWindow_L;
+    int eventBound_R = std::min(eventWindow_R, getMaxEvent() - 1);
+
+    if (gpu)
+    {
+        if (!computeInitialized)
+        {
+            initComputeShader();
+            initComputeBuffers();
+        }
+        if (!computeInitialized || !spectrumAnalyzer.init(resourceDir))
+        {
+            return;
+        }
+
+        spectrumAnalyzer.analyzeGPU(evtParticlesSSBO, glm::ivec2(camera_resolution), eventBound_L, eventBound_R, t0,
+            timeToSeconds, minFreq, maxFreq, numBins, spaceWindow, isPositiveOnly);
+    }
+    else
+    {
+        if (!pixelIndex.isBuilt())
+        {
+            buildPixelIndex();
+        }
+        spectrumAnalyzer.analyzeCPU(evtParticles, pixelIndex, eventBound_L, eventBound_R, t0, timeToSeconds, minFreq, maxFreq, numBins,
+            spaceWindow, isPositiveOnly);
+    }
+}
+
+void EventData::runPixelStatistics(bool gpu, bool shutter)
+{
+    if (evtParticles.empty())
+    {
+        return;
+    }
+
+    float timeToSeconds = 1.0f / 1000000 / getTimeScale();
+    float t0 = shutter ? timeWindow_L + timeShutterWindow_L : timeWindow_L;
+    float t1 = shutter ? timeWindow_L + timeShutterWindow_R : timeWindow_R;
+
+    // Both backends select the window by event index
+    int eventBound_L = shutter ? eventWindow_L + eventShutterWindow_L : eventWindow_L;
+    int eventBound_R = std::min(shutter ? eventWindow_L + eventShutterWindow_R : eventWindow_R, getMaxEvent() - 1);
+
+    if (gpu)
+    {
+        if (!computeInitialized)
+        {
+            initComputeShader();
+            initComputeBuffers();
+        }
+        if (!computeInitialized || !pixelStatistics.init(resourceDir))
+        {
+            return;
+        }
+        if (!pixelIndex.isBuilt())
+        {
+            buildPixelIndex();
+        }
+        pixelStatistics.computeGPU(evtParticlesSSBO, pixelIndex, dataVersion, eventBound_L, eventBound_R, t0, t1, timeToSeconds,
+            spaceWindow);
+    }
+    else
+    {
+        pixelStatistics.computeCPU(evtParticles, glm::ivec2(camera_resolution), eventBound_L, eventBound_R, t0, t1,
+            timeToSeconds, spaceWindow);
+    }
+}
+
+void EventData::updateClusters()
+{
+    if (evtParticles.empty())
+    {
+        return;
+    }
+
+    // Same shutter as drawFrame
+    int eventBound_L = eventWindow_L + eventShutterWindow_L;
+    int eventBound_R = std::min(eventWindow_L + eventShutterWindow_R, getMaxEvent() - 1);
+    clusterTracker.update(evtParticles, eventBound_L, eventBound_R, spaceWindow, isPositiveOnly);
+}
+
+void EventData::drawClusters()
+{
+    const std::vector<Cluster> &clusters = clusterTracker.getClusters();
+    if (clusters.empty())
+    {
+        return;
+    }
+
+    // Same camera space as the PCA overlay
+    glm::mat4 projection = glm::ortho(minXYZ.x, maxXYZ.x, minXYZ.y, maxXYZ.y);
+    auto toCamera = [&](glm::vec2 p) { return glm::vec2(projection * glm::vec4(p, 0.0f, 1.0f)); };
+    auto trackColor = [](int id) { return FilterBank::colorMap(glm::fract(id * 0.618034f)); }; // golden ratio spreads hues
+
+    glDisable(GL_BLEND);
+    glLineWidth(2.0f);
+
+    // 2 sigma ellipse along the principal axes of every cluster
+    const int segments = 32;
+    for (const Cluster &cluster : clusters)
+    {
+        glm::vec3 color = trackColor(cluster.trackID);
+        glm::vec2 major(std::cos(cluster.angle), std::sin(cluster.angle));
+        glm::vec2 minor(-major.y, major.x);
+        glColor3f(color.r, color.g, color.b);
+        glBegin(GL_LINE_LOOP);
+        for (int k = 0; k < segments; k++)
+        {
+            float a = 2.0f * glm::pi<float>() * k / segments;
+            glm::vec2 p = toCamera(cluster.mean + 2.0f * (std::cos(a) * cluster.sigma.x * major + std::sin(a) * cluster.sigma.y * minor));
+            glVertex2f(p.x, p.y);
+        }
+        glEnd();
+    }
+
+    // Recent centroids of every live track
+    int trailLength = std::max(clusterTracker.getSettings().trailLength, 0);
+    for (const Track &track : clusterTracker.getTracks())
+    {
+        if (!track.active || track.history.size() < 2)
+        {
+            continue;
+        }
+        glm::vec3 color = trackColor(track.id);
+        glColor3f(color.r, color.g, color.b);
+        glBegin(GL_LINE_STRIP);
+        size_t first = track.history.size() > static_cast<size_t>(trailLength) ? track.history.size() - trailLength : 0;
+        for (size_t k = first; k < track.history.size(); k++)
+        {
+            glm::vec2 p = toCamera(track.history[k].pos);
+            glVertex2f(p.x, p.y);
+        }
+        glEnd();
+    }
+
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+bool EventData::exportTracks(const std::string &path) const
+{
+    double timeToSeconds = 1.0 / 1000000 / getTimeScale(); // normalized time back to seconds
+    return clusterTracker.exportCSV(path, timeToSeconds);
+}
 
 void EventData::normalizeTime() {
-    float factor = diffScale * particleTimeDensity * TIME_CONVERSION;
+    float factor = getUnitFactor();
     minXYZ.z *= factor;
     maxXYZ.z *= factor;
     timeWindow_L *= factor;
@@ -899,7 +1625,7 @@ void EventData::normalizeTime() {
 }
 
 void EventData::oddizeTime() {
-    float factor = diffScale * particleTimeDensity * TIME_CONVERSION;
+    float factor = getUnitFactor();
     minXYZ.z /= factor;
     maxXYZ.z /= factor;
     timeWindow_L /= factor;
@@ -912,30 +1638,222 @@ float EventData::getTimestamp(uint eventIndex, float oddFactor) const {
     return evtParticles[eventIndex].z / oddFactor;
 }
 
-inline bool lessVec4_t(const glm::vec4& a, const glm::vec4& b) {
-    return a.z < b.z;
+void EventData::updateVisibility() {
+    if (!computeInitialized || !visibility.isActive() || evtParticles.empty() || !visibility.init(resourceDir)) {
+        return;
+    }
+
+    // The noise filter searches neighbours in the pixel index, streaming data changes too often to keep one
+    if (visibility.getSettings().noise && !isStreaming && !pixelIndex.isBuilt()) {
+        buildPixelIndex();
+    }
+
+    const HotPixelFilter &hotPixel = filterChain->getHotPixel();
+    GLuint selectionSSBO = selection.isValid(dataVersion) ? selection.getBuffer() : 0;
+    visibility.update(evtParticlesSSBO, evtParticles.size(), glm::ivec2(camera_resolution), dataVersion, pixelIndex,
+        hotPixel.getMask(), hotPixel.getRevision(), selectionSSBO, selection.getRevision());
+}
+
+size_t EventData::detectHotPixels(float numMADs, float minRate) {
+    std::vector<uint8_t> mask = hotPixelDetector.detect(numMADs, minRate);
+    if (mask.empty()) {
+        return 0;
+    }
+
+    if (!HotPixelDetector::saveMask(getHotPixelMaskPath(), mask, glm::ivec2(camera_resolution))) {
+        printf("Failed to save hot pixel mask to %s\n", getHotPixelMaskPath().c_str());
+    }
+    filterChain->getHotPixel().setMask(std::move(mask));
+    filterChain->getHotPixel().enabled = true;
+    return hotPixelDetector.getNumDetected();
+}
+
+bool EventData::loadHotPixelMask() {
+    // A mask of another camera is wrong even at the same resolution, so fall back to none
+    std::vector<uint8_t> mask;
+    bool found = HotPixelDetector::loadMask(getHotPixelMaskPath(), glm::ivec2(camera_resolution), mask);
+    filterChain->getHotPixel().setMask(std::move(mask)); // enabled stays the user's choice
+    if (found) {
+        printf("Applied hot pixel mask %s\n", getHotPixelMaskPath().c_str());
+    }
+    return found;
+}
+
+std::string EventData::getHotPixelMaskPath() const {
+    return HotPixelDetector::getMaskPath((resourceDir.empty() ? std::string("resources/") : resourceDir) + "masks/", cameraName);
+}
+
+void EventData::buildPixelIndex() {
+    pixelIndex.build(evtParticles, glm::ivec2(camera_resolution));
+}
+
+void EventData::buildSpatialIndex() {
+    spatialIndex.build(evtParticles);
+}
+
+int EventData::pickEvent(const glm::mat4 &viewProj, const glm::vec2 &ndc, float pixelRadius, float viewportHeight) {
+    pickedEvent = -1;
+    if (evtParticles.empty()) {
+        return pickedEvent;
+    }
+    if (!spatialIndex.isBuilt()) {
+        buildSpatialIndex();
+    }
+
+    // Ray through the near and far plane points under the cursor
+    glm::mat4 inv = glm::inverse(viewProj);
+    glm::vec4 nearPoint = inv * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inv * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 dir = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+    // Tolerance in world units at the depth of the events: one pixel spans 2 * depth / (P[1][1] * height)
+    glm::vec4 clipCenter = viewProj * glm::vec4(center, 1.0f);
+    float focal = glm::length(glm::vec3(viewProj[0][1], viewProj[1][1], viewProj[2][1])); // P[1][1], the view has no scale
+    float radius = pixelRadius * 2.0f * std::max(clipCenter.w, 1e-3f) / (focal * viewportHeight);
+
+    pickedEvent = spatialIndex.pick(evtParticles, origin, dir, radius);
+    return pickedEvent;
+}
+
+void EventData::queryWindowBox(std::vector<uint32_t> &out) {
+    if (evtParticles.empty()) {
+        return;
+    }
+    if (!spatialIndex.isBuilt()) {
+        buildSpatialIndex();
+    }
+
+    // spaceWindow: x = top, y = right, z = bottom, w = left
+    size_t last = evtParticles.size() - 1;
+    glm::vec3 boxMin(spaceWindow.w, spaceWindow.x, evtParticles[std::min<size_t>(eventWindow_L, last)].z);
+    glm::vec3 boxMax(spaceWindow.y, spaceWindow.z, evtParticles[std::min<size_t>(eventWindow_R, last)].z);
+    spatialIndex.queryBox(evtParticles, boxMin, boxMax, out);
+}
+
+void EventData::queryFrustum(const glm::mat4 &viewProj, std::vector<uint32_t> &out) {
+    if (evtParticles.empty()) {
+        return;
+    }
+    if (!spatialIndex.isBuilt()) {
+        buildSpatialIndex();
+    }
+    spatialIndex.queryFrustum(evtParticles, viewProj, out);
+}
+
+void EventData::nearestEvents(uint32_t event, int k, std::vector<uint32_t> &out) {
+    out.clear();
+    if (event >= evtParticles.size()) {
+        return;
+    }
+    if (!spatialIndex.isBuilt()) {
+        buildSpatialIndex();
+    }
+    spatialIndex.nearest(evtParticles, glm::vec3(evtParticles[event]), k, out);
+}
+
+void EventData::selectLasso(const glm::mat4 &viewProj, const std::vector<glm::vec2> &polygon, int mode) {
+    if (evtParticles.empty()) {
+        return;
+    }
+    if (!computeInitialized) {
+        initComputeShader();
+        initComputeBuffers();
+    }
+    if (!selection.init(resourceDir)) {
+        return;
+    }
+
+    // Hidden events are not selectable, unless the selection is itself what hides them
+    GLuint visibilitySSBO = 0;
+    if (!visibility.getSettings().selection) {
+        updateVisibility();
+        visibilitySSBO = visibility.isApplied() ? visibility.getBuffer() : 0;
+    }
+    selection.selectLasso(evtParticlesSSBO, evtParticles.size(), dataVersion, viewProj, polygon, mode, visibilitySSBO);
+}
+
+void EventData::selectPicked(int mode) {
+    if (evtParticles.empty()) {
+        return;
+    }
+    if (!computeInitialized) {
+        initComputeShader();
+        initComputeBuffers();
+    }
+    if (!selection.init(resourceDir)) {
+        return;
+    }
+    selection.selectEvent(evtParticlesSSBO, evtParticles.size(), dataVersion, pickedEvent, mode);
+}
+
+void EventData::clearSelection() {
+    selection.clear();
+}
+
+void EventData::fitWindowsToSelection(float oddFactor) {
+    if (!hasSelection()) {
+        return;
+    }
+
+    // Events are time sorted, so the first and last selected events bound the time window too
+    const SelectionStats &stats = selection.getStats();
+    eventWindow_L = stats.firstEvent;
+    eventWindow_R = stats.lastEvent;
+    timeWindow_L = getTimestamp(eventWindow_L, oddFactor);
+    timeWindow_R = getTimestamp(eventWindow_R, oddFactor);
+    spaceWindow = glm::vec4(stats.pixelMin.y, stats.pixelMax.x, stats.pixelMax.y, stats.pixelMin.x); // top, right, bottom, left
+}
+
+bool EventData::exportSelection(const std::string &path) const {
+    std::vector<uint32_t> bits;
+    uint32_t firstEvent = selection.readBits(bits);
+    if (bits.empty()) {
+        return false;
+    }
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    double timeToSeconds = 1.0 / 1000000 / getTimeScale(); // normalized time back to seconds
+    fprintf(file, "event,x,y,time_s,polarity\n");
+    for (size_t w = 0; w < bits.size(); w++) {
+        for (uint32_t word = bits[w]; word != 0; word &= word - 1) {
+            size_t event = firstEvent + w * 32 + std::countr_zero(word);
+            if (event >= evtParticles.size()) {
+                break;
+            }
+            const glm::vec4 &evt = evtParticles[event];
+            fprintf(file, "%zu,%d,%d,%.6f,%d\n", event, static_cast<int>(evt.x), static_cast<int>(evt.y), evt.z * timeToSeconds,
+                evt.w > 0.5f ? 1 : 0);
+        }
+    }
+
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
 }
 
 // If timestamp does not exist return first event included in window
 uint EventData::getFirstEvent(float timestamp, float normFactor) const {
-    assert(this->evtParticles.size() != 0);
-    glm::vec4 timestampVec4(0.0f, 0.0f, timestamp * normFactor, 0.0f); 
+    assert(this->timeIndex.size() == this->evtParticles.size() && !this->timeIndex.empty());
 
-    auto lb = std::lower_bound(evtParticles.begin(), evtParticles.end(), timestampVec4, lessVec4_t);
-    if (lb == evtParticles.end()) {
-        return static_cast<uint>(evtParticles.size() - 1);
+    size_t lb = timeIndex.lowerBound(timestamp * normFactor);
+    if (lb == timeIndex.size()) {
+        return static_cast<uint>(timeIndex.size() - 1);
     }
-    return std::distance(evtParticles.begin(), lb);
+    return static_cast<uint>(lb);
 } 
 
 // If timestamp does not exist return last event included in window
 uint EventData::getLastEvent(float timestamp, float normFactor) const {
-    assert(this->evtParticles.size() != 0);
-    glm::vec4 timestampVec4(0.0f, 0.0f, timestamp * normFactor, 0.0f); 
+    assert(this->timeIndex.size() == this->evtParticles.size() && !this->timeIndex.empty());
 
-    auto ub = std::upper_bound(evtParticles.begin(), evtParticles.end(), timestampVec4, lessVec4_t);
-    if (ub == evtParticles.begin()) {
+    size_t ub = timeIndex.upperBound(timestamp * normFactor);
+    if (ub == 0) {
         return 0;
     }
-    return std::distance(evtParticles.begin(), --ub);
+    return static_cast<uint>(ub - 1);
 }
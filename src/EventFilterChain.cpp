@@ -0,0 +1,448 @@
+#include "EventFilterChain.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <omp.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+    // Far enough in the past that t - NEVER never overflows and never falls inside a window
+    const int64_t NEVER = std::numeric_limits<int64_t>::min() / 2;
+
+    int countKept(const std::vector<uint8_t> &keep) {
+        const int n = static_cast<int>(keep.size());
+        int kept = 0;
+        #pragma omp parallel for reduction(+:kept)
+        for (int i = 0; i < n; i++) {
+            kept += keep[i];
+        }
+        return kept;
+    }
+
+    // Rows [bandStart(b), bandStart(b + 1)) belong to band b
+    int numBands(int height) {
+        return std::max(1, std::min(omp_get_max_threads(), height));
+    }
+
+    int bandStart(int band, int bands, int height) {
+        return static_cast<int>(static_cast<long long>(height) * band / bands);
+    }
+
+    std::vector<int> rowBands(int height, int bands) {
+        std::vector<int> bandOfRow(std::max(height, 0));
+        for (int b = 0; b < bands; b++) {
+            std::fill(bandOfRow.begin() + bandStart(b, bands, height), bandOfRow.begin() + bandStart(b + 1, bands, height), b);
+        }
+        return bandOfRow;
+    }
+
+    // Counting sort of the event indices by a key in [0, numKeys), a negative key leaves the event out.
+    // Stable, so bucket k, order[offsets[k] .. offsets[k + 1]), stays in batch (time) order
+    template <typename Key>
+    void bucketEvents(int n, int numKeys, Key key, std::vector<int> &offsets, std::vector<int> &order) {
+        offsets.assign(static_cast<size_t>(numKeys) + 1, 0);
+        for (int i = 0; i < n; i++) {
+            int k = key(i);
+            if (k >= 0) {
+                offsets[k + 1]++;
+            }
+        }
+        for (int k = 0; k < numKeys; k++) {
+            offsets[k + 1] += offsets[k];
+        }
+        order.resize(offsets[numKeys]);
+        std::vector<int> next(offsets.begin(), offsets.end() - 1);
+        for (int i = 0; i < n; i++) {
+            int k = key(i);
+            if (k >= 0) {
+                order[next[k]++] = i;
+            }
+        }
+    }
+}
+
+void ROIFilter::apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) {
+    const int n = static_cast<int>(batch.size());
+    const int minX = roiMin.x, minY = roiMin.y, maxX = roiMax.x, maxY = roiMax.y;
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        const FilterEvent &e = batch[i];
+        keep[i] &= static_cast<uint8_t>((e.x >= minX) & (e.x <= maxX) & (e.y >= minY) & (e.y <= maxY));
+    }
+}
+
+void PolarityFilter::apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) {
+    const int n = static_cast<int>(batch.size());
+    const uint8_t wanted = static_cast<uint8_t>(keepPolarity != 0);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        keep[i] &= static_cast<uint8_t>(batch[i].polarity == wanted);
+    }
+}
+
+void RefractoryFilter::reset(glm::ivec2 res) {
+    EventFilterStage::reset(res);
+    lastKept.assign(static_cast<size_t>(std::max(res.x, 0)) * std::max(res.y, 0), NEVER);
+}
+
+void RefractoryFilter::apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) {
+    if (lastKept.empty()) {
+        return;
+    }
+
+    // Purely per pixel, so bands of rows are independent and the result is exact
+    const int n = static_cast<int>(batch.size());
+    const int width = resolution.x;
+    const int height = resolution.y;
+    const int bands = numBands(height);
+    const std::vector<int> bandOfRow = rowBands(height, bands);
+    std::vector<int> offsets, order;
+    bucketEvents(n, bands, [&](int i) {
+        const FilterEvent &e = batch[i];
+        return keep[i] && e.x >= 0 && e.x < width && e.y >= 0 && e.y < height ? bandOfRow[e.y] : -1;
+    }, offsets, order);
+
+    #pragma omp parallel for num_threads(bands) schedule(static, 1)
+    for (int b = 0; b < bands; b++) {
+        for (int k = offsets[b]; k < offsets[b + 1]; k++) {
+            const int i = order[k];
+            const FilterEvent &e = batch[i];
+            int64_t &last = lastKept[static_cast<size_t>(e.y) * width + e.x];
+            if (e.timestamp - last < period) {
+                keep[i] = 0;
+            }
+            else {
+                last = e.timestamp;
+            }
+        }
+    }
+}
+
+void BackgroundActivityFilter::reset(glm::ivec2 res) {
+    EventFilterStage::reset(res);
+    lastSeen.assign(static_cast<size_t>(std::max(res.x, 0)) * std::max(res.y, 0), NEVER);
+}
+
+void BackgroundActivityFilter::apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) {
+    if (lastSeen.empty()) {
+        return;
+    }
+
+    const int n = static_cast<int>(batch.size());
+    const int width = resolution.x;
+    const int height = resolution.y;
+    const int bands = numBands(height);
+    const std::vector<int> bandOfRow = rowBands(height, bands);
+    auto reaches = [&](int i) {
+        const FilterEvent &e = batch[i];
+        return keep[i] && e.x >= 0 && e.x < width && e.y >= 0 && e.y < height;
+    };
+
+    // The events of every band, and those on the row just above and just below it, each in batch order
+    std::vector<int> offsets, order, aboveOffsets, aboveOrder, belowOffsets, belowOrder;
+    bucketEvents(n, bands, [&](int i) { return reaches(i) ? bandOfRow[batch[i].y] : -1; }, offsets, order);
+    bucketEvents(n, bands, [&](int i) {
+        int b = reaches(i) ? bandOfRow[batch[i].y] + 1 : bands;
+        return b < bands && batch[i].y == bandStart(b, bands, height) - 1 ? b : -1;
+    }, aboveOffsets, aboveOrder);
+    bucketEvents(n, bands, [&](int i) {
+        int b = reaches(i) ? bandOfRow[batch[i].y] - 1 : -1;
+        return b >= 0 && batch[i].y == bandStart(b + 1, bands, height) ? b : -1;
+    }, belowOffsets, belowOrder);
+
+    // Private copies of the rows around every band as they were before this batch, the only cross band reads
+    std::vector<int64_t> edges(static_cast<size_t>(bands) * 2 * width, NEVER);
+    for (int b = 0; b < bands; b++) {
+        const int y0 = bandStart(b, bands, height);
+        const int y1 = bandStart(b + 1, bands, height);
+        int64_t *above = edges.data() + static_cast<size_t>(2 * b) * width;
+        int64_t *below = above + width;
+        if (y0 > 0) {
+            std::copy_n(lastSeen.data() + static_cast<size_t>(y0 - 1) * width, width, above);
+        }
+        if (y1 < height) {
+            std::copy_n(lastSeen.data() + static_cast<size_t>(y1) * width, width, below);
+        }
+    }
+
+    // Replaying the neighbouring rows' events into the copies in batch order gives every event exactly the
+    // support it would have in one sequential pass, whatever the number of bands
+    #pragma omp parallel for num_threads(bands) schedule(static, 1)
+    for (int b = 0; b < bands; b++) {
+        const int y0 = bandStart(b, bands, height);
+        const int y1 = bandStart(b + 1, bands, height);
+        int64_t *above = edges.data() + static_cast<size_t>(2 * b) * width;
+        int64_t *below = above + width;
+        int nextAbove = aboveOffsets[b];
+        int nextBelow = belowOffsets[b];
+        for (int k = offsets[b]; k < offsets[b + 1]; k++) {
+            const int i = order[k];
+            for (; nextAbove < aboveOffsets[b + 1] && aboveOrder[nextAbove] < i; nextAbove++) {
+                const FilterEvent &h = batch[aboveOrder[nextAbove]];
+                above[h.x] = h.timestamp;
+            }
+            for (; nextBelow < belowOffsets[b + 1] && belowOrder[nextBelow] < i; nextBelow++) {
+                const FilterEvent &h = batch[belowOrder[nextBelow]];
+                below[h.x] = h.timestamp;
+            }
+
+            const FilterEvent &e = batch[i];
+            bool supported = false;
+            for (int dy = -1; dy <= 1; dy++) {
+                const int ny = e.y + dy;
+                if (ny < 0 || ny >= height) {
+                    continue;
+                }
+                const int64_t *row = ny < y0 ? above : (ny >= y1 ? below : lastSeen.data() + static_cast<size_t>(ny) * width);
+                for (int dx = -1; dx <= 1; dx++) {
+                    const int nx = e.x + dx;
+                    if ((dx == 0 && dy == 0) || nx < 0 || nx >= width) {
+                        continue;
+                    }
+                    supported |= e.timestamp - row[nx] <= window;
+                }
+            }
+
+            // Every event that reaches the stage supports its neighbours, kept or not
+            lastSeen[static_cast<size_t>(e.y) * width + e.x] = e.timestamp;
+            if (!supported) {
+                keep[i] = 0;
+            }
+        }
+    }
+}
+
+void HotPixelFilter::apply(const std::vector<FilterEvent> &batch, std::vector<uint8_t> &keep) {
+    if (mask.size() != static_cast<size_t>(resolution.x) * resolution.y || mask.empty()) {
+        return;
+    }
+
+    const int n = static_cast<int>(batch.size());
+    const int width = resolution.x;
+    const int height = resolution.y;
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        const FilterEvent &e = batch[i];
+        if (e.x >= 0 && e.y >= 0 && e.x < width && e.y < height) {
+            keep[i] &= static_cast<uint8_t>(mask[static_cast<size_t>(e.y) * width + e.x] == 0);
+        }
+    }
+}
+
+size_t HotPixelFilter::getNumMasked() const {
+    return static_cast<size_t>(std::count_if(mask.begin(), mask.end(), [](uint8_t m) { return m != 0; }));
+}
+
+void HotPixelDetector::reset(glm::ivec2 res) {
+    resolution = res;
+    counts.assign(static_cast<size_t>(std::max(res.x, 0)) * std::max(res.y, 0), 0);
+    numEvents = 0;
+    firstTimestamp = 0;
+    lastTimestamp = 0;
+}
+
+void HotPixelDetector::accumulate(const std::vector<FilterEvent> &batch) {
+    if (counts.empty() || batch.empty()) {
+        return;
+    }
+    if (numEvents == 0) {
+        firstTimestamp = batch.front().timestamp;
+        lastTimestamp = firstTimestamp;
+    }
+    lastTimestamp = std::max(lastTimestamp, batch.back().timestamp);
+    numEvents += batch.size();
+
+    // Every band owns the counters of its rows, so the increments need no atomics
+    const int n = static_cast<int>(batch.size());
+    const int width = resolution.x;
+    const int height = resolution.y;
+    const int bands = numBands(height);
+    const std::vector<int> bandOfRow = rowBands(height, bands);
+    std::vector<int> offsets, order;
+    bucketEvents(n, bands, [&](int i) {
+        const FilterEvent &e = batch[i];
+        return e.x >= 0 && e.x < width && e.y >= 0 && e.y < height ? bandOfRow[e.y] : -1;
+    }, offsets, order);
+
+    #pragma omp parallel for num_threads(bands) schedule(static, 1)
+    for (int b = 0; b < bands; b++) {
+        for (int k = offsets[b]; k < offsets[b + 1]; k++) {
+            const FilterEvent &e = batch[order[k]];
+            counts[static_cast<size_t>(e.y) * width + e.x]++;
+        }
+    }
+}
+
+double HotPixelDetector::getDurationSeconds() const {
+    return static_cast<double>(lastTimestamp - firstTimestamp) / 1e6;
+}
+
+std::vector<uint8_t> HotPixelDetector::detect(float numMADs, float minRate) {
+    auto start = std::chrono::steady_clock::now();
+    medianRate = 0.0f;
+    thresholdRate = 0.0f;
+    numDetected = 0;
+
+    const double duration = getDurationSeconds();
+    if (counts.empty() || numEvents == 0 || duration <= 0.0) {
+        return {};
+    }
+
+    // Silent pixels would drag the median to 0 on sparse scenes, only pixels that fired take part
+    std::vector<float> rates;
+    rates.reserve(counts.size());
+    for (uint32_t count : counts) {
+        if (count) {
+            rates.push_back(static_cast<float>(count / duration));
+        }
+    }
+    const int numActive = static_cast<int>(rates.size());
+    if (numActive == 0) {
+        return {};
+    }
+    std::nth_element(rates.begin(), rates.begin() + numActive / 2, rates.end());
+    medianRate = rates[numActive / 2];
+
+    const float median = medianRate;
+    #pragma omp parallel for
+    for (int i = 0; i < numActive; i++) {
+        rates[i] = std::fabs(rates[i] - median);
+    }
+    std::nth_element(rates.begin(), rates.begin() + numActive / 2, rates.end());
+    const float mad = rates[numActive / 2];
+
+    // A single event over the whole recording is the finest rate step, the MAD is 0 when most pixels fire alike
+    const float spread = std::max(1.4826f * mad, static_cast<float>(1.0 / duration));
+    thresholdRate = std::max(median + numMADs * spread, minRate);
+
+    const int numPixels = static_cast<int>(counts.size());
+    const double threshold = thresholdRate;
+    std::vector<uint8_t> mask(counts.size(), 0);
+    int detected = 0;
+    #pragma omp parallel for reduction(+:detected)
+    for (int p = 0; p < numPixels; p++) {
+        if (counts[p] / duration > threshold) {
+            mask[p] = 1;
+            detected++;
+        }
+    }
+    numDetected = detected;
+
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return mask;
+}
+
+bool HotPixelDetector::saveMask(const std::string &path, const std::vector<uint8_t> &mask, glm::ivec2 res) {
+    if (mask.size() != static_cast<size_t>(res.x) * res.y || mask.empty()) {
+        return false;
+    }
+
+    cv::Mat image(res.y, res.x, CV_8U);
+    for (size_t p = 0; p < mask.size(); p++) {
+        image.data[p] = mask[p] ? 255 : 0;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    return cv::imwrite(path, image);
+}
+
+bool HotPixelDetector::loadMask(const std::string &path, glm::ivec2 res, std::vector<uint8_t> &mask) {
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        return false;
+    }
+
+    cv::Mat image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+    if (image.empty() || image.cols != res.x || image.rows != res.y) {
+        return false;
+    }
+
+    mask.assign(static_cast<size_t>(res.x) * res.y, 0);
+    for (int y = 0; y < res.y; y++) {
+        const uint8_t *row = image.ptr<uint8_t>(y);
+        for (int x = 0; x < res.x; x++) {
+            mask[static_cast<size_t>(y) * res.x + x] = row[x] > 127;
+        }
+    }
+    return true;
+}
+
+std::string HotPixelDetector::getMaskPath(const std::string &maskDir, const std::string &cameraName) {
+    std::string name = cameraName.empty() ? "unknown" : cameraName;
+    for (char &c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+            c = '_';
+        }
+    }
+    return maskDir + name + ".png";
+}
+
+EventFilterChain::EventFilterChain() : input(0), output(0) {
+    // Cheap stateless stages first so the stateful ones see fewer events
+    auto roiStage = std::make_unique<ROIFilter>();
+    auto hotPixelStage = std::make_unique<HotPixelFilter>();
+    auto polarityStage = std::make_unique<PolarityFilter>();
+    auto refractoryStage = std::make_unique<RefractoryFilter>();
+    auto backgroundActivityStage = std::make_unique<BackgroundActivityFilter>();
+    roi = roiStage.get();
+    hotPixel = hotPixelStage.get();
+    polarity = polarityStage.get();
+    refractory = refractoryStage.get();
+    backgroundActivity = backgroundActivityStage.get();
+    stages.push_back(std::move(roiStage));
+    stages.push_back(std::move(hotPixelStage));
+    stages.push_back(std::move(polarityStage));
+    stages.push_back(std::move(refractoryStage));
+    stages.push_back(std::move(backgroundActivityStage));
+}
+
+void EventFilterChain::reset(glm::ivec2 resolution) {
+    for (auto &stage : stages) {
+        stage->reset(resolution);
+        stage->passed = 0;
+        stage->dropped = 0;
+    }
+    input = 0;
+    output = 0;
+}
+
+bool EventFilterChain::isActive() const {
+    return std::any_of(stages.begin(), stages.end(), [](const auto &stage) { return stage->enabled; });
+}
+
+void EventFilterChain::apply(std::vector<FilterEvent> &batch) {
+    input += batch.size();
+    if (!isActive() || batch.empty()) {
+        output += batch.size();
+        return;
+    }
+
+    keep.assign(batch.size(), 1);
+    int alive = static_cast<int>(batch.size());
+    for (auto &stage : stages) {
+        if (!stage->enabled || alive == 0) {
+            continue;
+        }
+        stage->apply(batch, keep);
+        int kept = countKept(keep);
+        stage->passed += kept;
+        stage->dropped += alive - kept;
+        alive = kept;
+    }
+
+    // Stable compaction, the batch stays time sorted
+    size_t out = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (keep[i]) {
+            batch[out++] = batch[i];
+        }
+    }
+    batch.resize(out);
+    output += out;
+}
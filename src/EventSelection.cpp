@@ -0,0 +1,196 @@
+#include "EventSelection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+
+namespace {
+    // Inverse of orderedBits in event_select.comp
+    float orderedFloat(uint32_t u) {
+        u = (u & 0x80000000u) ? u & 0x7FFFFFFFu : ~u;
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+}
+
+EventSelection::EventSelection() : initialized(false), selectionSSBO(0), statsSSBO(0), polygonSSBO(0), selectionCapacity(0),
+    selectedDataVersion(0), revision(0), valid(false), milliseconds(0.0) {}
+
+EventSelection::~EventSelection() {
+    GLuint buffers[] = { selectionSSBO, statsSSBO, polygonSSBO };
+    for (GLuint buffer : buffers) {
+        if (buffer) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+}
+
+bool EventSelection::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    selectProg.setShaderName(resource_dir + "event_select.comp");
+    if (!selectProg.init()) {
+        std::cerr << "Failed to initialize event selection shader" << std::endl;
+        return false;
+    }
+
+    selectProg.bind();
+    selectProg.addUniform("numEvents");
+    selectProg.addUniform("viewProj");
+    selectProg.addUniform("numPoints");
+    selectProg.addUniform("lassoBounds");
+    selectProg.addUniform("selectEvent");
+    selectProg.addUniform("mode");
+    selectProg.addUniform("keepOld");
+    selectProg.addUniform("useVisibility");
+    selectProg.unbind();
+
+    glGenBuffers(1, &selectionSSBO);
+    glGenBuffers(1, &statsSSBO);
+    glGenBuffers(1, &polygonSSBO);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 10 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, polygonSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LASSO_POINTS * sizeof(glm::vec2), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    initialized = true;
+    return true;
+}
+
+void EventSelection::clear() {
+    valid = false;
+    stats = SelectionStats();
+    revision++;
+}
+
+void EventSelection::selectLasso(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, const glm::mat4 &viewProj,
+    const std::vector<glm::vec2> &polygon, int mode, GLuint visibilitySSBO) {
+
+    if (!initialized || polygon.size() < 3) {
+        return;
+    }
+
+    int numPoints = static_cast<int>(std::min<size_t>(polygon.size(), MAX_LASSO_POINTS));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, polygonSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numPoints * sizeof(glm::vec2), polygon.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glm::vec2 lassoMin = polygon[0], lassoMax = polygon[0];
+    for (int i = 1; i < numPoints; i++) {
+        lassoMin = glm::min(lassoMin, polygon[i]);
+        lassoMax = glm::max(lassoMax, polygon[i]);
+    }
+
+    selectProg.bind();
+    glUniform4f(selectProg.getUniform("lassoBounds"), lassoMin.x, lassoMin.y, lassoMax.x, lassoMax.y);
+    selectProg.unbind();
+    run(evtParticlesSSBO, numEvents, dataVersion, viewProj, numPoints, -1, mode, visibilitySSBO);
+}
+
+void EventSelection::selectEvent(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, int event, int mode) {
+    if (!initialized) {
+        return;
+    }
+
+    // A miss still applies the mode, so clicking empty space with REPLACE clears the selection
+    run(evtParticlesSSBO, numEvents, dataVersion, glm::mat4(1.0f), 0, event >= 0 ? event : static_cast<int>(numEvents), mode, 0);
+}
+
+void EventSelection::run(GLuint evtParticlesSSBO, size_t numEvents, uint64_t dataVersion, const glm::mat4 &viewProj,
+    int numPoints, int event, int mode, GLuint visibilitySSBO) {
+
+    if (numEvents == 0) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Old bits only count if they were made over the same events
+    bool keepOld = valid && selectedDataVersion == dataVersion;
+    size_t numWords = (numEvents + 31) / 32;
+    if (numWords * sizeof(GLuint) > selectionCapacity) {
+        selectionCapacity = numWords * sizeof(GLuint);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, selectionSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, selectionCapacity, nullptr, GL_DYNAMIC_COPY);
+        keepOld = false;
+    }
+
+    const GLuint initialStats[10] = { 0u, 0u, 0xFFFFFFFFu, 0u, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0xFFFFFFFFu, 0u };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(initialStats), initialStats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    if (visibilitySSBO) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, visibilitySSBO);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, selectionSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, statsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, polygonSSBO);
+
+    selectProg.bind();
+    glUniform1ui(selectProg.getUniform("numEvents"), static_cast<GLuint>(numEvents));
+    glUniformMatrix4fv(selectProg.getUniform("viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+    glUniform1i(selectProg.getUniform("numPoints"), numPoints);
+    glUniform1i(selectProg.getUniform("selectEvent"), event);
+    glUniform1i(selectProg.getUniform("mode"), mode);
+    glUniform1i(selectProg.getUniform("keepOld"), keepOld);
+    glUniform1i(selectProg.getUniform("useVisibility"), visibilitySSBO != 0);
+    selectProg.dispatchGridStride(static_cast<GLuint>(numEvents));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    selectProg.unbind();
+
+    // Ten words, the only data read back
+    GLuint result[10];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(result), result);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    stats = SelectionStats();
+    stats.count = result[0];
+    if (stats.count > 0) {
+        stats.positive = result[1];
+        stats.firstEvent = result[2];
+        stats.lastEvent = result[3];
+        stats.pixelMin = glm::ivec2(result[4], result[5]);
+        stats.pixelMax = glm::ivec2(result[6], result[7]);
+        stats.t0 = orderedFloat(result[8]);
+        stats.t1 = orderedFloat(result[9]);
+    }
+
+    selectedDataVersion = dataVersion;
+    valid = true;
+    revision++;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void EventSelection::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, selectionSSBO);
+}
+
+uint32_t EventSelection::readBits(std::vector<uint32_t> &bits) const {
+    bits.clear();
+    if (!valid || stats.count == 0) {
+        return 0;
+    }
+
+    // Only the words spanning the selected range
+    size_t firstWord = stats.firstEvent / 32;
+    size_t lastWord = stats.lastEvent / 32;
+    bits.resize(lastWord - firstWord + 1);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, selectionSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, firstWord * sizeof(GLuint), bits.size() * sizeof(GLuint), bits.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return static_cast<uint32_t>(firstWord * 32);
+}
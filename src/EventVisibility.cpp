@@ -0,0 +1,228 @@
+#include "EventVisibility.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+
+EventVisibility::EventVisibility() : initialized(false), visibilitySSBO(0), supportSSBO(0), hotPixelSSBO(0),
+    offsetsSSBO(0), timesSSBO(0), visibilityCapacity(0), supportCapacity(0), hotPixelCapacity(0), offsetsCapacity(0),
+    timesCapacity(0), timerQuery(0), timerPending(false), milliseconds(0.0), appliedDataVersion(0),
+    appliedHotPixelRevision(0), appliedSelectionRevision(0), hasApplied(false), appliedAny(false), appliedNoise(false), version(1), supportDataVersion(0),
+    supportWindow(0.0f), hasSupport(false) {}
+
+EventVisibility::~EventVisibility() {
+    GLuint buffers[] = { visibilitySSBO, supportSSBO, hotPixelSSBO, offsetsSSBO, timesSSBO };
+    for (GLuint buffer : buffers) {
+        if (buffer) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+
+    if (timerQuery) {
+        glDeleteQueries(1, &timerQuery);
+        timerQuery = 0;
+    }
+}
+
+bool EventVisibility::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    visibilityProg.setShaderName(resource_dir + "event_visibility.comp");
+    supportProg.setShaderName(resource_dir + "event_support.comp");
+    if (!visibilityProg.init() || !supportProg.init()) {
+        std::cerr << "Failed to initialize event visibility shaders" << std::endl;
+        return false;
+    }
+
+    visibilityProg.bind();
+    visibilityProg.addUniform("numEvents");
+    visibilityProg.addUniform("width");
+    visibilityProg.addUniform("height");
+    visibilityProg.addUniform("usePolarity");
+    visibilityProg.addUniform("keepPolarity");
+    visibilityProg.addUniform("useROI");
+    visibilityProg.addUniform("roi");
+    visibilityProg.addUniform("numTimeRanges");
+    visibilityProg.addUniform("timeRanges");
+    visibilityProg.addUniform("useHotPixels");
+    visibilityProg.addUniform("useSupport");
+    visibilityProg.addUniform("useSelection");
+    visibilityProg.unbind();
+
+    supportProg.bind();
+    supportProg.addUniform("numEvents");
+    supportProg.addUniform("width");
+    supportProg.addUniform("height");
+    supportProg.addUniform("supportWindow");
+    supportProg.unbind();
+
+    glGenBuffers(1, &visibilitySSBO);
+    glGenBuffers(1, &supportSSBO);
+    glGenBuffers(1, &hotPixelSSBO);
+    glGenBuffers(1, &offsetsSSBO);
+    glGenBuffers(1, &timesSSBO);
+    glGenQueries(1, &timerQuery);
+
+    initialized = true;
+    return true;
+}
+
+bool EventVisibility::isActive() const {
+    return settings.polarity || settings.roi || settings.numTimeRanges > 0 || settings.hotPixels || settings.noise ||
+        settings.selection;
+}
+
+void EventVisibility::resizeBuffer(GLuint &buffer, size_t &capacity, size_t bytes) {
+    bytes = std::max<size_t>(bytes, 4);
+    if (bytes <= capacity) {
+        return;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    capacity = bytes;
+}
+
+void EventVisibility::runSupport(GLuint evtParticlesSSBO, size_t numEvents, glm::ivec2 res, const PixelIndex &pixelIndex) {
+    // Upload the index once per data version, the window can change without it
+    size_t numWords = (numEvents + 31) / 32;
+    resizeBuffer(supportSSBO, supportCapacity, numWords * sizeof(GLuint));
+    if (!hasSupport || supportDataVersion != appliedDataVersion) {
+        const std::vector<uint32_t> &offsets = pixelIndex.getOffsets();
+        const std::vector<float> &times = pixelIndex.getTimes();
+        resizeBuffer(offsetsSSBO, offsetsCapacity, offsets.size() * sizeof(uint32_t));
+        resizeBuffer(timesSSBO, timesCapacity, times.size() * sizeof(float));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, offsetsSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, offsets.size() * sizeof(uint32_t), offsets.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, timesSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, times.size() * sizeof(float), times.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, supportSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, offsetsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, timesSSBO);
+
+    supportProg.bind();
+    glUniform1ui(supportProg.getUniform("numEvents"), static_cast<GLuint>(numEvents));
+    glUniform1i(supportProg.getUniform("width"), res.x);
+    glUniform1i(supportProg.getUniform("height"), res.y);
+    glUniform1f(supportProg.getUniform("supportWindow"), settings.noiseWindow);
+    supportProg.dispatchGridStride(static_cast<GLuint>(numEvents));
+    supportProg.unbind();
+
+    supportDataVersion = appliedDataVersion;
+    supportWindow = settings.noiseWindow;
+    hasSupport = true;
+}
+
+void EventVisibility::update(GLuint evtParticlesSSBO, size_t numEvents, glm::ivec2 res, uint64_t dataVersion,
+    const PixelIndex &pixelIndex, const std::vector<uint8_t> &hotPixelMask, uint64_t hotPixelRevision,
+    GLuint selectionSSBO, uint64_t selectionRevision) {
+
+    if (!initialized || !isActive() || numEvents == 0) {
+        return;
+    }
+
+    // The noise filter needs an index over exactly the resident events
+    bool useSupport = settings.noise && pixelIndex.isBuilt() && pixelIndex.getResolution() == res;
+    if (hasApplied && settings == appliedSettings && dataVersion == appliedDataVersion &&
+        (!settings.hotPixels || hotPixelRevision == appliedHotPixelRevision) &&
+        (!settings.selection || selectionRevision == appliedSelectionRevision) && useSupport == appliedNoise) {
+        return;
+    }
+
+    size_t numPixels = static_cast<size_t>(res.x) * res.y;
+    bool useHotPixels = settings.hotPixels && hotPixelMask.size() == numPixels;
+    bool useSelection = settings.selection && selectionSSBO != 0;
+
+    if (!timerPending) {
+        glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+    }
+
+    appliedDataVersion = dataVersion;
+    if (useSupport && (!hasSupport || supportDataVersion != dataVersion || supportWindow != settings.noiseWindow)) {
+        runSupport(evtParticlesSSBO, numEvents, res, pixelIndex);
+    }
+
+    if (useHotPixels && (!hasApplied || hotPixelRevision != appliedHotPixelRevision || !appliedSettings.hotPixels)) {
+        std::vector<GLuint> bits((numPixels + 31) / 32, 0);
+        for (size_t p = 0; p < numPixels; p++) {
+            if (hotPixelMask[p]) {
+                bits[p >> 5] |= 1u << (p & 31);
+            }
+        }
+        resizeBuffer(hotPixelSSBO, hotPixelCapacity, bits.size() * sizeof(GLuint));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, hotPixelSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bits.size() * sizeof(GLuint), bits.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    size_t numWords = (numEvents + 31) / 32;
+    resizeBuffer(visibilitySSBO, visibilityCapacity, numWords * sizeof(GLuint));
+    resizeBuffer(supportSSBO, supportCapacity, numWords * sizeof(GLuint));
+    resizeBuffer(hotPixelSSBO, hotPixelCapacity, sizeof(GLuint));
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, visibilitySSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, supportSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, hotPixelSSBO);
+    if (useSelection) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, selectionSSBO);
+    }
+
+    visibilityProg.bind();
+    glUniform1ui(visibilityProg.getUniform("numEvents"), static_cast<GLuint>(numEvents));
+    glUniform1i(visibilityProg.getUniform("width"), res.x);
+    glUniform1i(visibilityProg.getUniform("height"), res.y);
+    glUniform1i(visibilityProg.getUniform("usePolarity"), settings.polarity);
+    glUniform1f(visibilityProg.getUniform("keepPolarity"), settings.keepPolarity != 0 ? 1.0f : 0.0f);
+    glUniform1i(visibilityProg.getUniform("useROI"), settings.roi);
+    glUniform4fv(visibilityProg.getUniform("roi"), 1, glm::value_ptr(settings.roiWindow));
+    glUniform1i(visibilityProg.getUniform("numTimeRanges"), std::clamp(settings.numTimeRanges, 0, VisibilitySettings::MAX_TIME_RANGES));
+    glUniform2fv(visibilityProg.getUniform("timeRanges"), VisibilitySettings::MAX_TIME_RANGES, glm::value_ptr(settings.timeRanges[0]));
+    glUniform1i(visibilityProg.getUniform("useHotPixels"), useHotPixels);
+    glUniform1i(visibilityProg.getUniform("useSupport"), useSupport);
+    glUniform1i(visibilityProg.getUniform("useSelection"), useSelection);
+    visibilityProg.dispatchGridStride(static_cast<GLuint>(numEvents));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    visibilityProg.unbind();
+
+    if (!timerPending) {
+        glEndQuery(GL_TIME_ELAPSED);
+        timerPending = true;
+    }
+
+    appliedSettings = settings;
+    appliedHotPixelRevision = hotPixelRevision;
+    appliedSelectionRevision = selectionRevision;
+    hasApplied = true;
+    appliedNoise = useSupport;
+    appliedAny = useSupport || useHotPixels || useSelection || settings.polarity || settings.roi || settings.numTimeRanges > 0;
+    version++;
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void EventVisibility::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING, visibilitySSBO);
+}
+
+double EventVisibility::getMilliseconds() {
+    if (timerPending) {
+        GLint available = 0;
+        glGetQueryObjectiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsed);
+            milliseconds = static_cast<double>(elapsed) / 1e6;
+            timerPending = false;
+        }
+    }
+    return milliseconds;
+}
@@ -0,0 +1,191 @@
+#include "FilterBank.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+
+FilterBank::FilterBank() : initialized(false), responseTexture(0), previewTexture(0), filtersSSBO(0), zeroPBO(0),
+    resolution(0), allocatedLayers(0), resolvedLayer(BEST_FILTER), resolvedGain(-1.0f) {}
+
+FilterBank::~FilterBank() {
+    if (responseTexture) {
+        glDeleteTextures(1, &responseTexture);
+        responseTexture = 0;
+    }
+
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+        previewTexture = 0;
+    }
+
+    if (filtersSSBO) {
+        glDeleteBuffers(1, &filtersSSBO);
+        filtersSSBO = 0;
+    }
+
+    if (zeroPBO) {
+        glDeleteBuffers(1, &zeroPBO);
+        zeroPBO = 0;
+    }
+}
+
+bool FilterBank::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    bankProg[0].setShaderName(resource_dir + "morlet_bank.comp");
+    bankProg[1].setShaderName(resource_dir + "morlet_bank.comp");
+    bankProg[1].addDefine("POSITIVE_ONLY");
+    resolveProg.setShaderName(resource_dir + "morlet_bank_resolve.comp");
+    if (!bankProg[0].init() || !bankProg[1].init() || !resolveProg.init()) {
+        std::cerr << "Failed to initialize filter bank shaders" << std::endl;
+        return false;
+    }
+
+    for (ComputeProgram &prog : bankProg) {
+        prog.bind();
+        prog.addUniform("numFilters");
+        prog.addUniform("eventBound_L");
+        prog.addUniform("eventBound_R");
+        prog.addUniform("spaceWindow");
+        prog.addUniform("centerT");
+        prog.unbind();
+    }
+
+    resolveProg.bind();
+    resolveProg.addUniform("numFilters");
+    resolveProg.addUniform("layer");
+    resolveProg.addUniform("gain");
+    resolveProg.unbind();
+
+    glGenBuffers(1, &filtersSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, filtersSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_FILTERS * sizeof(BankFilter), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &zeroPBO);
+
+    initialized = true;
+    return true;
+}
+
+void FilterBank::allocate(glm::ivec2 res, int numFilters) {
+    int layers = 2 * numFilters;
+    if (res == resolution && layers <= allocatedLayers) {
+        return;
+    }
+
+    if (responseTexture) {
+        glDeleteTextures(1, &responseTexture);
+    }
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+    }
+
+    glGenTextures(1, &responseTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, responseTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32I, res.x, res.y, layers);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &previewTexture);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (res != resolution) {
+        std::vector<GLint> zeros(static_cast<size_t>(res.x) * res.y, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, zeros.size() * sizeof(GLint), zeros.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    resolution = res;
+    allocatedLayers = layers;
+}
+
+void FilterBank::run(GLuint evtParticlesSSBO, const std::vector<BankFilter> &newFilters, glm::ivec2 res,
+    int eventBound_L, int eventBound_R, float centerT, const glm::vec4 &spaceWindow, bool isPositiveOnly) {
+
+    if (!initialized || newFilters.empty() || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    filters.assign(newFilters.begin(), newFilters.begin() + std::min<size_t>(newFilters.size(), MAX_FILTERS));
+    int numFilters = static_cast<int>(filters.size());
+    allocate(res, numFilters);
+    resolvedGain = -1.0f;
+
+    // Clear the layers in use from the zeroed pixel buffer, all on the GPU
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, responseTexture);
+    for (int layer = 0; layer < 2 * numFilters; layer++) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, res.x, res.y, 1, GL_RED_INTEGER, GL_INT, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, filtersSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numFilters * sizeof(BankFilter), filters.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (eventBound_L > eventBound_R) {
+        return;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, filtersSSBO);
+    glBindImageTexture(0, responseTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+
+    ComputeProgram &prog = bankProg[isPositiveOnly ? 1 : 0];
+    prog.bind();
+    glUniform1i(prog.getUniform("numFilters"), numFilters);
+    glUniform1i(prog.getUniform("eventBound_L"), eventBound_L);
+    glUniform1i(prog.getUniform("eventBound_R"), eventBound_R);
+    glUniform4fv(prog.getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+    glUniform1f(prog.getUniform("centerT"), centerT);
+
+    prog.dispatchGridStride(static_cast<GLuint>(eventBound_R - eventBound_L + 1));
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    prog.unbind();
+
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void FilterBank::resolve(int layer, float gain) {
+    if (!initialized || filters.empty()) {
+        return;
+    }
+    layer = std::min(layer, getNumFilters() - 1);
+
+    glBindImageTexture(0, responseTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32I);
+    glBindImageTexture(1, previewTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, filtersSSBO);
+
+    resolveProg.bind();
+    glUniform1i(resolveProg.getUniform("numFilters"), getNumFilters());
+    glUniform1i(resolveProg.getUniform("layer"), layer);
+    glUniform1f(resolveProg.getUniform("gain"), gain);
+    resolveProg.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    resolveProg.unbind();
+
+    resolvedLayer = layer;
+    resolvedGain = gain;
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+glm::vec3 FilterBank::colorMap(int k, int n) {
+    return colorMap(n > 1 ? static_cast<float>(k) / static_cast<float>(n - 1) : 0.0f);
+}
+
+glm::vec3 FilterBank::colorMap(float x) {
+    return glm::clamp(glm::vec3(1.5f - std::abs(4.0f * x - 3.0f), 1.5f - std::abs(4.0f * x - 2.0f),
+        1.5f - std::abs(4.0f * x - 1.0f)), 0.0f, 1.0f);
+}
@@ -0,0 +1,222 @@
+#include "FrameBatch.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "GLSL.h"
+
+FrameBatch::FrameBatch() : initialized(false), accumTexture(0), previewTexture(0), rangesSSBO(0), zeroPBO(0),
+    readFBO(0), resolution(0), allocatedLayers(0), resolvedLayer(-1) {}
+
+FrameBatch::~FrameBatch() {
+    if (accumTexture) {
+        glDeleteTextures(1, &accumTexture);
+        accumTexture = 0;
+    }
+
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+        previewTexture = 0;
+    }
+
+    if (rangesSSBO) {
+        glDeleteBuffers(1, &rangesSSBO);
+        rangesSSBO = 0;
+    }
+
+    if (zeroPBO) {
+        glDeleteBuffers(1, &zeroPBO);
+        zeroPBO = 0;
+    }
+
+    if (readFBO) {
+        glDeleteFramebuffers(1, &readFBO);
+        readFBO = 0;
+    }
+}
+
+std::string FrameBatch::buildLogTransmittanceGLSL() {
+    return "#define LOG_SCALE " + std::to_string(LOG_SCALE) + ".0\n"
+        "// Fixed point log(1 - s), s being the color basic.fsh outputs for the weight (negatives are scaled by 0.25)\n"
+        "int logTransmittance(float weight) {\n"
+        "    float s = weight < 0.0 ? 0.25 * weight : weight;\n"
+        "    return int(round(log(1.0 - min(s, 0.999)) * LOG_SCALE));\n"
+        "}\n";
+}
+
+bool FrameBatch::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    // Variants are compiled per contribution function on first use
+    batchKernels.setup(resource_dir + "digital_shutter_batch.comp", { "numLayers", "eventBound_L", "eventBound_R",
+        "spaceWindow", "funcFreq", "funcWidth", "baseContribution" }, { "POSITIVE_ONLY", "VISIBILITY" });
+    batchKernels.setInjection(LOG_TRANSMITTANCE_PLACEHOLDER, buildLogTransmittanceGLSL());
+
+    resolveProg.setShaderName(resource_dir + "dce_resolve.comp");
+    resolveProg.setInjection(LOG_TRANSMITTANCE_PLACEHOLDER, buildLogTransmittanceGLSL());
+    if (!resolveProg.init()) {
+        std::cerr << "Failed to initialize frame batch shaders" << std::endl;
+        return false;
+    }
+
+    resolveProg.bind();
+    resolveProg.addUniform("layer");
+    resolveProg.unbind();
+
+    glGenBuffers(1, &rangesSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rangesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LAYERS * sizeof(ShutterRange), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &zeroPBO);
+    glGenFramebuffers(1, &readFBO);
+
+    initialized = true;
+    return true;
+}
+
+void FrameBatch::allocate(glm::ivec2 res, int layers) {
+    if (res == resolution && layers <= allocatedLayers) {
+        return;
+    }
+
+    if (accumTexture) {
+        glDeleteTextures(1, &accumTexture);
+    }
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+    }
+
+    // Immutable storage is required for image load/store on integer formats
+    glGenTextures(1, &accumTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32I, res.x, res.y, layers);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &previewTexture);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, previewTexture, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // One zeroed layer, filled on the GPU; glClearTexImage would need GL 4.4
+    if (res != resolution) {
+        GLint zero = 0;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<size_t>(res.x) * res.y * sizeof(GLint), nullptr, GL_STATIC_DRAW);
+        glClearBufferData(GL_PIXEL_UNPACK_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    resolution = res;
+    allocatedLayers = layers;
+}
+
+void FrameBatch::render(GLuint evtParticlesSSBO, const std::vector<ShutterRange> &newRanges, glm::ivec2 res,
+    const glm::vec4 &spaceWindow, bool isPositiveOnly, int funcID, float freq, float width, float contribution,
+    bool useVisibility) {
+
+    if (!initialized || newRanges.empty() || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    ComputeProgram *batchProg = batchKernels.get(funcID, (isPositiveOnly ? 1u : 0u) | (useVisibility ? 2u : 0u));
+    if (!batchProg) {
+        return;
+    }
+
+    ranges.assign(newRanges.begin(), newRanges.begin() + std::min<size_t>(newRanges.size(), MAX_LAYERS));
+    int numLayers = static_cast<int>(ranges.size());
+    allocate(res, numLayers);
+    resolvedLayer = -1;
+
+    // Clear every layer that will be written from the zeroed pixel buffer, all on the GPU
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumTexture);
+    for (int layer = 0; layer < numLayers; layer++) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, res.x, res.y, 1, GL_RED_INTEGER, GL_INT, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rangesSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numLayers * sizeof(ShutterRange), ranges.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Union of all windows, each event in it is read once
+    int unionBound_L = ranges.front().eventBound_L;
+    int unionBound_R = ranges.front().eventBound_R;
+    for (const ShutterRange &range : ranges) {
+        unionBound_L = std::min(unionBound_L, range.eventBound_L);
+        unionBound_R = std::max(unionBound_R, range.eventBound_R);
+    }
+    if (unionBound_L > unionBound_R) {
+        return;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, rangesSSBO);
+    glBindImageTexture(0, accumTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+
+    batchProg->bind();
+    glUniform1i(batchProg->getUniform("numLayers"), numLayers);
+    glUniform1i(batchProg->getUniform("eventBound_L"), unionBound_L);
+    glUniform1i(batchProg->getUniform("eventBound_R"), unionBound_R);
+    glUniform4fv(batchProg->getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+    glUniform1f(batchProg->getUniform("funcFreq"), freq);
+    glUniform1f(batchProg->getUniform("funcWidth"), width);
+    glUniform1f(batchProg->getUniform("baseContribution"), contribution);
+
+    batchProg->dispatchGridStride(static_cast<GLuint>(unionBound_R - unionBound_L + 1));
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    batchProg->unbind();
+
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void FrameBatch::resolveLayer(int layer) {
+    if (!initialized || layer < 0 || layer >= getNumLayers()) {
+        return;
+    }
+
+    glBindImageTexture(0, accumTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32I);
+    glBindImageTexture(1, previewTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    resolveProg.bind();
+    glUniform1i(resolveProg.getUniform("layer"), layer);
+    resolveProg.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    resolveProg.unbind();
+
+    resolvedLayer = layer;
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void FrameBatch::bindLayerForRead(int layer) {
+    resolveLayer(layer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+}
+
+void FrameBatch::readLayersRaw(GLuint packBuffer) const {
+    if (!accumTexture) {
+        return;
+    }
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT); // the layers were written as images
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumTexture);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RED_INTEGER, GL_INT, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLSL::checkError(GET_FILE_LINE);
+}
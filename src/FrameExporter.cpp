@@ -0,0 +1,287 @@
+#include "FrameExporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "GLSL.h"
+
+FrameExporter::FrameExporter() : request(false), active(false), format(FLOAT_TIFF_FORMAT), values(INTENSITY_VALUES),
+    requestFrames(100), eventPeriod(false), resolution(0), funcID(0), freq(0.0f), nextFrame(0), startTime(0.0),
+    milliseconds(0.0), nextSlot(0), busyWorkers(0), stopping(false), writtenFrames(0), failedFrames(0) {}
+
+FrameExporter::~FrameExporter() {
+    cancel();
+    for (Slot &slot : slots) {
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+            slot.buffer = 0;
+        }
+    }
+}
+
+static double nowMilliseconds() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::string FrameExporter::framePath(int frame) const {
+    char name[16];
+    snprintf(name, sizeof(name), "_%05d", frame);
+    const char *extension = format == FLOAT_EXR_FORMAT ? ".exr" : (format == PNG16_FORMAT ? ".png" : ".tiff");
+    return basePath + name + extension;
+}
+
+bool FrameExporter::begin(const std::string &basePath, const std::vector<ShutterRange> &ranges, glm::ivec2 resolution,
+    double timeToSeconds, int funcID, float freq) {
+    request = false;
+    if (active || ranges.empty() || resolution.x <= 0 || resolution.y <= 0) {
+        return false;
+    }
+    if (format == PNG16_FORMAT) {
+        values = INTENSITY_VALUES; // the log sum is unbounded, only floats hold it
+    }
+
+    this->basePath = basePath;
+    this->ranges = ranges;
+    this->resolution = resolution;
+    this->funcID = funcID;
+    this->freq = freq;
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(basePath).parent_path(), error);
+
+    // The whole index is known up front, frame files appear as the encoders finish them
+    FILE *index = fopen((basePath + "_index.csv").c_str(), "w");
+    if (!index) {
+        std::cerr << "FrameExporter: cannot write " << basePath << "_index.csv" << std::endl;
+        return false;
+    }
+    fprintf(index, "frame,file,event_begin,event_end,time_begin_s,time_end_s,time_center_s\n");
+    for (size_t k = 0; k < ranges.size(); k++) {
+        const ShutterRange &range = ranges[k];
+        float beginT = 2.0f * range.centerT - range.endT;
+        fprintf(index, "%zu,%s,%d,%d,%.9f,%.9f,%.9f\n", k,
+            std::filesystem::path(framePath(static_cast<int>(k))).filename().string().c_str(), range.eventBound_L,
+            range.eventBound_R, beginT * timeToSeconds, range.endT * timeToSeconds, range.centerT * timeToSeconds);
+    }
+    bool ok = ferror(index) == 0;
+    fclose(index);
+    if (!ok) {
+        return false;
+    }
+
+    size_t chunkBytes = static_cast<size_t>(resolution.x) * resolution.y * sizeof(GLint) * CHUNK_LAYERS;
+    for (Slot &slot : slots) {
+        if (!slot.buffer) {
+            glGenBuffers(1, &slot.buffer);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, chunkBytes, nullptr, GL_STREAM_READ);
+        slot.fence = nullptr;
+        slot.numFrames = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    nextSlot = 0;
+
+    nextFrame = 0;
+    writtenFrames = 0;
+    failedFrames = 0;
+    startTime = nowMilliseconds();
+    milliseconds = 0.0;
+    startWorkers();
+    active = true;
+    return true;
+}
+
+std::vector<ShutterRange> FrameExporter::nextChunk() {
+    if (!active) {
+        return {};
+    }
+    milliseconds = nowMilliseconds() - startTime;
+
+    // nextSlot holds the older readback, the GPU finishes them in order
+    for (int k = 0; k < 2; ++k) {
+        if (!retire(slots[(nextSlot + k) % 2])) {
+            break;
+        }
+    }
+
+    if (nextFrame >= getNumFrames() || slots[nextSlot].fence != nullptr) {
+        return {};
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (static_cast<int>(jobs.size()) >= 2 * CHUNK_LAYERS) {
+            return {}; // encoders behind, let them catch up
+        }
+    }
+
+    int count = std::min(static_cast<int>(CHUNK_LAYERS), getNumFrames() - nextFrame);
+    return std::vector<ShutterRange>(ranges.begin() + nextFrame, ranges.begin() + nextFrame + count);
+}
+
+void FrameExporter::queueReadback(int numFrames) {
+    Slot &slot = slots[nextSlot];
+    batch.readLayersRaw(slot.buffer);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.firstFrame = nextFrame;
+    slot.numFrames = numFrames;
+    nextFrame += numFrames;
+    nextSlot = (nextSlot + 1) % 2;
+}
+
+bool FrameExporter::retire(Slot &slot) {
+    if (slot.fence == nullptr) {
+        return true;
+    }
+
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    size_t layerPixels = static_cast<size_t>(resolution.x) * resolution.y;
+    size_t bytes = layerPixels * sizeof(GLint) * slot.numFrames;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const GLint *mapped = static_cast<const GLint *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+    if (status != GL_WAIT_FAILED && mapped) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < slot.numFrames; i++) {
+            const GLint *layer = mapped + i * layerPixels;
+            jobs.push_back({ slot.firstFrame + i, std::vector<GLint>(layer, layer + layerPixels) });
+        }
+        jobsChanged.notify_all();
+    }
+    else {
+        failedFrames += slot.numFrames;
+    }
+    if (mapped) {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.numFrames = 0;
+    return true;
+}
+
+void FrameExporter::encode(const Job &job) {
+    int width = resolution.x;
+    int height = resolution.y;
+    float invScale = 1.0f / FrameBatch::LOG_SCALE;
+
+    // Layers are bottom row first, images top row first
+    cv::Mat image(height, width, format == PNG16_FORMAT ? CV_16U : CV_32F);
+    for (int y = 0; y < height; y++) {
+        const GLint *src = job.accum.data() + static_cast<size_t>(height - 1 - y) * width;
+        for (int x = 0; x < width; x++) {
+            float logT = src[x] * invScale;
+            float value = values == LOG_VALUES ? logT : 1.0f - 0.5f * std::exp(logT);
+            if (format == PNG16_FORMAT) {
+                image.at<uint16_t>(y, x) = static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+            }
+            else {
+                image.at<float>(y, x) = value;
+            }
+        }
+    }
+
+    bool ok = false;
+    try {
+        ok = cv::imwrite(framePath(job.frame), image);
+    }
+    catch (const cv::Exception &e) { // EXR support can be disabled at runtime (OPENCV_IO_ENABLE_OPENEXR)
+        std::cerr << "FrameExporter: " << e.what() << std::endl;
+    }
+    if (ok) {
+        ++writtenFrames;
+    }
+    else {
+        ++failedFrames;
+    }
+}
+
+void FrameExporter::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobsChanged.wait(lock, [this] { return !jobs.empty() || stopping; });
+        if (jobs.empty()) {
+            break;
+        }
+
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        busyWorkers++;
+        lock.unlock();
+
+        encode(job);
+
+        lock.lock();
+        busyWorkers--;
+        jobsChanged.notify_all();
+    }
+}
+
+void FrameExporter::startWorkers() {
+    stopWorkers();
+    int numWorkers = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, 8);
+    for (int i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&FrameExporter::workerLoop, this);
+    }
+}
+
+void FrameExporter::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobsChanged.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+bool FrameExporter::finishIfDone() {
+    if (!active || nextFrame < getNumFrames() || slots[0].fence != nullptr || slots[1].fence != nullptr) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!jobs.empty() || busyWorkers > 0) {
+            return false;
+        }
+    }
+
+    stopWorkers();
+    milliseconds = nowMilliseconds() - startTime;
+    active = false;
+    return true;
+}
+
+void FrameExporter::cancel() {
+    if (!active) {
+        return;
+    }
+
+    for (Slot &slot : slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        slot.numFrames = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.clear();
+    }
+    stopWorkers(); // frames being encoded still finish
+    active = false;
+}
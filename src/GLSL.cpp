@@ -13,8 +13,12 @@
 #include "GLSL.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
 
 using namespace std;
 
@@ -155,4 +159,146 @@ int textFileWrite(const char *fn, const char *s)
 	return(status);
 }
 
+static string programCacheDir;
+
+// Every user GLSL edit links a new source, so the directory is pruned to the most recently used binaries
+static const size_t MAX_CACHED_PROGRAMS = 128;
+static const uintmax_t MAX_CACHE_BYTES = 256ull << 20;
+
+void setProgramCacheDir(const string &dir)
+{
+	programCacheDir = dir;
+	if(!programCacheDir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(programCacheDir, ec);
+		if(ec) {
+			printf("Could not create program cache directory %s\n", programCacheDir.c_str());
+			programCacheDir.clear();
+		}
+	}
+}
+
+// FNV-1a
+uint64_t hashString(const string &s, uint64_t seed)
+{
+	uint64_t hash = seed;
+	for(unsigned char c : s) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Binaries are only valid for the driver that produced them
+static string cachePath(const string &source)
+{
+	string driver = string((const char *)glGetString(GL_VENDOR)) + "|" +
+		(const char *)glGetString(GL_RENDERER) + "|" + (const char *)glGetString(GL_VERSION);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hashString(source, hashString(driver)));
+	return (std::filesystem::path(programCacheDir) / name).string();
+}
+
+GLuint loadCachedProgram(const string &source)
+{
+	if(programCacheDir.empty()) {
+		return 0;
+	}
+
+	string path = cachePath(source);
+	ifstream file(path, ios::binary);
+	if(!file.is_open()) {
+		return 0;
+	}
+	GLenum format = 0;
+	file.read((char *)&format, sizeof(format));
+	if(!file) {
+		return 0;
+	}
+	vector<char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	if(binary.empty()) {
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+	GLint rc = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &rc);
+	if(!rc) {
+		// Driver update or corrupt file, recompile from source
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	// The write time doubles as the last use for pruning
+	file.close();
+	std::error_code ec;
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+	return program;
+}
+
+// Removes the least recently used binaries until the cache fits both caps
+static void pruneProgramCache()
+{
+	struct Entry {
+		std::filesystem::path path;
+		std::filesystem::file_time_type time;
+		uintmax_t size;
+	};
+	vector<Entry> entries;
+	uintmax_t totalBytes = 0;
+	std::error_code ec;
+	for(const auto &item : std::filesystem::directory_iterator(programCacheDir, ec)) {
+		if(!item.is_regular_file(ec) || item.path().extension() != ".bin") {
+			continue;
+		}
+		Entry entry{item.path(), item.last_write_time(ec), item.file_size(ec)};
+		if(ec) {
+			continue;
+		}
+		totalBytes += entry.size;
+		entries.push_back(entry);
+	}
+	if(entries.size() <= MAX_CACHED_PROGRAMS && totalBytes <= MAX_CACHE_BYTES) {
+		return;
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+	size_t count = entries.size();
+	for(const Entry &entry : entries) {
+		if(count <= MAX_CACHED_PROGRAMS && totalBytes <= MAX_CACHE_BYTES) {
+			break;
+		}
+		if(std::filesystem::remove(entry.path, ec)) {
+			count--;
+			totalBytes -= entry.size;
+		}
+	}
+}
+
+void saveCachedProgram(GLuint program, const string &source)
+{
+	if(programCacheDir.empty()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) {
+		return;
+	}
+	vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, NULL, &format, binary.data());
+
+	ofstream file(cachePath(source), ios::binary);
+	if(!file.is_open()) {
+		return;
+	}
+	file.write((const char *)&format, sizeof(format));
+	file.write(binary.data(), binary.size());
+	file.close();
+	pruneProgramCache();
+}
+
 }
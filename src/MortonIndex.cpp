@@ -0,0 +1,384 @@
+#include "MortonIndex.h"
+
+#include <chrono>
+#include <cfloat>
+#include <functional>
+#include <omp.h>
+#include <queue>
+#include <utility>
+
+namespace {
+    bool isEmpty(const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+        return boxMin.x > boxMax.x;
+    }
+
+    bool contains(const glm::vec3 &boxMin, const glm::vec3 &boxMax, const glm::vec3 &p) {
+        return p.x >= boxMin.x && p.y >= boxMin.y && p.z >= boxMin.z && p.x <= boxMax.x && p.y <= boxMax.y && p.z <= boxMax.z;
+    }
+
+    // Entry distance along the ray, false if the ray misses the box
+    bool rayBox(const glm::vec3 &origin, const glm::vec3 &invDir, const glm::vec3 &boxMin, const glm::vec3 &boxMax, float &tEnter) {
+        glm::vec3 t1 = (boxMin - origin) * invDir;
+        glm::vec3 t2 = (boxMax - origin) * invDir;
+        glm::vec3 tNear = glm::min(t1, t2);
+        glm::vec3 tFar = glm::max(t1, t2);
+        tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float tExit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        return tExit >= tEnter;
+    }
+
+    float boxDistance2(const glm::vec3 &boxMin, const glm::vec3 &boxMax, const glm::vec3 &p) {
+        glm::vec3 d = glm::max(glm::max(boxMin - p, p - boxMax), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+}
+
+MortonIndex::MortonIndex() : firstLeaf(0), numLeaves(0), buildMilliseconds(0.0) {}
+
+void MortonIndex::clear() {
+    order.clear();
+    nodes.clear();
+    firstLeaf = 0;
+    numLeaves = 0;
+}
+
+uint32_t MortonIndex::spreadBits(uint32_t v) {
+    // 10 bits -> every third bit of 30
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+void MortonIndex::sortByKey(std::vector<uint32_t> &keys) {
+    const int RADIX_BITS = 11;
+    const size_t NUM_BUCKETS = size_t(1) << RADIX_BITS;
+    const size_t n = keys.size();
+    const int numChunks = omp_get_max_threads();
+
+    std::vector<uint32_t> keysOut(n);
+    std::vector<uint32_t> orderOut(n);
+    std::vector<size_t> histograms(NUM_BUCKETS * numChunks);
+
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS) {
+        std::fill(histograms.begin(), histograms.end(), 0);
+
+        #pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < numChunks; c++) {
+            size_t *histogram = histograms.data() + NUM_BUCKETS * c;
+            for (size_t i = n * c / numChunks; i < n * (c + 1) / numChunks; i++) {
+                histogram[(keys[i] >> shift) & (NUM_BUCKETS - 1)]++;
+            }
+        }
+
+        // Exclusive prefix sum bucket major, chunk minor, so every chunk scatters in order (stable)
+        size_t sum = 0;
+        bool constantDigit = false;
+        for (size_t b = 0; b < NUM_BUCKETS && !constantDigit; b++) {
+            size_t bucketStart = sum;
+            for (int c = 0; c < numChunks; c++) {
+                size_t count = histograms[NUM_BUCKETS * c + b];
+                histograms[NUM_BUCKETS * c + b] = sum;
+                sum += count;
+            }
+            constantDigit = sum - bucketStart == n;
+        }
+        if (constantDigit) {
+            continue;
+        }
+
+        #pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < numChunks; c++) {
+            size_t *offsets = histograms.data() + NUM_BUCKETS * c;
+            for (size_t i = n * c / numChunks; i < n * (c + 1) / numChunks; i++) {
+                size_t dst = offsets[(keys[i] >> shift) & (NUM_BUCKETS - 1)]++;
+                keysOut[dst] = keys[i];
+                orderOut[dst] = order[i];
+            }
+        }
+        keys.swap(keysOut);
+        order.swap(orderOut);
+    }
+}
+
+void MortonIndex::build(const std::vector<glm::vec4> &events) {
+    auto start = std::chrono::steady_clock::now();
+    clear();
+    if (events.empty()) {
+        buildMilliseconds = 0.0;
+        return;
+    }
+
+    // Bounds, reduced by hand per chunk
+    const int n = static_cast<int>(events.size());
+    const int numChunks = omp_get_max_threads();
+    std::vector<glm::vec3> chunkMin(numChunks, glm::vec3(FLT_MAX));
+    std::vector<glm::vec3> chunkMax(numChunks, glm::vec3(-FLT_MAX));
+    #pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < numChunks; c++) {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (int i = static_cast<int>(int64_t(n) * c / numChunks); i < static_cast<int>(int64_t(n) * (c + 1) / numChunks); i++) {
+            lo = glm::min(lo, glm::vec3(events[i]));
+            hi = glm::max(hi, glm::vec3(events[i]));
+        }
+        chunkMin[c] = lo;
+        chunkMax[c] = hi;
+    }
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (int c = 0; c < numChunks; c++) {
+        boundsMin = glm::min(boundsMin, chunkMin[c]);
+        boundsMax = glm::max(boundsMax, chunkMax[c]);
+    }
+
+    const float cells = static_cast<float>((1 << MORTON_BITS) - 1);
+    const glm::vec3 scale = cells / glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+    std::vector<uint32_t> keys(n);
+    order.resize(n);
+    #pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        glm::uvec3 q = glm::uvec3(glm::clamp((glm::vec3(events[i]) - boundsMin) * scale, glm::vec3(0.0f), glm::vec3(cells)));
+        keys[i] = spreadBits(q.x) | (spreadBits(q.y) << 1) | (spreadBits(q.z) << 2);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    sortByKey(keys);
+
+    // Leaves padded to a power of two so the tree is complete
+    numLeaves = (order.size() + LEAF_SIZE - 1) / LEAF_SIZE;
+    size_t paddedLeaves = 1;
+    while (paddedLeaves < numLeaves) {
+        paddedLeaves <<= 1;
+    }
+    firstLeaf = paddedLeaves - 1;
+    nodes.assign(2 * paddedLeaves - 1, Node{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) });
+
+    const int numLeavesInt = static_cast<int>(numLeaves);
+    #pragma omp parallel for
+    for (int l = 0; l < numLeavesInt; l++) {
+        Node &leaf = nodes[firstLeaf + l];
+        for (size_t i = leafBegin(firstLeaf + l); i < leafEnd(firstLeaf + l); i++) {
+            leaf.boxMin = glm::min(leaf.boxMin, glm::vec3(events[order[i]]));
+            leaf.boxMax = glm::max(leaf.boxMax, glm::vec3(events[order[i]]));
+        }
+    }
+
+    // Level by level towards the root, level of width w starts at node w - 1
+    for (size_t width = paddedLeaves / 2; width >= 1; width /= 2) {
+        const int levelBegin = static_cast<int>(width - 1);
+        const int levelEnd = static_cast<int>(2 * width - 1);
+        #pragma omp parallel for
+        for (int i = levelBegin; i < levelEnd; i++) {
+            const Node &left = nodes[2 * i + 1];
+            const Node &right = nodes[2 * i + 2];
+            nodes[i] = { glm::min(left.boxMin, right.boxMin), glm::max(left.boxMax, right.boxMax) };
+        }
+    }
+
+    buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MortonIndex::appendSubtree(size_t node, std::vector<uint32_t> &out) const {
+    // A subtree owns a contiguous run of leaves, so its events are contiguous in order
+    size_t first = node, last = node;
+    while (!isLeaf(first)) {
+        first = 2 * first + 1;
+        last = 2 * last + 2;
+    }
+    size_t begin = std::min(leafBegin(first), order.size());
+    size_t end = std::min(leafBegin(last) + LEAF_SIZE, order.size());
+    if (begin < end) {
+        out.insert(out.end(), order.begin() + begin, order.begin() + end);
+    }
+}
+
+void MortonIndex::queryBox(const std::vector<glm::vec4> &events, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+    std::vector<uint32_t> &out) const {
+
+    if (!isBuilt()) {
+        return;
+    }
+
+    std::vector<size_t> stack = { 0 };
+    while (!stack.empty()) {
+        size_t node = stack.back();
+        stack.pop_back();
+        const Node &box = nodes[node];
+        if (isEmpty(box.boxMin, box.boxMax) || glm::any(glm::greaterThan(box.boxMin, boxMax)) || glm::any(glm::lessThan(box.boxMax, boxMin))) {
+            continue;
+        }
+        if (contains(boxMin, boxMax, box.boxMin) && contains(boxMin, boxMax, box.boxMax)) {
+            appendSubtree(node, out);
+        }
+        else if (isLeaf(node)) {
+            for (size_t i = leafBegin(node); i < leafEnd(node); i++) {
+                if (contains(boxMin, boxMax, glm::vec3(events[order[i]]))) {
+                    out.push_back(order[i]);
+                }
+            }
+        }
+        else {
+            stack.push_back(2 * node + 2);
+            stack.push_back(2 * node + 1);
+        }
+    }
+}
+
+void MortonIndex::queryFrustum(const std::vector<glm::vec4> &events, const glm::mat4 &viewProj, std::vector<uint32_t> &out) const {
+    if (!isBuilt()) {
+        return;
+    }
+
+    // Gribb / Hartmann planes, inside when dot(plane.xyz, p) + plane.w >= 0
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; r++) {
+        rows[r] = glm::vec4(viewProj[0][r], viewProj[1][r], viewProj[2][r], viewProj[3][r]);
+    }
+    const glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+        rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+
+    std::vector<size_t> stack = { 0 };
+    while (!stack.empty()) {
+        size_t node = stack.back();
+        stack.pop_back();
+        const Node &box = nodes[node];
+        if (isEmpty(box.boxMin, box.boxMax)) {
+            continue;
+        }
+
+        // Farthest corner along each normal decides outside, nearest decides fully inside
+        bool outside = false, inside = true;
+        for (const glm::vec4 &plane : planes) {
+            glm::vec3 normal(plane);
+            glm::vec3 farCorner = glm::mix(box.boxMin, box.boxMax, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+            glm::vec3 nearCorner = glm::mix(box.boxMax, box.boxMin, glm::vec3(glm::greaterThanEqual(normal, glm::vec3(0.0f))));
+            if (glm::dot(normal, farCorner) + plane.w < 0.0f) {
+                outside = true;
+                break;
+            }
+            inside &= glm::dot(normal, nearCorner) + plane.w >= 0.0f;
+        }
+
+        if (outside) {
+            continue;
+        }
+        if (inside) {
+            appendSubtree(node, out);
+        }
+        else if (isLeaf(node)) {
+            for (size_t i = leafBegin(node); i < leafEnd(node); i++) {
+                glm::vec3 p(events[order[i]]);
+                bool keep = true;
+                for (const glm::vec4 &plane : planes) {
+                    keep &= glm::dot(glm::vec3(plane), p) + plane.w >= 0.0f;
+                }
+                if (keep) {
+                    out.push_back(order[i]);
+                }
+            }
+        }
+        else {
+            stack.push_back(2 * node + 2);
+            stack.push_back(2 * node + 1);
+        }
+    }
+}
+
+int MortonIndex::pick(const std::vector<glm::vec4> &events, const glm::vec3 &origin, const glm::vec3 &dir, float radius) const {
+    if (!isBuilt()) {
+        return -1;
+    }
+
+    const glm::vec3 invDir = 1.0f / dir;
+    const glm::vec3 pad(radius);
+    const float radius2 = radius * radius;
+    int best = -1;
+    float bestT = FLT_MAX;
+
+    // Nearer child is visited first so bestT prunes the farther one early
+    std::vector<std::pair<size_t, float>> stack;
+    float tEnter;
+    if (rayBox(origin, invDir, nodes[0].boxMin - pad, nodes[0].boxMax + pad, tEnter)) {
+        stack.push_back({ 0, tEnter });
+    }
+    while (!stack.empty()) {
+        auto [node, tNode] = stack.back();
+        stack.pop_back();
+        if (tNode > bestT) {
+            continue;
+        }
+
+        if (isLeaf(node)) {
+            for (size_t i = leafBegin(node); i < leafEnd(node); i++) {
+                glm::vec3 v = glm::vec3(events[order[i]]) - origin;
+                float t = glm::dot(v, dir);
+                if (t >= 0.0f && t < bestT && glm::dot(v, v) - t * t <= radius2) {
+                    bestT = t;
+                    best = static_cast<int>(order[i]);
+                }
+            }
+            continue;
+        }
+
+        float tChild[2];
+        bool hit[2];
+        for (int c = 0; c < 2; c++) {
+            const Node &child = nodes[2 * node + 1 + c];
+            hit[c] = !isEmpty(child.boxMin, child.boxMax) && rayBox(origin, invDir, child.boxMin - pad, child.boxMax + pad, tChild[c]);
+        }
+        int nearer = (hit[0] && hit[1] && tChild[1] < tChild[0]) ? 1 : 0;
+        for (int c : { 1 - nearer, nearer }) {
+            if (hit[c] && tChild[c] <= bestT) {
+                stack.push_back({ 2 * node + 1 + c, tChild[c] });
+            }
+        }
+    }
+    return best;
+}
+
+void MortonIndex::nearest(const std::vector<glm::vec4> &events, const glm::vec3 &point, int k, std::vector<uint32_t> &out) const {
+    out.clear();
+    if (!isBuilt() || k <= 0) {
+        return;
+    }
+
+    // Best first over the boxes, results kept in a max heap of the k closest so far
+    using Entry = std::pair<float, size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> frontier;
+    std::priority_queue<Entry> results;
+    frontier.push({ boxDistance2(nodes[0].boxMin, nodes[0].boxMax, point), 0 });
+    while (!frontier.empty()) {
+        auto [distance2, node] = frontier.top();
+        frontier.pop();
+        if (static_cast<int>(results.size()) == k && distance2 >= results.top().first) {
+            break;
+        }
+
+        if (isLeaf(node)) {
+            for (size_t i = leafBegin(node); i < leafEnd(node); i++) {
+                glm::vec3 d = glm::vec3(events[order[i]]) - point;
+                float d2 = glm::dot(d, d);
+                if (static_cast<int>(results.size()) < k) {
+                    results.push({ d2, order[i] });
+                }
+                else if (d2 < results.top().first) {
+                    results.pop();
+                    results.push({ d2, order[i] });
+                }
+            }
+            continue;
+        }
+
+        for (size_t child = 2 * node + 1; child <= 2 * node + 2; child++) {
+            if (!isEmpty(nodes[child].boxMin, nodes[child].boxMax)) {
+                frontier.push({ boxDistance2(nodes[child].boxMin, nodes[child].boxMax, point), child });
+            }
+        }
+    }
+
+    out.resize(results.size());
+    for (size_t i = out.size(); i-- > 0;) {
+        out[i] = static_cast<uint32_t>(results.top().second);
+        results.pop();
+    }
+}
@@ -0,0 +1,181 @@
+#include "PixelIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+
+PixelIndex::PixelIndex() : resolution(0), buildMilliseconds(0.0) {}
+
+void PixelIndex::clear() {
+    offsets.clear();
+    eventIndices.clear();
+    times.clear();
+    resolution = glm::ivec2(0);
+}
+
+void PixelIndex::build(const std::vector<glm::vec4> &events, glm::ivec2 res) {
+    auto start = std::chrono::steady_clock::now();
+
+    clear();
+    if (res.x <= 0 || res.y <= 0) {
+        return;
+    }
+    resolution = res;
+
+    const int numPixels = res.x * res.y;
+    const int numEvents = static_cast<int>(events.size());
+    const int numChunks = std::max(1, std::min(omp_get_max_threads(), numEvents / 65536 + 1));
+
+    // Pixel of every event, -1 if outside the sensor
+    std::vector<int> pixelOf(numEvents);
+
+    // Count per chunk and pixel
+    std::vector<uint32_t> counts(static_cast<size_t>(numChunks) * numPixels, 0);
+    #pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+    for (int c = 0; c < numChunks; c++) {
+        int first = static_cast<int>(static_cast<long long>(numEvents) * c / numChunks);
+        int last = static_cast<int>(static_cast<long long>(numEvents) * (c + 1) / numChunks);
+        uint32_t *chunkCounts = counts.data() + static_cast<size_t>(c) * numPixels;
+        for (int i = first; i < last; i++) {
+            int x = static_cast<int>(events[i].x);
+            int y = static_cast<int>(events[i].y);
+            int p = contains(x, y) ? y * res.x + x : -1;
+            pixelOf[i] = p;
+            if (p >= 0) {
+                chunkCounts[p]++;
+            }
+        }
+    }
+
+    // Exclusive prefix sum over (pixel, chunk), turning counts into each chunk's write cursor
+    offsets.resize(static_cast<size_t>(numPixels) + 1);
+    uint32_t running = 0;
+    for (int p = 0; p < numPixels; p++) {
+        offsets[p] = running;
+        for (int c = 0; c < numChunks; c++) {
+            uint32_t &count = counts[static_cast<size_t>(c) * numPixels + p];
+            uint32_t n = count;
+            count = running;
+            running += n;
+        }
+    }
+    offsets[numPixels] = running;
+
+    // Scatter in event order so every pixel's slice ends up sorted by time
+    eventIndices.resize(running);
+    times.resize(running);
+    #pragma omp parallel for num_threads(numChunks) schedule(static, 1)
+    for (int c = 0; c < numChunks; c++) {
+        int first = static_cast<int>(static_cast<long long>(numEvents) * c / numChunks);
+        int last = static_cast<int>(static_cast<long long>(numEvents) * (c + 1) / numChunks);
+        uint32_t *cursor = counts.data() + static_cast<size_t>(c) * numPixels;
+        for (int i = first; i < last; i++) {
+            int p = pixelOf[i];
+            if (p >= 0) {
+                uint32_t dst = cursor[p]++;
+                eventIndices[dst] = static_cast<uint32_t>(i);
+                times[dst] = events[i].z;
+            }
+        }
+    }
+
+    buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+PixelIndex::Slice PixelIndex::getPixel(int x, int y) const {
+    Slice slice;
+    if (!isBuilt() || !contains(x, y)) {
+        return slice;
+    }
+    int p = y * resolution.x + x;
+    slice.eventIndices = eventIndices.data() + offsets[p];
+    slice.times = times.data() + offsets[p];
+    slice.size = offsets[p + 1] - offsets[p];
+    return slice;
+}
+
+PixelIndex::Slice PixelIndex::getPixel(int x, int y, float t0, float t1) const {
+    Slice slice = getPixel(x, y);
+    if (slice.size == 0) {
+        return slice;
+    }
+    const float *first = std::lower_bound(slice.times, slice.times + slice.size, t0);
+    const float *last = std::upper_bound(first, slice.times + slice.size, t1);
+    size_t skip = first - slice.times;
+    slice.eventIndices += skip;
+    slice.times += skip;
+    slice.size = last - first;
+    return slice;
+}
+
+PixelIndex::Slice PixelIndex::getPixelEvents(int x, int y, uint32_t eventBound_L, uint32_t eventBound_R) const {
+    Slice slice = getPixel(x, y);
+    if (slice.size == 0) {
+        return slice;
+    }
+    // Events are scattered in their original order, so the indices of a slice are ascending too
+    const uint32_t *first = std::lower_bound(slice.eventIndices, slice.eventIndices + slice.size, eventBound_L);
+    const uint32_t *last = std::upper_bound(first, slice.eventIndices + slice.size, eventBound_R);
+    size_t skip = first - slice.eventIndices;
+    slice.eventIndices += skip;
+    slice.times += skip;
+    slice.size = last - first;
+    return slice;
+}
+
+void PixelIndex::queryROI(glm::ivec2 roiMin, glm::ivec2 roiMax, float t0, float t1, std::vector<uint32_t> &out) const {
+    if (!isBuilt()) {
+        return;
+    }
+    roiMin = glm::max(roiMin, glm::ivec2(0));
+    roiMax = glm::min(roiMax, resolution - 1);
+    for (int y = roiMin.y; y <= roiMax.y; y++) {
+        for (int x = roiMin.x; x <= roiMax.x; x++) {
+            Slice slice = getPixel(x, y, t0, t1);
+            out.insert(out.end(), slice.eventIndices, slice.eventIndices + slice.size);
+        }
+    }
+}
+
+size_t PixelIndex::countROI(glm::ivec2 roiMin, glm::ivec2 roiMax, float t0, float t1) const {
+    if (!isBuilt()) {
+        return 0;
+    }
+    roiMin = glm::max(roiMin, glm::ivec2(0));
+    roiMax = glm::min(roiMax, resolution - 1);
+    size_t count = 0;
+    for (int y = roiMin.y; y <= roiMax.y; y++) {
+        for (int x = roiMin.x; x <= roiMax.x; x++) {
+            count += getPixel(x, y, t0, t1).size;
+        }
+    }
+    return count;
+}
+
+IntervalStats PixelIndex::getIntervalStats(int x, int y, float t0, float t1) const {
+    IntervalStats stats;
+    Slice slice = getPixel(x, y, t0, t1);
+    stats.count = static_cast<uint32_t>(slice.size);
+    if (slice.size < 2) {
+        return stats;
+    }
+
+    // Welford, intervals can be tiny compared to the timestamps
+    double mean = 0.0, m2 = 0.0;
+    float minInterval = slice.times[1] - slice.times[0];
+    float maxInterval = minInterval;
+    for (size_t i = 1; i < slice.size; i++) {
+        float interval = slice.times[i] - slice.times[i - 1];
+        double delta = interval - mean;
+        mean += delta / static_cast<double>(i);
+        m2 += delta * (interval - mean);
+        minInterval = std::min(minInterval, interval);
+        maxInterval = std::max(maxInterval, interval);
+    }
+
+    stats.mean = static_cast<float>(mean);
+    stats.variance = slice.size > 2 ? static_cast<float>(m2 / static_cast<double>(slice.size - 2)) : 0.0f;
+    stats.min = minInterval;
+    stats.max = maxInterval;
+    return stats;
+}
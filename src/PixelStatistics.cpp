@@ -0,0 +1,376 @@
+#include "PixelStatistics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <omp.h>
+#include <utility>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "FilterBank.h"
+#include "GLSL.h"
+
+PixelStatistics::PixelStatistics() : initialized(false), statsTexture(0), lastEventTexture(0), previewTexture(0), offsetsSSBO(0),
+    timesSSBO(0), eventIndicesSSBO(0), allocatedResolution(0), uploadedDataVersion(0), hasUpload(false), numTiles(0),
+    resolution(0), windowSeconds(0.0f), numEvents(0), milliseconds(0.0), usedGPU(false), previewMap(-1), previewGain(-1.0f) {}
+
+PixelStatistics::~PixelStatistics() {
+    GLuint textures[] = { statsTexture, lastEventTexture, previewTexture };
+    for (GLuint texture : textures) {
+        if (texture) {
+            glDeleteTextures(1, &texture);
+        }
+    }
+
+    GLuint buffers[] = { offsetsSSBO, timesSSBO, eventIndicesSSBO };
+    for (GLuint buffer : buffers) {
+        if (buffer) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+}
+
+bool PixelStatistics::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    statsProg.setShaderName(resource_dir + "pixel_stats.comp");
+    if (!statsProg.init()) {
+        std::cerr << "Failed to initialize pixel statistics shader" << std::endl;
+        return false;
+    }
+
+    statsProg.bind();
+    statsProg.addUniform("eventBound_L");
+    statsProg.addUniform("eventBound_R");
+    statsProg.addUniform("t0");
+    statsProg.addUniform("timeToSeconds");
+    statsProg.addUniform("spaceWindow");
+    statsProg.unbind();
+
+    glGenBuffers(1, &offsetsSSBO);
+    glGenBuffers(1, &timesSSBO);
+    glGenBuffers(1, &eventIndicesSSBO);
+
+    initialized = true;
+    return true;
+}
+
+void PixelStatistics::resizeMaps(glm::ivec2 res, float newWindowSeconds) {
+    if (res != resolution || !previewTexture) {
+        if (previewTexture) {
+            glDeleteTextures(1, &previewTexture);
+        }
+        glGenTextures(1, &previewTexture);
+        glBindTexture(GL_TEXTURE_2D, previewTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    size_t numPixels = static_cast<size_t>(res.x) * res.y;
+    countMap.assign(numPixels, 0.0f);
+    polarityMap.assign(numPixels, 0.0f);
+    intervalMeanMap.assign(numPixels, 0.0f);
+    intervalVarianceMap.assign(numPixels, 0.0f);
+    lastEventMap.assign(numPixels, 0.0f);
+
+    resolution = res;
+    windowSeconds = newWindowSeconds;
+    numEvents = 0;
+    previewGain = -1.0f;
+}
+
+void PixelStatistics::computeCPU(const std::vector<glm::vec4> &events, glm::ivec2 res, int eventBound_L, int eventBound_R,
+    float t0, float t1, float timeToSeconds, const glm::vec4 &spaceWindow) {
+
+    if (res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    resizeMaps(res, (t1 - t0) * timeToSeconds);
+    eventBound_L = std::max(eventBound_L, 0);
+    eventBound_R = std::min(eventBound_R, static_cast<int>(events.size()) - 1);
+    const int windowEvents = std::max(eventBound_R - eventBound_L + 1, 0);
+
+    // One tile per thread unless the sensor is too large to keep that many
+    const int numPixels = res.x * res.y;
+    const size_t tileBytes = static_cast<size_t>(numPixels) * sizeof(Cell);
+    numTiles = static_cast<int>(std::max<size_t>(std::min<size_t>(omp_get_max_threads(), MAX_TILE_BYTES / tileBytes), 1));
+    tiles.resize(static_cast<size_t>(numTiles) * numPixels);
+
+    // Tile k accumulates the k-th contiguous run of the window, so each tile is itself time sorted
+    #pragma omp parallel for schedule(static, 1)
+    for (int k = 0; k < numTiles; k++) {
+        Cell *tile = tiles.data() + static_cast<size_t>(k) * numPixels;
+        std::fill(tile, tile + numPixels, Cell{ 0, 0, 0.0f, 0.0f, 0.0, 0.0 });
+
+        const int begin = eventBound_L + static_cast<int>(static_cast<int64_t>(windowEvents) * k / numTiles);
+        const int end = eventBound_L + static_cast<int>(static_cast<int64_t>(windowEvents) * (k + 1) / numTiles);
+        for (int i = begin; i < end; i++) {
+            const glm::vec4 &e = events[i];
+            int x = static_cast<int>(e.x);
+            int y = static_cast<int>(e.y);
+            // spaceWindow: x = top, y = right, z = bottom, w = left
+            if (x < 0 || y < 0 || x >= res.x || y >= res.y ||
+                x < spaceWindow.w || x > spaceWindow.y || y < spaceWindow.x || y > spaceWindow.z) {
+                continue;
+            }
+
+            Cell &cell = tile[y * res.x + x];
+            float t = (e.z - t0) * timeToSeconds;
+            if (cell.count > 0) {
+                // Welford, the count-th interval of this tile
+                double interval = static_cast<double>(t) - cell.last;
+                double delta = interval - cell.intervalMean;
+                cell.intervalMean += delta / cell.count;
+                cell.intervalM2 += delta * (interval - cell.intervalMean);
+            }
+            else {
+                cell.first = t;
+            }
+            cell.last = t;
+            cell.count++;
+            if (e.w > 0.5f) {
+                cell.positive++;
+            }
+        }
+    }
+
+    // Merge the tiles of every pixel in time order
+    long long total = 0;
+    #pragma omp parallel for schedule(static) reduction(+:total)
+    for (int p = 0; p < numPixels; p++) {
+        Cell acc = tiles[p];
+        for (int k = 1; k < numTiles; k++) {
+            const Cell &cell = tiles[static_cast<size_t>(k) * numPixels + p];
+            if (cell.count == 0) {
+                continue;
+            }
+            if (acc.count == 0) {
+                acc = cell;
+                continue;
+            }
+
+            // The gap between the two tiles is one more interval of acc
+            double countA = acc.count;
+            double gap = static_cast<double>(cell.first) - acc.last;
+            double delta = gap - acc.intervalMean;
+            acc.intervalMean += delta / countA;
+            acc.intervalM2 += delta * (gap - acc.intervalMean);
+
+            // Chan et al. for the intervals inside the next tile
+            double countB = cell.count - 1.0;
+            if (countB > 0.0) {
+                double n = countA + countB;
+                delta = cell.intervalMean - acc.intervalMean;
+                acc.intervalMean += delta * countB / n;
+                acc.intervalM2 += cell.intervalM2 + delta * delta * countA * countB / n;
+            }
+
+            acc.count += cell.count;
+            acc.positive += cell.positive;
+            acc.last = cell.last;
+        }
+
+        if (acc.count == 0) {
+            continue;
+        }
+        countMap[p] = static_cast<float>(acc.count);
+        polarityMap[p] = static_cast<float>(acc.positive) / acc.count;
+        intervalMeanMap[p] = acc.count > 1 ? static_cast<float>(acc.intervalMean) : 0.0f;
+        intervalVarianceMap[p] = acc.count > 2 ? static_cast<float>(acc.intervalM2 / (acc.count - 2)) : 0.0f;
+        lastEventMap[p] = acc.last;
+        total += acc.count;
+    }
+
+    numEvents = static_cast<size_t>(total);
+    usedGPU = false;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PixelStatistics::uploadIndex(const PixelIndex &index, uint64_t dataVersion) {
+    if (hasUpload && dataVersion == uploadedDataVersion) {
+        return;
+    }
+
+    const std::vector<uint32_t> &offsets = index.getOffsets();
+    const std::vector<float> &times = index.getTimes();
+    const std::vector<uint32_t> &eventIndices = index.getEventIndices();
+
+    // Empty buffers cannot be bound, keep at least one element
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, offsetsSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(offsets.size(), 1) * sizeof(uint32_t), offsets.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, timesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(times.size(), 1) * sizeof(float), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, times.size() * sizeof(float), times.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, eventIndicesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(eventIndices.size(), 1) * sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, eventIndices.size() * sizeof(uint32_t), eventIndices.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    uploadedDataVersion = dataVersion;
+    hasUpload = true;
+}
+
+void PixelStatistics::computeGPU(GLuint evtParticlesSSBO, const PixelIndex &index, uint64_t dataVersion, int eventBound_L,
+    int eventBound_R, float t0, float t1, float timeToSeconds, const glm::vec4 &spaceWindow) {
+
+    glm::ivec2 res = index.getResolution();
+    if (!initialized || !index.isBuilt() || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    if (res != allocatedResolution) {
+        GLuint textures[] = { statsTexture, lastEventTexture };
+        for (GLuint texture : textures) {
+            if (texture) {
+                glDeleteTextures(1, &texture);
+            }
+        }
+
+        glGenTextures(1, &statsTexture);
+        glBindTexture(GL_TEXTURE_2D, statsTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, res.x, res.y);
+        glGenTextures(1, &lastEventTexture);
+        glBindTexture(GL_TEXTURE_2D, lastEventTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, res.x, res.y);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        allocatedResolution = res;
+    }
+
+    resizeMaps(res, (t1 - t0) * timeToSeconds);
+    uploadIndex(index, dataVersion);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, offsetsSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, timesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, eventIndicesSSBO);
+    glBindImageTexture(0, statsTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, lastEventTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    statsProg.bind();
+    glUniform1i(statsProg.getUniform("eventBound_L"), std::max(eventBound_L, 0));
+    glUniform1i(statsProg.getUniform("eventBound_R"), eventBound_R);
+    glUniform1f(statsProg.getUniform("t0"), t0);
+    glUniform1f(statsProg.getUniform("timeToSeconds"), timeToSeconds);
+    glUniform4fv(statsProg.getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+    statsProg.dispatch((res.x + 15) / 16, (res.y + 15) / 16, 1);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    statsProg.unbind();
+
+    // Read the maps back so both paths end in the same CPU side result
+    std::vector<glm::vec4> stats(static_cast<size_t>(res.x) * res.y);
+    glBindTexture(GL_TEXTURE_2D, statsTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, stats.data());
+    glBindTexture(GL_TEXTURE_2D, lastEventTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, lastEventMap.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    size_t total = 0;
+    for (size_t p = 0; p < stats.size(); p++) {
+        countMap[p] = stats[p].r;
+        polarityMap[p] = stats[p].g;
+        intervalMeanMap[p] = stats[p].b;
+        intervalVarianceMap[p] = stats[p].a;
+        total += static_cast<size_t>(stats[p].r);
+    }
+
+    numEvents = total;
+    usedGPU = true;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void PixelStatistics::updatePreview(int map, float gain) {
+    if (!hasResult()) {
+        return;
+    }
+
+    // Intervals span decades, so they are coloured on a log scale between the extremes of the map
+    const std::vector<float> &logMap = map == INTERVAL_VARIANCE_MAP ? intervalVarianceMap : intervalMeanMap;
+    float logMin = 0.0f, logMax = 0.0f;
+    if (map == INTERVAL_MEAN_MAP || map == INTERVAL_VARIANCE_MAP) {
+        bool found = false;
+        for (float v : logMap) {
+            if (v > 0.0f) {
+                float l = std::log(v);
+                logMin = found ? std::min(logMin, l) : l;
+                logMax = found ? std::max(logMax, l) : l;
+                found = true;
+            }
+        }
+    }
+    float logRange = logMax > logMin ? logMax - logMin : 1.0f;
+    float lastRange = windowSeconds > 0.0f ? windowSeconds : 1.0f;
+
+    std::vector<unsigned char> pixels(countMap.size() * 4);
+    for (size_t p = 0; p < countMap.size(); p++) {
+        float brightness = 1.0f - std::exp(-gain * countMap[p]);
+        glm::vec3 color;
+        if (map == POLARITY_MAP) {
+            color = FilterBank::colorMap(polarityMap[p]) * brightness;
+        }
+        else if (map == INTERVAL_MEAN_MAP || map == INTERVAL_VARIANCE_MAP) {
+            color = logMap[p] > 0.0f ? FilterBank::colorMap((std::log(logMap[p]) - logMin) / logRange) * brightness : glm::vec3(0.0f);
+        }
+        else if (map == LAST_EVENT_MAP) {
+            color = FilterBank::colorMap(std::clamp(lastEventMap[p] / lastRange, 0.0f, 1.0f)) * brightness;
+        }
+        else {
+            color = glm::vec3(brightness);
+        }
+        pixels[4 * p + 0] = static_cast<unsigned char>(color.r * 255.0f + 0.5f);
+        pixels[4 * p + 1] = static_cast<unsigned char>(color.g * 255.0f + 0.5f);
+        pixels[4 * p + 2] = static_cast<unsigned char>(color.b * 255.0f + 0.5f);
+        pixels[4 * p + 3] = 255;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    previewMap = map;
+    previewGain = gain;
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+bool PixelStatistics::exportMaps(const std::string &basePath) const {
+    if (!hasResult()) {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(basePath).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    const std::pair<const char *, const std::vector<float> *> maps[] = {
+        { "count", &countMap },
+        { "polarity", &polarityMap },
+        { "interval_mean", &intervalMeanMap },
+        { "interval_variance", &intervalVarianceMap },
+        { "last_event", &lastEventMap },
+    };
+
+    bool ok = true;
+    for (const auto &map : maps) {
+        // Header only, imwrite does not modify the data
+        cv::Mat image(resolution.y, resolution.x, CV_32F, const_cast<float *>(map.second->data()));
+        ok &= cv::imwrite(basePath + "_" + map.first + ".tiff", image);
+    }
+    return ok;
+}
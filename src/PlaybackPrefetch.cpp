@@ -0,0 +1,84 @@
+#include "PlaybackPrefetch.h"
+
+PlaybackPrefetch::PlaybackPrefetch() : filled{ false, false }, front(0), shownSlot(0), key(), hasKey(false),
+    lastPresentTime(-1.0), achievedFPS(0.0f), hits(0), misses(0) {}
+
+bool PlaybackPrefetch::init(const std::string &resource_dir) {
+    return slots[0].init(resource_dir) && slots[1].init(resource_dir);
+}
+
+void PlaybackPrefetch::validate(const PrefetchKey &newKey) {
+    if (hasKey && newKey == key) {
+        return;
+    }
+    key = newKey;
+    hasKey = true;
+    filled[0] = false;
+    filled[1] = false;
+}
+
+int PlaybackPrefetch::find(const ShutterRange &range, int &layer) const {
+    // Front first, it is where playback normally is
+    for (int slot : { front, 1 - front }) {
+        if (!filled[slot]) {
+            continue;
+        }
+        for (int i = 0; i < slots[slot].getNumLayers(); i++) {
+            const ShutterRange &candidate = slots[slot].getRange(i);
+            if (candidate.eventBound_L == range.eventBound_L && candidate.eventBound_R == range.eventBound_R) {
+                layer = i;
+                return slot;
+            }
+        }
+    }
+    return -1;
+}
+
+void PlaybackPrefetch::fill(int slot, const std::vector<ShutterRange> &ranges, GLuint evtParticlesSSBO) {
+    if (!hasKey || ranges.empty()) {
+        filled[slot] = false;
+        return;
+    }
+
+    slots[slot].render(evtParticlesSSBO, ranges, key.resolution, key.spaceWindow, key.isPositiveOnly, key.funcID,
+        key.freq, key.width, key.contribution, key.visibilityVersion != 0);
+    filled[slot] = slots[slot].getNumLayers() > 0;
+}
+
+void PlaybackPrefetch::invalidateBack() {
+    filled[1 - front] = false;
+}
+
+void PlaybackPrefetch::show(int slot, int layer) {
+    // Playback moved past the front slot, its frames are behind and it becomes the next refill
+    if (slot != front) {
+        filled[front] = false;
+        front = slot;
+    }
+    if (slots[slot].getResolvedLayer() != layer) {
+        slots[slot].resolveLayer(layer);
+    }
+    shownSlot = slot;
+}
+
+void PlaybackPrefetch::notePresented(double t, bool hit) {
+    if (hit) {
+        hits++;
+    }
+    else {
+        misses++;
+    }
+
+    if (lastPresentTime >= 0.0 && t > lastPresentTime) {
+        float instantFPS = static_cast<float>(1.0 / (t - lastPresentTime));
+        achievedFPS = achievedFPS > 0.0f ? 0.9f * achievedFPS + 0.1f * instantFPS : instantFPS;
+    }
+    lastPresentTime = t;
+}
+
+void PlaybackPrefetch::resetStats() {
+    lastPresentTime = -1.0;
+    achievedFPS = 0.0f;
+    hits = 0;
+    misses = 0;
+}
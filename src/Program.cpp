@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
 
 #include "GLSL.h"
 
@@ -36,15 +37,34 @@ bool Program::init()
 {
 	GLint rc;
 	
+	// Read shader sources
+	char *vshader = GLSL::textFileRead(vShaderName.c_str());
+	char *fshader = GLSL::textFileRead(fShaderName.c_str());
+	if(vshader == NULL || fshader == NULL) {
+		free(vshader);
+		free(fshader);
+		return false;
+	}
+	string cacheSource = string(vshader) + '\0' + fshader;
+
+	// Linked binary from an earlier run with the exact same sources and driver
+	pid = GLSL::loadCachedProgram(cacheSource);
+	if(pid != 0) {
+		free(vshader);
+		free(fshader);
+		if(isVerbose()) {
+			cout << "Loaded cached program " << vShaderName << " and " << fShaderName << endl;
+		}
+		return true;
+	}
+	
 	// Create shader handles
 	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
-	
-	// Read shader sources
-	const char *vshader = GLSL::textFileRead(vShaderName.c_str());
-	const char *fshader = GLSL::textFileRead(fShaderName.c_str());
 	glShaderSource(VS, 1, &vshader, NULL);
 	glShaderSource(FS, 1, &fshader, NULL);
+	free(vshader);
+	free(fshader);
 	
 	// Compile vertex shader
 	glCompileShader(VS);
@@ -76,6 +96,7 @@ bool Program::init()
         }
 	glAttachShader(pid, VS);
 	glAttachShader(pid, FS);
+	glProgramParameteri(pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(pid);
 	glGetProgramiv(pid, GL_LINK_STATUS, &rc);
 	if(!rc) {
@@ -86,6 +107,7 @@ bool Program::init()
 		return false;
 	}
 	
+	GLSL::saveCachedProgram(pid, cacheSource);
 	GLSL::checkError(GET_FILE_LINE);
 	return true;
 }
@@ -0,0 +1,178 @@
+#include "RatePyramid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <omp.h>
+
+RatePyramid::RatePyramid() : version(0), buildMilliseconds(0.0) {}
+
+void RatePyramid::clear() {
+    levels.clear();
+    version++;
+}
+
+RatePyramid::Bin RatePyramid::merge(const Bin &a, const Bin &b) {
+    return { a.positive + b.positive, a.negative + b.negative, std::min(a.minCount, b.minCount), std::max(a.maxCount, b.maxCount) };
+}
+
+void RatePyramid::resizeBase(size_t numBins) {
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    levels[0].resize(numBins, Bin{});
+
+    // Every level halves the one below, down to a single bin
+    size_t k = 1;
+    while (levels[k - 1].size() > 1) {
+        if (k == levels.size()) {
+            levels.emplace_back();
+        }
+        levels[k].resize((levels[k - 1].size() + 1) / 2, Bin{});
+        k++;
+    }
+    levels.resize(k);
+}
+
+void RatePyramid::updateParents(size_t first, size_t last) {
+    for (size_t k = 1; k < levels.size(); k++) {
+        first >>= 1;
+        last >>= 1;
+        const std::vector<Bin> &children = levels[k - 1];
+        std::vector<Bin> &parents = levels[k];
+        for (size_t i = first; i <= last && i < parents.size(); i++) {
+            parents[i] = 2 * i + 1 < children.size() ? merge(children[2 * i], children[2 * i + 1]) : children[2 * i];
+        }
+    }
+}
+
+void RatePyramid::build(const std::vector<glm::vec4> &events, double toMicroseconds) {
+    auto start = std::chrono::steady_clock::now();
+    levels.clear();
+    version++;
+    if (events.empty()) {
+        return;
+    }
+
+    auto binOf = [&](const glm::vec4 &e) {
+        return std::max<int64_t>(static_cast<int64_t>(e.z * toMicroseconds / BASE_BIN_US), 0);
+    };
+    const int64_t numBins = binOf(events.back()) + 1;
+    resizeBase(static_cast<size_t>(numBins));
+
+    // Chunks of bins; each finds its first event by binary search and scans forward, no bin is shared
+    std::vector<Bin> &base = levels[0];
+    const int numChunks = omp_get_max_threads() * 4;
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < numChunks; c++) {
+        const int64_t b0 = numBins * c / numChunks;
+        const int64_t b1 = numBins * (c + 1) / numChunks;
+        if (b0 == b1) {
+            continue;
+        }
+        auto it = std::lower_bound(events.begin(), events.end(), b0, [&](const glm::vec4 &e, int64_t bin) { return binOf(e) < bin; });
+        for (; it != events.end(); ++it) {
+            int64_t b = binOf(*it);
+            if (b >= b1) {
+                break;
+            }
+            if (it->w > 0.5f) {
+                base[b].positive++;
+            }
+            else {
+                base[b].negative++;
+            }
+        }
+        for (int64_t b = b0; b < b1; b++) {
+            uint32_t total = static_cast<uint32_t>(std::min<uint64_t>(base[b].positive + base[b].negative, UINT32_MAX));
+            base[b].minCount = total;
+            base[b].maxCount = total;
+        }
+    }
+
+    for (size_t k = 1; k < levels.size(); k++) {
+        const std::vector<Bin> &children = levels[k - 1];
+        std::vector<Bin> &parents = levels[k];
+        const int numParents = static_cast<int>(parents.size());
+        const int numChildren = static_cast<int>(children.size());
+        #pragma omp parallel for
+        for (int i = 0; i < numParents; i++) {
+            parents[i] = 2 * i + 1 < numChildren ? merge(children[2 * i], children[2 * i + 1]) : children[2 * i];
+        }
+    }
+
+    buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RatePyramid::append(const std::vector<FilterEvent> &batch, int64_t origin) {
+    if (batch.empty()) {
+        return;
+    }
+
+    auto binOf = [&](const FilterEvent &e) { return static_cast<size_t>(std::max<int64_t>((e.timestamp - origin) / BASE_BIN_US, 0)); };
+    size_t oldSize = getNumBaseBins();
+    size_t first = SIZE_MAX, last = 0;
+    for (const FilterEvent &e : batch) {
+        size_t b = binOf(e);
+        first = std::min(first, b);
+        last = std::max(last, b);
+    }
+    if (last >= oldSize) {
+        resizeBase(last + 1);
+        first = std::min(first, oldSize > 0 ? oldSize - 1 : 0); // the old last parent gains children
+        last = levels[0].size() - 1;
+    }
+
+    std::vector<Bin> &base = levels[0];
+    for (const FilterEvent &e : batch) {
+        Bin &bin = base[binOf(e)];
+        if (e.polarity) {
+            bin.positive++;
+        }
+        else {
+            bin.negative++;
+        }
+        uint32_t total = static_cast<uint32_t>(std::min<uint64_t>(bin.positive + bin.negative, UINT32_MAX));
+        bin.minCount = total;
+        bin.maxCount = total;
+    }
+
+    updateParents(first, last);
+}
+
+void RatePyramid::query(double t0, double t1, int numColumns, std::vector<TimelineColumn> &columns) const {
+    columns.assign(std::max(numColumns, 0), TimelineColumn{ 0.0f, 0.0f, 0.0f, 0.0f });
+    if (levels.empty() || numColumns <= 0 || t1 <= t0) {
+        return;
+    }
+
+    // Coarsest level whose bins are still no wider than a column
+    const double columnWidth = (t1 - t0) / numColumns;
+    int level = 0;
+    while (level + 1 < static_cast<int>(levels.size()) && static_cast<double>(BASE_BIN_US << (level + 1)) <= columnWidth) {
+        level++;
+    }
+    const std::vector<Bin> &bins = levels[level];
+    const double binWidth = static_cast<double>(BASE_BIN_US << level);
+    const int64_t lastBin = static_cast<int64_t>(bins.size()) - 1;
+    const double baseSeconds = BASE_BIN_US * 1e-6;
+
+    for (int c = 0; c < numColumns; c++) {
+        double a = t0 + c * columnWidth;
+        int64_t i0 = static_cast<int64_t>(std::floor(a / binWidth));
+        int64_t i1 = std::max(i0, static_cast<int64_t>(std::ceil((a + columnWidth) / binWidth)) - 1);
+        if (i1 < 0 || i0 > lastBin) {
+            continue;
+        }
+        i0 = std::max<int64_t>(i0, 0);
+        i1 = std::min(i1, lastBin);
+
+        Bin sum = bins[i0];
+        for (int64_t i = i0 + 1; i <= i1; i++) {
+            sum = merge(sum, bins[i]);
+        }
+        double seconds = (i1 - i0 + 1) * binWidth * 1e-6;
+        columns[c] = { static_cast<float>(sum.positive / seconds), static_cast<float>(sum.negative / seconds),
+            static_cast<float>(sum.minCount / baseSeconds), static_cast<float>(sum.maxCount / baseSeconds) };
+    }
+}
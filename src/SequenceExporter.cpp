@@ -0,0 +1,182 @@
+#include "SequenceExporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include <opencv2/opencv.hpp>
+
+#include "EventData.h"
+#include "FrameScene.h"
+#include "GLSL.h"
+
+SequenceExporter::SequenceExporter() : request(false), active(false), target(DCE_TARGET), output(VIDEO_OUTPUT),
+    format(VideoRecorder::RGB24_FORMAT), numFrames(300), eventPeriod(false), resolution(1280, 720), followPath(false),
+    timeWindow_L(0.0f), timeWindow_R(0.0f), eventWindow_L(0), eventWindow_R(0), period_T(0.0f), period_E(0),
+    startPose{ glm::vec3(0.0f), glm::vec2(0.0f) }, startAutoUpdate(0), nextFrame(0), startTime(0.0), milliseconds(0.0), fboResolution(0) {}
+
+SequenceExporter::~SequenceExporter() {}
+
+static double nowMilliseconds() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool SequenceExporter::init(const std::string &resource_dir) {
+    return sceneRecorder.init(resource_dir) && frameRecorder.init(resource_dir);
+}
+
+bool SequenceExporter::begin(EventData &evtData, const Camera &camera, FrameViewportFBO &frameScene, const std::string &basePath,
+    float framePeriod_T, GLuint framePeriod_E)
+{
+    request = false;
+    if (active || evtData.getMaxEvent() == 0) {
+        return false;
+    }
+    if ((eventPeriod && framePeriod_E == 0) || (!eventPeriod && framePeriod_T <= 0.0f)) {
+        std::cerr << "SequenceExporter: set a frame period first" << std::endl;
+        return false;
+    }
+
+    numFrames = std::max(numFrames, 1);
+    resolution = glm::max(resolution, glm::ivec2(16));
+    if (!sceneFBO || resolution != fboResolution) {
+        sceneFBO = std::make_unique<BaseViewportFBO>();
+        frameFBO = std::make_unique<BaseViewportFBO>();
+        if (!sceneFBO->initialize(resolution.x, resolution.y) || !frameFBO->initialize(resolution.x, resolution.y, true)) {
+            sceneFBO.reset();
+            frameFBO.reset();
+            return false;
+        }
+        fboResolution = resolution;
+    }
+
+    this->basePath = basePath.empty() ? std::string("export") : basePath;
+    timeWindow_L = evtData.getTimeWindow_L();
+    timeWindow_R = evtData.getTimeWindow_R();
+    eventWindow_L = evtData.getEventWindow_L();
+    eventWindow_R = evtData.getEventWindow_R();
+    period_T = framePeriod_T;
+    period_E = framePeriod_E;
+    startPose = camera.getPose();
+    startAutoUpdate = frameScene.getAutoUpdate();
+    frameScene.getAutoUpdate() = FrameViewportFBO::MANUAL_UPDATE; // the export owns the windows
+
+    nextFrame = 0;
+    startTime = nowMilliseconds();
+    milliseconds = 0.0;
+    active = true;
+    return true;
+}
+
+void SequenceExporter::applyFrame(EventData &evtData, Camera &camera, int k) const {
+    // From the start of the export, not the previous frame, so rounding never accumulates
+    if (eventPeriod) {
+        GLuint maxEvent = evtData.getMaxEvent() - 1;
+        evtData.getEventWindow_L() = std::min(maxEvent, eventWindow_L + static_cast<GLuint>(k) * period_E);
+        evtData.getEventWindow_R() = std::min(maxEvent, eventWindow_R + static_cast<GLuint>(k) * period_E);
+        evtData.getTimeWindow_L() = evtData.getTimestamp(evtData.getEventWindow_L());
+        evtData.getTimeWindow_R() = evtData.getTimestamp(evtData.getEventWindow_R());
+    }
+    else {
+        float maxTime = evtData.getMaxTimestamp();
+        evtData.getTimeWindow_L() = std::min(maxTime, timeWindow_L + k * period_T);
+        evtData.getTimeWindow_R() = std::min(maxTime, timeWindow_R + k * period_T);
+        evtData.getEventWindow_L() = evtData.getFirstEvent(evtData.getTimeWindow_L());
+        evtData.getEventWindow_R() = evtData.getLastEvent(evtData.getTimeWindow_R());
+    }
+
+    float at = numFrames > 1 ? static_cast<float>(k) / (numFrames - 1) : 0.0f;
+    camera.setPose(followPath ? samplePath(keyframes, at, startPose) : startPose);
+}
+
+std::string SequenceExporter::getOutputName(int target) const {
+    return basePath + (target == SCENE_TARGET ? "_scene" : "_dce");
+}
+
+void SequenceExporter::writeFrame(int target, int k) {
+    if (output == VIDEO_OUTPUT) {
+        getRecorder(target).capture();
+        return;
+    }
+
+    pixels.resize(static_cast<size_t>(resolution.x) * resolution.y * 3);
+    GLint packAlignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, resolution.x, resolution.y, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+
+    // Bottom-up RGB to top-down BGR for OpenCV
+    cv::Mat image(resolution.y, resolution.x, CV_8UC3, pixels.data());
+    cv::Mat flipped;
+    cv::flip(image, flipped, 0);
+    cv::cvtColor(flipped, flipped, cv::COLOR_RGB2BGR);
+
+    char frameName[16];
+    snprintf(frameName, sizeof(frameName), "_%05d.png", k);
+    std::string path = getOutputName(target) + frameName;
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    if (!cv::imwrite(path, flipped)) {
+        std::cerr << "SequenceExporter: failed to write " << path << std::endl;
+    }
+}
+
+void SequenceExporter::advance() {
+    ++nextFrame;
+    milliseconds = (nowMilliseconds() - startTime) / nextFrame;
+}
+
+void SequenceExporter::finish(EventData &evtData, Camera &camera, FrameViewportFBO &frameScene) {
+    if (!active) {
+        return;
+    }
+
+    sceneRecorder.stop();
+    frameRecorder.stop();
+
+    evtData.getTimeWindow_L() = timeWindow_L;
+    evtData.getTimeWindow_R() = timeWindow_R;
+    evtData.getEventWindow_L() = eventWindow_L;
+    evtData.getEventWindow_R() = eventWindow_R;
+    camera.setPose(startPose);
+    frameScene.getAutoUpdate() = startAutoUpdate;
+    active = false;
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+CameraPose SequenceExporter::samplePath(const std::vector<CameraKeyframe> &keyframes, float at, const CameraPose &fallback) {
+    if (keyframes.empty()) {
+        return fallback;
+    }
+    if (at <= keyframes.front().at) {
+        return keyframes.front().pose;
+    }
+    if (at >= keyframes.back().at) {
+        return keyframes.back().pose;
+    }
+
+    auto next = std::upper_bound(keyframes.begin(), keyframes.end(), at,
+        [](float value, const CameraKeyframe &key) { return value < key.at; });
+    const CameraKeyframe &b = *next;
+    const CameraKeyframe &a = *(next - 1);
+    float s = b.at > a.at ? (at - a.at) / (b.at - a.at) : 1.0f;
+    return { glm::mix(a.pose.translations, b.pose.translations, s), glm::mix(a.pose.rotations, b.pose.rotations, s) };
+}
+
+void SequenceExporter::addKeyframe(float at, const CameraPose &pose) {
+    at = glm::clamp(at, 0.0f, 1.0f);
+    for (CameraKeyframe &key : keyframes) {
+        if (std::abs(key.at - at) < 1e-4f) {
+            key.pose = pose;
+            return;
+        }
+    }
+
+    auto position = std::upper_bound(keyframes.begin(), keyframes.end(), at,
+        [](float value, const CameraKeyframe &key) { return value < key.at; });
+    keyframes.insert(position, { at, pose });
+}
@@ -0,0 +1,225 @@
+#include "SlidingAccumulator.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "FrameBatch.h"
+#include "GLSL.h"
+
+SlidingAccumulator::SlidingAccumulator() : initialized(false), accumTexture(0), previewTexture(0), readFBO(0), countSSBO(0), zeroPBO(0),
+    resolution(0), valid(false), curBound_L(0), curBound_R(-1), curDataVersion(0), curSpaceWindow(0.0f),
+    curIsPositiveOnly(false), curContribution(0.0f), lastUpdateEvents(0) {}
+
+SlidingAccumulator::~SlidingAccumulator() {
+    if (accumTexture) {
+        glDeleteTextures(1, &accumTexture);
+        accumTexture = 0;
+    }
+
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+        previewTexture = 0;
+    }
+
+    if (readFBO) {
+        glDeleteFramebuffers(1, &readFBO);
+        readFBO = 0;
+    }
+
+    if (countSSBO) {
+        glDeleteBuffers(1, &countSSBO);
+        countSSBO = 0;
+    }
+
+    if (zeroPBO) {
+        glDeleteBuffers(1, &zeroPBO);
+        zeroPBO = 0;
+    }
+}
+
+bool SlidingAccumulator::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    accumulateProg.setShaderName(resource_dir + "dce_accumulate.comp");
+    resolveProg.setShaderName(resource_dir + "dce_resolve.comp");
+    accumulateProg.setInjection(FrameBatch::LOG_TRANSMITTANCE_PLACEHOLDER, FrameBatch::buildLogTransmittanceGLSL());
+    resolveProg.setInjection(FrameBatch::LOG_TRANSMITTANCE_PLACEHOLDER, FrameBatch::buildLogTransmittanceGLSL());
+    if (!accumulateProg.init() || !resolveProg.init()) {
+        std::cerr << "Failed to initialize sliding accumulator shaders" << std::endl;
+        return false;
+    }
+
+    accumulateProg.bind();
+    accumulateProg.addUniform("eventBound_L");
+    accumulateProg.addUniform("eventBound_R");
+    accumulateProg.addUniform("accumSign");
+    accumulateProg.addUniform("spaceWindow");
+    accumulateProg.addUniform("isPositiveOnly");
+    accumulateProg.addUniform("baseContribution");
+    accumulateProg.unbind();
+
+    resolveProg.bind();
+    resolveProg.addUniform("layer");
+    resolveProg.unbind();
+
+    glGenFramebuffers(1, &readFBO);
+
+    glGenBuffers(1, &countSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLint), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenBuffers(1, &zeroPBO);
+
+    initialized = true;
+    return true;
+}
+
+void SlidingAccumulator::allocate(glm::ivec2 res) {
+    if (res == resolution && accumTexture != 0) {
+        return;
+    }
+
+    if (accumTexture) {
+        glDeleteTextures(1, &accumTexture);
+    }
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+    }
+
+    glGenTextures(1, &accumTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32I, res.x, res.y, 1);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &previewTexture);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, previewTexture, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // Zeroed on the GPU like FrameBatch, glClearTexImage would need GL 4.4
+    GLint zero = 0;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<size_t>(res.x) * res.y * sizeof(GLint), nullptr, GL_STATIC_DRAW);
+    glClearBufferData(GL_PIXEL_UNPACK_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    resolution = res;
+    valid = false;
+}
+
+void SlidingAccumulator::clear() {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, accumTexture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, resolution.x, resolution.y, 1, GL_RED_INTEGER, GL_INT, nullptr);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    GLint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countSSBO);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void SlidingAccumulator::accumulate(int eventBound_L, int eventBound_R, int sign) {
+    if (eventBound_L > eventBound_R) {
+        return;
+    }
+
+    glUniform1i(accumulateProg.getUniform("eventBound_L"), eventBound_L);
+    glUniform1i(accumulateProg.getUniform("eventBound_R"), eventBound_R);
+    glUniform1i(accumulateProg.getUniform("accumSign"), sign);
+
+    GLuint numEvents = static_cast<GLuint>(eventBound_R - eventBound_L + 1);
+    accumulateProg.dispatchGridStride(numEvents);
+    lastUpdateEvents += numEvents;
+}
+
+bool SlidingAccumulator::update(GLuint evtParticlesSSBO, uint64_t dataVersion, glm::ivec2 res, int eventBound_L, int eventBound_R,
+    const glm::vec4 &spaceWindow, bool isPositiveOnly, float contribution) {
+
+    if (!initialized || res.x <= 0 || res.y <= 0) {
+        return false;
+    }
+    allocate(res);
+
+    bool sameSettings = valid && dataVersion == curDataVersion && spaceWindow == curSpaceWindow &&
+        isPositiveOnly == curIsPositiveOnly && contribution == curContribution;
+    bool overlaps = eventBound_L <= curBound_R && curBound_L <= eventBound_R;
+
+    if (sameSettings && eventBound_L == curBound_L && eventBound_R == curBound_R) {
+        return false;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, countSSBO);
+    glBindImageTexture(0, accumTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+
+    accumulateProg.bind();
+    glUniform4fv(accumulateProg.getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+    glUniform1i(accumulateProg.getUniform("isPositiveOnly"), isPositiveOnly ? 1 : 0);
+    glUniform1f(accumulateProg.getUniform("baseContribution"), contribution);
+
+    lastUpdateEvents = 0;
+    if (!sameSettings || !overlaps) {
+        // Nothing to reuse
+        clear();
+        accumulate(eventBound_L, eventBound_R, 1);
+    }
+    else {
+        // Only the deltas at both ends of the window
+        accumulate(eventBound_L, curBound_L - 1, 1);       // grew to the left
+        accumulate(curBound_L, eventBound_L - 1, -1);      // shrank from the left
+        accumulate(curBound_R + 1, eventBound_R, 1);       // grew to the right
+        accumulate(eventBound_R + 1, curBound_R, -1);      // shrank from the right
+    }
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    accumulateProg.unbind();
+
+    valid = true;
+    curBound_L = eventBound_L;
+    curBound_R = eventBound_R;
+    curDataVersion = dataVersion;
+    curSpaceWindow = spaceWindow;
+    curIsPositiveOnly = isPositiveOnly;
+    curContribution = contribution;
+
+    GLSL::checkError(GET_FILE_LINE);
+    return true;
+}
+
+void SlidingAccumulator::draw(glm::ivec2 srcMin, glm::ivec2 srcMax, glm::vec2 viewport_resolution) {
+    if (!initialized || !valid) {
+        return;
+    }
+
+    glBindImageTexture(0, accumTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32I);
+    glBindImageTexture(1, previewTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    resolveProg.bind();
+    glUniform1i(resolveProg.getUniform("layer"), 0);
+    resolveProg.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    resolveProg.unbind();
+
+    // Scale the event data region over the whole viewport, same mapping as the ortho projection in drawFrame
+    GLint drawFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glBlitFramebuffer(srcMin.x, srcMin.y, srcMax.x + 1, srcMax.y + 1,
+        0, 0, static_cast<GLint>(viewport_resolution.x), static_cast<GLint>(viewport_resolution.y),
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFBO);
+
+    GLSL::checkError(GET_FILE_LINE);
+}
@@ -0,0 +1,328 @@
+#include "SpectrumAnalyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "FilterBank.h"
+#include "GLSL.h"
+
+SpectrumAnalyzer::SpectrumAnalyzer() : initialized(false), spectrumTexture(0), mapsTexture(0), previewTexture(0), zeroPBO(0),
+    allocatedLayers(0), allocatedResolution(0), resolution(0), minFreq(0.0f), maxFreq(0.0f), milliseconds(0.0),
+    usedGPU(false), previewMap(-1), previewGain(-1.0f) {}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+    if (spectrumTexture) {
+        glDeleteTextures(1, &spectrumTexture);
+        spectrumTexture = 0;
+    }
+
+    if (mapsTexture) {
+        glDeleteTextures(1, &mapsTexture);
+        mapsTexture = 0;
+    }
+
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+        previewTexture = 0;
+    }
+
+    if (zeroPBO) {
+        glDeleteBuffers(1, &zeroPBO);
+        zeroPBO = 0;
+    }
+}
+
+bool SpectrumAnalyzer::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    spectrumProg[0].setShaderName(resource_dir + "spectrum.comp");
+    spectrumProg[1].setShaderName(resource_dir + "spectrum.comp");
+    spectrumProg[1].addDefine("POSITIVE_ONLY");
+    resolveProg.setShaderName(resource_dir + "spectrum_resolve.comp");
+    if (!spectrumProg[0].init() || !spectrumProg[1].init() || !resolveProg.init()) {
+        std::cerr << "Failed to initialize spectrum shaders" << std::endl;
+        return false;
+    }
+
+    for (ComputeProgram &prog : spectrumProg) {
+        prog.bind();
+        prog.addUniform("numBins");
+        prog.addUniform("eventBound_L");
+        prog.addUniform("eventBound_R");
+        prog.addUniform("spaceWindow");
+        prog.addUniform("startT");
+        prog.addUniform("timeToSeconds");
+        prog.addUniform("minFreq");
+        prog.addUniform("deltaFreq");
+        prog.unbind();
+    }
+
+    resolveProg.bind();
+    resolveProg.addUniform("numBins");
+    resolveProg.addUniform("firstBin");
+    resolveProg.addUniform("minFreq");
+    resolveProg.addUniform("deltaFreq");
+    resolveProg.unbind();
+
+    glGenBuffers(1, &zeroPBO);
+
+    initialized = true;
+    return true;
+}
+
+void SpectrumAnalyzer::allocate(glm::ivec2 res, int numBins) {
+    int layers = 2 * numBins;
+    if (res == allocatedResolution && layers <= allocatedLayers) {
+        return;
+    }
+
+    if (spectrumTexture) {
+        glDeleteTextures(1, &spectrumTexture);
+    }
+    if (mapsTexture) {
+        glDeleteTextures(1, &mapsTexture);
+    }
+
+    glGenTextures(1, &spectrumTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, spectrumTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32I, res.x, res.y, layers);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &mapsTexture);
+    glBindTexture(GL_TEXTURE_2D, mapsTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA32F, res.x, res.y);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (res != allocatedResolution) {
+        std::vector<GLint> zeros(static_cast<size_t>(res.x) * res.y, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, zeros.size() * sizeof(GLint), zeros.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    allocatedResolution = res;
+    allocatedLayers = layers;
+}
+
+void SpectrumAnalyzer::resizeMaps(glm::ivec2 res, float newMinFreq, float newMaxFreq) {
+    if (res != resolution || !previewTexture) {
+        if (previewTexture) {
+            glDeleteTextures(1, &previewTexture);
+        }
+        glGenTextures(1, &previewTexture);
+        glBindTexture(GL_TEXTURE_2D, previewTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    size_t numPixels = static_cast<size_t>(res.x) * res.y;
+    frequencyMap.assign(numPixels, 0.0f);
+    magnitudeMap.assign(numPixels, 0.0f);
+    phaseMap.assign(numPixels, 0.0f);
+
+    resolution = res;
+    minFreq = newMinFreq;
+    maxFreq = newMaxFreq;
+    previewGain = -1.0f;
+}
+
+void SpectrumAnalyzer::analyzeCPU(const std::vector<glm::vec4> &events, const PixelIndex &index, int eventBound_L,
+    int eventBound_R, float t0, float timeToSeconds, float newMinFreq, float newMaxFreq, int numBins, const glm::vec4 &spaceWindow, bool isPositiveOnly) {
+
+    glm::ivec2 res = index.getResolution();
+    if (!index.isBuilt() || numBins <= 0 || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    numBins = std::min(numBins, MAX_BINS);
+    resizeMaps(res, newMinFreq, newMaxFreq);
+    if (eventBound_L > eventBound_R || eventBound_R < 0) {
+        usedGPU = false;
+        milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return;
+    }
+    const uint32_t first = static_cast<uint32_t>(std::max(eventBound_L, 0));
+    const uint32_t last = static_cast<uint32_t>(eventBound_R);
+    const double deltaFreq = numBins > 1 ? (static_cast<double>(newMaxFreq) - newMinFreq) / (numBins - 1) : 0.0;
+    const int firstBin = (newMinFreq <= 0.0f && numBins > 1) ? 1 : 0; // DC only counts events
+    const double TWO_PI = 6.283185307179586;
+
+    // spaceWindow: x = top, y = right, z = bottom, w = left
+    const int numPixels = res.x * res.y;
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < numPixels; p++) {
+        int x = p % res.x;
+        int y = p / res.x;
+        if (x < spaceWindow.w || x > spaceWindow.y || y < spaceWindow.x || y > spaceWindow.z) {
+            continue;
+        }
+
+        PixelIndex::Slice slice = index.getPixelEvents(x, y, first, last);
+        if (slice.size == 0) {
+            continue;
+        }
+
+        float re[MAX_BINS] = {};
+        float im[MAX_BINS] = {};
+        for (size_t i = 0; i < slice.size; i++) {
+            float polarity = events[slice.eventIndices[i]].w;
+            if (isPositiveOnly && polarity != 1.0f) {
+                continue;
+            }
+            float polarityVal = polarity == 0.0f ? -1.0f : 1.0f;
+
+            // w = exp(-2i pi minFreq t), rotated by exp(-2i pi deltaFreq t) per bin; angles reduced in double
+            double seconds = (static_cast<double>(slice.times[i]) - t0) * timeToSeconds;
+            double a0 = -TWO_PI * std::fmod(newMinFreq * seconds, 1.0);
+            double da = -TWO_PI * std::fmod(deltaFreq * seconds, 1.0);
+            float wRe = static_cast<float>(std::cos(a0)) * polarityVal;
+            float wIm = static_cast<float>(std::sin(a0)) * polarityVal;
+            float rotRe = static_cast<float>(std::cos(da));
+            float rotIm = static_cast<float>(std::sin(da));
+            for (int k = 0; k < numBins; k++) {
+                re[k] += wRe;
+                im[k] += wIm;
+                float nextRe = wRe * rotRe - wIm * rotIm;
+                wIm = wRe * rotIm + wIm * rotRe;
+                wRe = nextRe;
+            }
+        }
+
+        int best = firstBin;
+        float bestMagnitude = -1.0f;
+        for (int k = firstBin; k < numBins; k++) {
+            float magnitude = std::sqrt(re[k] * re[k] + im[k] * im[k]);
+            if (magnitude > bestMagnitude) {
+                bestMagnitude = magnitude;
+                best = k;
+            }
+        }
+
+        frequencyMap[p] = static_cast<float>(newMinFreq + deltaFreq * best);
+        magnitudeMap[p] = std::max(bestMagnitude, 0.0f);
+        phaseMap[p] = bestMagnitude > 0.0f ? std::atan2(im[best], re[best]) : 0.0f;
+    }
+
+    usedGPU = false;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void SpectrumAnalyzer::analyzeGPU(GLuint evtParticlesSSBO, glm::ivec2 res, int eventBound_L, int eventBound_R, float t0,
+    float timeToSeconds, float newMinFreq, float newMaxFreq, int numBins, const glm::vec4 &spaceWindow, bool isPositiveOnly) {
+
+    if (!initialized || numBins <= 0 || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    numBins = std::min(numBins, MAX_BINS);
+    allocate(res, numBins);
+    resizeMaps(res, newMinFreq, newMaxFreq);
+    float deltaFreq = numBins > 1 ? (newMaxFreq - newMinFreq) / (numBins - 1) : 0.0f;
+    int firstBin = (newMinFreq <= 0.0f && numBins > 1) ? 1 : 0;
+
+    // Clear the layers in use from the zeroed pixel buffer, all on the GPU
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroPBO);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, spectrumTexture);
+    for (int layer = 0; layer < 2 * numBins; layer++) {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, res.x, res.y, 1, GL_RED_INTEGER, GL_INT, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (eventBound_L <= eventBound_R) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+        glBindImageTexture(0, spectrumTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+
+        ComputeProgram &prog = spectrumProg[isPositiveOnly ? 1 : 0];
+        prog.bind();
+        glUniform1i(prog.getUniform("numBins"), numBins);
+        glUniform1i(prog.getUniform("eventBound_L"), eventBound_L);
+        glUniform1i(prog.getUniform("eventBound_R"), eventBound_R);
+        glUniform4fv(prog.getUniform("spaceWindow"), 1, glm::value_ptr(spaceWindow));
+        glUniform1f(prog.getUniform("startT"), t0);
+        glUniform1f(prog.getUniform("timeToSeconds"), timeToSeconds);
+        glUniform1f(prog.getUniform("minFreq"), newMinFreq);
+        glUniform1f(prog.getUniform("deltaFreq"), deltaFreq);
+
+        prog.dispatchGridStride(static_cast<GLuint>(eventBound_R - eventBound_L + 1));
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        prog.unbind();
+    }
+
+    glBindImageTexture(0, spectrumTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32I);
+    glBindImageTexture(1, mapsTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    resolveProg.bind();
+    glUniform1i(resolveProg.getUniform("numBins"), numBins);
+    glUniform1i(resolveProg.getUniform("firstBin"), firstBin);
+    glUniform1f(resolveProg.getUniform("minFreq"), newMinFreq);
+    glUniform1f(resolveProg.getUniform("deltaFreq"), deltaFreq);
+    resolveProg.dispatch((res.x + 15) / 16, (res.y + 15) / 16, 1);
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    resolveProg.unbind();
+
+    // Read the maps back so both paths end in the same CPU side result
+    std::vector<glm::vec4> maps(static_cast<size_t>(res.x) * res.y);
+    glBindTexture(GL_TEXTURE_2D, mapsTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, maps.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    for (size_t p = 0; p < maps.size(); p++) {
+        frequencyMap[p] = maps[p].r;
+        magnitudeMap[p] = maps[p].g;
+        phaseMap[p] = maps[p].b;
+    }
+
+    usedGPU = true;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void SpectrumAnalyzer::updatePreview(int map, float gain) {
+    if (!hasResult()) {
+        return;
+    }
+
+    const float PI = 3.14159265f;
+    float freqRange = maxFreq > minFreq ? maxFreq - minFreq : 1.0f;
+    std::vector<unsigned char> pixels(frequencyMap.size() * 4);
+    for (size_t p = 0; p < frequencyMap.size(); p++) {
+        float brightness = 1.0f - std::exp(-gain * magnitudeMap[p]);
+        glm::vec3 color;
+        if (map == MAGNITUDE_MAP) {
+            color = glm::vec3(brightness);
+        }
+        else if (map == PHASE_MAP) {
+            color = FilterBank::colorMap((phaseMap[p] + PI) / (2.0f * PI)) * brightness;
+        }
+        else {
+            color = FilterBank::colorMap((frequencyMap[p] - minFreq) / freqRange) * brightness;
+        }
+        pixels[4 * p + 0] = static_cast<unsigned char>(color.r * 255.0f + 0.5f);
+        pixels[4 * p + 1] = static_cast<unsigned char>(color.g * 255.0f + 0.5f);
+        pixels[4 * p + 2] = static_cast<unsigned char>(color.b * 255.0f + 0.5f);
+        pixels[4 * p + 3] = 255;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, resolution.x, resolution.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    previewMap = map;
+    previewGain = gain;
+    GLSL::checkError(GET_FILE_LINE);
+}
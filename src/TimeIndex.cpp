@@ -0,0 +1,80 @@
+#include "TimeIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+TimeIndex::TimeIndex() : t0(0.0f), invWidth(0.0f) {}
+
+void TimeIndex::clear() {
+    times.clear();
+    bucketStart.clear();
+    t0 = 0.0f;
+    invWidth = 0.0f;
+}
+
+void TimeIndex::build(const std::vector<glm::vec4> &events) {
+    times.resize(events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        times[i] = events[i].z;
+    }
+    rebucket();
+}
+
+void TimeIndex::rebucket() {
+    bucketStart.clear();
+    if (times.empty()) {
+        return;
+    }
+
+    t0 = times.front();
+    float span = times.back() - t0;
+    size_t numBuckets = std::max<size_t>(1, times.size() / EVENTS_PER_BUCKET);
+    invWidth = span > 0.0f ? static_cast<float>(numBuckets) / span : 0.0f;
+
+    // One pass: bucket b starts at the first event whose bucket is >= b
+    bucketStart.reserve(numBuckets + 2);
+    for (size_t i = 0; i < times.size(); i++) {
+        size_t b = bucketOf(times[i]);
+        while (bucketStart.size() <= b) {
+            bucketStart.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    bucketStart.push_back(static_cast<uint32_t>(times.size())); // sentinel
+}
+
+size_t TimeIndex::bucketOf(float t) const {
+    float b = (t - t0) * invWidth;
+    if (!(b > 0.0f)) { // also catches NaN
+        return 0;
+    }
+    return static_cast<size_t>(b);
+}
+
+size_t TimeIndex::lowerBound(float t) const {
+    if (times.empty() || t <= times.front()) {
+        return 0;
+    }
+    if (t > times.back()) {
+        return times.size();
+    }
+
+    // bucketOf is monotonic, so events in earlier buckets are < t and events in later buckets are > t
+    size_t b = std::min(bucketOf(t), bucketStart.size() - 2);
+    size_t lo = bucketStart[b];
+    size_t hi = bucketStart[b + 1];
+    return std::lower_bound(times.begin() + lo, times.begin() + hi, t) - times.begin();
+}
+
+size_t TimeIndex::upperBound(float t) const {
+    if (times.empty() || t < times.front()) {
+        return 0;
+    }
+    if (t >= times.back()) {
+        return times.size();
+    }
+
+    size_t b = std::min(bucketOf(t), bucketStart.size() - 2);
+    size_t lo = bucketStart[b];
+    size_t hi = bucketStart[b + 1];
+    return std::upper_bound(times.begin() + lo, times.begin() + hi, t) - times.begin();
+}
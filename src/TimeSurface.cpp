@@ -0,0 +1,350 @@
+#include "TimeSurface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "GLSL.h"
+
+TimeSurface::TimeSurface() : initialized(false), lastTexture(0), previewTexture(0), readFBO(0), resolution(0), epoch(0), valid(false),
+    curBegin(0), curEnd(-1), curDataVersion(0), curToMicros(0.0f), curVisibilityVersion(0), hostValid(false),
+    dirtyRowMin(std::numeric_limits<int>::max()), dirtyRowMax(-1), queryTime(0), lastUpdateEvents(0),
+    milliseconds(0.0) {}
+
+TimeSurface::~TimeSurface() {
+    if (lastTexture) {
+        glDeleteTextures(1, &lastTexture);
+        lastTexture = 0;
+    }
+
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+        previewTexture = 0;
+    }
+
+    if (readFBO) {
+        glDeleteFramebuffers(1, &readFBO);
+        readFBO = 0;
+    }
+}
+
+bool TimeSurface::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    updateProg.setShaderName(resource_dir + "time_surface_update.comp");
+    renderProg.setShaderName(resource_dir + "time_surface.comp");
+    if (!updateProg.init() || !renderProg.init()) {
+        std::cerr << "Failed to initialize time surface shaders" << std::endl;
+        return false;
+    }
+
+    updateProg.bind();
+    updateProg.addUniform("eventBound_L");
+    updateProg.addUniform("eventBound_R");
+    updateProg.addUniform("toMicros");
+    updateProg.addUniform("epoch");
+    updateProg.addUniform("useVisibility");
+    updateProg.unbind();
+
+    renderProg.bind();
+    renderProg.addUniform("queryTime");
+    renderProg.addUniform("decay");
+    renderProg.addUniform("mode");
+    renderProg.addUniform("posColor");
+    renderProg.addUniform("negColor");
+    renderProg.unbind();
+
+    glGenFramebuffers(1, &readFBO);
+
+    initialized = true;
+    return true;
+}
+
+void TimeSurface::allocate(glm::ivec2 res) {
+    if (res == resolution && lastTexture != 0) {
+        return;
+    }
+
+    if (lastTexture) {
+        glDeleteTextures(1, &lastTexture);
+    }
+    if (previewTexture) {
+        glDeleteTextures(1, &previewTexture);
+    }
+
+    glGenTextures(1, &lastTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, lastTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R32I, res.x, res.y, 2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenTextures(1, &previewTexture);
+    glBindTexture(GL_TEXTURE_2D, previewTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, res.x, res.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, previewTexture, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    resolution = res;
+    valid = false;
+    dirtyRowMin = 0;
+    dirtyRowMax = res.y - 1; // the host copy, if any, goes up whole
+}
+
+void TimeSurface::clear() {
+    valid = false;
+    hostValid = false;
+    hostLast.clear();
+    epoch = 0;
+    dirtyRowMin = std::numeric_limits<int>::max();
+    dirtyRowMax = -1;
+}
+
+void TimeSurface::clearDevice() {
+    std::vector<GLint> never(static_cast<size_t>(resolution.x) * resolution.y * 2, static_cast<GLint>(NEVER));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, lastTexture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, resolution.x, resolution.y, 2, GL_RED_INTEGER, GL_INT, never.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+int32_t TimeSurface::relative(int64_t time) const {
+    // NEVER + 1 keeps what fell off the start distinguishable from no event at all
+    return static_cast<int32_t>(std::clamp<int64_t>(time - epoch, static_cast<int64_t>(NEVER) + 1, INT32_MAX));
+}
+
+void TimeSurface::rebaseHost(int64_t newEpoch, glm::ivec2 res) {
+    int64_t shift = newEpoch - epoch;
+    for (int32_t &last : hostLast) {
+        if (last != NEVER) {
+            int64_t moved = static_cast<int64_t>(last) - shift;
+            last = moved <= NEVER ? NEVER : static_cast<int32_t>(moved);
+        }
+    }
+    epoch = newEpoch;
+    dirtyRowMin = 0;
+    dirtyRowMax = res.y - 1;
+}
+
+void TimeSurface::store(size_t index, int64_t time, glm::ivec2 res) {
+    if (time - epoch > REBASE_SPAN) {
+        rebaseHost(time, res);
+    }
+    hostLast[index] = relative(time);
+}
+
+void TimeSurface::ingest(const std::vector<FilterEvent> &batch, glm::ivec2 res, int64_t firstTimestamp) {
+    size_t numPixels = static_cast<size_t>(res.x) * res.y;
+    if (hostLast.size() != 2 * numPixels) {
+        hostLast.assign(2 * numPixels, static_cast<int32_t>(NEVER));
+        epoch = 0;
+        dirtyRowMin = 0;
+        dirtyRowMax = res.y - 1;
+    }
+    hostValid = true;
+
+    // Later events overwrite earlier ones, a time ordered batch needs no comparison
+    for (const FilterEvent &evt : batch) {
+        if (evt.x < 0 || evt.y < 0 || evt.x >= res.x || evt.y >= res.y) {
+            continue;
+        }
+        size_t layer = evt.polarity ? 0 : numPixels;
+        store(layer + static_cast<size_t>(evt.y) * res.x + evt.x, evt.timestamp - firstTimestamp, res);
+        dirtyRowMin = std::min<int>(dirtyRowMin, evt.y);
+        dirtyRowMax = std::max<int>(dirtyRowMax, evt.y);
+    }
+}
+
+void TimeSurface::ingest(const std::vector<glm::vec4> &events, glm::ivec2 res) {
+    size_t numPixels = static_cast<size_t>(res.x) * res.y;
+    if (hostLast.size() != 2 * numPixels) {
+        hostLast.assign(2 * numPixels, static_cast<int32_t>(NEVER));
+        epoch = 0;
+    }
+    hostValid = true;
+    dirtyRowMin = 0;
+    dirtyRowMax = res.y - 1;
+
+    for (const glm::vec4 &evt : events) {
+        int x = static_cast<int>(evt.x);
+        int y = static_cast<int>(evt.y);
+        if (x < 0 || y < 0 || x >= res.x || y >= res.y) {
+            continue;
+        }
+        size_t layer = evt.w > 0.5f ? 0 : numPixels;
+        store(layer + static_cast<size_t>(y) * res.x + x, std::llround(evt.z), res);
+    }
+}
+
+void TimeSurface::updateStreamed(glm::ivec2 res) {
+    if (!initialized || !hostValid || res.x <= 0 || res.y <= 0 || hostLast.size() != static_cast<size_t>(res.x) * res.y * 2) {
+        return;
+    }
+    allocate(res);
+    if (dirtyRowMin > dirtyRowMax) {
+        return;
+    }
+
+    // Rows [dirtyRowMin, dirtyRowMax] of both layers straight from the host copy
+    glBindTexture(GL_TEXTURE_2D_ARRAY, lastTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, resolution.y);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, dirtyRowMin);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, dirtyRowMin, 0, resolution.x, dirtyRowMax - dirtyRowMin + 1, 2,
+        GL_RED_INTEGER, GL_INT, hostLast.data());
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    dirtyRowMin = std::numeric_limits<int>::max();
+    dirtyRowMax = -1;
+    valid = false; // the device surface no longer matches any file mode range
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void TimeSurface::scatter(int eventBound_L, int eventBound_R) {
+    if (eventBound_L > eventBound_R) {
+        return;
+    }
+
+    glUniform1i(updateProg.getUniform("eventBound_L"), eventBound_L);
+    glUniform1i(updateProg.getUniform("eventBound_R"), eventBound_R);
+
+    GLuint numEvents = static_cast<GLuint>(eventBound_R - eventBound_L + 1);
+    updateProg.dispatchGridStride(numEvents);
+    lastUpdateEvents += numEvents;
+}
+
+void TimeSurface::update(GLuint evtParticlesSSBO, uint64_t dataVersion, glm::ivec2 res, int horizonBegin, int eventEnd,
+    float toMicros, int64_t query, uint64_t visibilityVersion) {
+
+    if (!initialized || res.x <= 0 || res.y <= 0) {
+        return;
+    }
+    allocate(res);
+    hostValid = false;
+    hostLast.clear();
+
+    // A query too far from the epoch in either direction rebuilds around a new one
+    bool sameData = valid && dataVersion == curDataVersion && toMicros == curToMicros && visibilityVersion == curVisibilityVersion &&
+        std::abs(query - epoch) <= REBASE_SPAN;
+    if (sameData && eventEnd == curEnd && horizonBegin >= curBegin) {
+        return;
+    }
+    if (!sameData) {
+        epoch = query;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, evtParticlesSSBO);
+    glBindImageTexture(0, lastTexture, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+
+    updateProg.bind();
+    glUniform1f(updateProg.getUniform("toMicros"), toMicros);
+    glUniform1f(updateProg.getUniform("epoch"), static_cast<float>(static_cast<double>(epoch) / toMicros));
+    glUniform1i(updateProg.getUniform("useVisibility"), visibilityVersion != 0);
+
+    lastUpdateEvents = 0;
+    if (!sameData || eventEnd < curEnd || horizonBegin < curBegin) {
+        // Going back in time or reaching further back than what is held, nothing to reuse
+        clearDevice();
+        scatter(horizonBegin, eventEnd);
+        curBegin = horizonBegin;
+    }
+    else if (horizonBegin > curEnd + 1) {
+        // Jumped past the horizon, what is held is older than anything that will show
+        scatter(horizonBegin, eventEnd);
+        curBegin = horizonBegin;
+    }
+    else {
+        scatter(curEnd + 1, eventEnd);
+    }
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    updateProg.unbind();
+
+    valid = true;
+    curEnd = eventEnd;
+    curDataVersion = dataVersion;
+    curToMicros = toMicros;
+    curVisibilityVersion = visibilityVersion;
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+void TimeSurface::draw(int64_t query, float tau, int mode, const glm::vec3 &posColor, const glm::vec3 &negColor,
+    glm::ivec2 srcMin, glm::ivec2 srcMax, glm::vec2 viewport_resolution) {
+
+    if (!initialized || !lastTexture || (!valid && !hostValid)) {
+        return;
+    }
+    queryTime = query;
+
+    glBindImageTexture(0, lastTexture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32I);
+    glBindImageTexture(1, previewTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    renderProg.bind();
+    glUniform1i(renderProg.getUniform("queryTime"), relative(query));
+    glUniform1f(renderProg.getUniform("decay"), 1.0f / std::max(tau, 1.0f));
+    glUniform1i(renderProg.getUniform("mode"), mode);
+    glUniform3fv(renderProg.getUniform("posColor"), 1, glm::value_ptr(posColor));
+    glUniform3fv(renderProg.getUniform("negColor"), 1, glm::value_ptr(negColor));
+    renderProg.dispatch((resolution.x + 15) / 16, (resolution.y + 15) / 16, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    renderProg.unbind();
+
+    // Scale the event data region over the whole viewport, same mapping as the ortho projection in drawFrame
+    GLint drawFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glBlitFramebuffer(srcMin.x, srcMin.y, srcMax.x + 1, srcMax.y + 1,
+        0, 0, static_cast<GLint>(viewport_resolution.x), static_cast<GLint>(viewport_resolution.y),
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFBO);
+
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+bool TimeSurface::exportSurfaces(const std::string &basePath, int64_t query, float tau) const {
+    if (!lastTexture || (!valid && !hostValid)) {
+        return false;
+    }
+
+    // The device surface is current in both modes once drawn
+    size_t numPixels = static_cast<size_t>(resolution.x) * resolution.y;
+    std::vector<int32_t> last(2 * numPixels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, lastTexture);
+    glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RED_INTEGER, GL_INT, last.data());
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(basePath).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+
+    bool ok = true;
+    const char *names[] = { "positive", "negative" };
+    float decay = 1.0f / std::max(tau, 1.0f);
+    int32_t queryRelative = relative(query);
+    for (int layer = 0; layer < 2; layer++) {
+        cv::Mat image(resolution.y, resolution.x, CV_32F);
+        float *out = image.ptr<float>();
+        const int32_t *in = last.data() + layer * numPixels;
+        for (size_t p = 0; p < numPixels; p++) {
+            out[p] = in[p] == NEVER || in[p] > queryRelative ? 0.0f : std::exp(-static_cast<float>(queryRelative - in[p]) * decay);
+        }
+        ok &= cv::imwrite(basePath + "_" + names[layer] + ".tiff", image);
+    }
+    return ok;
+}
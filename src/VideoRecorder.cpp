@@ -0,0 +1,288 @@
+#include "VideoRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "GLSL.h"
+
+VideoRecorder::VideoRecorder() : initialized(false), sourceTexture(0), recording(false), policy(DROP_POLICY),
+    format(RGB24_FORMAT), recordFormat(RGB24_FORMAT), width(0), height(0), frameBytes(0), pipe(nullptr),
+    closePipe(nullptr), head(0), stopping(false), capturedFrames(0), droppedFrames(0), blockedFrames(0), writtenFrames(0),
+    queueDepth(0), lagMilliseconds(0.0), writeMilliseconds(0.0) {}
+
+VideoRecorder::~VideoRecorder() {
+    stop();
+}
+
+bool VideoRecorder::init(const std::string &resource_dir) {
+    if (initialized) {
+        return true;
+    }
+
+    convertProg.setShaderName(resource_dir + "video_yuv420.comp");
+    if (!convertProg.init()) {
+        std::cerr << "Failed to initialize video conversion shader" << std::endl;
+        return false;
+    }
+
+    convertProg.bind();
+    convertProg.addUniform("paddedSize");
+    convertProg.addUniform("numWords");
+    convertProg.unbind();
+
+    initialized = true;
+    return true;
+}
+
+size_t VideoRecorder::frameSize(int format, GLuint width, GLuint height) {
+    size_t pixels = (size_t)paddedSize(format, width) * paddedSize(format, height);
+    if (format == RGB24_FORMAT) {
+        return pixels * 3;
+    }
+    return pixels * 3 / 2;
+}
+
+double VideoRecorder::now() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool VideoRecorder::start(FILE *pipe, int (*closePipe)(FILE *), GLuint width, GLuint height) {
+    stop();
+    if (pipe == nullptr || width == 0 || height == 0 || (format != RGB24_FORMAT && !initialized)) {
+        std::cerr << "VideoRecorder: no output, empty frame or no yuv420p conversion shader" << std::endl;
+        if (pipe != nullptr && closePipe != nullptr) {
+            closePipe(pipe);
+        }
+        return false;
+    }
+
+    this->pipe = pipe;
+    this->closePipe = closePipe;
+    this->width = width;
+    this->height = height;
+    recordFormat = format;
+    frameBytes = frameSize(recordFormat, width, height);
+
+    // The conversion writes whole words, round the buffers up
+    for (Slot &slot : ring) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (frameBytes + 3) & ~size_t(3), nullptr, GL_STREAM_READ);
+        slot.fence = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    head = 0;
+
+    if (recordFormat != RGB24_FORMAT) {
+        glGenTextures(1, &sourceTexture);
+        glBindTexture(GL_TEXTURE_2D, sourceTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    if (recordFormat == Y4M_FORMAT) { // 2x2 averaged chroma is centre sited, as in 420jpeg
+        fprintf(pipe, "YUV4MPEG2 W%u H%u F30:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", paddedSize(recordFormat, width),
+            paddedSize(recordFormat, height));
+    }
+
+    queue.clear();
+    stopping = false;
+    capturedFrames = 0;
+    droppedFrames = 0;
+    blockedFrames = 0;
+    writtenFrames = 0;
+    queueDepth = 0;
+    lagMilliseconds = 0.0;
+    writeMilliseconds = 0.0;
+
+    writer = std::thread(&VideoRecorder::writerLoop, this);
+    recording = true;
+    return true;
+}
+
+void VideoRecorder::capture() {
+    if (!recording) {
+        return;
+    }
+
+    // Forward every read that already landed, oldest first; the rest are still in flight
+    for (int k = 0; k < RING_SIZE; ++k) {
+        if (!retire(ring[(head + k) % RING_SIZE], false, false)) {
+            break;
+        }
+    }
+
+    // The oldest read still pending holds the slot this frame needs
+    Slot &slot = ring[head];
+    if (slot.fence != nullptr) {
+        if (policy == DROP_POLICY) {
+            ++droppedFrames;
+            return;
+        }
+        ++blockedFrames;
+        retire(slot, true, false);
+    }
+
+    if (recordFormat == RGB24_FORMAT) {
+        GLint packAlignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1); // rgb24 rows are tightly packed in the pipe
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D, sourceTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLuint numWords = static_cast<GLuint>((frameBytes + 3) / 4);
+        glBindImageTexture(0, sourceTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA8);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, slot.buffer);
+        convertProg.bind();
+        glUniform2i(convertProg.getUniform("paddedSize"), static_cast<GLint>(paddedSize(recordFormat, width)),
+            static_cast<GLint>(paddedSize(recordFormat, height)));
+        glUniform1ui(convertProg.getUniform("numWords"), numWords);
+        convertProg.dispatchGridStride(numWords);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+        convertProg.unbind();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, 0);
+        GLSL::checkError(GET_FILE_LINE);
+    }
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.captureTime = now();
+    head = (head + 1) % RING_SIZE;
+    ++capturedFrames;
+}
+
+bool VideoRecorder::retire(Slot &slot, bool wait, bool force) {
+    if (slot.fence == nullptr) {
+        return true;
+    }
+
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+    }
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    if (status == GL_WAIT_FAILED) {
+        ++droppedFrames;
+        return true;
+    }
+    return enqueue(slot, force);
+}
+
+bool VideoRecorder::enqueue(Slot &slot, bool force) {
+    Frame frame;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if ((int)queue.size() >= QUEUE_CAPACITY) {
+            if (policy == DROP_POLICY && !force) {
+                ++droppedFrames;
+                return true;
+            }
+            ++blockedFrames;
+            queueChanged.wait(lock, [this] { return (int)queue.size() < QUEUE_CAPACITY; });
+        }
+        if (!freeFrames.empty()) {
+            frame = std::move(freeFrames.back());
+            freeFrames.pop_back();
+        }
+    }
+
+    // Only this thread adds to the queue, so the space found above is still there after the copy
+    frame.pixels.resize(frameBytes);
+    frame.captureTime = slot.captureTime;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+    bool copied = mapped != nullptr;
+    if (copied) {
+        std::memcpy(frame.pixels.data(), mapped, frameBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!copied) {
+        ++droppedFrames;
+        freeFrames.push_back(std::move(frame));
+        return true;
+    }
+    queue.push_back(std::move(frame));
+    queueDepth = (int)queue.size();
+    queueChanged.notify_all();
+    return true;
+}
+
+void VideoRecorder::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        queueChanged.wait(lock, [this] { return !queue.empty() || stopping; });
+        if (queue.empty()) {
+            break; // stopping and flushed
+        }
+
+        Frame frame = std::move(queue.front());
+        queue.pop_front();
+        queueDepth = (int)queue.size();
+        queueChanged.notify_all();
+        lock.unlock();
+
+        double begin = now();
+        if (recordFormat == Y4M_FORMAT) {
+            fputs("FRAME\n", pipe);
+        }
+        fwrite(frame.pixels.data(), frameBytes, 1, pipe);
+        double end = now();
+        writeMilliseconds = end - begin;
+        lagMilliseconds = end - frame.captureTime;
+        ++writtenFrames;
+
+        lock.lock();
+        freeFrames.push_back(std::move(frame));
+    }
+}
+
+void VideoRecorder::stop() {
+    if (!recording) {
+        return;
+    }
+
+    // Every captured frame reaches the encoder, whatever the policy
+    for (int k = 0; k < RING_SIZE; ++k) {
+        retire(ring[(head + k) % RING_SIZE], true, true);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    writer.join();
+
+    if (closePipe != nullptr) {
+        closePipe(pipe);
+    }
+    pipe = nullptr;
+
+    for (Slot &slot : ring) {
+        glDeleteBuffers(1, &slot.buffer);
+        slot.buffer = 0;
+    }
+    if (sourceTexture) {
+        glDeleteTextures(1, &sourceTexture);
+        sourceTexture = 0;
+    }
+    freeFrames.clear();
+    queueDepth = 0;
+    recording = false;
+}
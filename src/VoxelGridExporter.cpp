@@ -0,0 +1,162 @@
+#include "VoxelGridExporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+VoxelGridExporter::VoxelGridExporter() : request(false), bins(5), windowMs(50.0f), strideMs(50.0f), file(nullptr),
+    streamed(false), failed(false), resolution(0), numBins(0), length(0), stride(0), hasStart(false), windowStart(0),
+    lastTimestamp(0), pendingBegin(0), nextEvent(0), writtenWindows(0), milliseconds(0.0) {}
+
+VoxelGridExporter::~VoxelGridExporter() {
+    finish();
+}
+
+bool VoxelGridExporter::begin(const std::string &path, glm::ivec2 resolution, bool streamed) {
+    request = false;
+    if (isActive() || resolution.x <= 0 || resolution.y <= 0) {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "VoxelGridExporter: cannot write " << path << std::endl;
+        return false;
+    }
+
+    this->resolution = resolution;
+    this->streamed = streamed;
+    numBins = std::max(bins, 1);
+    length = std::max<int64_t>(static_cast<int64_t>(std::llround(windowMs * 1000.0)), 1);
+    stride = std::max<int64_t>(static_cast<int64_t>(std::llround(strideMs * 1000.0)), 1);
+    grid.assign(static_cast<size_t>(POLARITIES) * numBins * resolution.x * resolution.y, 0.0f);
+
+    failed = false;
+    hasStart = false;
+    windowStart = 0;
+    lastTimestamp = 0;
+    pending.clear();
+    pendingBegin = 0;
+    nextEvent = 0;
+    writtenWindows = 0;
+    milliseconds = 0.0;
+    return writeHeader(0);
+}
+
+bool VoxelGridExporter::writeHeader(uint64_t numWindows) {
+    // .npy version 1.0: magic, version, little endian header length, then the dict padded to HEADER_BYTES
+    std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(numWindows) + ", " +
+        std::to_string(POLARITIES) + ", " + std::to_string(numBins) + ", " + std::to_string(resolution.y) + ", " +
+        std::to_string(resolution.x) + "), }";
+    const size_t prefix = 10;
+    dict.resize(HEADER_BYTES - prefix - 1, ' ');
+    dict += '\n';
+
+    unsigned char head[prefix] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        static_cast<unsigned char>(dict.size() & 0xff), static_cast<unsigned char>(dict.size() >> 8) };
+    fseek(file, 0, SEEK_SET);
+    bool ok = fwrite(head, 1, prefix, file) == prefix && fwrite(dict.data(), 1, dict.size(), file) == dict.size();
+    fseek(file, 0, SEEK_END);
+    failed |= !ok;
+    return ok;
+}
+
+void VoxelGridExporter::writeWindow(size_t end) {
+    std::fill(grid.begin(), grid.end(), 0.0f);
+
+    const int width = resolution.x;
+    const int height = resolution.y;
+    const size_t plane = static_cast<size_t>(width) * height;
+    const double scale = numBins > 1 ? (numBins - 1) / static_cast<double>(length) : 0.0;
+    const int64_t start = windowStart;
+    const int first = static_cast<int>(pendingBegin);
+    const int last = static_cast<int>(end);
+    float *cells = grid.data();
+
+    #pragma omp parallel for
+    for (int i = first; i < last; i++) {
+        const FilterEvent &evt = pending[i];
+        if (evt.x < 0 || evt.y < 0 || evt.x >= width || evt.y >= height) {
+            continue;
+        }
+
+        double t = (evt.timestamp - start) * scale;
+        int b = static_cast<int>(std::floor(t));
+        float frac = static_cast<float>(t - b);
+        size_t cell = (evt.polarity ? 0 : 1) * numBins * plane + static_cast<size_t>(evt.y) * width + evt.x;
+        if (b >= 0 && b < numBins) {
+            #pragma omp atomic
+            cells[cell + b * plane] += 1.0f - frac;
+        }
+        if (frac > 0.0f && b + 1 >= 0 && b + 1 < numBins) {
+            #pragma omp atomic
+            cells[cell + (b + 1) * plane] += frac;
+        }
+    }
+
+    if (fwrite(grid.data(), sizeof(float), grid.size(), file) != grid.size()) {
+        failed = true;
+    }
+    writtenWindows++;
+}
+
+void VoxelGridExporter::feed(const std::vector<FilterEvent> &batch) {
+    if (!isActive() || batch.empty()) {
+        return;
+    }
+    auto begin = std::chrono::steady_clock::now();
+
+    pending.insert(pending.end(), batch.begin(), batch.end());
+    lastTimestamp = pending.back().timestamp;
+    if (!hasStart) {
+        windowStart = pending[pendingBegin].timestamp;
+        hasStart = true;
+    }
+
+    auto before = [](const FilterEvent &evt, int64_t t) { return evt.timestamp < t; };
+    while (lastTimestamp >= windowStart + length) {
+        size_t end = std::lower_bound(pending.begin() + pendingBegin, pending.end(), windowStart + length, before) - pending.begin();
+        writeWindow(end);
+        windowStart += stride;
+        pendingBegin = std::lower_bound(pending.begin() + pendingBegin, pending.end(), windowStart, before) - pending.begin();
+    }
+
+    // Drop what every remaining window is past
+    if (pendingBegin > pending.size() / 2) {
+        pending.erase(pending.begin(), pending.begin() + pendingBegin);
+        pendingBegin = 0;
+    }
+
+    milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+bool VoxelGridExporter::finish() {
+    if (!isActive()) {
+        return false;
+    }
+
+    // Windows that start before the last event, the final ones only partly covered
+    auto before = [](const FilterEvent &evt, int64_t t) { return evt.timestamp < t; };
+    while (hasStart && windowStart <= lastTimestamp) {
+        size_t end = std::lower_bound(pending.begin() + pendingBegin, pending.end(), windowStart + length, before) - pending.begin();
+        writeWindow(end);
+        windowStart += stride;
+        pendingBegin = std::lower_bound(pending.begin() + pendingBegin, pending.end(), windowStart, before) - pending.begin();
+    }
+
+    writeHeader(writtenWindows);
+    failed |= fclose(file) != 0;
+    file = nullptr;
+
+    pending.clear();
+    pending.shrink_to_fit();
+    pendingBegin = 0;
+    grid.clear();
+    grid.shrink_to_fit();
+    return !failed;
+}
@@ -20,6 +20,8 @@ using namespace std;
 
 // TODO make background process?
 static const string cmd_format {"ffmpeg -y -f rawvideo -pix_fmt rgb24 -s %ux%u -i - -c:v libx264 -pix_fmt yuv420p -vf \"pad=ceil(iw/2)*2:ceil(ih/2)*2, vflip\" -r 30 -preset veryfast %s.mp4"};
+// Frames already flipped, padded and converted by the recorder
+static const string cmd_format_yuv {"ffmpeg -y -f rawvideo -pix_fmt yuv420p -s %ux%u -i - -c:v libx264 -r 30 -preset veryfast %s.mp4"};
 
 // We can pass in a user pointer to callback functions - shouldn't require an updater; vars have inf lifespan
 GLFWwindow *g_window;
@@ -42,9 +44,10 @@ FrameViewportFBO g_frameSceneFBO;
 
 bool recording;
 string video_name;
-GLuint vid_width, vid_height;
-FILE *ffmpeg;
-vector<unsigned char> pixels;
+VideoRecorder g_videoRecorder;
+VideoRecorder g_batchRecorder; // Frame batch layers, one per render loop iteration
+int g_batchRecordLayer{ 0 };   // Next layer g_batchRecorder captures
+SequenceExporter g_sequenceExporter;
 
 Mesh g_meshSphere;
 Program g_progBasic, g_progInst, g_progFrame, g_progTexture; // g_progTexture is texture shader
@@ -54,6 +57,7 @@ BPMaterial g_lightMat;
 
 // TODO: Maybe we want unique_ptr
 shared_ptr<EventData> g_eventData;
+shared_ptr<EventFilterChain> g_filterChain = make_shared<EventFilterChain>(); // Outlives g_eventData, so filter settings apply to every load
 
 float g_particleScale(3.0f);
 
@@ -91,7 +95,10 @@ static void streamEvtDataAndCamera() {
 
 static void updateEvtDataAndCamera() {
     // Load .aedat events into EventData object //
+    bool autoHotPixelMask = g_eventData ? g_eventData->getAutoHotPixelMask() : true;
     g_eventData = make_shared<EventData>();
+    g_eventData->setFilterChain(g_filterChain);
+    g_eventData->getAutoHotPixelMask() = autoHotPixelMask;
     g_eventData->setResourceDir(g_resourceDir);
     g_eventData->initParticlesFromFile(g_dataFilepath);
     g_eventData->initInstancing(g_progInst);
@@ -104,6 +111,7 @@ static void updateEvtDataAndCamera() {
 static void initEvtDataAndCamera() {
     // Load .aedat events into EventData object //
     g_eventData = make_shared<EventData>();
+    g_eventData->setFilterChain(g_filterChain);
     g_eventData->initParticlesEmpty();
     g_eventData->initInstancing(g_progInst);
     g_eventData->setResourceDir(g_resourceDir);
@@ -158,6 +166,10 @@ static void init() {
     g_meshSphere.loadMesh(g_resourceDir + "sphere.obj");
     g_meshSphere.init();
 
+    g_videoRecorder.init(g_resourceDir);
+    g_batchRecorder.init(g_resourceDir);
+    g_sequenceExporter.init(g_resourceDir);
+
     g_lightPos = glm::vec3(0.0f, 1000.0f, 0.0f);
     g_lightCol = glm::vec3((187 / 255.0f), (178 / 255.0f), (233 / 255.0f));
     g_lightMat = BPMaterial(g_lightCol, g_lightCol, g_lightCol, 100.0f);
@@ -170,6 +182,32 @@ static void init() {
     GLSL::checkError();
 }
 
+// DCE viewport content into the bound framebuffer, shared by the live viewport and the sequence export
+// which waits for the pca moments instead of picking them up on a later redraw
+static void drawDCEFrame(glm::vec2 viewport_resolution, bool exporting = false) {
+    glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (g_frameSceneFBO.getTimeSurface()) {
+        g_eventData->drawTimeSurface(viewport_resolution, g_frameSceneFBO.getSurfaceTau() * 1000.0f,
+            g_frameSceneFBO.getSurfaceMode());
+    }
+    else {
+        g_eventData->drawFrame(g_progFrame, viewport_resolution, g_frameSceneFBO.getContributionFunc(),
+            g_frameSceneFBO.getFreq(), g_frameSceneFBO.getPCA(), g_frameSceneFBO.getWeightedPCA(),
+            g_frameSceneFBO.getIncremental(), exporting);
+    }
+
+    // Clusters and tracks step with the frame
+    if (g_frameSceneFBO.getClusters()) {
+        g_eventData->updateClusters();
+        g_eventData->drawClusters();
+    }
+}
+
 static void render() {
     float t = static_cast<float>(glfwGetTime());
 
@@ -231,8 +269,7 @@ static void render() {
     g_mainSceneFBO.unbind();
 
     // Draw Frame // 
-    // FIXME: make method for this i.e. g_eventData->drawDCEFrame() ? render() easily gets bloated, this is fine though if we
-    // don't have many more
+    bool playbackTick = false;
     float nextUpdateTime = t - 1 / g_frameSceneFBO.getUpdateFPS();
     if (g_frameSceneFBO.getAutoUpdate() != FrameViewportFBO::MANUAL_UPDATE && nextUpdateTime >= g_frameSceneFBO.getLastRenderTime()) {
         if (g_frameSceneFBO.getAutoUpdate() == FrameViewportFBO::EVENT_AUTO_UPDATE) {
@@ -268,33 +305,86 @@ static void render() {
             }
         }
         g_frameSceneFBO.setDirtyBit(true); 
-        g_frameSceneFBO.setLastRenderTime(t);
+        // Step the schedule by one period so render loop jitter does not lower the rate, unless far behind
+        float period = 1 / g_frameSceneFBO.getUpdateFPS();
+        g_frameSceneFBO.setLastRenderTime(glm::max(g_frameSceneFBO.getLastRenderTime() + period, t - period));
+        playbackTick = true;
+    }
+
+    // Auto-play frames come from the prefetch ring when it can produce them
+    // Overlays and time surfaces are drawn into the FBO, so those frames are not prefetched
+    if (g_frameSceneFBO.getDirtyBit() && playbackTick && g_frameSceneFBO.getPrefetch() && !g_frameSceneFBO.getPCA() &&
+        !g_frameSceneFBO.getClusters() && !g_frameSceneFBO.getTimeSurface()) {
+        bool prefetched = g_eventData->drawFramePrefetched(g_frameSceneFBO.getPrefetchFrames(),
+            g_frameSceneFBO.getAutoUpdate() == FrameViewportFBO::EVENT_AUTO_UPDATE,
+            g_frameSceneFBO.getFramePeriod_T(), g_frameSceneFBO.getFramePeriod_E(),
+            g_frameSceneFBO.getContributionFunc(), g_frameSceneFBO.getFreq(), t);
+        g_frameSceneFBO.getShowPrefetch() = prefetched;
+        if (prefetched) {
+            g_frameSceneFBO.setDirtyBit(false);
+        }
+    }
+    else if (g_frameSceneFBO.getDirtyBit()) {
+        g_frameSceneFBO.getShowPrefetch() = false;
     }
 
     if (g_frameSceneFBO.getDirtyBit()) {
+        if (playbackTick) {
+            g_eventData->getPlaybackPrefetch().notePresented(t, false);
+        }
         g_frameSceneFBO.bind();
         glViewport(0, 0, width, height); 
-        glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-        glDisable(GL_DEPTH_TEST); 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
-
-        glm::vec2 viewport_resolution(g_frameSceneFBO.getFBOwidth(), g_frameSceneFBO.getFBOheight());
-        g_eventData->drawFrame(g_progFrame, viewport_resolution, 
-            g_frameSceneFBO.isMorlet(), g_frameSceneFBO.getFreq(), g_frameSceneFBO.getPCA()); 
-                
+        drawDCEFrame(glm::vec2(g_frameSceneFBO.getFBOwidth(), g_frameSceneFBO.getFBOheight()));
         g_frameSceneFBO.unbind();
         g_frameSceneFBO.setDirtyBit(false);
     }
 
+    // Batched frames for scrubbing / recording //
+    if (g_frameSceneFBO.getBatchRequest() != FrameViewportFBO::MANUAL_UPDATE) {
+        g_eventData->drawFrameBatch(g_frameSceneFBO.getBatchFrames(), 
+            g_frameSceneFBO.getBatchRequest() == FrameViewportFBO::EVENT_AUTO_UPDATE,
+            g_frameSceneFBO.getFramePeriod_T(), g_frameSceneFBO.getFramePeriod_E(),
+            g_frameSceneFBO.getContributionFunc(), g_frameSceneFBO.getFreq());
+        g_frameSceneFBO.getBatchRequest() = FrameViewportFBO::MANUAL_UPDATE;
+        g_frameSceneFBO.getBatchLayer() = 0;
+        g_frameSceneFBO.getShowBatch() = true;
+    }
+
+    // Morlet filter bank over the current shutter //
+    if (g_frameSceneFBO.getBankRequest()) {
+        g_eventData->runFilterBank(g_frameSceneFBO.getBankFilters(), g_frameSceneFBO.getBankMinFreq(),
+            g_frameSceneFBO.getBankMaxFreq(), g_frameSceneFBO.getBankCycles());
+        g_eventData->getFilterBank().resolve(g_frameSceneFBO.getBankLayer(), g_frameSceneFBO.getBankGain());
+        g_frameSceneFBO.getBankRequest() = false;
+        g_frameSceneFBO.getShowBank() = true;
+    }
+
+    // Per pixel spectrum over the current time window //
+    if (g_frameSceneFBO.getSpectrumRequest()) {
+        g_eventData->runSpectrum(g_frameSceneFBO.getSpectrumGPU(), g_frameSceneFBO.getSpectrumBins(),
+            g_frameSceneFBO.getSpectrumMinFreq(), g_frameSceneFBO.getSpectrumMaxFreq());
+        g_eventData->getSpectrumAnalyzer().updatePreview(g_frameSceneFBO.getSpectrumMap(), g_frameSceneFBO.getSpectrumGain());
+        g_frameSceneFBO.getSpectrumRequest() = false;
+        g_frameSceneFBO.getShowSpectrum() = true;
+        g_frameSceneFBO.getShowStats() = false;
+    }
+
+    // Per pixel statistics maps over the time window or shutter //
+    if (g_frameSceneFBO.getStatsRequest()) {
+        g_eventData->runPixelStatistics(g_frameSceneFBO.getStatsGPU(), g_frameSceneFBO.getStatsShutter());
+        g_eventData->getPixelStatistics().updatePreview(g_frameSceneFBO.getStatsMap(), g_frameSceneFBO.getStatsGain());
+        g_frameSceneFBO.getStatsRequest() = false;
+        g_frameSceneFBO.getShowStats() = true;
+        g_frameSceneFBO.getShowSpectrum() = false;
+    }
+
     // Build ImGui Docking & Main Viewport //
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
         
         drawGUI(g_camera, g_fps, g_particleScale, g_maxZ, g_isMainviewportHovered, g_mainSceneFBO, 
-            g_frameSceneFBO, g_eventData, g_dataFilepath, video_name, recording, g_dataDir, g_loadFile, g_dataStreamed, g_resetStream, g_pauseStream, g_showFrameData, g_particleTimeDensity);
+            g_frameSceneFBO, g_eventData, g_dataFilepath, video_name, recording, g_videoRecorder, g_sequenceExporter, g_dataDir, g_loadFile, g_dataStreamed, g_resetStream, g_pauseStream, g_showFrameData, g_particleTimeDensity);
     
     // Render ImGui //
         ImGui::Render();
@@ -311,37 +401,188 @@ static void render() {
     GLSL::checkError(GET_FILE_LINE);
 }
 
+static FILE *open_ffmpeg(GLuint width, GLuint height, const string &name, const string &format = cmd_format) {
+    // Dynamically construct command
+    unsigned int cmd_size = static_cast<unsigned int>(format.size() + std::to_string(width).size() + 
+        std::to_string(height).size() + name.size() - 6) + 1; // -6 accounts for each %_ // JH: +1 added to avoid writing 1 byte out of bounds
+    char *cmd = new char[cmd_size]; 
+    snprintf(cmd, cmd_size, format.c_str(), width, height, name.c_str()); // use snprintf to avoid writing out of bounds
+
+    FILE *pipe = popen_macro(cmd, "wb");
+    if (!pipe) {
+        cerr << "Could not start ffmpeg for " << name << ", is it on the PATH?" << endl;
+    }
+
+    delete[] cmd;
+    return pipe;
+}
+
+// Opens the output of the recorder's format and starts it, false if the output could not be opened
+static bool start_recorder(VideoRecorder &recorder, GLuint width, GLuint height, const string &name) {
+    int format = recorder.getFormat();
+    if (format == VideoRecorder::Y4M_FORMAT) { // lossless, no encoder
+        FILE *file = fopen((name + ".y4m").c_str(), "wb");
+        if (!file) {
+            cerr << "Could not open " << name << ".y4m for recording" << endl;
+            return false;
+        }
+        return recorder.start(file, fclose, width, height);
+    }
+    FILE *pipe = format == VideoRecorder::YUV420_FORMAT
+        ? open_ffmpeg(VideoRecorder::paddedSize(format, width), VideoRecorder::paddedSize(format, height), name, cmd_format_yuv)
+        : open_ffmpeg(width, height, name);
+    if (!pipe) {
+        return false;
+    }
+    return recorder.start(pipe, pclose_macro, width, height);
+}
+
 // FIXME: Add params and move to utils ?
 static void video_output() {
     if (recording) {
 
-        if (ffmpeg == nullptr) { // Check if beginning recording
-            vid_width = g_mainSceneFBO.getFBOwidth();
-            vid_height = g_mainSceneFBO.getFBOheight();
-
-            // Dynamically construct command
-            unsigned int cmd_size = static_cast<unsigned int>(cmd_format.size() + std::to_string(vid_width).size() + 
-                std::to_string(vid_height).size() + video_name.size() - 6) + 1; // -6 accounts for each %_ // JH: +1 added to avoid writing 1 byte out of bounds
-            char *cmd = new char[cmd_size]; 
-            snprintf(cmd, cmd_size, cmd_format.c_str(), vid_width, vid_height, video_name.c_str()); // use snprintf to avoid writing out of bounds
-
-            ffmpeg = popen_macro(cmd, "wb");
-            if (!ffmpeg) { cerr << "ffmpeg error" << endl; } // TODO add error handling?
-      
-            delete[] cmd;
-            pixels.resize(vid_width * vid_height * 3);
+        if (!g_videoRecorder.isRecording()) { // Check if beginning recording
+            GLuint vid_width = g_mainSceneFBO.getFBOwidth();
+            GLuint vid_height = g_mainSceneFBO.getFBOheight();
+
+            if (!start_recorder(g_videoRecorder, vid_width, vid_height, video_name)) {
+                recording = false;
+                return;
+            }
         }
 
-        glReadPixels(0, 0, vid_width, vid_height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data()); 
-        fwrite(pixels.data(), vid_width * vid_height * 3, 1, ffmpeg);
+        // Queues the read into a pixel buffer, the encoder pipe is fed from the recorder's writer thread
+        g_videoRecorder.capture();
     }
-    else if (ffmpeg != nullptr) { // Check if recording stopped
-        pclose_macro(ffmpeg);
-        ffmpeg = nullptr;
+    else if (g_videoRecorder.isRecording()) { // Check if recording stopped
+        g_videoRecorder.stop();
     }
 
 }
 
+// Offline export: renders fixed steps of the windows off-screen, as many frames as fit in the loop budget
+static void export_sequence() {
+    SequenceExporter &exporter = g_sequenceExporter;
+    if (exporter.getRequest()) {
+        if (exporter.begin(*g_eventData, g_camera, g_frameSceneFBO, video_name, g_frameSceneFBO.getFramePeriod_T(),
+            g_frameSceneFBO.getFramePeriod_E())) {
+            for (int target : { SequenceExporter::DCE_TARGET, SequenceExporter::SCENE_TARGET }) {
+                if (!exporter.renders(target) || exporter.getOutput() != SequenceExporter::VIDEO_OUTPUT) {
+                    continue;
+                }
+                VideoRecorder &recorder = exporter.getRecorder(target);
+                recorder.getFormat() = exporter.getFormat();
+                recorder.getPolicy() = VideoRecorder::BLOCK_POLICY; // every frame, however slow the encoder
+                glm::ivec2 res = exporter.getResolution();
+                if (!start_recorder(recorder, res.x, res.y, exporter.getOutputName(target))) {
+                    exporter.finish(*g_eventData, g_camera, g_frameSceneFBO);
+                    return;
+                }
+            }
+        }
+    }
+    if (!exporter.isActive()) {
+        return;
+    }
+
+    glm::ivec2 res = exporter.getResolution();
+    float liveAspect = g_camera.aspect;
+    g_camera.aspect = static_cast<float>(res.x) / res.y;
+    double budgetStart = glfwGetTime();
+    while (!exporter.isDone() && glfwGetTime() - budgetStart < 0.05) {
+        int k = exporter.getNextFrame();
+        exporter.applyFrame(*g_eventData, g_camera, k);
+
+        if (exporter.renders(SequenceExporter::SCENE_TARGET)) {
+            exporter.getFBO(SequenceExporter::SCENE_TARGET).bind();
+            glViewport(0, 0, res.x, res.y);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glEnable(GL_DEPTH_TEST);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            MatrixStack P, MV;
+            P.pushMatrix();
+            MV.pushMatrix();
+            g_camera.applyProjectionMatrix(P);
+            g_camera.applyViewMatrix(MV);
+            g_eventData->drawInstanced(MV, P, g_progInst, g_progBasic, g_particleScale);
+            P.popMatrix();
+            MV.popMatrix();
+
+            exporter.writeFrame(SequenceExporter::SCENE_TARGET, k);
+            exporter.getFBO(SequenceExporter::SCENE_TARGET).unbind();
+        }
+
+        if (exporter.renders(SequenceExporter::DCE_TARGET)) {
+            exporter.getFBO(SequenceExporter::DCE_TARGET).bind();
+            glViewport(0, 0, res.x, res.y);
+            drawDCEFrame(glm::vec2(res), true);
+
+            exporter.writeFrame(SequenceExporter::DCE_TARGET, k);
+            exporter.getFBO(SequenceExporter::DCE_TARGET).unbind();
+        }
+
+        exporter.advance();
+    }
+    g_camera.aspect = liveAspect;
+
+    if (exporter.isDone()) {
+        exporter.finish(*g_eventData, g_camera, g_frameSceneFBO);
+    }
+    g_frameSceneFBO.setDirtyBit(true); // show where the export got to
+    GLSL::checkError(GET_FILE_LINE);
+}
+
+// Raw DCE frame export, readback and encoding run behind the render loop
+static void export_frames() {
+    FrameExporter &exporter = g_eventData->getFrameExporter();
+    if (exporter.getRequest()) {
+        g_eventData->beginFrameExport((video_name.empty() ? string("dce") : video_name) + "_frames", exporter.getRequestFrames(),
+            exporter.getEventPeriod(), g_frameSceneFBO.getFramePeriod_T(), g_frameSceneFBO.getFramePeriod_E(),
+            g_frameSceneFBO.getContributionFunc(), g_frameSceneFBO.getFreq());
+    }
+    g_eventData->stepFrameExport();
+}
+
+// Voxel grid tensor export, the resident recording a chunk per frame or the stream as it is read
+static void export_voxels() {
+    VoxelGridExporter &exporter = g_eventData->getVoxelExporter();
+    if (exporter.getRequest()) {
+        g_eventData->beginVoxelExport((video_name.empty() ? string("events") : video_name) + "_voxels.npy");
+    }
+    g_eventData->stepVoxelExport();
+}
+
+// Writes the layers of the frame batch, in order, as the frames of a single <name>_batch video at camera resolution,
+// one layer per iteration through its own recorder so the encoder never runs on the render thread
+static void record_batch() {
+    FrameBatch &batch = g_eventData->getFrameBatch();
+    if (g_frameSceneFBO.getRecordBatch() && !g_batchRecorder.isRecording() && batch.getNumLayers() > 0) {
+        g_batchRecorder.getFormat() = g_videoRecorder.getFormat();
+        g_batchRecorder.getPolicy() = VideoRecorder::BLOCK_POLICY; // every layer, however slow the encoder
+        glm::ivec2 res = batch.getResolution();
+        if (start_recorder(g_batchRecorder, res.x, res.y, video_name + "_batch")) {
+            g_batchRecordLayer = 0;
+        }
+    }
+    g_frameSceneFBO.getRecordBatch() = false;
+    if (!g_batchRecorder.isRecording()) {
+        return;
+    }
+
+    if (g_batchRecordLayer < batch.getNumLayers()) {
+        GLint readFBO = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFBO);
+        batch.bindLayerForRead(g_batchRecordLayer++);
+        g_batchRecorder.capture();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    }
+    if (g_batchRecordLayer >= batch.getNumLayers()) {
+        g_batchRecorder.stop();
+        batch.resolveLayer(g_frameSceneFBO.getBatchLayer()); // Restore the scrubbed frame
+    }
+}
+
 int main(int argc, char** argv) {
     // resources/ data/ 
     if (argc < 3) {
@@ -386,6 +627,7 @@ int main(int argc, char** argv) {
     cout << "OpenGL Version: " << glGetString(GL_VERSION) << endl;
     cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
     GLSL::checkVersion();
+    GLSL::setProgramCacheDir(g_resourceDir + "shader_cache/"); // Linked program binaries, skips compiling on later launches
 
     glfwSwapInterval(1);
     glfwSetKeyCallback(g_window, key_callback);
@@ -419,11 +661,30 @@ int main(int argc, char** argv) {
         glfwSwapBuffers(g_window);
         glfwPollEvents();
 
+        // PCA overlay needs the asynchronously read back moments, redraw the frame once they arrive
+        if (g_eventData->pollReadbacks() && g_frameSceneFBO.getPCA()) {
+            g_frameSceneFBO.setDirtyBit(true);
+        }
+
+        // A streamed time surface follows the ingest, redraw it with every batch
+        if (g_dataStreamed && g_frameSceneFBO.getTimeSurface()) {
+            g_frameSceneFBO.setDirtyBit(true);
+        }
+
+        export_sequence();
+        export_frames();
+        export_voxels();
         video_output();
         render();
+        record_batch();
     }
 
     // Cleanup //
+    g_videoRecorder.stop(); // flush a recording still running while the context is alive
+    g_batchRecorder.stop();
+    g_sequenceExporter.finish(*g_eventData, g_camera, g_frameSceneFBO);
+    g_eventData->getFrameExporter().cancel();
+    g_eventData->getVoxelExporter().finish();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
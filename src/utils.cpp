@@ -10,6 +10,8 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <algorithm>
+#include <chrono>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -35,7 +37,9 @@ enum unitLabelsIndex {
     shutterInitial,
     shutterFinal,
     FWHM,
-    dTime
+    dTime,
+    noiseSupport,
+    clusterTime
 };
 
 void initLabels() {
@@ -44,8 +48,10 @@ void initLabels() {
         "Frame Period (",
         "Shutter Initial (",
         "Shutter Final (",
-        "Full Width at Half Measure (",
-        "Final - Initial Time: %.3f ("
+        "Function Width [FWHM / sigma / tau] (",
+        "Final - Initial Time: %.3f (",
+        "Noise Support Window (",
+        "Time Radius, 0 for space only ("
     });
 }
 
@@ -193,6 +199,9 @@ Program genInstProg(const std::string &resource_dir) {
 
     prog.addUniform("negColor");
     prog.addUniform("posColor");
+    prog.addUniform("useVisibility");
+    prog.addUniform("useSelection");
+    prog.addUniform("selectColor");
 
     prog.addAttribute("aPos");
     prog.addAttribute("aNor");
@@ -576,9 +585,136 @@ static void spaceWindowWrapper(bool &dSpaceWindow, shared_ptr<EventData> &evtDat
     evtData->getSpaceWindow().w = std::clamp(evtData->getSpaceWindow().w, evtData->getMin_XYZ().x, evtData->getMax_XYZ().x); 
 }
 
+// Event rate over the whole recording; wheel zooms, right drag pans, left click / drag sets the time window
+static void timelineWrapper(bool &dTimeWindow, shared_ptr<EventData> &evtData, bool isStreaming) {
+    const RatePyramid &pyramid = evtData->getRatePyramid();
+    static double viewStart = 0.0, viewEnd = 0.0; // microseconds since the first event
+    static uint64_t viewVersion = 0;
+    static double dragStart = 0.0;
+    static bool logScale = false;
+    static vector<TimelineColumn> columns;
+
+    double duration = pyramid.getDurationMicroseconds();
+    // Pyramid microseconds to the oddized window units, through the factor of oddizeTime
+    double toUnits = evtData->getUnitFactor() > 0.0f ? evtData->getTimeScale() / evtData->getUnitFactor() : 1.0 / EventData::TIME_CONVERSION;
+    if (pyramid.getVersion() != viewVersion || isStreaming || viewEnd <= viewStart) { // New data, or the stream keeps growing
+        viewStart = 0.0;
+        viewEnd = duration;
+        viewVersion = pyramid.getVersion();
+    }
+
+    ImGui::Begin("Timeline");
+        ImGui::Checkbox("Log Scale", &logScale);
+        ImGui::SameLine();
+        if (ImGui::Button("Show All")) {
+            viewStart = 0.0;
+            viewEnd = duration;
+        }
+        ImGui::SameLine();
+        ImGui::Text("[%.4f, %.4f] %s", viewStart * toUnits, viewEnd * toUnits,
+            timeUnits[evtData->getUnitType()].c_str());
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImVec2 size = ImGui::GetContentRegionAvail();
+        size.x = std::max(size.x, 64.0f);
+        size.y = std::max(size.y, 48.0f);
+        ImGui::InvisibleButton("##timeline", size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+        bool hovered = ImGui::IsItemHovered();
+
+        double viewWidth = std::max(viewEnd - viewStart, 1.0);
+        auto toTime = [&](float x) { return viewStart + (x - origin.x) / size.x * viewWidth; };
+        auto toX = [&](double time) { return origin.x + static_cast<float>((time - viewStart) / viewWidth) * size.x; };
+
+        // Zoom around the cursor and pan, both clamped to the recording
+        ImGuiIO &io = ImGui::GetIO();
+        if (hovered && io.MouseWheel != 0.0f && duration > 0.0) {
+            double pivot = toTime(io.MousePos.x);
+            double scale = std::pow(0.8, io.MouseWheel);
+            double width = std::clamp(viewWidth * scale, static_cast<double>(RatePyramid::BASE_BIN_US), duration);
+            viewStart = pivot - (pivot - viewStart) * width / viewWidth;
+            viewEnd = viewStart + width;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Right)) {
+            double shift = -io.MouseDelta.x / size.x * viewWidth;
+            viewStart += shift;
+            viewEnd += shift;
+        }
+        if (viewStart < 0.0) {
+            viewEnd -= viewStart;
+            viewStart = 0.0;
+        }
+        if (viewEnd > duration) {
+            viewStart = std::max(0.0, viewStart - (viewEnd - duration));
+            viewEnd = duration;
+        }
+
+        // Left drag selects the window, a click recenters the current one
+        if (!isStreaming && evtData->getMaxEvent() > 0) {
+            if (ImGui::IsItemActivated() && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+                dragStart = toTime(io.MousePos.x);
+            }
+            if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left)) {
+                double dragEnd = toTime(io.MousePos.x);
+                evtData->getTimeWindow_L() = static_cast<float>(std::min(dragStart, dragEnd) * toUnits);
+                evtData->getTimeWindow_R() = static_cast<float>(std::max(dragStart, dragEnd) * toUnits);
+                dTimeWindow = true;
+            }
+            else if (ImGui::IsItemDeactivated() && !ImGui::IsMouseDragPastThreshold(ImGuiMouseButton_Left) &&
+                ImGui::IsMouseReleased(ImGuiMouseButton_Left)) {
+                float halfWidth = 0.5f * (evtData->getTimeWindow_R() - evtData->getTimeWindow_L());
+                float center = static_cast<float>(dragStart * toUnits);
+                evtData->getTimeWindow_L() = center - halfWidth;
+                evtData->getTimeWindow_R() = center + halfWidth;
+                dTimeWindow = true;
+            }
+        }
+
+        // One pyramid query per frame, a column per pixel
+        int numColumns = static_cast<int>(size.x);
+        pyramid.query(viewStart, viewStart + viewWidth, numColumns, columns);
+        float peak = 1.0f;
+        for (const TimelineColumn &column : columns) {
+            peak = std::max(peak, std::max(column.maxRate, column.positiveRate + column.negativeRate));
+        }
+        auto toHeight = [&](float rate) {
+            float h = logScale ? std::log1p(rate) / std::log1p(peak) : rate / peak;
+            return std::clamp(h, 0.0f, 1.0f) * size.y;
+        };
+
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        ImVec2 bottomRight(origin.x + size.x, origin.y + size.y);
+        drawList->AddRectFilled(origin, bottomRight, IM_COL32(20, 20, 20, 255));
+        const glm::vec3 &pos = evtData->getPosColor();
+        const glm::vec3 &neg = evtData->getNegColor();
+        ImU32 posColor = ImGui::ColorConvertFloat4ToU32(ImVec4(pos.r, pos.g, pos.b, 1.0f));
+        ImU32 negColor = ImGui::ColorConvertFloat4ToU32(ImVec4(neg.r, neg.g, neg.b, 1.0f));
+        for (int c = 0; c < numColumns; c++) {
+            const TimelineColumn &column = columns[c];
+            float x = origin.x + c;
+            float negHeight = toHeight(column.negativeRate);
+            float totalHeight = toHeight(column.positiveRate + column.negativeRate);
+            drawList->AddLine(ImVec2(x, bottomRight.y - toHeight(column.minRate)), ImVec2(x, bottomRight.y - toHeight(column.maxRate)),
+                IM_COL32(90, 90, 90, 255)); // burst envelope
+            drawList->AddLine(ImVec2(x, bottomRight.y), ImVec2(x, bottomRight.y - negHeight), negColor);
+            drawList->AddLine(ImVec2(x, bottomRight.y - negHeight), ImVec2(x, bottomRight.y - totalHeight), posColor);
+        }
+
+        // Current time window (GUI time units here)
+        float windowL = std::clamp(toX(evtData->getTimeWindow_L() / toUnits), origin.x, bottomRight.x);
+        float windowR = std::clamp(toX(evtData->getTimeWindow_R() / toUnits), origin.x, bottomRight.x);
+        drawList->AddRectFilled(ImVec2(windowL, origin.y), ImVec2(std::max(windowR, windowL + 1.0f), bottomRight.y), IM_COL32(255, 255, 255, 50));
+
+        if (hovered && numColumns > 0) {
+            int c = std::clamp(static_cast<int>(io.MousePos.x - origin.x), 0, numColumns - 1);
+            ImGui::SetTooltip("%.4f %s\n+ %.0f ev/s\n- %.0f ev/s\nbase bins %.0f to %.0f ev/s", toTime(io.MousePos.x) * toUnits,
+                timeUnits[evtData->getUnitType()].c_str(), columns[c].positiveRate, columns[c].negativeRate, columns[c].minRate, columns[c].maxRate);
+        }
+    ImGui::End();
+}
+
 void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool &is_mainViewportHovered,
     BaseViewportFBO &mainSceneFBO, FrameViewportFBO &frameSceneFBO, shared_ptr<EventData> &evtData, std::string& datafilepath,
-    std::string &video_name, bool &recording, std::string &datadirectory, bool &loadFile, bool &dataStreamed, bool &resetStream, bool &pauseStream, bool &showFrameData, float &particleTimeDensity) {
+    std::string &video_name, bool &recording, VideoRecorder &videoRecorder, SequenceExporter &sequenceExporter, std::string &datadirectory, bool &loadFile, bool &dataStreamed, bool &resetStream, bool &pauseStream, bool &showFrameData, float &particleTimeDensity) {
 
     drawGUIDockspace();
 
@@ -617,6 +753,75 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         ImGui::Image((ImTextureID)mainSceneFBO.getColorTexture(), final_sz, ImVec2(0, 1), ImVec2(1, 0));
         is_mainViewportHovered = ImGui::IsItemHovered();
 
+        // Click to pick an event, settings in the Spatial Query window
+        static bool clickToPick = false;
+        static float pickRadius = 4.0f;
+
+        // Click or lasso selection, settings in the Selection window. Shift adds, ctrl subtracts
+        static int selectTool = 0; // 0 off, 1 click, 2 lasso
+        static int selectMode = EventSelection::REPLACE;
+        static vector<ImVec2> lassoPoints;
+        static bool lassoActive = false;
+        ImVec2 viewportMin = ImGui::GetItemRectMin();
+        auto toNDC = [&](ImVec2 p) {
+            return glm::vec2((p.x - viewportMin.x) / final_sz.x * 2.0f - 1.0f, 1.0f - (p.y - viewportMin.y) / final_sz.y * 2.0f);
+        };
+        auto viewProj = [&camera]() {
+            MatrixStack P, MV;
+            camera.applyProjectionMatrix(P);
+            camera.applyViewMatrix(MV);
+            return P.topMatrix() * MV.topMatrix();
+        };
+        ImGuiIO &io = ImGui::GetIO();
+        int modeNow = selectMode;
+        if (io.KeyShift) {
+            modeNow = EventSelection::ADD;
+        }
+        else if (io.KeyCtrl) {
+            modeNow = EventSelection::SUBTRACT;
+        }
+
+        if ((clickToPick || selectTool == 1) && is_mainViewportHovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+            evtData->pickEvent(viewProj(), toNDC(io.MousePos), pickRadius, final_sz.y);
+            if (selectTool == 1) {
+                evtData->selectPicked(modeNow);
+                dProcessingOptions |= evtData->getVisibility().getSettings().selection;
+            }
+        }
+
+        if (selectTool == 2) {
+            if (is_mainViewportHovered && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+                lassoPoints.clear();
+                lassoActive = true;
+            }
+            if (lassoActive && ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+                // Thin the stroke to points a few pixels apart, the shader tests every edge per event
+                ImVec2 mouse = io.MousePos;
+                ImVec2 last = lassoPoints.empty() ? ImVec2(-1e9f, -1e9f) : lassoPoints.back();
+                float dx = mouse.x - last.x, dy = mouse.y - last.y;
+                if (dx * dx + dy * dy > 9.0f && lassoPoints.size() < EventSelection::MAX_LASSO_POINTS) {
+                    lassoPoints.push_back(mouse);
+                }
+                if (lassoPoints.size() > 1) {
+                    ImGui::GetWindowDrawList()->AddPolyline(lassoPoints.data(), static_cast<int>(lassoPoints.size()),
+                        IM_COL32(255, 204, 0, 255), ImDrawFlags_Closed, 1.5f);
+                }
+            }
+            else if (lassoActive) {
+                lassoActive = false;
+                if (lassoPoints.size() >= 3) {
+                    vector<glm::vec2> polygon(lassoPoints.size());
+                    std::transform(lassoPoints.begin(), lassoPoints.end(), polygon.begin(), toNDC);
+                    evtData->selectLasso(viewProj(), polygon, modeNow);
+                    dProcessingOptions |= evtData->getVisibility().getSettings().selection;
+                }
+                lassoPoints.clear();
+            }
+        }
+        else {
+            lassoActive = false;
+        }
+
         // Gizmo::EditCamera(camera, final_sz); // comment in to use gizmo (IN PROGRESS)
 
     ImGui::End();
@@ -637,6 +842,65 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         ImGui::SliderInt("##modFreq", (int *) &EventData::modFreq, 1, 10000, "%d", 1 << 5);
         EventData::modFreq = std::max((uint) 1, EventData::modFreq);
 
+        // Ingest filters, run over every batch as it is read (file or stream)
+        ImGui::Text("Event Filters (applied on load)");
+        EventFilterChain &filterChain = evtData->getFilterChain();
+        ROIFilter &roiFilter = filterChain.getROI();
+        ImGui::Checkbox("ROI", &roiFilter.enabled);
+        if (roiFilter.enabled) {
+            ImGui::DragInt2("ROI Min", &roiFilter.roiMin.x, 1.0f, 0, INT16_MAX);
+            ImGui::DragInt2("ROI Max", &roiFilter.roiMax.x, 1.0f, 0, INT16_MAX);
+        }
+        HotPixelFilter &hotPixelFilter = filterChain.getHotPixel();
+        ImGui::Checkbox("Hot Pixel Mask", &hotPixelFilter.enabled);
+        ImGui::SameLine();
+        ImGui::Text("(%zu pixels)", hotPixelFilter.getNumMasked());
+        ImGui::Checkbox("Apply Stored Camera Mask", &evtData->getAutoHotPixelMask());
+        {
+            // Outlier test over the per pixel rates of everything read since the last load or stream start
+            static float hotPixelMADs = 8.0f;
+            static float hotPixelMinRate = 1.0f;
+            ImGui::SliderFloat("Hot Pixel Threshold (MADs)", &hotPixelMADs, 1.0f, 50.0f, "%.1f");
+            ImGui::SliderFloat("Hot Pixel Minimum Rate (ev/s)", &hotPixelMinRate, 0.0f, 1000.0f, "%.1f", ImGuiSliderFlags_Logarithmic);
+            const HotPixelDetector &detector = evtData->getHotPixelDetector();
+            ImGui::BeginDisabled(detector.getNumEvents() == 0);
+            if (ImGui::Button("Detect Hot Pixels")) {
+                evtData->detectHotPixels(hotPixelMADs, hotPixelMinRate);
+                if (!dataStreamed && evtData->getMaxEvent() > 0) { // Reload so the masked events are never stored or uploaded
+                    loadFile = true;
+                    dFile = true;
+                }
+            }
+            ImGui::EndDisabled();
+            if (detector.getThresholdRate() > 0.0f) {
+                ImGui::Text("%zu hot pixels above %.1f ev/s (median %.2f ev/s, %.1f ms)", detector.getNumDetected(),
+                    detector.getThresholdRate(), detector.getMedianRate(), detector.getMilliseconds());
+            }
+            if (!evtData->getCameraName().empty()) {
+                ImGui::TextWrapped("Mask: %s", evtData->getHotPixelMaskPath().c_str());
+            }
+        }
+        PolarityFilter &polarityFilter = filterChain.getPolarity();
+        ImGui::Checkbox("Polarity", &polarityFilter.enabled);
+        if (polarityFilter.enabled) {
+            ImGui::SameLine();
+            ImGui::RadioButton("Positive", &polarityFilter.keepPolarity, 1);
+            ImGui::SameLine();
+            ImGui::RadioButton("Negative", &polarityFilter.keepPolarity, 0);
+        }
+        RefractoryFilter &refractoryFilter = filterChain.getRefractory();
+        ImGui::Checkbox("Refractory", &refractoryFilter.enabled);
+        if (refractoryFilter.enabled) {
+            ImGui::InputScalar("Refractory Period (us)", ImGuiDataType_S64, &refractoryFilter.period);
+            refractoryFilter.period = std::max<int64_t>(refractoryFilter.period, 0);
+        }
+        BackgroundActivityFilter &baFilter = filterChain.getBackgroundActivity();
+        ImGui::Checkbox("Background Activity", &baFilter.enabled);
+        if (baFilter.enabled) {
+            ImGui::InputScalar("Support Window (us)", ImGuiDataType_S64, &baFilter.window);
+            baFilter.window = std::max<int64_t>(baFilter.window, 0);
+        }
+
 
 
         // TODO: Cache recent files and state?
@@ -654,6 +918,22 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         ImGui::Separator();
         ImGui::PlotLines("##FPS History", fps_historyBuf.data(), static_cast<int>(fps_historyBuf.size()), static_cast<int>(fps_bufIdx), nullptr, 0.0f, maxFPS + 10.0f, ImVec2(0, 80));
         ImGui::Separator();
+        ImGui::Text("DCE Events: %u", evtData->getDCEOutputCount());
+        ImGui::Text("Incremental Events Touched: %llu", (unsigned long long) evtData->getSlidingAccumulator().getLastUpdateEvents());
+        ImGui::Separator();
+        {
+            // Ingest filter counters since the last load
+            EventFilterChain &chain = evtData->getFilterChain();
+            ImGui::Text("Filtered: %llu in, %llu out", (unsigned long long) chain.getInput(), (unsigned long long) chain.getOutput());
+            for (int i = 0; i < chain.getNumStages(); i++) {
+                const EventFilterStage &stage = chain.getStage(i);
+                if (stage.enabled || stage.passed || stage.dropped) {
+                    ImGui::Text("  %s: %llu passed, %llu dropped", stage.getName(),
+                        (unsigned long long) stage.passed, (unsigned long long) stage.dropped);
+                }
+            }
+        }
+        ImGui::Separator();
     ImGui::End();
 
     // Add control scheme for streaming data
@@ -708,10 +988,11 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         
 
         // Windows
-        float normFactor = evtData->getDiffScale() * evtData->getParticleTimeDensity() * EventData::TIME_CONVERSION;
+        float normFactor = evtData->getUnitFactor();
         evtData->oddizeTime();
         frameSceneFBO.oddizeTime(normFactor);
 
+        timelineWrapper(dTimeWindow, evtData, dataStreamed);
         timeWindowWrapper(dTimeWindow, evtData, frameSceneFBO);
         eventWindowWrapper(dEventWindow, evtData, frameSceneFBO); 
         if (dTimeWindow) { // Ensure windows match (time window == events window)
@@ -770,22 +1051,111 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         if (ImGui::Button("Play (Time period)") && frameSceneFBO.getAutoUpdate() == FrameViewportFBO::MANUAL_UPDATE) {
             frameSceneFBO.getAutoUpdate() = FrameViewportFBO::TIME_AUTO_UPDATE;
             frameSceneFBO.setLastRenderTime(glfwGetTime());
+            evtData->getPlaybackPrefetch().resetStats();
         }
         if (ImGui::Button("Play (Events period)") && frameSceneFBO.getAutoUpdate() == FrameViewportFBO::MANUAL_UPDATE) {
             frameSceneFBO.getAutoUpdate() = FrameViewportFBO::EVENT_AUTO_UPDATE;
             frameSceneFBO.setLastRenderTime(glfwGetTime());
+            evtData->getPlaybackPrefetch().resetStats();
         }
         frameSceneFBO.getUpdateFPS() = std::max(frameSceneFBO.getUpdateFPS(), 0.0f);
+        ImGui::Checkbox("Prefetch Playback", &frameSceneFBO.getPrefetch());
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Renders auto-play frames ahead in batches. Those frames use the batch resolve,\n"
+                "so they can look slightly different from the paused frame.");
+        }
+        ImGui::SameLine();
+        ImGui::SliderInt("##PrefetchFrames", &frameSceneFBO.getPrefetchFrames(), 1, FrameBatch::MAX_LAYERS, "%d frames ahead");
+        if (frameSceneFBO.getAutoUpdate() != FrameViewportFBO::MANUAL_UPDATE) {
+            const PlaybackPrefetch &prefetch = evtData->getPlaybackPrefetch();
+            ImGui::Text("Playback: %.1f / %.1f FPS (prefetched %llu, drawn %llu)", prefetch.getAchievedFPS(),
+                frameSceneFBO.getUpdateFPS(), static_cast<unsigned long long>(prefetch.getHits()),
+                static_cast<unsigned long long>(prefetch.getMisses()));
+        }
+
+        // Batched frames, computed in one dispatch for scrubbing and recording
+        ImGui::SliderInt("Batch Frames", &frameSceneFBO.getBatchFrames(), 1, FrameBatch::MAX_LAYERS);
+        if (ImGui::Button("Batch (Time period)")) {
+            frameSceneFBO.getBatchRequest() = FrameViewportFBO::TIME_AUTO_UPDATE;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Batch (Events period)")) {
+            frameSceneFBO.getBatchRequest() = FrameViewportFBO::EVENT_AUTO_UPDATE;
+        }
+
+        // Morlet filter bank, many frequencies in one pass over the shutter
+        ImGui::SliderInt("Bank Filters", &frameSceneFBO.getBankFilters(), 1, FilterBank::MAX_FILTERS);
+        ImGui::DragFloatRange2("Bank Frequencies (Hz)", &frameSceneFBO.getBankMinFreq(), &frameSceneFBO.getBankMaxFreq(),
+            0.5f, 0.01f, 10000.0f, "%.2f", "%.2f", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderFloat("Bank Cycles (0 = FWHM)", &frameSceneFBO.getBankCycles(), 0.0f, 20.0f, "%.1f");
+        if (ImGui::Button("Run Filter Bank")) {
+            frameSceneFBO.getBankRequest() = true;
+        }
+
+        // Per pixel spectrum over the time window, linear bins
+        ImGui::SliderInt("Spectrum Bins", &frameSceneFBO.getSpectrumBins(), 2, SpectrumAnalyzer::MAX_BINS);
+        ImGui::DragFloatRange2("Spectrum Frequencies (Hz)", &frameSceneFBO.getSpectrumMinFreq(), &frameSceneFBO.getSpectrumMaxFreq(),
+            0.5f, 0.0f, 10000.0f, "%.2f", "%.2f");
+        ImGui::Checkbox("Spectrum On GPU", &frameSceneFBO.getSpectrumGPU());
+        ImGui::SameLine();
+        if (ImGui::Button("Run Spectrum")) {
+            frameSceneFBO.getSpectrumRequest() = true;
+        }
+
+        // Per pixel count, polarity, interval and last event maps
+        ImGui::Checkbox("Stats On GPU", &frameSceneFBO.getStatsGPU());
+        ImGui::SameLine();
+        ImGui::Checkbox("Stats Over Shutter", &frameSceneFBO.getStatsShutter());
+        ImGui::SameLine();
+        if (ImGui::Button("Run Pixel Stats")) {
+            frameSceneFBO.getStatsRequest() = true;
+        }
 
         // "Post" processing
         MorletFunc::h /= normFactor;
         dProcessingOptions |= ImGui::SliderFloat("Frequency (Hz)", &frameSceneFBO.getFreq(), 0.001f, 250); // TODO decide reasonable range
         dProcessingOptions |= ImGui::SliderFloat(unitLabels[FWHM].c_str(), &MorletFunc::h, 0.0001f, (evtData->getTimeWindow_R() - evtData->getTimeWindow_L()) * 0.5, "%.4f");
-        dProcessingOptions |= ImGui::Checkbox("Morlet Shutter", &frameSceneFBO.isMorlet());
+        ContributionRegistry &registry = ContributionRegistry::instance();
+        dProcessingOptions |= ImGui::Combo("Contribution Function", &frameSceneFBO.getContributionFunc(), registry.getComboItems());
+        if (frameSceneFBO.getContributionFunc() == ContributionRegistry::USER_GLSL) {
+            static char userGLSL[2048] = "";
+            if (userGLSL[0] == '\0') {
+                registry.get(ContributionRegistry::USER_GLSL).glsl.copy(userGLSL, sizeof(userGLSL) - 1);
+            }
+            ImGui::Text("float contributionWeight(float t, float polarityVal, float centerT, float endT) {");
+            ImGui::InputTextMultiline("##UserGLSL", userGLSL, sizeof(userGLSL), ImVec2(-1, ImGui::GetTextLineHeight() * 6));
+            ImGui::Text("}");
+            if (ImGui::Button("Compile")) {
+                registry.setUserGLSL(userGLSL);
+                dProcessingOptions = true;
+            }
+            const string &error = registry.get(ContributionRegistry::USER_GLSL).error;
+            if (!error.empty()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%s", error.c_str());
+            }
+        }
         dProcessingOptions |= ImGui::Checkbox("PCA", &frameSceneFBO.getPCA());
+        ImGui::SameLine();
+        dProcessingOptions |= ImGui::Checkbox("Weighted", &frameSceneFBO.getWeightedPCA());
         dProcessingOptions |= ImGui::Checkbox("Positive Events Only", &evtData->getIsPositiveOnly());
+        dProcessingOptions |= ImGui::Checkbox("Incremental Box Shutter", &frameSceneFBO.getIncremental());
         frameSceneFBO.getFreq() = std::max(frameSceneFBO.getFreq(), 0.01f);
         MorletFunc::h = std::max(MorletFunc::h, 0.0001f) * normFactor;
+
+        // Shape of the selected function over the shutter, evaluated with its CPU implementation
+        {
+            float shutter_L = evtData->getTimeShutterWindow_L() * normFactor;
+            float shutter_R = evtData->getTimeShutterWindow_R() * normFactor;
+            ContributionParams params = { BaseFunc::contribution, frameSceneFBO.getFreq() / 1000000 / evtData->getTimeScale(),
+                MorletFunc::h, 0.5f * (shutter_L + shutter_R), shutter_R };
+            float shape[64];
+            for (int i = 0; i < 64; i++) {
+                float t = shutter_L + (shutter_R - shutter_L) * i / 63.0f;
+                shape[i] = registry.evaluate(frameSceneFBO.getContributionFunc(), t, 1.0f, params);
+            }
+            ImGui::PlotLines("##ContributionShape", shape, 64, 0, "Positive event weight", -4.0f * BaseFunc::contribution,
+                BaseFunc::contribution, ImVec2(0, 60));
+        }
         ImGui::Separator();
 
         // Video (ffmpeg) controls
@@ -797,21 +1167,607 @@ void drawGUI(Camera& camera, float fps, float &particle_scale, float &maxZ, bool
         if (ImGui::Button("Stop Record")) {
             recording = false;
         }
+        // Drop keeps the frame rate when the encoder falls behind, back-pressure keeps every frame
+        ImGui::Combo("Full Queue##video", &videoRecorder.getPolicy(), "Drop Frames\0Back-Pressure\0");
+        // rgb24 leaves flipping and conversion to ffmpeg, yuv420p is converted on the GPU at half the bytes
+        ImGui::BeginDisabled(videoRecorder.isRecording());
+        ImGui::Combo("Format##video", &videoRecorder.getFormat(), "RGB24 (ffmpeg)\0YUV420 (ffmpeg)\0Y4M (lossless)\0");
+        ImGui::EndDisabled();
+        if (videoRecorder.isRecording()) {
+            ImGui::Text("Frames %llu captured, %llu written", (unsigned long long)videoRecorder.getCapturedFrames(),
+                (unsigned long long)videoRecorder.getWrittenFrames());
+            ImGui::Text("Dropped %llu, blocked %llu", (unsigned long long)videoRecorder.getDroppedFrames(),
+                (unsigned long long)videoRecorder.getBlockedFrames());
+            ImGui::Text("Queue %d / %d, lag %.1f ms, write %.1f ms", videoRecorder.getQueueDepth(),
+                static_cast<int>(VideoRecorder::QUEUE_CAPACITY), videoRecorder.getLagMilliseconds(),
+                videoRecorder.getWriteMilliseconds());
+        }
+        ImGui::Separator();
+
+        // Offline export, fixed window steps rendered off-screen whatever the live frame rate
+        ImGui::Text("Sequence export");
+        ImGui::BeginDisabled(sequenceExporter.isActive());
+        ImGui::Combo("Viewports##export", &sequenceExporter.getTarget(), "DCE\0Main Scene\0Both\0");
+        ImGui::Combo("Output##export", &sequenceExporter.getOutput(), "Video\0PNG Sequence\0");
+        if (sequenceExporter.getOutput() == SequenceExporter::VIDEO_OUTPUT) {
+            ImGui::Combo("Format##export", &sequenceExporter.getFormat(), "RGB24 (ffmpeg)\0YUV420 (ffmpeg)\0Y4M (lossless)\0");
+        }
+        ImGui::InputInt2("Resolution##export", &sequenceExporter.getResolution().x);
+        ImGui::InputInt("Frames##export", &sequenceExporter.getNumFrames());
+        ImGui::Checkbox("Step Events##export", &sequenceExporter.getEventPeriod());
+        ImGui::SameLine();
+        ImGui::TextDisabled("(Frame Period of the %s window)", sequenceExporter.getEventPeriod() ? "event" : "time");
+
+        // Keyframes capture the live camera at a fraction of the export
+        ImGui::Checkbox("Camera Path##export", &sequenceExporter.getFollowPath());
+        if (sequenceExporter.getFollowPath()) {
+            static float keyAt = 0.0f;
+            ImGui::SliderFloat("Key At##export", &keyAt, 0.0f, 1.0f, "%.2f");
+            ImGui::SameLine();
+            if (ImGui::Button("Add Key##export")) {
+                sequenceExporter.addKeyframe(keyAt, camera.getPose());
+            }
+            std::vector<CameraKeyframe> &keyframes = sequenceExporter.getKeyframes();
+            for (size_t i = 0; i < keyframes.size(); i++) {
+                ImGui::PushID(static_cast<int>(i));
+                ImGui::Text("Key %.2f", keyframes[i].at);
+                ImGui::SameLine();
+                if (ImGui::SmallButton("View")) {
+                    camera.setPose(keyframes[i].pose);
+                }
+                ImGui::SameLine();
+                bool remove = ImGui::SmallButton("Remove");
+                ImGui::PopID();
+                if (remove) {
+                    keyframes.erase(keyframes.begin() + i);
+                    break;
+                }
+            }
+        }
+        if (ImGui::Button("Export Sequence")) {
+            sequenceExporter.getRequest() = true;
+        }
+        ImGui::EndDisabled();
+
+        if (sequenceExporter.isActive()) {
+            int numFrames = sequenceExporter.getNumFrames();
+            char progress[64];
+            snprintf(progress, sizeof(progress), "%d / %d", sequenceExporter.getNextFrame(), numFrames);
+            ImGui::ProgressBar(static_cast<float>(sequenceExporter.getNextFrame()) / numFrames, ImVec2(-1, 0), progress);
+            ImGui::Text("%.1f ms per frame", sequenceExporter.getMilliseconds());
+            if (ImGui::Button("Cancel Export")) {
+                sequenceExporter.finish(*evtData, camera, frameSceneFBO);
+            }
+        }
+        ImGui::Separator();
+
+        // Raw DCE values for further processing, encoded on worker threads with a CSV index of the windows
+        ImGui::Text("Raw frame export");
+        FrameExporter &frameExporter = evtData->getFrameExporter();
+        ImGui::BeginDisabled(frameExporter.isActive() || dataStreamed);
+        ImGui::Combo("Format##raw", &frameExporter.getFormat(), "Float TIFF (32-bit)\0Float EXR (32-bit)\0PNG (16-bit)\0");
+        ImGui::BeginDisabled(frameExporter.getFormat() == FrameExporter::PNG16_FORMAT);
+        ImGui::Combo("Values##raw", &frameExporter.getValues(), "Intensity\0Log Transmittance Sum\0");
+        ImGui::EndDisabled();
+        ImGui::InputInt("Frames##raw", &frameExporter.getRequestFrames());
+        ImGui::Checkbox("Step Events##raw", &frameExporter.getEventPeriod());
+        if (ImGui::Button("Export Frames")) {
+            frameExporter.getRequest() = true;
+        }
+        ImGui::EndDisabled();
+
+        if (frameExporter.isActive()) {
+            int numFrames = frameExporter.getNumFrames();
+            char progress[64];
+            snprintf(progress, sizeof(progress), "%d / %d written", frameExporter.getWrittenFrames(), numFrames);
+            ImGui::ProgressBar(static_cast<float>(frameExporter.getWrittenFrames()) / numFrames, ImVec2(-1, 0), progress);
+            ImGui::Text("%d rendered, %.0f ms", frameExporter.getRenderedFrames(), frameExporter.getMilliseconds());
+            if (ImGui::Button("Cancel##raw")) {
+                frameExporter.cancel();
+            }
+        }
+        else if (frameExporter.getNumFrames() > 0) {
+            ImGui::Text("Last export: %d written, %d failed in %.0f ms", frameExporter.getWrittenFrames(),
+                frameExporter.getFailedFrames(), frameExporter.getMilliseconds());
+        }
+        ImGui::Separator();
+
+        // Voxel grids over sliding windows as one .npy tensor (windows, polarity, bins, height, width)
+        ImGui::Text("Voxel grid export");
+        VoxelGridExporter &voxelExporter = evtData->getVoxelExporter();
+        ImGui::BeginDisabled(voxelExporter.isActive());
+        ImGui::SliderInt("Time Bins##voxel", &voxelExporter.getBins(), 1, 32);
+        ImGui::InputFloat("Window (ms)##voxel", &voxelExporter.getWindowMs(), 1.0f, 10.0f, "%.3f");
+        ImGui::InputFloat("Stride (ms)##voxel", &voxelExporter.getStrideMs(), 1.0f, 10.0f, "%.3f");
+        if (ImGui::Button(dataStreamed ? "Export Voxels From Stream" : "Export Voxels")) {
+            voxelExporter.getRequest() = true;
+        }
+        ImGui::EndDisabled();
+
+        if (voxelExporter.isActive()) {
+            if (voxelExporter.isStreamed()) {
+                ImGui::Text("%llu windows from the stream", (unsigned long long)voxelExporter.getWrittenWindows());
+                if (ImGui::Button("Finish##voxel")) {
+                    voxelExporter.finish();
+                }
+            }
+            else {
+                size_t numEvents = evtData->getMaxEvent();
+                ImGui::ProgressBar(numEvents > 0 ? static_cast<float>(voxelExporter.getNextEvent()) / numEvents : 1.0f);
+                ImGui::Text("%llu windows", (unsigned long long)voxelExporter.getWrittenWindows());
+            }
+        }
+        else if (voxelExporter.getWrittenWindows() > 0) {
+            ImGui::Text("Last export: %llu windows in %.0f ms", (unsigned long long)voxelExporter.getWrittenWindows(),
+                voxelExporter.getMilliseconds());
+        }
 
     ImGui::End();
 
     ImGui::Begin("Frame");
         ImGui::Text("Digital Coded Exposure"); 
 
+        // Scrub timeline over the batched frames
+        FrameBatch &batch = evtData->getFrameBatch();
+        bool showBatch = frameSceneFBO.getShowBatch() && batch.getNumLayers() > 0;
+        if (batch.getNumLayers() > 0) {
+            ImGui::Checkbox("Show Batch", &frameSceneFBO.getShowBatch());
+            ImGui::SameLine();
+            int &layer = frameSceneFBO.getBatchLayer();
+            if (ImGui::SliderInt("##BatchLayer", &layer, 0, batch.getNumLayers() - 1, "Frame %d") || layer != batch.getResolvedLayer()) {
+                layer = std::clamp(layer, 0, batch.getNumLayers() - 1);
+                batch.resolveLayer(layer);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Record Batch")) {
+                frameSceneFBO.getRecordBatch() = true;
+            }
+            const ShutterRange &range = batch.getRange(layer);
+            ImGui::Text("Events [%d, %d]", range.eventBound_L, range.eventBound_R);
+        }
+
+        // Filter bank response: flip through filters or show the best one per pixel
+        FilterBank &bank = evtData->getFilterBank();
+        bool showBank = frameSceneFBO.getShowBank() && bank.getNumFilters() > 0;
+        if (bank.getNumFilters() > 0) {
+            ImGui::Checkbox("Show Filter Bank", &frameSceneFBO.getShowBank());
+            ImGui::SameLine();
+            int &bankLayer = frameSceneFBO.getBankLayer();
+            bankLayer = std::clamp(bankLayer, -1, bank.getNumFilters() - 1);
+            float layerHz = bankLayer >= 0 ? bank.getFilter(bankLayer).freq * 1000000 * evtData->getTimeScale() : 0.0f;
+            ImGui::SliderInt("##BankLayer", &bankLayer, -1, bank.getNumFilters() - 1, bankLayer < 0 ? "Best" : "Filter %d");
+            ImGui::SameLine();
+            ImGui::SliderFloat("Gain", &frameSceneFBO.getBankGain(), 0.001f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            if (!bank.isResolved(bankLayer, frameSceneFBO.getBankGain())) {
+                bank.resolve(bankLayer, frameSceneFBO.getBankGain());
+            }
+            if (bankLayer >= 0) {
+                ImGui::Text("%.2f Hz", layerHz);
+            }
+            else {
+                // Legend of the best filter colour map
+                for (int k = 0; k < bank.getNumFilters(); k++) {
+                    glm::vec3 c = FilterBank::colorMap(k, bank.getNumFilters());
+                    char label[32];
+                    snprintf(label, sizeof(label), "%.2f Hz##bank%d", bank.getFilter(k).freq * 1000000 * evtData->getTimeScale(), k);
+                    ImGui::ColorButton(label, ImVec4(c.r, c.g, c.b, 1.0f), ImGuiColorEditFlags_NoAlpha);
+                    if (k + 1 < bank.getNumFilters()) {
+                        ImGui::SameLine();
+                    }
+                }
+            }
+        }
+
+        // Spectrum maps: dominant frequency, magnitude or phase, brightness from the magnitude
+        SpectrumAnalyzer &spectrum = evtData->getSpectrumAnalyzer();
+        bool showSpectrum = frameSceneFBO.getShowSpectrum() && spectrum.hasResult();
+        if (spectrum.hasResult()) {
+            ImGui::Checkbox("Show Spectrum", &frameSceneFBO.getShowSpectrum());
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(120);
+            ImGui::Combo("##SpectrumMap", &frameSceneFBO.getSpectrumMap(), "Frequency\0Magnitude\0Phase\0");
+            ImGui::SameLine();
+            ImGui::SliderFloat("Spectrum Gain", &frameSceneFBO.getSpectrumGain(), 0.001f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            if (!spectrum.isResolved(frameSceneFBO.getSpectrumMap(), frameSceneFBO.getSpectrumGain())) {
+                spectrum.updatePreview(frameSceneFBO.getSpectrumMap(), frameSceneFBO.getSpectrumGain());
+            }
+            ImGui::Text("%s: %.1f ms, %.2f - %.2f Hz", spectrum.getUsedGPU() ? "GPU" : "CPU", spectrum.getMilliseconds(),
+                spectrum.getMinFreq(), spectrum.getMaxFreq());
+        }
+
+        // Statistics maps: colour from the selected map, brightness from the event count
+        PixelStatistics &pixelStats = evtData->getPixelStatistics();
+        bool showStats = frameSceneFBO.getShowStats() && pixelStats.hasResult();
+        if (pixelStats.hasResult()) {
+            ImGui::Checkbox("Show Pixel Stats", &frameSceneFBO.getShowStats());
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(160);
+            ImGui::Combo("##StatsMap", &frameSceneFBO.getStatsMap(), "Count\0Positive Fraction\0Interval Mean\0Interval Variance\0Last Event\0");
+            ImGui::SameLine();
+            ImGui::SliderFloat("Stats Gain", &frameSceneFBO.getStatsGain(), 0.001f, 1.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+            if (!pixelStats.isResolved(frameSceneFBO.getStatsMap(), frameSceneFBO.getStatsGain())) {
+                pixelStats.updatePreview(frameSceneFBO.getStatsMap(), frameSceneFBO.getStatsGain());
+            }
+            ImGui::Text("%s: %.1f ms, %zu events over %.4f s", pixelStats.getUsedGPU() ? "GPU" : "CPU", pixelStats.getMilliseconds(),
+                pixelStats.getNumEvents(), pixelStats.getWindowSeconds());
+            if (!pixelStats.getUsedGPU()) {
+                ImGui::SameLine();
+                ImGui::Text("(%d tiles)", pixelStats.getNumTiles());
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Export Stats")) {
+                string statsPath = video_name.empty() ? string("pixel_stats") : video_name + "_stats";
+                if (pixelStats.exportMaps(statsPath)) {
+                    cout << "Wrote pixel statistics to " << statsPath << "_*.tiff" << endl;
+                }
+                else {
+                    cerr << "Failed to write pixel statistics to " << statsPath << "_*.tiff" << endl;
+                }
+            }
+        }
+
         // TODO ask Andrew about aspect ratio standards/preferences
         image_sz = ImGui::GetContentRegionAvail();
         final_sz = ImVec2(image_sz.x, image_sz.y); // fbo viewport is static ish
-        ImGui::Image((ImTextureID)frameSceneFBO.getColorTexture(), final_sz);
+        if (showStats) {
+            ImGui::Image((ImTextureID)pixelStats.getPreviewTexture(), final_sz);
+            if (ImGui::IsItemHovered()) {
+                ImVec2 itemMin = ImGui::GetItemRectMin();
+                ImVec2 mouse = ImGui::GetIO().MousePos;
+                glm::ivec2 res = pixelStats.getResolution();
+                int px = std::clamp(static_cast<int>((mouse.x - itemMin.x) / final_sz.x * res.x), 0, res.x - 1);
+                int py = std::clamp(static_cast<int>((mouse.y - itemMin.y) / final_sz.y * res.y), 0, res.y - 1);
+                size_t p = static_cast<size_t>(py) * res.x + px;
+                ImGui::SetTooltip("(%d, %d)\n%.0f events, %.0f%% positive\ninterval mean %.3g s, std %.3g s\nlast event %.4f s", px, py,
+                    pixelStats.getCountMap()[p], pixelStats.getPolarityMap()[p] * 100.0f, pixelStats.getIntervalMeanMap()[p],
+                    std::sqrt(pixelStats.getIntervalVarianceMap()[p]), pixelStats.getLastEventMap()[p]);
+            }
+        }
+        else if (showSpectrum) {
+            ImGui::Image((ImTextureID)spectrum.getPreviewTexture(), final_sz);
+            if (ImGui::IsItemHovered()) {
+                // Image spans the texture 1:1 in uv, so the cursor maps straight to a sensor pixel
+                ImVec2 itemMin = ImGui::GetItemRectMin();
+                ImVec2 mouse = ImGui::GetIO().MousePos;
+                glm::ivec2 res = spectrum.getResolution();
+                int px = std::clamp(static_cast<int>((mouse.x - itemMin.x) / final_sz.x * res.x), 0, res.x - 1);
+                int py = std::clamp(static_cast<int>((mouse.y - itemMin.y) / final_sz.y * res.y), 0, res.y - 1);
+                size_t p = static_cast<size_t>(py) * res.x + px;
+                ImGui::SetTooltip("(%d, %d)\n%.2f Hz\nmagnitude %.1f\nphase %.2f rad", px, py,
+                    spectrum.getFrequencyMap()[p], spectrum.getMagnitudeMap()[p], spectrum.getPhaseMap()[p]);
+            }
+        }
+        else if (showBank) {
+            ImGui::Image((ImTextureID)bank.getPreviewTexture(), final_sz);
+        }
+        else if (showBatch) {
+            ImGui::Image((ImTextureID)batch.getPreviewTexture(), final_sz);
+        }
+        else if (frameSceneFBO.getShowPrefetch()) {
+            ImGui::Image((ImTextureID)evtData->getPlaybackPrefetch().getPreviewTexture(), final_sz);
+        }
+        else {
+            ImGui::Image((ImTextureID)frameSceneFBO.getColorTexture(), final_sz);
+        }
+    ImGui::End();
+
+    ImGui::Begin("Pixel Query");
+        const PixelIndex &pixelIndex = evtData->getPixelIndex();
+        ImGui::Checkbox("Build Pixel Index On Load", &evtData->getAutoPixelIndex());
+        if (ImGui::Button("Build Pixel Index")) {
+            evtData->buildPixelIndex();
+        }
+        if (pixelIndex.isBuilt()) {
+            ImGui::Text("Indexed %zu events in %.1f ms", pixelIndex.getNumEvents(), pixelIndex.getBuildMilliseconds());
+
+            // Time window queries, intervals are shown in the current time unit
+            float t0 = evtData->getTimeWindow_L() * normFactor;
+            float t1 = evtData->getTimeWindow_R() * normFactor;
+            static int queryPixel[2] = {0, 0};
+            ImGui::InputInt2("Pixel", queryPixel);
+            IntervalStats stats = pixelIndex.getIntervalStats(queryPixel[0], queryPixel[1], t0, t1);
+            ImGui::Text("Events in window: %u", stats.count);
+            ImGui::Text("Interval mean: %.4f  std: %.4f", stats.mean / normFactor, std::sqrt(stats.variance) / normFactor);
+            ImGui::Text("Interval min: %.4f  max: %.4f", stats.min / normFactor, stats.max / normFactor);
+
+            // spaceWindow: x = top, y = right, z = bottom, w = left
+            const glm::vec4 &roi = evtData->getSpaceWindow();
+            size_t roiEvents = pixelIndex.countROI(glm::ivec2(roi.w, roi.x), glm::ivec2(roi.y, roi.z), t0, t1);
+            ImGui::Text("Events in space window: %zu", roiEvents);
+        }
+        else {
+            ImGui::Text("Pixel index not built");
+        }
+    ImGui::End();
+
+    ImGui::Begin("Spatial Query");
+        // Picking, box, frustum and nearest neighbour queries over the (x, y, t) Morton index
+        const MortonIndex &spatialIndex = evtData->getSpatialIndex();
+        if (ImGui::Button("Build Spatial Index")) {
+            evtData->buildSpatialIndex();
+        }
+        if (spatialIndex.isBuilt()) {
+            ImGui::Text("Indexed %zu events in %zu leaves, %.1f ms", spatialIndex.getNumEvents(), spatialIndex.getNumLeaves(),
+                spatialIndex.getBuildMilliseconds());
+        }
+        else {
+            ImGui::Text("Spatial index not built, the first query builds it");
+        }
+
+        ImGui::Checkbox("Click To Pick", &clickToPick);
+        ImGui::SameLine();
+        ImGui::SliderFloat("Pick Radius (px)", &pickRadius, 1.0f, 20.0f, "%.0f");
+        static int numNeighbours = 16;
+        ImGui::SliderInt("Neighbours", &numNeighbours, 1, 256);
+
+        // Neighbours are cached per pick, the picked event itself comes back first
+        static vector<uint32_t> neighbours;
+        static int neighboursOf = -1;
+        static int neighboursK = 0;
+        int picked = evtData->getPickedEvent();
+        if (picked >= 0) {
+            const glm::vec4 &evt = evtData->getEvent(picked);
+            ImGui::Text("Event %d: (%.0f, %.0f) at %.4f %s, %s", picked, evt.x, evt.y, evt.z / normFactor,
+                timeUnits[evtData->getUnitType()].c_str(), evt.w > 0.5f ? "positive" : "negative");
+
+            if (neighboursOf != picked || neighboursK != numNeighbours) {
+                evtData->nearestEvents(picked, numNeighbours + 1, neighbours);
+                neighboursOf = picked;
+                neighboursK = numNeighbours;
+            }
+            if (neighbours.size() > 1) {
+                float maxDistance = 0.0f;
+                float t0 = evt.z, t1 = evt.z;
+                int positive = 0;
+                for (size_t i = 1; i < neighbours.size(); i++) {
+                    const glm::vec4 &other = evtData->getEvent(neighbours[i]);
+                    maxDistance = std::max(maxDistance, glm::length(glm::vec3(other) - glm::vec3(evt)));
+                    t0 = std::min(t0, other.z);
+                    t1 = std::max(t1, other.z);
+                    positive += other.w > 0.5f;
+                }
+                ImGui::Text("%zu neighbours within %.2f, %d positive", neighbours.size() - 1, maxDistance, positive);
+                ImGui::Text("Neighbour times [%.4f, %.4f] %s", t0 / normFactor, t1 / normFactor, timeUnits[evtData->getUnitType()].c_str());
+            }
+        }
+        else {
+            neighboursOf = -1;
+            ImGui::Text("No event picked");
+        }
+
+        // Counts over the space and time windows, or everything the main viewport camera sees
+        static size_t queryCount = 0;
+        static double queryMilliseconds = 0.0;
+        static const char *queryName = nullptr;
+        bool boxQuery = ImGui::Button("Count In Windows");
+        ImGui::SameLine();
+        bool viewQuery = ImGui::Button("Count In View");
+        if (boxQuery || viewQuery) {
+            vector<uint32_t> found;
+            auto start = std::chrono::steady_clock::now();
+            if (boxQuery) {
+                evtData->queryWindowBox(found);
+            }
+            else {
+                MatrixStack P, MV;
+                camera.applyProjectionMatrix(P);
+                camera.applyViewMatrix(MV);
+                evtData->queryFrustum(P.topMatrix() * MV.topMatrix(), found);
+            }
+            queryMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            queryCount = found.size();
+            queryName = boxQuery ? "windows" : "view";
+        }
+        if (queryName) {
+            ImGui::Text("%zu events in %s, %.2f ms", queryCount, queryName, queryMilliseconds);
+        }
+    ImGui::End();
+
+    ImGui::Begin("Selection");
+        // Bitmask over the loaded events, edited on the GPU from the main viewport
+        ImGui::Text("Tool");
+        ImGui::SameLine();
+        ImGui::RadioButton("Off##selection", &selectTool, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("Click##selection", &selectTool, 1);
+        ImGui::SameLine();
+        ImGui::RadioButton("Lasso##selection", &selectTool, 2);
+        ImGui::Text("Mode");
+        ImGui::SameLine();
+        ImGui::RadioButton("Replace##selection", &selectMode, EventSelection::REPLACE);
+        ImGui::SameLine();
+        ImGui::RadioButton("Add##selection", &selectMode, EventSelection::ADD);
+        ImGui::SameLine();
+        ImGui::RadioButton("Subtract##selection", &selectMode, EventSelection::SUBTRACT);
+        ImGui::Text("Shift adds, Ctrl subtracts");
+        ImGui::ColorEdit3("Highlight", &evtData->getSelectColor()[0], ImGuiColorEditFlags_NoInputs);
+
+        const EventSelection &selection = evtData->getSelection();
+        if (evtData->hasSelection()) {
+            const SelectionStats &sel = selection.getStats();
+            ImGui::Text("%u events, %u positive, %u negative", sel.count, sel.positive, sel.count - sel.positive);
+            ImGui::Text("Events [%u, %u]", sel.firstEvent, sel.lastEvent);
+            ImGui::Text("Time [%.4f, %.4f] %s", sel.t0 / normFactor, sel.t1 / normFactor, timeUnits[evtData->getUnitType()].c_str());
+            ImGui::Text("Pixels (%d, %d) - (%d, %d)", sel.pixelMin.x, sel.pixelMin.y, sel.pixelMax.x, sel.pixelMax.y);
+            ImGui::Text("Last update: %.2f ms", selection.getMilliseconds());
+        }
+        else {
+            ImGui::Text("Nothing selected");
+        }
+
+        ImGui::BeginDisabled(!evtData->hasSelection());
+        if (ImGui::Button("Fit Windows To Selection")) {
+            evtData->fitWindowsToSelection(normFactor);
+            dEventWindow = true;
+            dSpaceWindow = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export Selection")) {
+            string selectionPath = (video_name.empty() ? string("selection") : video_name + "_selection") + ".csv";
+            if (evtData->exportSelection(selectionPath)) {
+                cout << "Wrote selected events to " << selectionPath << endl;
+            }
+            else {
+                cerr << "Failed to write selected events to " << selectionPath << endl;
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear##selection")) {
+            evtData->clearSelection();
+            dProcessingOptions = true;
+        }
+        ImGui::EndDisabled();
+    ImGui::End();
+
+    ImGui::Begin("Visibility Filters");
+        // Evaluated on the GPU over the loaded events, nothing is re-read or re-uploaded
+        EventVisibility &visibility = evtData->getVisibility();
+        VisibilitySettings &vis = visibility.getSettings();
+        dProcessingOptions |= ImGui::Checkbox("Polarity##visibility", &vis.polarity);
+        if (vis.polarity) {
+            ImGui::SameLine();
+            dProcessingOptions |= ImGui::RadioButton("Positive##visibility", &vis.keepPolarity, 1);
+            ImGui::SameLine();
+            dProcessingOptions |= ImGui::RadioButton("Negative##visibility", &vis.keepPolarity, 0);
+        }
+
+        dProcessingOptions |= ImGui::Checkbox("ROI##visibility", &vis.roi);
+        if (vis.roi) {
+            ImGui::SameLine();
+            if (ImGui::Button("Use Space Window")) {
+                vis.roiWindow = evtData->getSpaceWindow();
+                dProcessingOptions = true;
+            }
+            ImGui::Text("Top %.0f  Right %.0f  Bottom %.0f  Left %.0f", vis.roiWindow.x, vis.roiWindow.y, vis.roiWindow.z, vis.roiWindow.w);
+        }
+
+        // Time ranges are stored normalized and shown in the current unit
+        ImGui::Text("Time Ranges (%d/%d)", vis.numTimeRanges, VisibilitySettings::MAX_TIME_RANGES);
+        ImGui::SameLine();
+        ImGui::BeginDisabled(vis.numTimeRanges >= VisibilitySettings::MAX_TIME_RANGES);
+        if (ImGui::Button("Add Time Window")) {
+            vis.timeRanges[vis.numTimeRanges++] = glm::vec2(evtData->getTimeWindow_L(), evtData->getTimeWindow_R()) * normFactor;
+            dProcessingOptions = true;
+        }
+        ImGui::EndDisabled();
+        for (int i = 0; i < vis.numTimeRanges; i++) {
+            ImGui::PushID(i);
+            ImGui::Text("[%.4f, %.4f]", vis.timeRanges[i].x / normFactor, vis.timeRanges[i].y / normFactor);
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Remove")) {
+                std::copy(vis.timeRanges + i + 1, vis.timeRanges + vis.numTimeRanges, vis.timeRanges + i);
+                vis.numTimeRanges--;
+                dProcessingOptions = true;
+            }
+            ImGui::PopID();
+        }
+
+        dProcessingOptions |= ImGui::Checkbox("Hot Pixels##visibility", &vis.hotPixels);
+        ImGui::SameLine();
+        ImGui::Text("(%zu pixels)", evtData->getFilterChain().getHotPixel().getNumMasked());
+
+        dProcessingOptions |= ImGui::Checkbox("Selected Only##visibility", &vis.selection);
+        ImGui::SameLine();
+        ImGui::Text("(%u events)", evtData->hasSelection() ? evtData->getSelection().getStats().count : 0u);
+
+        dProcessingOptions |= ImGui::Checkbox("Noise##visibility", &vis.noise);
+        if (vis.noise && visibility.isActive() && !visibility.isNoiseApplied()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(inactive, needs the pixel index)");
+        }
+        if (vis.noise) {
+            float noiseWindow = vis.noiseWindow / normFactor;
+            if (ImGui::SliderFloat(unitLabels[noiseSupport].c_str(), &noiseWindow, 0.0001f, 10.0f, "%.4f", ImGuiSliderFlags_Logarithmic)) {
+                vis.noiseWindow = std::max(noiseWindow, 0.0001f) * normFactor;
+                dProcessingOptions = true;
+            }
+        }
+
+        if (visibility.isApplied()) {
+            ImGui::Text("Last update: %.3f ms", visibility.getMilliseconds());
+        }
+    ImGui::End();
+
+    ImGui::Begin("Clusters");
+        // DBSCAN over the shutter, rerun whenever the frame is redrawn with a new shutter
+        ClusterTracker &tracker = evtData->getClusterTracker();
+        ClusterSettings &clusterSettings = tracker.getSettings();
+        dProcessingOptions |= ImGui::Checkbox("Cluster And Track", &frameSceneFBO.getClusters());
+        dProcessingOptions |= ImGui::SliderFloat("Radius (px)", &clusterSettings.eps, 0.5f, 20.0f, "%.1f");
+        dProcessingOptions |= ImGui::SliderInt("Min Events", &clusterSettings.minPts, 1, 200);
+        float clusterTimeEps = clusterSettings.timeEps / normFactor;
+        if (ImGui::SliderFloat(unitLabels[clusterTime].c_str(), &clusterTimeEps, 0.0f, 10.0f, "%.4f", ImGuiSliderFlags_Logarithmic)) {
+            clusterSettings.timeEps = std::max(clusterTimeEps, 0.0f) * normFactor;
+            dProcessingOptions = true;
+        }
+        dProcessingOptions |= ImGui::SliderInt("Max Events", &clusterSettings.maxPoints, 1000, 1000000, "%d", ImGuiSliderFlags_Logarithmic);
+        dProcessingOptions |= ImGui::SliderFloat("Track Gate (px)", &clusterSettings.gate, 1.0f, 200.0f, "%.1f");
+        dProcessingOptions |= ImGui::SliderInt("Max Missed Windows", &clusterSettings.maxMissed, 0, 30);
+        dProcessingOptions |= ImGui::SliderInt("Trail Length", &clusterSettings.trailLength, 0, 256);
+
+        ImGui::Text("%zu clusters, %d live tracks, %zu tracks total", tracker.getClusters().size(),
+            tracker.getNumActiveTracks(), tracker.getTracks().size());
+        ImGui::Text("%zu events, %zu noise, %.2f ms", tracker.getNumPoints(), tracker.getNumNoise(), tracker.getMilliseconds());
+        if (ImGui::Button("Reset Tracks")) {
+            tracker.reset();
+            dProcessingOptions = true;
+        }
+        ImGui::SameLine();
+        ImGui::BeginDisabled(tracker.getTracks().empty());
+        if (ImGui::Button("Export Tracks")) {
+            string trackPath = (video_name.empty() ? string("tracks") : video_name + "_tracks") + ".csv";
+            if (evtData->exportTracks(trackPath)) {
+                cout << "Wrote tracks to " << trackPath << endl;
+            }
+            else {
+                cerr << "Failed to write tracks to " << trackPath << endl;
+            }
+        }
+        ImGui::EndDisabled();
+    ImGui::End();
+
+    ImGui::Begin("Time Surface");
+        // Decayed last event time per pixel and polarity, drawn in place of the DCE frame at the end of the shutter
+        if (ImGui::Checkbox("Show Time Surface", &frameSceneFBO.getTimeSurface())) {
+            dProcessingOptions = true;
+            frameSceneFBO.getShowBatch() = false;
+            frameSceneFBO.getShowBank() = false;
+            frameSceneFBO.getShowSpectrum() = false;
+            frameSceneFBO.getShowStats() = false;
+        }
+        dProcessingOptions |= ImGui::SliderFloat("Tau (ms)", &frameSceneFBO.getSurfaceTau(), 0.1f, 1000.0f, "%.2f", ImGuiSliderFlags_Logarithmic);
+        frameSceneFBO.getSurfaceTau() = std::max(frameSceneFBO.getSurfaceTau(), 0.001f);
+        dProcessingOptions |= ImGui::Combo("Surface", &frameSceneFBO.getSurfaceMode(), "Polarity Colors\0Merged\0Signed\0");
+
+        const TimeSurface &surface = evtData->getTimeSurface();
+        if (surface.isStreamed()) {
+            ImGui::Text("Streamed, %.4f s since the first event", surface.getQueryTime() / 1e6);
+        }
+        else if (surface.hasResult()) {
+            ImGui::Text("%llu events scattered, %.2f ms", (unsigned long long) surface.getLastUpdateEvents(), surface.getMilliseconds());
+        }
+        ImGui::BeginDisabled(!surface.hasResult());
+        if (ImGui::Button("Export Surface")) {
+            string surfacePath = video_name.empty() ? string("time_surface") : video_name + "_time_surface";
+            if (surface.exportSurfaces(surfacePath, surface.getQueryTime(), frameSceneFBO.getSurfaceTau() * 1000.0f)) {
+                cout << "Wrote time surfaces to " << surfacePath << "_*.tiff" << endl;
+            }
+            else {
+                cerr << "Failed to write time surfaces to " << surfacePath << "_*.tiff" << endl;
+            }
+        }
+        ImGui::EndDisabled();
     ImGui::End();
 
     evtData->normalizeTime();
     frameSceneFBO.normalizeTime(normFactor);
     frameSceneFBO.setDirtyBit(dFile | dTimeWindow | dEventWindow | dSpaceWindow | dProcessingOptions);
+    if (dTimeWindow || dEventWindow || dSpaceWindow) { // Back to the live frame once the window moves
+        frameSceneFBO.getShowBatch() = false;
+        frameSceneFBO.getShowBank() = false;
+        frameSceneFBO.getShowSpectrum() = false;
+        frameSceneFBO.getShowStats() = false;
+    }
 
     if (loadFile) {
         unitLabels.clear();